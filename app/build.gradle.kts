@@ -5,6 +5,17 @@ plugins {
     kotlin("plugin.serialization") version "2.0.21"
 }
 
+// Path to a llama.cpp checkout (-PllamaSourceDir=... or gradle.properties).
+// When set, llama/ggml are built from source with one CPU backend per
+// arm64 variant instead of packaging the prebuilt jniLibs.
+val llamaSourceDir = providers.gradleProperty("llamaSourceDir").orNull
+
+// -PinferenceDaemon=true makes the app use a running slm-daemon. Rooted or
+// SELinux-permissive devices only: an untrusted_app may not connect to a
+// socket of an adb shell process nor pass memfds to it, so stock builds
+// keep the engine in-process.
+val inferenceDaemon = providers.gradleProperty("inferenceDaemon").orNull == "true"
+
 android {
     namespace = "com.mad.assignment"
     compileSdk {
@@ -20,6 +31,8 @@ android {
 
         testInstrumentationRunner = "androidx.test.runner.AndroidJUnitRunner"
 
+        buildConfigField("boolean", "INFERENCE_DAEMON", inferenceDaemon.toString())
+
         ndk {
             abiFilters += listOf("arm64-v8a")
         }
@@ -27,6 +40,9 @@ android {
         externalNativeBuild {
             cmake {
                 cppFlags += ""
+                if (llamaSourceDir != null) {
+                    arguments += "-DLLAMA_SOURCE_DIR=$llamaSourceDir"
+                }
             }
         }
     }
@@ -47,8 +63,20 @@ android {
     kotlinOptions {
         jvmTarget = "11"
     }
+    buildFeatures {
+        buildConfig = true
+    }
+
+    if (llamaSourceDir != null) {
+        sourceSets["main"].jniLibs.setSrcDirs(emptyList<String>())
+    }
 
     packaging {
+        // Extract the .so files so ggml can scan nativeLibraryDir for the
+        // CPU variant modules
+        jniLibs {
+            useLegacyPackaging = true
+        }
         resources {
             excludes += listOf(
                 "META-INF/DEPENDENCIES",
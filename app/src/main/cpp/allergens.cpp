@@ -0,0 +1,277 @@
+#include "allergens.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+const char* const ALLERGEN_LABELS[N_ALLERGENS] = {
+        "milk", "egg", "peanut", "tree nut",
+        "wheat", "soy", "fish", "shellfish", "sesame"
+};
+
+// Basic normalization only - model must output correct category names
+static const std::pair<const char*, const char*> ALLERGEN_MAPPING[] = {
+        {"eggs", "egg"},
+        {"peanuts", "peanut"},
+        {"tree nuts", "tree nut"},
+        {"treenut", "tree nut"},
+        {"treenuts", "tree nut"},
+};
+
+static const char* const ALLERGEN_KEYWORDS[N_ALLERGENS] = {
+        "milk|cream|butter|cheese|whey|casein|lactose|dairy|yogurt|ghee|curd|buttermilk",
+        "egg|albumin|mayonnaise|meringue|ovum|lysozyme|ovalbumin",
+        "peanut|groundnut|arachis|monkey nut",
+        "almond|walnut|cashew|pecan|pistachio|hazelnut|macadamia|brazil nut|chestnut|nut|"
+        "praline|marzipan|nougat",
+        "wheat|flour|gluten|semolina|durum|spelt|bulgur|couscous|bread|pasta|noodle|cereal|"
+        "bran|starch",
+        "soy|soya|tofu|edamame|miso|tempeh|lecithin",
+        "fish|anchovy|sardine|tuna|salmon|cod|bass|mackerel|tilapia|trout|herring|haddock",
+        "shrimp|prawn|crab|lobster|crayfish|oyster|mussel|clam|scallop|crustacean|mollusk|"
+        "squid|octopus",
+        "sesame|tahini|halvah|hummus",
+};
+
+static int labelIndex(const std::string& token) {
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        if (token == ALLERGEN_LABELS[i]) {
+            return i;
+        }
+    }
+    for (const auto& m : ALLERGEN_MAPPING) {
+        if (token == m.first) {
+            return labelIndex(m.second);
+        }
+    }
+    return -1;
+}
+
+static std::string trim(const std::string& s) {
+    size_t b = 0;
+    size_t e = s.size();
+    while (b < e && isspace((unsigned char) s[b])) b++;
+    while (e > b && isspace((unsigned char) s[e - 1])) e--;
+    return s.substr(b, e - b);
+}
+
+std::string buildAllergenPrompt(const std::string& ingredients) {
+    return "Detect allergens in the ingredients. Output only allergens from this list: "
+           "milk, egg, peanut, tree nut, wheat, soy, fish, shellfish, sesame\n"
+           "\n"
+           "Ingredients: " + ingredients + "\n"
+           "\n"
+           "Allergens:";
+}
+
+std::string buildTunedPrompt(const std::string& ingredients) {
+    return "Ingredients: " + ingredients + "\nAllergens:";
+}
+
+AllergenMask parsePredictedAllergens(const std::string& raw_output) {
+    // Clean raw output
+    std::string cleaned;
+    for (size_t i = 0; i < raw_output.size(); i++) {
+        // "Ġ" (U+0120, byte-level BPE space marker)
+        if ((unsigned char) raw_output[i] == 0xC4 && i + 1 < raw_output.size() &&
+            (unsigned char) raw_output[i + 1] == 0xA0) {
+            i++;
+            continue;
+        }
+        char c = raw_output[i];
+        if (c == '_' || c == '-') {
+            c = ' ';
+        }
+        cleaned += (char) tolower((unsigned char) c);
+    }
+
+    // Split on , \n ; & : . ( ) and the word "and"
+    std::vector<std::string> tokens;
+    std::string current;
+    for (size_t i = 0; i < cleaned.size(); i++) {
+        char c = cleaned[i];
+        if (c == ',' || c == '\n' || c == ';' || c == '&' || c == ':' ||
+            c == '.' || c == '(' || c == ')') {
+            tokens.push_back(current);
+            current.clear();
+        } else if (cleaned.compare(i, 3, "and") == 0) {
+            tokens.push_back(current);
+            current.clear();
+            i += 2;
+        } else {
+            current += c;
+        }
+    }
+    tokens.push_back(current);
+
+    AllergenMask mask = 0;
+    for (const std::string& raw : tokens) {
+        int idx = labelIndex(trim(raw));
+        if (idx >= 0) {
+            mask |= (AllergenMask) (1u << idx);
+        }
+    }
+    return mask;
+}
+
+AllergenMask parseAllergenList(const std::string& list) {
+    AllergenMask mask = 0;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        std::string token = trim(list.substr(start, comma - start));
+        std::transform(token.begin(), token.end(), token.begin(),
+                       [](unsigned char c) { return (char) tolower(c); });
+        int idx = labelIndex(token);
+        if (idx >= 0) {
+            mask |= (AllergenMask) (1u << idx);
+        }
+        start = comma + 1;
+    }
+    return mask;
+}
+
+std::string formatAllergenMask(AllergenMask mask) {
+    std::vector<std::string> names;
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        if (mask & (1u << i)) {
+            names.emplace_back(ALLERGEN_LABELS[i]);
+        }
+    }
+    if (names.empty()) {
+        return "none";
+    }
+
+    std::sort(names.begin(), names.end());
+    std::string out;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (i > 0) {
+            out += ", ";
+        }
+        out += names[i];
+    }
+    return out;
+}
+
+AllergenMask allergensMentionedIn(const std::string& ingredients) {
+    std::string text = ingredients;
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return (char) tolower(c); });
+
+    AllergenMask mask = 0;
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        const std::string keywords = ALLERGEN_KEYWORDS[i];
+        size_t start = 0;
+        while (start < keywords.size()) {
+            size_t bar = keywords.find('|', start);
+            if (bar == std::string::npos) {
+                bar = keywords.size();
+            }
+            if (text.find(keywords.substr(start, bar - start)) != std::string::npos) {
+                mask |= (AllergenMask) (1u << i);
+                break;
+            }
+            start = bar + 1;
+        }
+    }
+    return mask;
+}
+
+// ================= Prediction quality =================
+void AllergenScore::add(AllergenMask predicted, AllergenMask truth) {
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        const bool p = predicted & (1u << i);
+        const bool t = truth & (1u << i);
+        if (p && t) tp[i]++;
+        else if (p) fp[i]++;
+        else if (t) fn[i]++;
+        else tn[i]++;
+    }
+    n_samples++;
+    if (predicted == truth) {
+        n_exact++;
+    }
+}
+
+void AllergenScore::remove(AllergenMask predicted, AllergenMask truth) {
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        const bool p = predicted & (1u << i);
+        const bool t = truth & (1u << i);
+        if (p && t) tp[i]--;
+        else if (p) fp[i]--;
+        else if (t) fn[i]--;
+        else tn[i]--;
+    }
+    n_samples--;
+    if (predicted == truth) {
+        n_exact--;
+    }
+}
+
+void AllergenScore::merge(const AllergenScore& other) {
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        tp[i] += other.tp[i];
+        fp[i] += other.fp[i];
+        fn[i] += other.fn[i];
+        tn[i] += other.tn[i];
+    }
+    n_samples += other.n_samples;
+    n_exact += other.n_exact;
+}
+
+static long sum(const long* v) {
+    long s = 0;
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        s += v[i];
+    }
+    return s;
+}
+
+static double ratio(long num, long den) {
+    return den > 0 ? (double) num / den : 0.0;
+}
+
+double AllergenScore::precision() const {
+    return ratio(sum(tp), sum(tp) + sum(fp));
+}
+
+double AllergenScore::recall() const {
+    return ratio(sum(tp), sum(tp) + sum(fn));
+}
+
+double AllergenScore::microF1() const {
+    return ratio(2 * sum(tp), 2 * sum(tp) + sum(fp) + sum(fn));
+}
+
+double AllergenScore::macroF1() const {
+    double total = 0.0;
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        total += ratio(2 * tp[i], 2 * tp[i] + fp[i] + fn[i]);
+    }
+    return total / N_ALLERGENS;
+}
+
+double AllergenScore::exactMatchRatio() const {
+    return ratio(n_exact, n_samples);
+}
+
+double AllergenScore::hammingLoss() const {
+    return ratio(sum(fp) + sum(fn), n_samples * N_ALLERGENS);
+}
+
+double AllergenScore::falseNegativeRate() const {
+    return ratio(sum(fn), sum(tp) + sum(fn));
+}
+
+std::string AllergenScore::summary() const {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "N=%ld P=%.3f R=%.3f microF1=%.3f macroF1=%.3f EMR=%.3f HL=%.4f FNR=%.3f",
+             n_samples, precision(), recall(), microF1(), macroF1(),
+             exactMatchRatio(), hammingLoss(), falseNegativeRate());
+    return buf;
+}
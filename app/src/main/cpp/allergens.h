@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// ================= Allergen labels =================
+// Bit i of an AllergenMask is ALLERGEN_LABELS[i]
+constexpr int N_ALLERGENS = 9;
+extern const char* const ALLERGEN_LABELS[N_ALLERGENS];
+
+using AllergenMask = uint16_t;
+
+// Same zero-shot prompt as MainActivity.buildPrompt()
+std::string buildAllergenPrompt(const std::string& ingredients);
+
+// Prompt of models fine-tuned with slm-finetune: the instruction is in the
+// weights, only the ingredients are left
+std::string buildTunedPrompt(const std::string& ingredients);
+
+// Raw model output -> mask, mirrors MainActivity.parseInferenceResult()
+AllergenMask parsePredictedAllergens(const std::string& raw_output);
+
+// Ground truth "milk, wheat" -> mask
+AllergenMask parseAllergenList(const std::string& list);
+
+// "milk, wheat" (sorted like the Kotlin side) or "none"
+std::string formatAllergenMask(AllergenMask mask);
+
+// Allergens whose keywords appear in the ingredient text, same keyword
+// table as FirestoreRepository (hallucination check, Table 3)
+AllergenMask allergensMentionedIn(const std::string& ingredients);
+
+// ================= Prediction quality =================
+// Confusion counts per allergen, aggregated over samples (Table 2)
+struct AllergenScore {
+    long tp[N_ALLERGENS] = {};
+    long fp[N_ALLERGENS] = {};
+    long fn[N_ALLERGENS] = {};
+    long tn[N_ALLERGENS] = {};
+    long n_samples = 0;
+    long n_exact = 0;
+
+    void add(AllergenMask predicted, AllergenMask truth);
+    void remove(AllergenMask predicted, AllergenMask truth);  // undo add()
+    void merge(const AllergenScore& other);
+
+    double precision() const;  // micro
+    double recall() const;     // micro
+    double microF1() const;
+    double macroF1() const;
+    double exactMatchRatio() const;
+    double hammingLoss() const;
+    double falseNegativeRate() const;
+
+    std::string summary() const;
+};
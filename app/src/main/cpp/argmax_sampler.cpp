@@ -0,0 +1,252 @@
+#include "argmax_sampler.h"
+#include <algorithm>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SLM_X86_DISPATCH 1
+#endif
+
+// ================= Argmax kernels =================
+// One pass: every lane keeps its running maximum and where it saw it
+// first (strictly greater replaces), then the lanes are reduced with the
+// lowest index winning ties. The scalar tail continues from the reduced
+// result.
+
+int argmaxLogitsScalar(const float* logits, int n) {
+    int best = 0;
+    for (int i = 1; i < n; i++) {
+        if (logits[i] > logits[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Folds lane results (value, index) and the tail [from, n) into one index
+static int reduceLanes(const float* values, const int32_t* indices, int n_lanes,
+                       const float* logits, int from, int n) {
+    int best = indices[0];
+    float best_value = values[0];
+    for (int l = 1; l < n_lanes; l++) {
+        if (values[l] > best_value || (values[l] == best_value && indices[l] < best)) {
+            best = indices[l];
+            best_value = values[l];
+        }
+    }
+    for (int i = from; i < n; i++) {
+        if (logits[i] > best_value) {
+            best = i;
+            best_value = logits[i];
+        }
+    }
+    return best;
+}
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+
+int argmaxLogits(const float* logits, int n) {
+    if (n < 8) {
+        return argmaxLogitsScalar(logits, n);
+    }
+    // Two independent chains hide the compare/select latency
+    static const int32_t LANES[4] = {0, 1, 2, 3};
+    const int32x4_t step = vdupq_n_s32(8);
+    int32x4_t idx0 = vld1q_s32(LANES);
+    int32x4_t idx1 = vaddq_s32(idx0, vdupq_n_s32(4));
+    float32x4_t max0 = vld1q_f32(logits);
+    float32x4_t max1 = vld1q_f32(logits + 4);
+    int32x4_t best0 = idx0;
+    int32x4_t best1 = idx1;
+    int i = 8;
+    for (; i + 8 <= n; i += 8) {
+        idx0 = vaddq_s32(idx0, step);
+        idx1 = vaddq_s32(idx1, step);
+        const float32x4_t v0 = vld1q_f32(logits + i);
+        const float32x4_t v1 = vld1q_f32(logits + i + 4);
+        const uint32x4_t gt0 = vcgtq_f32(v0, max0);
+        const uint32x4_t gt1 = vcgtq_f32(v1, max1);
+        max0 = vbslq_f32(gt0, v0, max0);
+        max1 = vbslq_f32(gt1, v1, max1);
+        best0 = vbslq_s32(gt0, idx0, best0);
+        best1 = vbslq_s32(gt1, idx1, best1);
+    }
+
+    float values[8];
+    int32_t indices[8];
+    vst1q_f32(values, max0);
+    vst1q_f32(values + 4, max1);
+    vst1q_s32(indices, best0);
+    vst1q_s32(indices + 4, best1);
+    return reduceLanes(values, indices, 8, logits, i, n);
+}
+
+#elif defined(SLM_X86_DISPATCH)
+
+__attribute__((target("avx2")))
+static int argmaxLogitsAvx2(const float* logits, int n) {
+    if (n < 16) {
+        return argmaxLogitsScalar(logits, n);
+    }
+    const __m256i step = _mm256_set1_epi32(16);
+    __m256i idx0 = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i idx1 = _mm256_add_epi32(idx0, _mm256_set1_epi32(8));
+    __m256 max0 = _mm256_loadu_ps(logits);
+    __m256 max1 = _mm256_loadu_ps(logits + 8);
+    __m256i best0 = idx0;
+    __m256i best1 = idx1;
+    int i = 16;
+    for (; i + 16 <= n; i += 16) {
+        idx0 = _mm256_add_epi32(idx0, step);
+        idx1 = _mm256_add_epi32(idx1, step);
+        const __m256 v0 = _mm256_loadu_ps(logits + i);
+        const __m256 v1 = _mm256_loadu_ps(logits + i + 8);
+        const __m256 gt0 = _mm256_cmp_ps(v0, max0, _CMP_GT_OQ);
+        const __m256 gt1 = _mm256_cmp_ps(v1, max1, _CMP_GT_OQ);
+        max0 = _mm256_blendv_ps(max0, v0, gt0);
+        max1 = _mm256_blendv_ps(max1, v1, gt1);
+        best0 = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best0),
+                                                     _mm256_castsi256_ps(idx0), gt0));
+        best1 = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best1),
+                                                     _mm256_castsi256_ps(idx1), gt1));
+    }
+
+    float values[16];
+    int32_t indices[16];
+    _mm256_storeu_ps(values, max0);
+    _mm256_storeu_ps(values + 8, max1);
+    _mm256_storeu_si256((__m256i*) indices, best0);
+    _mm256_storeu_si256((__m256i*) (indices + 8), best1);
+    return reduceLanes(values, indices, 16, logits, i, n);
+}
+
+__attribute__((target("avx512f")))
+static int argmaxLogitsAvx512(const float* logits, int n) {
+    if (n < 32) {
+        return argmaxLogitsScalar(logits, n);
+    }
+    const __m512i step = _mm512_set1_epi32(32);
+    __m512i idx0 = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i idx1 = _mm512_add_epi32(idx0, _mm512_set1_epi32(16));
+    __m512 max0 = _mm512_loadu_ps(logits);
+    __m512 max1 = _mm512_loadu_ps(logits + 16);
+    __m512i best0 = idx0;
+    __m512i best1 = idx1;
+    int i = 32;
+    for (; i + 32 <= n; i += 32) {
+        idx0 = _mm512_add_epi32(idx0, step);
+        idx1 = _mm512_add_epi32(idx1, step);
+        const __m512 v0 = _mm512_loadu_ps(logits + i);
+        const __m512 v1 = _mm512_loadu_ps(logits + i + 16);
+        const __mmask16 gt0 = _mm512_cmp_ps_mask(v0, max0, _CMP_GT_OQ);
+        const __mmask16 gt1 = _mm512_cmp_ps_mask(v1, max1, _CMP_GT_OQ);
+        max0 = _mm512_mask_blend_ps(gt0, max0, v0);
+        max1 = _mm512_mask_blend_ps(gt1, max1, v1);
+        best0 = _mm512_mask_blend_epi32(gt0, best0, idx0);
+        best1 = _mm512_mask_blend_epi32(gt1, best1, idx1);
+    }
+
+    float values[32];
+    int32_t indices[32];
+    _mm512_storeu_ps(values, max0);
+    _mm512_storeu_ps(values + 16, max1);
+    _mm512_storeu_si512(indices, best0);
+    _mm512_storeu_si512(indices + 16, best1);
+    return reduceLanes(values, indices, 32, logits, i, n);
+}
+
+int argmaxLogits(const float* logits, int n) {
+    static const int level = __builtin_cpu_supports("avx512f") ? 2
+                             : __builtin_cpu_supports("avx2") ? 1 : 0;
+    switch (level) {
+        case 2: return argmaxLogitsAvx512(logits, n);
+        case 1: return argmaxLogitsAvx2(logits, n);
+        default: return argmaxLogitsScalar(logits, n);
+    }
+}
+
+#else
+
+int argmaxLogits(const float* logits, int n) {
+    return argmaxLogitsScalar(logits, n);
+}
+
+#endif
+
+// ================= llama_sampler_i =================
+struct ArgmaxContext {
+    std::vector<llama_token> allowed;  // sorted, empty = all
+};
+
+static const char* argmaxName(const llama_sampler*) {
+    return "slm-argmax";
+}
+
+// Chain path: the array is already built, a plain scan is as good
+static void argmaxApply(llama_sampler* sampler, llama_token_data_array* cur_p) {
+    const ArgmaxContext* ctx = (const ArgmaxContext*) sampler->ctx;
+    int64_t best = -1;
+    for (size_t i = 0; i < cur_p->size; i++) {
+        const llama_token_data& data = cur_p->data[i];
+        if (!ctx->allowed.empty() &&
+            !std::binary_search(ctx->allowed.begin(), ctx->allowed.end(), data.id)) {
+            continue;
+        }
+        if (best < 0 || data.logit > cur_p->data[best].logit) {
+            best = (int64_t) i;
+        }
+    }
+    cur_p->selected = best < 0 ? 0 : best;
+}
+
+static llama_sampler* argmaxClone(const llama_sampler* sampler) {
+    return initArgmaxSampler(((const ArgmaxContext*) sampler->ctx)->allowed);
+}
+
+static void argmaxFree(llama_sampler* sampler) {
+    delete (ArgmaxContext*) sampler->ctx;
+}
+
+static const llama_sampler_i ARGMAX_SAMPLER_I = {
+        /* .name   = */ argmaxName,
+        /* .accept = */ nullptr,
+        /* .apply  = */ argmaxApply,
+        /* .reset  = */ nullptr,
+        /* .clone  = */ argmaxClone,
+        /* .free   = */ argmaxFree,
+};
+
+llama_sampler* initArgmaxSampler(const std::vector<llama_token>& allowed) {
+    ArgmaxContext* ctx = new ArgmaxContext();
+    llama_sampler* sampler = llama_sampler_init(&ARGMAX_SAMPLER_I, ctx);
+    setArgmaxAllowed(sampler, allowed);
+    return sampler;
+}
+
+void setArgmaxAllowed(llama_sampler* sampler, const std::vector<llama_token>& allowed) {
+    ArgmaxContext* ctx = (ArgmaxContext*) sampler->ctx;
+    ctx->allowed = allowed;
+    std::sort(ctx->allowed.begin(), ctx->allowed.end());
+    ctx->allowed.erase(std::unique(ctx->allowed.begin(), ctx->allowed.end()), ctx->allowed.end());
+}
+
+llama_token argmaxSample(llama_sampler* sampler, llama_context* ctx, int32_t idx) {
+    const float* logits = llama_get_logits_ith(ctx, idx);
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(llama_get_model(ctx)));
+    const ArgmaxContext* argmax = (const ArgmaxContext*) sampler->ctx;
+
+    // A short allowed list is cheaper to visit than the row
+    if (!argmax->allowed.empty()) {
+        llama_token best = -1;
+        for (llama_token token : argmax->allowed) {
+            if (token < n_vocab && (best < 0 || logits[token] > logits[best])) {
+                best = token;
+            }
+        }
+        if (best >= 0) {
+            return best;
+        }
+    }
+    return argmaxLogits(logits, n_vocab);
+}
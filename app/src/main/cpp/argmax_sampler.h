@@ -0,0 +1,30 @@
+#pragma once
+
+#include "llama/llama.h"
+#include <vector>
+
+// ================= Argmax sampler =================
+// Greedy sampling straight over the logits row. llama_sampler_sample()
+// first fills a llama_token_data_array with the whole vocabulary (152k
+// entries for Qwen) and then scans it; argmaxSample() scans the row with
+// a vectorised argmax and builds nothing. Ties go to the lowest token id,
+// like llama_sampler_init_greedy().
+//
+// The sampler also implements llama_sampler_i, so it can sit in a chain;
+// that path gets the array like any other sampler.
+
+// Index of the largest value, first one on ties. NEON on arm64,
+// AVX-512 / AVX2 picked at run time on x86-64 hosts.
+int argmaxLogits(const float* logits, int n);
+
+// Scalar reference, for the benchmark
+int argmaxLogitsScalar(const float* logits, int n);
+
+// allowed: token ids the argmax is restricted to, empty = whole vocabulary
+llama_sampler* initArgmaxSampler(const std::vector<llama_token>& allowed = {});
+
+// Replaces the allowed tokens of a sampler made by initArgmaxSampler
+void setArgmaxAllowed(llama_sampler* sampler, const std::vector<llama_token>& allowed);
+
+// llama_sampler_sample() for an argmax sampler without the token array
+llama_token argmaxSample(llama_sampler* sampler, llama_context* ctx, int32_t idx);
@@ -0,0 +1,142 @@
+#include "cascade.h"
+#include "ingredient_atoms.h"
+#include "native-log.h"
+#include "scheduler.h"
+#include <cmath>
+#include <cstdio>
+
+float answerConfidence(float min_logprob, int n_logprobs) {
+    return n_logprobs > 0 ? std::exp(min_logprob) : 0.0f;
+}
+
+// One model over the given items, all queued at once
+static bool runStage(const std::string& model_path,
+                     int template_type,
+                     const EngineConfig& config,
+                     const std::vector<std::string>& ingredients,
+                     const std::vector<size_t>& items,
+                     std::vector<Request>& requests) {
+    Session* session = openSession(model_path, template_type, config);
+    if (!session) {
+        return false;
+    }
+    Scheduler scheduler;
+    initScheduler(scheduler, session);
+
+    requests.assign(items.size(), Request());
+    for (size_t k = 0; k < items.size(); k++) {
+        const std::string item = compressIngredients(ingredients[items[k]],
+                                                     config.compress_ingredients);
+        requests[k].id = (int) items[k];
+        requests[k].prompt_tokens = tokenize(session->vocab,
+                                             formatAllergenPrompt(item, template_type), true);
+        requests[k].max_tokens = config.max_tokens;
+        requests[k].logprobs = true;
+        submitRequest(scheduler, &requests[k]);
+    }
+    runUntilIdle(scheduler);
+
+    freeScheduler(scheduler);
+    closeSession(session);
+    return true;
+}
+
+static long latencyMs(const Request& request) {
+    return elapsedMs(request.t_submit, request.t_done);
+}
+
+// "LAT_MS=12;..." -> value replaced, or the key appended to the metrics
+static std::string withMeta(const std::string& result, const std::string& key, long value) {
+    const size_t bar = result.find('|');
+    std::string meta = result.substr(0, bar);
+    const std::string rest = bar == std::string::npos ? "" : result.substr(bar);
+    const size_t pos = meta.find(key + "=");
+    if (pos == std::string::npos) {
+        return meta + ";" + key + "=" + std::to_string(value) + rest;
+    }
+    const size_t end = std::min(meta.find(';', pos), meta.size());
+    meta.replace(pos, end - pos, key + "=" + std::to_string(value));
+    return meta + rest;
+}
+
+bool runCascade(const CascadeConfig& config,
+                const std::vector<std::string>& ingredients,
+                CascadeReport& report) {
+    report = CascadeReport();
+    report.outcomes.resize(ingredients.size());
+
+    // ================= Small model =================
+    std::vector<size_t> all(ingredients.size());
+    for (size_t i = 0; i < all.size(); i++) {
+        all[i] = i;
+    }
+    std::vector<Request> small;
+    auto t_small = Clock::now();
+    if (!runStage(config.small_path, config.small_template, config.engine, ingredients, all, small)) {
+        return false;
+    }
+    report.small_wall_ms = elapsedMs(t_small, Clock::now());
+
+    std::vector<size_t> escalate;
+    for (const Request& request : small) {
+        CascadeOutcome& outcome = report.outcomes[request.id];
+        outcome.small_ms = latencyMs(request);
+        if (request.failed) {
+            escalate.push_back(request.id);
+            continue;
+        }
+        outcome.confidence = answerConfidence(request.min_logprob, request.n_logprobs);
+        outcome.small_predicted = parsePredictedAllergens(request.output);
+        outcome.predicted = outcome.small_predicted;
+        outcome.result = formatResult(request);
+        if (outcome.confidence < config.min_confidence) {
+            escalate.push_back(request.id);
+        }
+    }
+
+    // ================= Large model, unsure items only =================
+    std::vector<Request> large;
+    if (!escalate.empty()) {
+        auto t_large = Clock::now();
+        if (!runStage(config.large_path, config.large_template, config.engine, ingredients,
+                      escalate, large)) {
+            // Keep the small model's answers
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "Cascade: cannot load %s, %zu items keep the small answer",
+                                config.large_path.c_str(), escalate.size());
+        }
+        report.large_wall_ms = elapsedMs(t_large, Clock::now());
+    }
+    for (const Request& request : large) {
+        CascadeOutcome& outcome = report.outcomes[request.id];
+        outcome.large_ms = latencyMs(request);
+        if (request.failed) {
+            continue;
+        }
+        outcome.escalated = true;
+        outcome.predicted = parsePredictedAllergens(request.output);
+        outcome.result = formatResult(request);
+        report.n_escalated++;
+    }
+
+    for (CascadeOutcome& outcome : report.outcomes) {
+        if (outcome.result.empty()) {
+            continue;
+        }
+        char confidence[16];
+        snprintf(confidence, sizeof(confidence), "%.3f", outcome.confidence);
+        outcome.result = withMeta(outcome.result, "LAT_MS", outcome.small_ms + outcome.large_ms);
+        outcome.result.insert(outcome.result.find('|'),
+                              std::string(";CASCADE=") + (outcome.escalated ? "large" : "small") +
+                              ";CONF=" + confidence +
+                              ";SMALL_MS=" + std::to_string(outcome.small_ms) +
+                              ";LARGE_MS=" + std::to_string(outcome.large_ms));
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "Cascade: %zu items, %ld escalated (confidence < %.2f), "
+                        "small %ld ms, large %ld ms",
+                        ingredients.size(), report.n_escalated, config.min_confidence,
+                        report.small_wall_ms, report.large_wall_ms);
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "allergens.h"
+#include "engine.h"
+#include <string>
+#include <vector>
+
+// ================= Small-to-large cascade =================
+// Every item runs on the small model first; only the answers it is unsure
+// of go to the large model. Confidence is the probability of the weakest
+// sampled token of the small model's answer: a label it hesitated on
+// pulls it down. An answer cut at a complete label list (LabelsComplete)
+// samples no end of turn, so hesitating to end only counts when the model
+// ended on its own. The two models are loaded one after the other, never
+// together.
+struct CascadeConfig {
+    std::string small_path;
+    int small_template = 0;
+    std::string large_path;
+    int large_template = 0;
+    float min_confidence = 0.6f;  // escalate below this
+    EngineConfig engine;          // both sessions; compress_ingredients applies
+};
+
+struct CascadeOutcome {
+    std::string result;   // answering model's formatResult plus the cascade keys, "" on failure
+    AllergenMask predicted = 0;
+    AllergenMask small_predicted = 0;
+    float confidence = 0.0f;  // small model's
+    bool escalated = false;
+    long small_ms = 0;        // latency on each model, 0 when not run
+    long large_ms = 0;
+};
+
+struct CascadeReport {
+    std::vector<CascadeOutcome> outcomes;  // in input order
+    long n_escalated = 0;
+    long small_wall_ms = 0;  // each stage, model load included
+    long large_wall_ms = 0;
+};
+
+// exp(min token log-probability) of a request run with Request::logprobs
+float answerConfidence(float min_logprob, int n_logprobs);
+
+// Result metrics: the answering model's, LAT_MS the sum over both models,
+// plus CASCADE=small|large;CONF=<c>;SMALL_MS=<ms>;LARGE_MS=<ms>.
+// False when the small model cannot be loaded.
+bool runCascade(const CascadeConfig& config,
+                const std::vector<std::string>& ingredients,
+                CascadeReport& report);
@@ -0,0 +1,22 @@
+#include "checksum.h"
+#include <mutex>
+
+uint32_t crc32Ieee(const uint8_t* data, size_t size) {
+    static uint32_t table[256];
+    static std::once_flag table_once;
+    std::call_once(table_once, [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    });
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
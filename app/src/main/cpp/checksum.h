@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE polynomial, same values as zlib's crc32) for the on-disk
+// logs: result store blocks and run journal records
+uint32_t crc32Ieee(const uint8_t* data, size_t size);
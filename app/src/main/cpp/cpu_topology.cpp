@@ -0,0 +1,189 @@
+#include "cpu_topology.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <dirent.h>
+#include <thread>
+
+std::vector<int> detectCoresByCluster() {
+    const int n_cpus = (int) std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::pair<long, int>> freq_cpu;
+    for (int cpu = 0; cpu < n_cpus; cpu++) {
+        long max_freq = 0;
+        char path[128];
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+        if (FILE* f = fopen(path, "r")) {
+            if (fscanf(f, "%ld", &max_freq) != 1) {
+                max_freq = 0;
+            }
+            fclose(f);
+        }
+        freq_cpu.emplace_back(max_freq, cpu);
+    }
+
+    // Fastest cluster first, cpu id order within a cluster
+    std::stable_sort(freq_cpu.begin(), freq_cpu.end(),
+                     [](const std::pair<long, int>& a, const std::pair<long, int>& b) {
+                         return a.first > b.first;
+                     });
+
+    std::vector<int> cpus;
+    for (const auto& fc : freq_cpu) {
+        cpus.push_back(fc.second);
+    }
+    return cpus;
+}
+
+std::string joinCpus(const std::vector<int>& cpus) {
+    std::string out;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        if (i > 0) {
+            out += ",";
+        }
+        out += std::to_string(cpus[i]);
+    }
+    return out;
+}
+
+// The CPU backend is linked in with the prebuilt libraries but a loadable
+// module with GGML_BACKEND_DL, so its entry points are looked up through
+// the backend registry in both cases
+static void* cpuProcAddress(const char* name) {
+    ggml_backend_dev_t dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    ggml_backend_reg_t reg = dev ? ggml_backend_dev_backend_reg(dev) : nullptr;
+    return reg ? ggml_backend_reg_get_proc_address(reg, name) : nullptr;
+}
+
+ggml_threadpool* createPinnedThreadpool(const std::vector<int>& cpus) {
+    auto threadpool_new = (decltype(ggml_threadpool_new)*) cpuProcAddress("ggml_threadpool_new");
+    if (!threadpool_new) {
+        return nullptr;
+    }
+
+    ggml_threadpool_params params = ggml_threadpool_params_default((int) cpus.size());
+    for (int cpu : cpus) {
+        if (cpu < GGML_MAX_N_THREADS) {
+            params.cpumask[cpu] = true;
+        }
+    }
+    params.strict_cpu = true;
+    return threadpool_new(&params);
+}
+
+void freeThreadpool(ggml_threadpool* threadpool) {
+    auto threadpool_free = (decltype(ggml_threadpool_free)*) cpuProcAddress("ggml_threadpool_free");
+    if (threadpool && threadpool_free) {
+        threadpool_free(threadpool);
+    }
+}
+
+// "0-3,8-11" -> {0,1,2,3,8,9,10,11}
+static std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        std::string range = list.substr(start, comma - start);
+        int lo = 0;
+        int hi = 0;
+        if (sscanf(range.c_str(), "%d-%d", &lo, &hi) == 2) {
+            for (int c = lo; c <= hi; c++) {
+                cpus.push_back(c);
+            }
+        } else if (sscanf(range.c_str(), "%d", &lo) == 1) {
+            cpus.push_back(lo);
+        }
+        start = comma + 1;
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> detectNumaNodes() {
+    std::vector<std::vector<int>> nodes;
+
+    if (DIR* dir = opendir("/sys/devices/system/node")) {
+        std::vector<int> node_ids;
+        while (dirent* entry = readdir(dir)) {
+            int id;
+            if (sscanf(entry->d_name, "node%d", &id) == 1) {
+                node_ids.push_back(id);
+            }
+        }
+        closedir(dir);
+        std::sort(node_ids.begin(), node_ids.end());
+
+        for (int id : node_ids) {
+            char path[128];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+            if (FILE* f = fopen(path, "r")) {
+                char buf[1024] = {};
+                if (fgets(buf, sizeof(buf), f)) {
+                    std::vector<int> cpus = parseCpuList(buf);
+                    if (!cpus.empty()) {
+                        nodes.push_back(cpus);
+                    }
+                }
+                fclose(f);
+            }
+        }
+    }
+
+    if (nodes.empty()) {
+        std::vector<int> all;
+        const int n_cpus = (int) std::max(1u, std::thread::hardware_concurrency());
+        for (int c = 0; c < n_cpus; c++) {
+            all.push_back(c);
+        }
+        nodes.push_back(all);
+    }
+    return nodes;
+}
+
+// Name -> value of every feature the loaded CPU backend was built with
+static std::vector<std::pair<std::string, std::string>> cpuFeatures() {
+    std::vector<std::pair<std::string, std::string>> features;
+    auto get_features = (ggml_backend_get_features_t) cpuProcAddress("ggml_backend_get_features");
+    if (!get_features) {
+        return features;
+    }
+
+    ggml_backend_dev_t dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    for (ggml_backend_feature* f = get_features(ggml_backend_dev_backend_reg(dev)); f->name; f++) {
+        features.emplace_back(f->name, f->value);
+    }
+    return features;
+}
+
+std::string describeCpuFeatures() {
+    std::string out;
+    for (const auto& feature : cpuFeatures()) {
+        if (feature.second == "0") {
+            continue;
+        }
+        std::string name = feature.first;
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return (char) tolower(c); });
+        out += out.empty() ? "" : " ";
+        out += name;
+    }
+    return out.empty() ? "generic" : out;
+}
+
+bool cpuHasRepackKernels() {
+    bool has_repack = false;
+    bool has_kernels = false;
+    for (const auto& feature : cpuFeatures()) {
+        if (feature.second == "0") {
+            continue;
+        }
+        has_repack |= feature.first == "REPACK";
+        has_kernels |= feature.first == "DOTPROD" || feature.first == "MATMUL_INT8" ||
+                       feature.first == "AVX2";
+    }
+    return has_repack && has_kernels;
+}
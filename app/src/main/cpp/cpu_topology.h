@@ -0,0 +1,34 @@
+#pragma once
+
+#include "llama/ggml-backend.h"
+#include "llama/ggml-cpu.h"
+#include <string>
+#include <vector>
+
+// ================= CPU topology =================
+
+// Online cores ordered fastest cluster first (by cpuinfo_max_freq)
+std::vector<int> detectCoresByCluster();
+
+// Cores grouped by NUMA node; one node holding every core when the
+// machine (or the platform) does not expose /sys/devices/system/node
+std::vector<std::vector<int>> detectNumaNodes();
+
+// ggml threadpool with one thread strictly placed on each listed core;
+// nullptr if no CPU backend is loaded
+ggml_threadpool* createPinnedThreadpool(const std::vector<int>& cpus);
+void freeThreadpool(ggml_threadpool* threadpool);
+
+// "0,1,2,3"
+std::string joinCpus(const std::vector<int>& cpus);
+
+// ================= CPU features =================
+
+// "neon dotprod matmul_int8 repack" / "avx2 ..." - the features of the
+// loaded CPU backend (with GGML_BACKEND_DL, of the variant picked at load)
+std::string describeCpuFeatures();
+
+// True when the CPU backend was built with repacking and has interleaved
+// mat-mul kernels for these cores: dotprod or i8mm on ARM, AVX2 on x86.
+// Without them the extra buffer types only cost load time.
+bool cpuHasRepackKernels();
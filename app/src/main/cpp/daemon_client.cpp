@@ -0,0 +1,108 @@
+#include "daemon_client.h"
+#include "engine.h"
+#include "native-log.h"
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Large enough for a batch of long ingredient lists
+static const uint32_t RING_CAPACITY = 1u << 20;
+
+bool connectDaemon(DaemonClient& client, const std::string& socket_path) {
+    disconnectDaemon(client);
+
+    client.sock = connectUnixSocket(socket_path);
+    if (client.sock < 0) {
+        return false;
+    }
+
+    if (!createShmRing(client.requests, RING_CAPACITY, "slm-requests") ||
+        !createShmRing(client.responses, RING_CAPACITY, "slm-responses")) {
+        disconnectDaemon(client);
+        return false;
+    }
+
+    const int fds[2] = {client.requests.fd, client.responses.fd};
+    if (!sendWithFds(client.sock, DAEMON_HELLO, fds, 2)) {
+        disconnectDaemon(client);
+        return false;
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "Connected to inference daemon at %s", socket_path.c_str());
+    return true;
+}
+
+void disconnectDaemon(DaemonClient& client) {
+    if (client.sock >= 0) {
+        close(client.sock);
+        client.sock = -1;
+    }
+    if (client.requests.header) {
+        closeShmRing(client.requests);
+    }
+    if (client.responses.header) {
+        closeShmRing(client.responses);
+    }
+}
+
+bool daemonRunBatch(DaemonClient& client,
+                    const std::vector<std::string>& prompts,
+                    const std::string& model_path,
+                    int template_type,
+                    RequestPriority priority,
+                    std::vector<std::string>& results) {
+
+    results.assign(prompts.size(), "");
+
+    const int first_id = client.next_id;
+    client.next_id += (int) prompts.size();
+
+    size_t n_sent = 0;
+    size_t n_received = 0;
+    while (n_received < prompts.size()) {
+        // ---- push as many requests as fit ----
+        size_t n_pushed = 0;
+        while (n_sent < prompts.size()) {
+            DaemonRequest request;
+            request.id = first_id + (int) n_sent;
+            request.model_path = model_path;
+            request.template_type = template_type;
+            request.priority = priority;
+            request.prompt = prompts[n_sent];
+
+            if (!ringPush(client.requests, encodeDaemonRequest(request))) {
+                break;
+            }
+            n_sent++;
+            n_pushed++;
+        }
+
+        if (n_pushed > 0) {
+            const char kick = DAEMON_KICK_REQUEST;
+            if (send(client.sock, &kick, 1, MSG_NOSIGNAL) != 1) {
+                disconnectDaemon(client);
+                return false;
+            }
+        }
+
+        // ---- wait for responses ----
+        char tag;
+        if (read(client.sock, &tag, 1) != 1) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Inference daemon disconnected");
+            disconnectDaemon(client);
+            return false;
+        }
+
+        std::string message;
+        while (ringPop(client.responses, message)) {
+            int id;
+            std::string result;
+            if (decodeDaemonResponse(message, id, result) &&
+                id >= first_id && id < first_id + (int) prompts.size()) {
+                results[id - first_id] = result;
+                n_received++;
+            }
+        }
+    }
+    return true;
+}
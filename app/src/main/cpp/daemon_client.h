@@ -0,0 +1,32 @@
+#pragma once
+
+#include "daemon_protocol.h"
+#include "shm_ring.h"
+#include <string>
+#include <vector>
+
+// ================= Daemon client =================
+// In-app side of the out-of-process engine. When connected, runModelBatch
+// sends prompts to slm-daemon instead of loading the model in the app.
+struct DaemonClient {
+    int sock = -1;
+    ShmRing requests;   // app -> daemon
+    ShmRing responses;  // daemon -> app
+    int next_id = 1;
+};
+
+bool connectDaemon(DaemonClient& client, const std::string& socket_path);
+void disconnectDaemon(DaemonClient& client);
+
+inline bool isDaemonConnected(const DaemonClient& client) {
+    return client.sock >= 0;
+}
+
+// formatResult() strings in prompt order, "" for failed items. Returns
+// false (and disconnects) if the daemon went away.
+bool daemonRunBatch(DaemonClient& client,
+                    const std::vector<std::string>& prompts,
+                    const std::string& model_path,
+                    int template_type,
+                    RequestPriority priority,
+                    std::vector<std::string>& results);
@@ -0,0 +1,156 @@
+#include "daemon_protocol.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+std::string encodeDaemonRequest(const DaemonRequest& request) {
+    // MODEL goes last: a path may contain ';' but never '|'
+    return "ID=" + std::to_string(request.id) +
+           ";TEMPLATE=" + std::to_string(request.template_type) +
+           ";PRIORITY=" + std::to_string(request.priority == RequestPriority::Interactive ? 0 : 1) +
+           ";MODEL=" + request.model_path +
+           "|" + request.prompt;
+}
+
+bool decodeDaemonRequest(const std::string& message, DaemonRequest& request) {
+    const size_t bar = message.find('|');
+    if (bar == std::string::npos) {
+        return false;
+    }
+
+    const std::string meta = message.substr(0, bar);
+    const size_t model = meta.find(";MODEL=");
+    if (model == std::string::npos) {
+        return false;
+    }
+
+    int priority = 1;
+    if (sscanf(meta.c_str(), "ID=%d;TEMPLATE=%d;PRIORITY=%d",
+               &request.id, &request.template_type, &priority) != 3) {
+        return false;
+    }
+
+    request.priority = priority == 0 ? RequestPriority::Interactive : RequestPriority::Batch;
+    request.model_path = meta.substr(model + strlen(";MODEL="));
+    request.prompt = message.substr(bar + 1);
+    return true;
+}
+
+std::string encodeDaemonResponse(int id, const std::string& result) {
+    return "ID=" + std::to_string(id) + "|" + result;
+}
+
+bool decodeDaemonResponse(const std::string& message, int& id, std::string& result) {
+    const size_t bar = message.find('|');
+    if (bar == std::string::npos || sscanf(message.c_str(), "ID=%d", &id) != 1) {
+        return false;
+    }
+    result = message.substr(bar + 1);
+    return true;
+}
+
+static socklen_t makeAddress(const std::string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    const size_t n = std::min(path.size(), sizeof(addr.sun_path) - 1);
+    memcpy(addr.sun_path, path.c_str(), n);
+    if (!path.empty() && path[0] == '@') {
+        addr.sun_path[0] = '\0';  // abstract namespace
+    }
+    return (socklen_t) (offsetof(sockaddr_un, sun_path) + n);
+}
+
+int listenUnixSocket(const std::string& path) {
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    if (!path.empty() && path[0] != '@') {
+        unlink(path.c_str());
+    }
+
+    sockaddr_un addr;
+    socklen_t len = makeAddress(path, addr);
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), len) != 0 || listen(sock, 8) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int connectUnixSocket(const std::string& path) {
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    sockaddr_un addr;
+    socklen_t len = makeAddress(path, addr);
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+bool sendWithFds(int sock, char tag, const int* fds, int n_fds) {
+    iovec iov = {&tag, 1};
+
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    char control[CMSG_SPACE(sizeof(int) * 4)] = {};
+    if (n_fds > 0) {
+        if (n_fds > 4) {
+            return false;
+        }
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+    }
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1;
+}
+
+bool recvWithFds(int sock, char& tag, int* fds, int n_fds) {
+    iovec iov = {&tag, 1};
+
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    char control[CMSG_SPACE(sizeof(int) * 4)] = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) {
+        return false;
+    }
+
+    int received = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            received = (int) ((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            const int n = std::min(received, n_fds);
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * n);
+            for (int k = n; k < received; k++) {
+                int extra;
+                memcpy(&extra, CMSG_DATA(cmsg) + sizeof(int) * k, sizeof(int));
+                close(extra);
+            }
+        }
+    }
+    return received >= n_fds;
+}
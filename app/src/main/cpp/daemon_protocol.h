@@ -0,0 +1,42 @@
+#pragma once
+
+#include "scheduler.h"
+#include <string>
+
+// ================= Daemon protocol =================
+// Control traffic goes over a Unix domain socket, payloads over two
+// shared-memory rings the client creates and hands over at connect time:
+//
+//   client -> daemon  HELLO byte + SCM_RIGHTS {request ring, response ring}
+//   client -> daemon  KICK_REQUEST after pushing requests
+//   daemon -> client  KICK_RESPONSE after pushing responses
+//
+// A socket path starting with '@' lives in the abstract namespace, which
+// works from an app sandbox without a shared directory.
+
+constexpr char DAEMON_HELLO = 'H';
+constexpr char DAEMON_KICK_REQUEST = 'R';
+constexpr char DAEMON_KICK_RESPONSE = 'D';
+constexpr const char* DAEMON_DEFAULT_SOCKET = "@slm-daemon";
+
+struct DaemonRequest {
+    int id = 0;
+    std::string model_path;
+    int template_type = 0;
+    RequestPriority priority = RequestPriority::Batch;
+    std::string prompt;
+};
+
+// ID=<n>;TEMPLATE=<t>;PRIORITY=<p>;MODEL=<path>|<prompt>
+std::string encodeDaemonRequest(const DaemonRequest& request);
+bool decodeDaemonRequest(const std::string& message, DaemonRequest& request);
+
+// ID=<n>|<formatResult(), empty on failure>
+std::string encodeDaemonResponse(int id, const std::string& result);
+bool decodeDaemonResponse(const std::string& message, int& id, std::string& result);
+
+int listenUnixSocket(const std::string& path);
+int connectUnixSocket(const std::string& path);
+
+bool sendWithFds(int sock, char tag, const int* fds, int n_fds);
+bool recvWithFds(int sock, char& tag, int* fds, int n_fds);
@@ -0,0 +1,277 @@
+#include "dataset.h"
+#include "allergens.h"
+#include "json.h"
+#include "engine.h"
+#include "native-log.h"
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// Open Food Facts allergen tags -> our nine labels; the rest (celery,
+// mustard, lupin, sulphites) are not part of the task
+static const std::pair<const char*, const char*> OFF_ALLERGEN_TAGS[] = {
+        {"en:milk", "milk"},
+        {"en:eggs", "egg"},
+        {"en:peanuts", "peanut"},
+        {"en:nuts", "tree nut"},
+        {"en:gluten", "wheat"},
+        {"en:soybeans", "soy"},
+        {"en:fish", "fish"},
+        {"en:crustaceans", "shellfish"},
+        {"en:molluscs", "shellfish"},
+        {"en:sesame-seeds", "sesame"},
+};
+
+// Open Food Facts export line
+static FoodRecord recordFromOffJson(const JsonValue& value) {
+    FoodRecord record;
+    record.code = value.getString("code");
+    record.name = value.getString("product_name");
+    record.ingredients = value.getString("ingredients_text");
+
+    AllergenMask mask = 0;
+    const JsonValue* tags = value.get("allergens_tags");
+    if (tags && tags->type == JsonValue::Type::Array) {
+        for (const JsonValue& tag : tags->array) {
+            if (!record.allergens_raw.empty()) {
+                record.allergens_raw += ", ";
+            }
+            record.allergens_raw += tag.string;
+            for (const auto& m : OFF_ALLERGEN_TAGS) {
+                if (tag.string == m.first) {
+                    mask |= parseAllergenList(m.second);
+                }
+            }
+        }
+    }
+    // Ground truth uses "" rather than "none"
+    record.allergens_mapped = mask ? formatAllergenMask(mask) : "";
+    return record;
+}
+
+static FoodRecord recordFromJson(const JsonValue& value) {
+    // OFF exports also have an "ingredients" field, but it is an array
+    if (value.get("ingredients_text") || value.get("product_name")) {
+        return recordFromOffJson(value);
+    }
+
+    FoodRecord record;
+    record.id = (int) value.getNumber("id");
+    record.name = value.getString("name");
+    record.ingredients = value.getString("ingredients");
+    record.allergens_raw = value.getString("allergensRaw");
+    record.allergens_mapped = value.getString("allergensMapped");
+    return record;
+}
+
+bool loadDataset(const std::string& path, std::vector<FoodRecord>& records) {
+    std::ifstream in(path);
+    if (!in) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot open dataset %s", path.c_str());
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+
+    JsonValue root;
+    std::string error;
+    if (!parseJson(buffer.str(), root, &error) || root.type != JsonValue::Type::Array) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Bad dataset %s: %s",
+                            path.c_str(), error.empty() ? "not an array" : error.c_str());
+        return false;
+    }
+
+    records.clear();
+    records.reserve(root.array.size());
+    for (const JsonValue& value : root.array) {
+        records.push_back(recordFromJson(value));
+    }
+    return true;
+}
+
+// ================= Streaming datasets =================
+static const char BINARY_MAGIC[4] = {'S', 'L', 'M', 'D'};
+static const uint32_t BINARY_VERSION = 1;
+
+// Binary record: u32 id, then code, name, ingredients, allergens_raw and
+// allergens_mapped as u32 length + bytes
+static bool readU32(FILE* file, uint32_t& value) {
+    return fread(&value, sizeof(value), 1, file) == 1;
+}
+
+static bool readString(FILE* file, std::string& value) {
+    uint32_t n;
+    if (!readU32(file, n)) {
+        return false;
+    }
+    value.resize(n);
+    return n == 0 || fread(&value[0], 1, n, file) == n;
+}
+
+static bool writeU32(FILE* file, uint32_t value) {
+    return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+static bool writeString(FILE* file, const std::string& value) {
+    return writeU32(file, (uint32_t) value.size()) &&
+           fwrite(value.data(), 1, value.size(), file) == value.size();
+}
+
+static bool readLine(FILE* file, std::string& line) {
+    line.clear();
+    char buf[16384];
+    while (fgets(buf, sizeof(buf), file)) {
+        line += buf;
+        if (!line.empty() && line.back() == '\n') {
+            line.pop_back();
+            return true;
+        }
+    }
+    return !line.empty();
+}
+
+bool openDatasetStream(const std::string& path, DatasetStream& stream) {
+    stream = DatasetStream();
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot open dataset %s", path.c_str());
+        return false;
+    }
+
+    char magic[4] = {};
+    uint32_t version = 0;
+    if (fread(magic, 1, 4, file) == 4 && memcmp(magic, BINARY_MAGIC, 4) == 0) {
+        if (!readU32(file, version) || version != BINARY_VERSION) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "Unsupported binary dataset version %u", version);
+            fclose(file);
+            return false;
+        }
+        stream.format = DatasetFormat::Binary;
+        stream.file = file;
+        return true;
+    }
+
+    // JSON array or JSONL: look at the first non-blank character
+    rewind(file);
+    int c;
+    while ((c = fgetc(file)) != EOF && isspace(c)) {
+    }
+    rewind(file);
+
+    if (c == '[') {
+        fclose(file);
+        stream.format = DatasetFormat::JsonArray;
+        return loadDataset(path, stream.records);
+    }
+
+    stream.format = DatasetFormat::Jsonl;
+    stream.file = file;
+    return true;
+}
+
+bool readRecord(DatasetStream& stream, FoodRecord& record) {
+    switch (stream.format) {
+        case DatasetFormat::JsonArray:
+            if ((size_t) stream.n_read >= stream.records.size()) {
+                return false;
+            }
+            record = stream.records[stream.n_read];
+            break;
+
+        case DatasetFormat::Binary: {
+            uint32_t id;
+            if (!readU32(stream.file, id)) {
+                return false;
+            }
+            record = FoodRecord();
+            record.id = (int) id;
+            if (!readString(stream.file, record.code) ||
+                !readString(stream.file, record.name) ||
+                !readString(stream.file, record.ingredients) ||
+                !readString(stream.file, record.allergens_raw) ||
+                !readString(stream.file, record.allergens_mapped)) {
+                __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                    "Truncated binary dataset after %ld records", stream.n_read);
+                return false;
+            }
+            break;
+        }
+
+        case DatasetFormat::Jsonl: {
+            std::string line;
+            while (true) {
+                if (!readLine(stream.file, line)) {
+                    return false;
+                }
+                if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                    continue;
+                }
+                JsonValue value;
+                if (parseJson(line, value) && value.type == JsonValue::Type::Object) {
+                    record = recordFromJson(value);
+                    break;
+                }
+                stream.n_skipped_lines++;
+            }
+            // Open Food Facts lines carry a barcode, not a small id
+            if (record.id == 0) {
+                record.id = (int) stream.n_read + 1;
+            }
+            break;
+        }
+    }
+
+    stream.n_read++;
+    return true;
+}
+
+void closeDatasetStream(DatasetStream& stream) {
+    if (stream.file) {
+        fclose(stream.file);
+        stream.file = nullptr;
+    }
+    stream.records.clear();
+}
+
+bool compileDataset(const std::string& in_path, const std::string& out_path, long* n_records) {
+    DatasetStream in;
+    if (!openDatasetStream(in_path, in)) {
+        return false;
+    }
+
+    FILE* out = fopen(out_path.c_str(), "wb");
+    if (!out) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot write %s", out_path.c_str());
+        closeDatasetStream(in);
+        return false;
+    }
+
+    bool ok = fwrite(BINARY_MAGIC, 1, 4, out) == 4 && writeU32(out, BINARY_VERSION);
+
+    FoodRecord record;
+    while (ok && readRecord(in, record)) {
+        ok = writeU32(out, (uint32_t) record.id) &&
+             writeString(out, record.code) &&
+             writeString(out, record.name) &&
+             writeString(out, record.ingredients) &&
+             writeString(out, record.allergens_raw) &&
+             writeString(out, record.allergens_mapped);
+    }
+
+    if (n_records) {
+        *n_records = in.n_read;
+    }
+    if (in.n_skipped_lines > 0) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                            "Skipped %ld malformed lines", in.n_skipped_lines);
+    }
+
+    closeDatasetStream(in);
+    ok = fclose(out) == 0 && ok;
+    return ok;
+}
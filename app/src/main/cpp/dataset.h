@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ================= Dataset =================
+// One labelled product, same fields as FoodItem.kt
+struct FoodRecord {
+    int id = 0;
+    std::string code;  // Open Food Facts barcode, if any
+    std::string name;
+    std::string ingredients;
+    std::string allergens_raw;
+    std::string allergens_mapped;  // ground truth
+};
+
+// Reads a JSON array in the food_preprocessed.json layout
+bool loadDataset(const std::string& path, std::vector<FoodRecord>& records);
+
+// ================= Streaming datasets =================
+// Reads one record at a time so memory stays bounded however large the
+// dataset is. The format is picked from the file contents:
+//   Binary     compiled with compileDataset(), starts with "SLMD"
+//   JsonArray  food_preprocessed.json (small, parsed up front)
+//   Jsonl      one object per line, either our FoodItem fields or an
+//              Open Food Facts export (code, product_name,
+//              ingredients_text, allergens_tags)
+enum class DatasetFormat { Binary, JsonArray, Jsonl };
+
+struct DatasetStream {
+    DatasetFormat format = DatasetFormat::Jsonl;
+    FILE* file = nullptr;
+    long n_read = 0;
+    long n_skipped_lines = 0;  // malformed JSONL lines
+
+    // JsonArray only
+    std::vector<FoodRecord> records;
+};
+
+bool openDatasetStream(const std::string& path, DatasetStream& stream);
+
+// false at the end of the dataset
+bool readRecord(DatasetStream& stream, FoodRecord& record);
+
+void closeDatasetStream(DatasetStream& stream);
+
+// Any supported format -> Binary
+bool compileDataset(const std::string& in_path, const std::string& out_path, long* n_records);
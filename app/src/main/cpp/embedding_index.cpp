@@ -0,0 +1,633 @@
+#include "embedding_index.h"
+#include "checksum.h"
+#include "engine.h"
+#include "native-log.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#if !defined(__ARM_FEATURE_DOTPROD) && defined(__linux__)
+#include <sys/auxv.h>
+#define SLM_ARM_DOTPROD_DISPATCH 1
+#ifndef HWCAP_ASIMDDP
+#define HWCAP_ASIMDDP (1 << 20)
+#endif
+#endif
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SLM_X86_DISPATCH 1
+#endif
+
+// ================= Dot-product kernels =================
+// arm64 (the app's only ABI) is NEON by definition. The int8 kernel uses
+// SDOT: always when the build targets armv8.2+dotprod, otherwise (the
+// default armv8-a NDK build) through a dotprod-attributed copy picked at
+// run time from HWCAP_ASIMDDP. On x86-64 hosts the AVX2/FMA versions are
+// compiled with target attributes and picked at run time the same way, so
+// the tools stay runnable on any x86-64 machine.
+
+static float dotF32Scalar(const float* a, const float* b, int n) {
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static int32_t dotI8Scalar(const int8_t* a, const int8_t* b, int n) {
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += (int32_t) a[i] * b[i];
+    }
+    return sum;
+}
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+
+static float dotF32(const float* a, const float* b, int n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(acc0, acc1)) + dotF32Scalar(a + i, b + i, n - i);
+}
+
+#if defined(__ARM_FEATURE_DOTPROD)
+
+static int32_t dotI8(const int8_t* a, const int8_t* b, int n) {
+    int32x4_t acc = vdupq_n_s32(0);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc = vdotq_s32(acc, vld1q_s8(a + i), vld1q_s8(b + i));
+    }
+    return vaddvq_s32(acc) + dotI8Scalar(a + i, b + i, n - i);
+}
+
+#else
+
+static int32_t dotI8Neon(const int8_t* a, const int8_t* b, int n) {
+    int32x4_t acc = vdupq_n_s32(0);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const int8x16_t va = vld1q_s8(a + i);
+        const int8x16_t vb = vld1q_s8(b + i);
+        // |q| <= 127, so two products fit in int16
+        int16x8_t p = vmull_s8(vget_low_s8(va), vget_low_s8(vb));
+        p = vmlal_s8(p, vget_high_s8(va), vget_high_s8(vb));
+        acc = vpadalq_s16(acc, p);
+    }
+    return vaddvq_s32(acc) + dotI8Scalar(a + i, b + i, n - i);
+}
+
+#if defined(SLM_ARM_DOTPROD_DISPATCH)
+
+#if defined(__clang__)
+__attribute__((target("dotprod")))
+#else
+__attribute__((target("+dotprod")))
+#endif
+static int32_t dotI8Sdot(const int8_t* a, const int8_t* b, int n) {
+    int32x4_t acc = vdupq_n_s32(0);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc = vdotq_s32(acc, vld1q_s8(a + i), vld1q_s8(b + i));
+    }
+    return vaddvq_s32(acc) + dotI8Scalar(a + i, b + i, n - i);
+}
+
+static bool hasDotProd() {
+    static const bool dotprod = (getauxval(AT_HWCAP) & HWCAP_ASIMDDP) != 0;
+    return dotprod;
+}
+
+static int32_t dotI8(const int8_t* a, const int8_t* b, int n) {
+    return hasDotProd() ? dotI8Sdot(a, b, n) : dotI8Neon(a, b, n);
+}
+
+#else
+
+static int32_t dotI8(const int8_t* a, const int8_t* b, int n) {
+    return dotI8Neon(a, b, n);
+}
+
+#endif
+#endif
+
+#elif defined(SLM_X86_DISPATCH)
+
+__attribute__((target("avx2,fma")))
+static float dotF32Avx2(const float* a, const float* b, int n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    return _mm_cvtss_f32(sum) + dotF32Scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int32_t dotI8Avx2(const int8_t* a, const int8_t* b, int n) {
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*) (a + i)));
+        const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*) (b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+    return _mm_cvtsi128_si32(sum) + dotI8Scalar(a + i, b + i, n - i);
+}
+
+static bool hasAvx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return avx2;
+}
+
+static float dotF32(const float* a, const float* b, int n) {
+    return hasAvx2() ? dotF32Avx2(a, b, n) : dotF32Scalar(a, b, n);
+}
+
+static int32_t dotI8(const int8_t* a, const int8_t* b, int n) {
+    return hasAvx2() ? dotI8Avx2(a, b, n) : dotI8Scalar(a, b, n);
+}
+
+#else
+
+static float dotF32(const float* a, const float* b, int n) {
+    return dotF32Scalar(a, b, n);
+}
+
+static int32_t dotI8(const int8_t* a, const int8_t* b, int n) {
+    return dotI8Scalar(a, b, n);
+}
+
+#endif
+
+float dotProduct(const float* a, const float* b, int n) {
+    return dotF32(a, b, n);
+}
+
+static void normalize(float* v, int n) {
+    const float norm = std::sqrt(dotF32(v, v, n));
+    if (norm > 0.0f) {
+        for (int i = 0; i < n; i++) {
+            v[i] /= norm;
+        }
+    }
+}
+
+// Symmetric int8, returns the scale (value = q * scale)
+static float quantizeRow(const float* v, int n, int8_t* q) {
+    float max_abs = 0.0f;
+    for (int i = 0; i < n; i++) {
+        max_abs = std::max(max_abs, std::fabs(v[i]));
+    }
+    const float scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+    for (int i = 0; i < n; i++) {
+        q[i] = (int8_t) std::lround(v[i] / scale);
+    }
+    return scale;
+}
+
+// ================= Embedder =================
+Embedder* openSharedEmbedder(llama_model* model, const std::string& model_path, int n_threads) {
+    // Memory is cleared after every decode, so the context only has to
+    // hold one batch of texts
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = 2048;
+    ctx_params.n_batch = 2048;
+    ctx_params.n_ubatch = 2048;
+    ctx_params.n_seq_max = 8;
+    ctx_params.n_threads = n_threads;
+    ctx_params.n_threads_batch = n_threads;
+    ctx_params.kv_unified = true;
+    ctx_params.pooling_type = LLAMA_POOLING_TYPE_MEAN;
+
+    llama_context* ctx = llama_init_from_model(model, ctx_params);
+    if (!ctx) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Failed to create embedding context");
+        return nullptr;
+    }
+    llama_set_embeddings(ctx, true);
+
+    Embedder* embedder = new Embedder();
+    embedder->model = model;
+    embedder->ctx = ctx;
+    embedder->vocab = llama_model_get_vocab(model);
+    embedder->n_embd = llama_model_n_embd(model);
+    embedder->n_seq_max = (int) llama_n_seq_max(ctx);
+    embedder->n_batch = (int) llama_n_batch(ctx);
+    embedder->model_name = model_path.substr(model_path.find_last_of('/') + 1);
+    return embedder;
+}
+
+Embedder* openEmbedder(const std::string& model_path, int n_threads) {
+    llama_model* model = loadModel(model_path);
+    if (!model) {
+        return nullptr;
+    }
+    Embedder* embedder = openSharedEmbedder(model, model_path, n_threads);
+    if (!embedder) {
+        llama_model_free(model);
+        return nullptr;
+    }
+    embedder->owns_model = true;
+    return embedder;
+}
+
+void closeEmbedder(Embedder* embedder) {
+    if (!embedder) {
+        return;
+    }
+    llama_free(embedder->ctx);
+    if (embedder->owns_model) {
+        llama_model_free(embedder->model);
+    }
+    delete embedder;
+}
+
+bool embedTexts(Embedder& embedder, const std::vector<std::string>& texts, std::vector<float>& out) {
+    const int n_embd = embedder.n_embd;
+    out.assign(texts.size() * n_embd, 0.0f);
+
+    llama_batch batch = llama_batch_init(embedder.n_batch, 0, 1);
+    llama_memory_t mem = llama_get_memory(embedder.ctx);
+    std::vector<size_t> batch_texts;  // text index of each sequence in the batch
+
+    auto flush = [&]() -> bool {
+        if (batch_texts.empty()) {
+            return true;
+        }
+        llama_memory_clear(mem, true);
+        if (llama_decode(embedder.ctx, batch) != 0) {
+            return false;
+        }
+        for (size_t s = 0; s < batch_texts.size(); s++) {
+            const float* embd = llama_get_embeddings_seq(embedder.ctx, (llama_seq_id) s);
+            if (!embd) {
+                return false;
+            }
+            float* row = out.data() + batch_texts[s] * n_embd;
+            memcpy(row, embd, n_embd * sizeof(float));
+            normalize(row, n_embd);
+        }
+        batch.n_tokens = 0;
+        batch_texts.clear();
+        return true;
+    };
+
+    bool ok = true;
+    for (size_t t = 0; t < texts.size() && ok; t++) {
+        std::vector<llama_token> tokens = tokenize(embedder.vocab, texts[t], true);
+        if ((int) tokens.size() > embedder.n_batch) {
+            tokens.resize(embedder.n_batch);
+        }
+        if (tokens.empty()) {
+            // Nothing to pool (empty text, no BOS): stays a zero vector,
+            // similarity 0 to every row
+            continue;
+        }
+        if (batch.n_tokens + (int) tokens.size() > embedder.n_batch ||
+            (int) batch_texts.size() == embedder.n_seq_max) {
+            ok = flush();
+        }
+
+        // Pooled over every token of the sequence: all positions are outputs
+        const llama_seq_id seq_id = (llama_seq_id) batch_texts.size();
+        for (size_t i = 0; i < tokens.size(); i++) {
+            const int j = batch.n_tokens++;
+            batch.token[j] = tokens[i];
+            batch.pos[j] = (llama_pos) i;
+            batch.seq_id[j][0] = seq_id;
+            batch.n_seq_id[j] = 1;
+            batch.logits[j] = true;
+        }
+        batch_texts.push_back(t);
+    }
+    ok = ok && flush();
+
+    llama_batch_free(batch);
+    if (!ok) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Embedding decode failed");
+    }
+    return ok;
+}
+
+// ================= Index =================
+void addToIndex(EmbeddingIndex& index, const float* vectors, long n_rows,
+                const AllergenMask* labels, const int32_t* ids) {
+    const int n_embd = index.n_embd;
+    const long first = index.size();
+    if (index.int8) {
+        index.qvectors.resize((first + n_rows) * n_embd);
+        index.scales.resize(first + n_rows);
+    } else {
+        index.vectors.resize((first + n_rows) * n_embd);
+    }
+
+    std::vector<float> row(n_embd);
+    for (long r = 0; r < n_rows; r++) {
+        memcpy(row.data(), vectors + r * n_embd, n_embd * sizeof(float));
+        normalize(row.data(), n_embd);
+        if (index.int8) {
+            index.scales[first + r] = quantizeRow(row.data(), n_embd,
+                                                  index.qvectors.data() + (first + r) * n_embd);
+        } else {
+            memcpy(index.vectors.data() + (first + r) * n_embd, row.data(), n_embd * sizeof(float));
+        }
+        index.labels.push_back(labels[r]);
+        index.ids.push_back(ids[r]);
+    }
+}
+
+// Cosine similarity of the query with every row
+static void scoreRows(const EmbeddingIndex& index, const float* query, std::vector<float>& scores) {
+    const int n_embd = index.n_embd;
+    const long n_rows = index.size();
+    scores.resize(n_rows);
+
+    if (index.int8) {
+        std::vector<int8_t> q(n_embd);
+        const float q_scale = quantizeRow(query, n_embd, q.data());
+        const int8_t* rows = index.qvectors.data();
+        for (long r = 0; r < n_rows; r++) {
+            scores[r] = (float) dotI8(q.data(), rows + r * n_embd, n_embd) * q_scale * index.scales[r];
+        }
+    } else {
+        const float* rows = index.vectors.data();
+        for (long r = 0; r < n_rows; r++) {
+            scores[r] = dotF32(query, rows + r * n_embd, n_embd);
+        }
+    }
+}
+
+// Similarity-weighted share of the k nearest rows carrying each allergen
+static void neighbourVotes(const EmbeddingIndex& index, const std::vector<float>& scores, int k,
+                           long exclude_row, float* votes) {
+    std::vector<long> order;
+    order.reserve(scores.size());
+    for (long r = 0; r < (long) scores.size(); r++) {
+        if (r != exclude_row) {
+            order.push_back(r);
+        }
+    }
+    const size_t n = std::min(order.size(), (size_t) std::max(k, 1));
+    std::partial_sort(order.begin(), order.begin() + n, order.end(),
+                      [&scores](long a, long b) { return scores[a] > scores[b]; });
+
+    float total = 0.0f;
+    std::fill(votes, votes + N_ALLERGENS, 0.0f);
+    for (size_t i = 0; i < n; i++) {
+        const float w = std::max(scores[order[i]], 0.0f);
+        total += w;
+        for (int a = 0; a < N_ALLERGENS; a++) {
+            if (index.labels[order[i]] & (1u << a)) {
+                votes[a] += w;
+            }
+        }
+    }
+    if (total > 0.0f) {
+        for (int a = 0; a < N_ALLERGENS; a++) {
+            votes[a] /= total;
+        }
+    }
+}
+
+AllergenMask classifyEmbedding(const EmbeddingIndex& index,
+                               const float* query,
+                               int k,
+                               float* votes,
+                               long exclude_row) {
+    float local_votes[N_ALLERGENS];
+    float* v = votes ? votes : local_votes;
+    if (index.size() == 0) {
+        std::fill(v, v + N_ALLERGENS, 0.0f);
+        return 0;
+    }
+
+    std::vector<float> scores;
+    scoreRows(index, query, scores);
+    neighbourVotes(index, scores, k, exclude_row, v);
+
+    AllergenMask mask = 0;
+    for (int a = 0; a < N_ALLERGENS; a++) {
+        if (v[a] > 0.0f && v[a] >= index.thresholds[a]) {
+            mask |= (AllergenMask) (1u << a);
+        }
+    }
+    return mask;
+}
+
+void fitThresholds(const float* scores, const AllergenMask* labels, long n_rows, float* thresholds) {
+    for (int a = 0; a < N_ALLERGENS; a++) {
+        float best_threshold = thresholds[a];
+        double best_f1 = -1.0;
+        for (int step = 1; step <= 19; step++) {
+            const float threshold = step * 0.05f;
+            long tp = 0, fp = 0, fn = 0;
+            for (long r = 0; r < n_rows; r++) {
+                const float v = scores[r * N_ALLERGENS + a];
+                const bool predicted = v > 0.0f && v >= threshold;
+                const bool truth = (labels[r] & (1u << a)) != 0;
+                tp += predicted && truth;
+                fp += predicted && !truth;
+                fn += !predicted && truth;
+            }
+            const double f1 = tp > 0 ? 2.0 * tp / (2.0 * tp + fp + fn) : 0.0;
+            if (f1 > best_f1) {
+                best_f1 = f1;
+                best_threshold = threshold;
+            }
+        }
+        thresholds[a] = best_threshold;
+    }
+}
+
+void calibrateThresholds(EmbeddingIndex& index, int k) {
+    const int n_embd = index.n_embd;
+    const long n_rows = index.size();
+    if (n_rows < 2) {
+        return;
+    }
+
+    // Leave-one-out votes of every row
+    std::vector<float> votes(n_rows * N_ALLERGENS);
+    std::vector<float> query(n_embd);
+    std::vector<float> scores;
+    for (long r = 0; r < n_rows; r++) {
+        if (index.int8) {
+            for (int i = 0; i < n_embd; i++) {
+                query[i] = index.qvectors[r * n_embd + i] * index.scales[r];
+            }
+        } else {
+            memcpy(query.data(), index.vectors.data() + r * n_embd, n_embd * sizeof(float));
+        }
+        scoreRows(index, query.data(), scores);
+        neighbourVotes(index, scores, k, r, votes.data() + r * N_ALLERGENS);
+    }
+
+    fitThresholds(votes.data(), index.labels.data(), n_rows, index.thresholds);
+}
+
+bool buildEmbeddingIndex(Embedder& embedder,
+                         const std::vector<FoodRecord>& records,
+                         bool int8,
+                         EmbeddingIndex& index) {
+    std::vector<std::string> texts;
+    std::vector<AllergenMask> labels;
+    std::vector<int32_t> ids;
+    for (const FoodRecord& record : records) {
+        texts.push_back(record.ingredients);
+        labels.push_back(parseAllergenList(record.allergens_mapped));
+        ids.push_back(record.id);
+    }
+
+    std::vector<float> vectors;
+    if (!embedTexts(embedder, texts, vectors)) {
+        return false;
+    }
+
+    index = EmbeddingIndex();
+    index.model_name = embedder.model_name;
+    index.n_embd = embedder.n_embd;
+    index.int8 = int8;
+    addToIndex(index, vectors.data(), (long) records.size(), labels.data(), ids.data());
+    return true;
+}
+
+// ================= Index file =================
+// "SLEI" + version, then the header fields, the rows and a CRC-32 of
+// everything after the magic
+static const char INDEX_MAGIC[8] = {'S', 'L', 'E', 'I', 1, 0, 0, 0};
+
+template <typename T>
+static void put(std::vector<uint8_t>& bytes, const T* values, size_t count) {
+    const uint8_t* p = (const uint8_t*) values;
+    bytes.insert(bytes.end(), p, p + count * sizeof(T));
+}
+
+template <typename T>
+static bool get(const std::vector<uint8_t>& bytes, size_t& pos, T* values, size_t count) {
+    const size_t size = count * sizeof(T);
+    if (bytes.size() - pos < size) {
+        return false;
+    }
+    memcpy(values, bytes.data() + pos, size);
+    pos += size;
+    return true;
+}
+
+bool saveEmbeddingIndex(const std::string& path, const EmbeddingIndex& index) {
+    std::vector<uint8_t> bytes;
+    const int64_t n_rows = index.size();
+    const int32_t n_embd = index.n_embd;
+    const uint8_t int8 = index.int8 ? 1 : 0;
+    const uint32_t name_len = (uint32_t) index.model_name.size();
+
+    put(bytes, &n_embd, 1);
+    put(bytes, &int8, 1);
+    put(bytes, &n_rows, 1);
+    put(bytes, index.thresholds, N_ALLERGENS);
+    put(bytes, &name_len, 1);
+    put(bytes, index.model_name.data(), name_len);
+    put(bytes, index.ids.data(), n_rows);
+    put(bytes, index.labels.data(), n_rows);
+    if (index.int8) {
+        put(bytes, index.scales.data(), n_rows);
+        put(bytes, index.qvectors.data(), n_rows * n_embd);
+    } else {
+        put(bytes, index.vectors.data(), n_rows * n_embd);
+    }
+    const uint32_t crc = crc32Ieee(bytes.data(), bytes.size());
+
+    const std::string tmp_path = path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const bool ok = fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC), 1, file) == 1 &&
+                    fwrite(bytes.data(), bytes.size(), 1, file) == 1 &&
+                    fwrite(&crc, sizeof(crc), 1, file) == 1;
+    if (fclose(file) != 0 || !ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadEmbeddingIndex(const std::string& path, EmbeddingIndex& index) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        bytes.insert(bytes.end(), buf, buf + n);
+    }
+    fclose(file);
+
+    uint32_t crc;
+    if (bytes.size() < sizeof(INDEX_MAGIC) + sizeof(crc) ||
+        memcmp(bytes.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        return false;
+    }
+    memcpy(&crc, bytes.data() + bytes.size() - sizeof(crc), sizeof(crc));
+    bytes.resize(bytes.size() - sizeof(crc));
+    bytes.erase(bytes.begin(), bytes.begin() + sizeof(INDEX_MAGIC));
+    if (crc32Ieee(bytes.data(), bytes.size()) != crc) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Embedding index %s is corrupt", path.c_str());
+        return false;
+    }
+
+    EmbeddingIndex loaded;
+    size_t pos = 0;
+    int32_t n_embd = 0;
+    uint8_t int8 = 0;
+    int64_t n_rows = 0;
+    uint32_t name_len = 0;
+    if (!get(bytes, pos, &n_embd, 1) || !get(bytes, pos, &int8, 1) ||
+        !get(bytes, pos, &n_rows, 1) || !get(bytes, pos, loaded.thresholds, N_ALLERGENS) ||
+        !get(bytes, pos, &name_len, 1) || n_embd <= 0 || n_rows < 0) {
+        return false;
+    }
+    loaded.model_name.resize(name_len);
+    loaded.n_embd = n_embd;
+    loaded.int8 = int8 != 0;
+    loaded.ids.resize(n_rows);
+    loaded.labels.resize(n_rows);
+    bool ok = get(bytes, pos, &loaded.model_name[0], name_len) &&
+              get(bytes, pos, loaded.ids.data(), n_rows) &&
+              get(bytes, pos, loaded.labels.data(), n_rows);
+    if (loaded.int8) {
+        loaded.scales.resize(n_rows);
+        loaded.qvectors.resize(n_rows * n_embd);
+        ok = ok && get(bytes, pos, loaded.scales.data(), n_rows) &&
+             get(bytes, pos, loaded.qvectors.data(), n_rows * n_embd);
+    } else {
+        loaded.vectors.resize(n_rows * n_embd);
+        ok = ok && get(bytes, pos, loaded.vectors.data(), n_rows * n_embd);
+    }
+    if (!ok || pos != bytes.size()) {
+        return false;
+    }
+
+    index = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "allergens.h"
+#include "dataset.h"
+#include "llama/llama.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ================= Embedding classifier =================
+// Classification without generation: the ingredient text goes through the
+// model once (prefill only, mean-pooled embedding, no decode) and the
+// allergens are voted by the k nearest labelled products of a reference
+// index. Per-item cost is one prefill, and the index is a contiguous
+// matrix searched with SIMD dot products, so it can hold thousands of
+// products.
+
+// Mean-pooled embedding context over a model, separate from the
+// generation context (pooling is fixed when a context is created)
+struct Embedder {
+    llama_model* model = nullptr;
+    llama_context* ctx = nullptr;
+    const llama_vocab* vocab = nullptr;
+    int n_embd = 0;
+    int n_seq_max = 0;
+    int n_batch = 0;          // tokens per llama_decode, longer texts are cut
+    bool owns_model = false;
+    std::string model_name;   // file name, recorded in the index
+};
+
+Embedder* openEmbedder(const std::string& model_path, int n_threads);
+
+// Over an already loaded model, e.g. the resident session's; the model
+// must outlive the embedder
+Embedder* openSharedEmbedder(llama_model* model, const std::string& model_path, int n_threads);
+
+void closeEmbedder(Embedder* embedder);
+
+// Float dot product with the index's SIMD kernel
+float dotProduct(const float* a, const float* b, int n);
+
+// L2-normalised embeddings, texts.size() x n_embd. Several texts share
+// each llama_decode as separate sequences. A text without tokens gets a
+// zero row.
+bool embedTexts(Embedder& embedder, const std::vector<std::string>& texts, std::vector<float>& out);
+
+// Labelled reference vectors, one row per product. Rows are stored as
+// int8 with a per-row scale (4x smaller, integer dot products) or as float.
+struct EmbeddingIndex {
+    std::string model_name;
+    int n_embd = 0;
+    bool int8 = true;
+
+    std::vector<float> vectors;     // float rows
+    std::vector<int8_t> qvectors;   // int8 rows
+    std::vector<float> scales;      // int8 row scales
+    std::vector<AllergenMask> labels;
+    std::vector<int32_t> ids;
+
+    // An allergen is predicted when the similarity-weighted share of the
+    // neighbours carrying it reaches its threshold (calibrateThresholds)
+    float thresholds[N_ALLERGENS] = {0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f};
+
+    long size() const { return (long) labels.size(); }
+};
+
+// Appends L2-normalised rows
+void addToIndex(EmbeddingIndex& index, const float* vectors, long n_rows,
+                const AllergenMask* labels, const int32_t* ids);
+
+// Written atomically (temp file + rename), CRC-checked on load
+bool saveEmbeddingIndex(const std::string& path, const EmbeddingIndex& index);
+bool loadEmbeddingIndex(const std::string& path, EmbeddingIndex& index);
+
+// query is L2-normalised; votes (optional) receives the weighted share
+// per allergen. Row exclude_row is skipped (leave-one-out).
+AllergenMask classifyEmbedding(const EmbeddingIndex& index,
+                               const float* query,
+                               int k,
+                               float* votes = nullptr,
+                               long exclude_row = -1);
+
+// Per-allergen thresholds maximising F1 of scores >= threshold on a
+// 0.05..0.95 grid; scores and labels are n_rows x N_ALLERGENS / n_rows
+void fitThresholds(const float* scores, const AllergenMask* labels, long n_rows, float* thresholds);
+
+// Sets index.thresholds to the values maximising each allergen's F1 over
+// a leave-one-out pass on the index itself
+void calibrateThresholds(EmbeddingIndex& index, int k);
+
+// Builds an index from labelled records (ingredient text, ground truth)
+bool buildEmbeddingIndex(Embedder& embedder,
+                         const std::vector<FoodRecord>& records,
+                         bool int8,
+                         EmbeddingIndex& index);
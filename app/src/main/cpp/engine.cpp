@@ -0,0 +1,270 @@
+#include "engine.h"
+#include "allergens.h"
+#include "cpu_topology.h"
+#include "stop_controller.h"
+#include "native-log.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <mutex>
+
+std::string formatPrompt(const std::string& prompt, int template_type) {
+    switch (template_type) {
+        case 1:
+            // Gemma format (Vikhr-Gemma-2B)
+            return "<start_of_turn>user\n" + prompt + "<end_of_turn>\n<start_of_turn>model\n";
+        case 2:
+            // Llama 3 format (Llama-3.2-1B, Llama-3.2-3B)
+            return "<|begin_of_text|><|start_header_id|>user<|end_header_id|>\n\n" + prompt + "<|eot_id|><|start_header_id|>assistant<|end_header_id|>\n\n";
+        case 3:
+            // Phi format (Phi-3.5-mini, Phi-3-mini-4k)
+            return "<|user|>\n" + prompt + "<|end|>\n<|assistant|>\n";
+        case TEMPLATE_TUNED:
+            // Fine-tuned on plain text, see finetune.h
+            return prompt;
+        default:
+            // ChatML format (Qwen 2.5) - templateType=0 or default
+            return "<|im_start|>user\n" + prompt + "<|im_end|>\n<|im_start|>assistant\n";
+    }
+}
+
+std::string formatAllergenPrompt(const std::string& ingredients, int template_type) {
+    if (template_type == TEMPLATE_TUNED) {
+        return buildTunedPrompt(ingredients);
+    }
+    return formatPrompt(buildAllergenPrompt(ingredients), template_type);
+}
+
+int guessTemplateType(const std::string& model_path) {
+    std::string name = model_path.substr(model_path.find_last_of('/') + 1);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return (char) tolower(c); });
+
+    if (name.find("gemma") != std::string::npos) return 1;
+    if (name.find("llama") != std::string::npos) return 2;
+    if (name.find("phi") != std::string::npos) return 3;
+    return 0;
+}
+
+// RssAnon from /proc/self/status, 0 when unavailable
+static long rssAnonKb() {
+    long kb = 0;
+    if (FILE* f = fopen("/proc/self/status", "r")) {
+        char line[128];
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "RssAnon: %ld kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return kb;
+}
+
+void initBackends(const std::string& backend_dir) {
+    static std::once_flag backend_once;
+    std::call_once(backend_once, [&backend_dir] {
+#ifdef SLM_GGML_BACKEND_DL
+        if (backend_dir.empty()) {
+            ggml_backend_load_all();
+        } else {
+            ggml_backend_load_all_from_path(backend_dir.c_str());
+        }
+#endif
+        llama_backend_init();
+
+        __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "ggml backends: %zu, CPU features: %s",
+                            ggml_backend_reg_count(), describeCpuFeatures().c_str());
+    });
+}
+
+llama_model* loadModel(const std::string& model_path, bool repack, ModelLoadStats* stats) {
+
+    // ================= Backend (once per process) =================
+    initBackends("");
+
+    // ================= Load model =================
+    ModelLoadStats load;
+    load.cpu_features = describeCpuFeatures();
+    load.repack = repack && cpuHasRepackKernels();
+
+    llama_model_params model_params = llama_model_default_params();
+    model_params.use_extra_bufts = load.repack;
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Loading model from: %s (cpu: %s, repack: %s)",
+                        model_path.c_str(), load.cpu_features.c_str(), load.repack ? "on" : "off");
+
+    const long anon_before = rssAnonKb();
+    auto t_start = Clock::now();
+    llama_model* model = llama_model_load_from_file(model_path.c_str(), model_params);
+    load.load_ms = elapsedMs(t_start, Clock::now());
+    load.anon_kb = std::max(0L, rssAnonKb() - anon_before);
+
+    if (!model) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "Failed to load model");
+        return nullptr;
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Model loaded in %ld ms, +%ld kB anonymous memory",
+                        load.load_ms, load.anon_kb);
+    if (stats) {
+        *stats = load;
+    }
+    return model;
+}
+
+Session* openSession(const std::string& model_path,
+                     int template_type,
+                     const EngineConfig& config) {
+
+    ModelLoadStats load_stats;
+    llama_model* model = loadModel(model_path, config.repack_weights, &load_stats);
+    if (!model) {
+        return nullptr;
+    }
+
+    Session* session = openSharedSession(model, model_path, template_type, config);
+    if (!session) {
+        llama_model_free(model);
+        return nullptr;
+    }
+
+    session->owns_model = true;
+    session->load_stats = load_stats;
+    return session;
+}
+
+Session* openSharedSession(llama_model* model,
+                           const std::string& model_path,
+                           int template_type,
+                           const EngineConfig& config) {
+
+    // ================= Context =================
+    // One unified KV buffer shared by n_seq_max sequences. n_batch equals
+    // n_ubatch so every llama_decode runs exactly one micro-batch and the
+    // compute buffer is sized once for the chunk limit.
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = config.n_ctx_seq * config.n_seq_max;
+    ctx_params.n_batch = config.n_ubatch;
+    ctx_params.n_ubatch = config.n_ubatch;
+    ctx_params.n_seq_max = config.n_seq_max;
+    ctx_params.n_threads = config.n_threads;
+    ctx_params.n_threads_batch = config.n_threads;
+    ctx_params.kv_unified = true;
+
+    llama_context* ctx = llama_init_from_model(model, ctx_params);
+    if (!ctx) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "Failed to create context");
+        return nullptr;
+    }
+
+    Session* session = new Session();
+    session->model_path = model_path;
+    session->template_type = template_type;
+    session->config = config;
+    session->model = model;
+    session->ctx = ctx;
+    session->vocab = llama_model_get_vocab(model);
+    session->owns_model = false;
+    if (config.label_budget) {
+        session->config.max_tokens = std::max(config.max_tokens, labelAnswerBudget(session->vocab));
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "Session ready: n_ctx=%u n_seq_max=%d n_ubatch=%d max_tokens=%d",
+                        llama_n_ctx(ctx), config.n_seq_max, config.n_ubatch,
+                        session->config.max_tokens);
+
+    return session;
+}
+
+void closeSession(Session* session) {
+    if (!session) {
+        return;
+    }
+
+    llama_free(session->ctx);
+    for (LoraAdapter& lora : session->adapters) {
+        llama_adapter_lora_free(lora.adapter);
+    }
+    if (session->owns_model) {
+        llama_model_free(session->model);
+    }
+    delete session;
+}
+
+int loadLoraAdapter(Session* session, const std::string& path, float scale) {
+    for (size_t i = 0; i < session->adapters.size(); i++) {
+        if (session->adapters[i].path == path) {
+            return (int) i;
+        }
+    }
+
+    llama_adapter_lora* adapter = llama_adapter_lora_init(session->model, path.c_str());
+    if (!adapter) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "Failed to load LoRA adapter %s", path.c_str());
+        return -1;
+    }
+
+    LoraAdapter lora;
+    lora.path = path;
+    lora.adapter = adapter;
+    lora.scale = scale;
+    const uint64_t n_invocation = llama_adapter_get_alora_n_invocation_tokens(adapter);
+    const llama_token* invocation = llama_adapter_get_alora_invocation_tokens(adapter);
+    if (n_invocation > 0 && invocation) {
+        lora.invocation.assign(invocation, invocation + n_invocation);
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "LoRA adapter %zu: %s scale=%.2f%s",
+                        session->adapters.size(), path.c_str(), scale,
+                        lora.invocation.empty() ? "" : " (activated)");
+
+    session->adapters.push_back(std::move(lora));
+    return (int) session->adapters.size() - 1;
+}
+
+std::vector<llama_token> tokenize(const llama_vocab* vocab,
+                                  const std::string& text,
+                                  bool add_special) {
+
+    std::vector<llama_token> tokens(text.size() + 64);
+
+    int n = llama_tokenize(
+            vocab,
+            text.c_str(),
+            text.size(),
+            tokens.data(),
+            tokens.size(),
+            add_special,
+            false
+    );
+
+    if (n < 0) {
+        // Buffer too small: -n is the required size
+        tokens.resize(-n);
+        n = llama_tokenize(vocab, text.c_str(), text.size(),
+                           tokens.data(), tokens.size(), add_special, false);
+    }
+
+    tokens.resize(n > 0 ? n : 0);
+    return tokens;
+}
+
+std::string tokenToPiece(const llama_vocab* vocab, llama_token token) {
+    char buf[128];
+    int n = llama_token_to_piece(
+            vocab, token, buf, sizeof(buf), 0, true);
+
+    return n > 0 ? std::string(buf, n) : std::string();
+}
+
+long elapsedMs(Clock::time_point t_start, Clock::time_point t_end) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            t_end - t_start
+    ).count();
+}
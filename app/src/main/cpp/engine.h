@@ -0,0 +1,128 @@
+#pragma once
+
+#include "llama/llama.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define LOG_TAG "SLM_NATIVE"
+
+// ================= Engine configuration =================
+// The context holds one unified KV cache of n_ctx_seq * n_seq_max cells
+// (2048 * 5 = 10240), five times a single-sequence session: at f16 about
+// 280 MB for Qwen 2.5 1.5B, 320 MB for Llama 3.2 1B and 1.1 GB for
+// Llama 3.2 3B, allocated when the session opens. Lower n_seq_max on
+// devices that cannot spare it.
+struct EngineConfig {
+    int n_ctx_seq  = 2048;  // per-sequence context (long ingredient lists)
+    int n_seq_max  = 5;     // sequences decoded together in one context
+    int n_interactive_seqs = 1;  // slots reserved for interactive requests
+    int n_ubatch   = 256;   // upper bound of tokens per llama_decode step
+    int n_threads  = 4;
+    int max_tokens = 32;    // generation budget per request
+    bool label_budget = true;  // raise max_tokens to the vocab's labelAnswerBudget()
+    bool prefix_cache = true;  // keep finished prompts in their slot for reuse
+    std::string kv_archive_dir;  // post-prefill state archive (kv_archive.h), "" = off
+    bool repack_weights = true;  // CPU repacked weight layouts where the cores have kernels
+    int compress_ingredients = 0;  // IngredientCompression applied before tokenisation
+};
+
+// What the loader chose for a model and what it cost
+struct ModelLoadStats {
+    std::string cpu_features;  // describeCpuFeatures()
+    bool repack = false;       // extra (repack) buffer types were enabled
+    long load_ms = 0;
+    long anon_kb = 0;          // anonymous memory added by the load: repacked
+                               // copies of the weights, the rest stays mmap'd
+};
+
+// ================= LoRA adapters =================
+// Task adapters loaded onto a session's model. The base weights stay
+// resident and shared; the scheduler applies an adapter per request
+// (Request::adapter), switching the context's adapter set between steps.
+// An activated LoRA (aLoRA) only applies from its invocation tokens on:
+// the prompt before them is computed by the base model, so its KV cells
+// are shared with base-model requests and with other aLoRAs.
+struct LoraAdapter {
+    std::string path;
+    llama_adapter_lora* adapter = nullptr;
+    float scale = 1.0f;
+    std::vector<llama_token> invocation;  // aLoRA invocation sequence, empty = plain LoRA
+};
+
+// ================= Session =================
+// A loaded model plus one multi-sequence context. Sessions stay resident
+// between inferences so the GGUF is only mapped once per model switch.
+struct Session {
+    std::string model_path;
+    int template_type = 0;
+    EngineConfig config;
+
+    llama_model* model = nullptr;
+    llama_context* ctx = nullptr;
+    const llama_vocab* vocab = nullptr;
+    bool owns_model = true;  // false when several sessions share one model
+    ModelLoadStats load_stats;  // openSession only
+
+    // Indexed by Request::adapter; only grows, and only while no request
+    // is in flight (see loadLoraAdapter)
+    std::vector<LoraAdapter> adapters;
+};
+
+// Template types: 0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3, 3 = Phi,
+// 4 = fine-tuned for the task (finetune.h, plain text, no chat turns)
+constexpr int TEMPLATE_TUNED = 4;
+
+std::string formatPrompt(const std::string& prompt, int template_type);
+
+// The allergen prompt for a template: the zero-shot instruction in chat
+// turns, or buildTunedPrompt() as is for TEMPLATE_TUNED
+std::string formatAllergenPrompt(const std::string& ingredients, int template_type);
+
+// Template type from a GGUF file name, e.g. "Llama-3.2-1B-Instruct-Q4_K_M.gguf" -> 2
+int guessTemplateType(const std::string& model_path);
+
+// Registers the ggml backends once per process. When llama.cpp is built
+// from source (SLM_GGML_BACKEND_DL) the CPU backend is one library per
+// microarchitecture and the best one found in backend_dir is loaded
+// ("" = next to the executable; the app passes its nativeLibraryDir).
+// With the prebuilt libraries the CPU backend is linked in and
+// backend_dir is ignored.
+void initBackends(const std::string& backend_dir);
+
+// Calls initBackends("") if nothing did yet; nullptr on failure. With repack
+// the CPU backend's extra buffer types are enabled when the cores have
+// the interleaved kernels (cpuHasRepackKernels). llama.cpp then moves
+// each weight it can repack (Q4_0, IQ4_NL, Q4_K, Q8_0 mat-mul weights)
+// into the repack buffer and leaves the rest, such as the embeddings
+// used by get_rows, in the mmap'd file.
+llama_model* loadModel(const std::string& model_path,
+                       bool repack = true,
+                       ModelLoadStats* stats = nullptr);
+
+Session* openSession(const std::string& model_path,
+                     int template_type,
+                     const EngineConfig& config);
+
+// Context over an already loaded model (data-parallel shards). The model
+// must outlive the session.
+Session* openSharedSession(llama_model* model,
+                           const std::string& model_path,
+                           int template_type,
+                           const EngineConfig& config);
+
+void closeSession(Session* session);
+
+// Index of the adapter in session->adapters, loading it on first use;
+// -1 on failure. Must not run while the session's scheduler is decoding.
+int loadLoraAdapter(Session* session, const std::string& path, float scale = 1.0f);
+
+std::vector<llama_token> tokenize(const llama_vocab* vocab,
+                                  const std::string& text,
+                                  bool add_special);
+
+std::string tokenToPiece(const llama_vocab* vocab, llama_token token);
+
+using Clock = std::chrono::high_resolution_clock;
+
+long elapsedMs(Clock::time_point t_start, Clock::time_point t_end);
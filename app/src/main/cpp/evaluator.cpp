@@ -0,0 +1,525 @@
+#include "evaluator.h"
+#include "cpu_topology.h"
+#include "ingredient_atoms.h"
+#include "json.h"
+#include "native-log.h"
+#include "scheduler.h"
+#include "spsc_queue.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+// Shards are spread over NUMA nodes round-robin; inside a node each shard
+// takes a contiguous block of cores.
+static std::vector<std::vector<int>> assignShardCores(int n_shards, int threads_per_shard) {
+    const std::vector<std::vector<int>> nodes = detectNumaNodes();
+
+    std::vector<int> shards_on_node(nodes.size(), 0);
+    for (int k = 0; k < n_shards; k++) {
+        shards_on_node[k % nodes.size()]++;
+    }
+
+    std::vector<std::vector<int>> split(n_shards);
+    std::vector<size_t> next_core(nodes.size(), 0);
+    for (int k = 0; k < n_shards; k++) {
+        const size_t node = k % nodes.size();
+        const std::vector<int>& cores = nodes[node];
+
+        int n_threads = threads_per_shard;
+        if (n_threads <= 0) {
+            n_threads = std::max(1, (int) cores.size() / std::max(1, shards_on_node[node]));
+        }
+
+        for (int t = 0; t < n_threads; t++) {
+            // Wraps around (oversubscribes) if more threads were asked for than the node has
+            split[k].push_back(cores[next_core[node] % cores.size()]);
+            next_core[node]++;
+        }
+    }
+    return split;
+}
+
+// ================= Pipeline =================
+struct PipelineItem {
+    FoodRecord record;
+    std::string prompt;
+    Request request;
+    EvalOutcome outcome;
+};
+
+using ItemQueue = SpscQueue<std::unique_ptr<PipelineItem>>;
+
+struct ShardPipeline {
+    explicit ShardPipeline(size_t depth)
+            : records(depth), prompts(depth), tokens(depth), done(depth), scored(depth) {}
+
+    ItemQueue records;  // read -> prepare
+    ItemQueue prompts;  // prepare -> tokenize
+    ItemQueue tokens;   // tokenize -> infer
+    ItemQueue done;     // infer -> score
+    ItemQueue scored;   // score -> persist
+    long model_ms = 0;
+};
+
+using RecordSource = std::function<bool(FoodRecord&)>;
+
+// Deals items round-robin to the shards; a shard that falls behind
+// blocks the reader instead of growing its queue
+static void readStage(const RecordSource& next, long first_seq,
+                      std::vector<std::unique_ptr<ShardPipeline>>& pipes) {
+    long seq = first_seq;
+    std::unique_ptr<PipelineItem> item(new PipelineItem());
+    while (next(item->record)) {
+        item->outcome.seq = seq;
+        pipes[seq % pipes.size()]->records.push(std::move(item));
+        item.reset(new PipelineItem());
+        seq++;
+    }
+    for (auto& pipe : pipes) {
+        pipe->records.close();
+    }
+}
+
+static void prepareStage(int template_type, int compression, ShardPipeline& pipe) {
+    std::unique_ptr<PipelineItem> item;
+    while (pipe.records.pop(item)) {
+        item->prompt = formatAllergenPrompt(
+                compressIngredients(item->record.ingredients, compression), template_type);
+        pipe.prompts.push(std::move(item));
+    }
+    pipe.prompts.close();
+}
+
+static void tokenizeStage(Session* session, ShardPipeline& pipe) {
+    std::unique_ptr<PipelineItem> item;
+    while (pipe.prompts.pop(item)) {
+        item->request.prompt_tokens = tokenize(session->vocab, item->prompt, true);
+        item->outcome.prompt_tokens = (long) item->request.prompt_tokens.size();
+        item->request.max_tokens = session->config.max_tokens;
+        pipe.tokens.push(std::move(item));
+    }
+    pipe.tokens.close();
+}
+
+// Keeps up to two rounds of sequences queued in the scheduler so a slot
+// freed by one step is refilled in the next
+static void inferStage(Session* session, ShardPipeline& pipe) {
+    Scheduler scheduler;
+    initScheduler(scheduler, session);
+
+    const size_t max_in_flight = 2 * (size_t) session->config.n_seq_max;
+    std::vector<std::unique_ptr<PipelineItem>> in_flight;
+    bool input_done = false;
+
+    while (true) {
+        while (!input_done && in_flight.size() < max_in_flight) {
+            std::unique_ptr<PipelineItem> item;
+            if (in_flight.empty()) {
+                // Nothing to decode meanwhile: block
+                if (!pipe.tokens.pop(item)) {
+                    input_done = true;
+                    break;
+                }
+            } else if (!pipe.tokens.tryPop(item)) {
+                break;
+            }
+            item->request.id = item->record.id;
+            submitRequest(scheduler, &item->request);
+            in_flight.push_back(std::move(item));
+        }
+
+        if (in_flight.empty()) {
+            break;
+        }
+
+        auto t_step = Clock::now();
+        stepScheduler(scheduler);
+        pipe.model_ms += elapsedMs(t_step, Clock::now());
+
+        // Finished requests move on; this thread is the only one stepping
+        for (auto& pending : in_flight) {
+            if (pending->request.state == RequestState::Done) {
+                pipe.done.push(std::move(pending));
+            }
+        }
+        in_flight.erase(std::remove(in_flight.begin(), in_flight.end(), nullptr),
+                        in_flight.end());
+    }
+
+    freeScheduler(scheduler);
+    pipe.done.close();
+}
+
+static void scoreStage(int shard, ShardPipeline& pipe) {
+    std::unique_ptr<PipelineItem> item;
+    while (pipe.done.pop(item)) {
+        const FoodRecord& record = item->record;
+        const Request& request = item->request;
+
+        EvalOutcome& outcome = item->outcome;
+        outcome.id = record.id;
+        outcome.code = record.code;
+        outcome.shard = shard;
+        outcome.truth = parseAllergenList(record.allergens_mapped);
+        if (!request.failed) {
+            outcome.result = formatResult(request);
+            outcome.raw_output = request.output;
+            outcome.stop = request.stop_reason;
+            outcome.predicted = parsePredictedAllergens(request.output);
+        }
+
+        // Only the outcome travels further
+        item->prompt.clear();
+        item->request = Request();
+        pipe.scored.push(std::move(item));
+    }
+    pipe.scored.close();
+}
+
+// Restores dataset order across shards, accumulates the score in that
+// order (so it always matches a prefix of the dataset) and persists
+static void persistStage(std::vector<std::unique_ptr<ShardPipeline>>& pipes,
+                         const ShardedEvalConfig& config,
+                         EvalReport& report) {
+    std::map<long, std::unique_ptr<PipelineItem>> pending;
+    long next = config.resume.n_done;
+    size_t n_open = pipes.size();
+    std::vector<bool> open(pipes.size(), true);
+    int spins = 0;
+
+    EvalCheckpoint checkpoint = config.resume;
+    report.score = checkpoint.score;
+    report.n_failed = checkpoint.n_failed;
+
+    while (n_open > 0 || !pending.empty()) {
+        bool progress = false;
+        for (size_t k = 0; k < pipes.size(); k++) {
+            if (!open[k]) {
+                continue;
+            }
+            // Check closed before the last pop so nothing pushed before close() is lost
+            const bool closed = pipes[k]->scored.isClosed();
+            std::unique_ptr<PipelineItem> item;
+            if (pipes[k]->scored.tryPop(item)) {
+                const long seq = item->outcome.seq;
+                pending[seq] = std::move(item);
+                progress = true;
+            } else if (closed) {
+                open[k] = false;
+                n_open--;
+            }
+        }
+
+        for (auto it = pending.begin(); it != pending.end() && it->first == next;
+             it = pending.erase(it)) {
+            const EvalOutcome& outcome = it->second->outcome;
+            // A failed item has no prediction; scoring it as "none" would
+            // count every true label as a miss
+            if (outcome.result.empty()) {
+                report.n_failed++;
+            } else {
+                report.score.add(outcome.predicted, outcome.truth);
+                report.stops[outcome.stop]++;
+            }
+            report.prompt_tokens += outcome.prompt_tokens;
+            if (config.persist) {
+                config.persist(outcome);
+            }
+            next++;
+
+            if (config.checkpoint && config.checkpoint_every > 0 &&
+                next % config.checkpoint_every == 0) {
+                checkpoint.n_done = next;
+                checkpoint.score = report.score;
+                checkpoint.n_failed = report.n_failed;
+                config.checkpoint(checkpoint);
+            }
+        }
+
+        if (n_open == 0 && !pending.empty() && pending.begin()->first != next) {
+            // Cannot happen unless a stage dropped an item
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "Persist stage missing item %ld", next);
+            break;
+        }
+
+        if (progress) {
+            spins = 0;
+        } else {
+            spscBackoff(spins);
+        }
+    }
+
+    report.n_items = next;
+    if (config.checkpoint) {
+        checkpoint.n_done = next;
+        checkpoint.complete = true;
+        checkpoint.score = report.score;
+        checkpoint.n_failed = report.n_failed;
+        config.checkpoint(checkpoint);
+    }
+}
+
+static bool runPipelines(const std::string& model_path,
+                         int template_type,
+                         const RecordSource& next,
+                         const ShardedEvalConfig& config,
+                         EvalReport& report) {
+
+    const int n_shards = std::max(1, config.n_shards);
+
+    report = EvalReport();
+    report.model_path = model_path;
+    report.shard_cpus = assignShardCores(n_shards, config.threads_per_shard);
+
+    // Resume: the first n_done items are already persisted
+    FoodRecord skipped;
+    for (long i = 0; i < config.resume.n_done; i++) {
+        if (!next(skipped)) {
+            break;
+        }
+    }
+
+    auto t_start = Clock::now();
+
+    // ================= One model, K contexts =================
+    llama_model* model = loadModel(model_path, config.engine.repack_weights, &report.load);
+    if (!model) {
+        return false;
+    }
+
+    std::vector<Session*> sessions(n_shards, nullptr);
+    std::vector<ggml_threadpool*> pools(n_shards, nullptr);
+    bool ok = true;
+    for (int k = 0; k < n_shards && ok; k++) {
+        EngineConfig engine = config.engine;
+        engine.n_threads = (int) report.shard_cpus[k].size();
+
+        sessions[k] = openSharedSession(model, model_path, template_type, engine);
+        if (!sessions[k]) {
+            ok = false;
+            break;
+        }
+        pools[k] = createPinnedThreadpool(report.shard_cpus[k]);
+        llama_attach_threadpool(sessions[k]->ctx, pools[k], pools[k]);
+
+        __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Shard %d on cores [%s]",
+                            k, joinCpus(report.shard_cpus[k]).c_str());
+    }
+
+    // ================= Run shard pipelines =================
+    if (ok) {
+        std::vector<std::unique_ptr<ShardPipeline>> pipes;
+        std::vector<std::thread> threads;
+        for (int k = 0; k < n_shards; k++) {
+            pipes.emplace_back(new ShardPipeline((size_t) std::max(2, config.queue_depth)));
+        }
+        threads.emplace_back(readStage, std::cref(next), config.resume.n_done, std::ref(pipes));
+        for (int k = 0; k < n_shards; k++) {
+            ShardPipeline& pipe = *pipes[k];
+            threads.emplace_back(prepareStage, template_type,
+                                 config.engine.compress_ingredients, std::ref(pipe));
+            threads.emplace_back(tokenizeStage, sessions[k], std::ref(pipe));
+            threads.emplace_back(inferStage, sessions[k], std::ref(pipe));
+            threads.emplace_back(scoreStage, k, std::ref(pipe));
+        }
+        threads.emplace_back(persistStage, std::ref(pipes), std::cref(config), std::ref(report));
+        for (std::thread& t : threads) {
+            t.join();
+        }
+
+        for (const auto& pipe : pipes) {
+            report.model_ms = std::max(report.model_ms, pipe->model_ms);
+        }
+    }
+
+    for (int k = 0; k < n_shards; k++) {
+        if (sessions[k]) {
+            llama_detach_threadpool(sessions[k]->ctx);
+            closeSession(sessions[k]);
+        }
+        if (pools[k]) {
+            freeThreadpool(pools[k]);
+        }
+    }
+    llama_model_free(model);
+
+    report.wall_ms = elapsedMs(t_start, Clock::now());
+
+    return ok;
+}
+
+bool runShardedEvaluation(const std::string& model_path,
+                          int template_type,
+                          const std::vector<FoodRecord>& records,
+                          const ShardedEvalConfig& config,
+                          EvalReport& report) {
+
+    size_t i = 0;
+    RecordSource next = [&](FoodRecord& record) {
+        if (i >= records.size()) {
+            return false;
+        }
+        record = records[i++];
+        return true;
+    };
+
+    // Collect outcomes on top of the caller's sink
+    std::vector<EvalOutcome> outcomes;
+    ShardedEvalConfig collecting = config;
+    collecting.persist = [&](const EvalOutcome& outcome) {
+        outcomes.push_back(outcome);
+        if (config.persist) {
+            config.persist(outcome);
+        }
+    };
+
+    const bool ok = runPipelines(model_path, template_type, next, collecting, report);
+    report.outcomes = std::move(outcomes);
+    return ok;
+}
+
+bool runStreamingEvaluation(const std::string& model_path,
+                            int template_type,
+                            DatasetStream& dataset,
+                            const ShardedEvalConfig& config,
+                            EvalReport& report) {
+
+    RecordSource next = [&](FoodRecord& record) {
+        return readRecord(dataset, record);
+    };
+    return runPipelines(model_path, template_type, next, config, report);
+}
+
+// ================= Checkpoints =================
+static std::string countsToJson(const long* counts) {
+    std::string out = "[";
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        out += (i > 0 ? "," : "") + std::to_string(counts[i]);
+    }
+    return out + "]";
+}
+
+static void countsFromJson(const JsonValue* value, long* counts) {
+    if (!value || value->type != JsonValue::Type::Array) {
+        return;
+    }
+    for (int i = 0; i < N_ALLERGENS && i < (int) value->array.size(); i++) {
+        counts[i] = (long) value->array[i].number;
+    }
+}
+
+bool saveCheckpoint(const std::string& path, const EvalCheckpoint& checkpoint) {
+    const AllergenScore& score = checkpoint.score;
+    const std::string text =
+            "{\"model\":" + jsonQuote(checkpoint.model_path) +
+            ",\"dataset\":" + jsonQuote(checkpoint.dataset_path) +
+            ",\"done\":" + std::to_string(checkpoint.n_done) +
+            ",\"complete\":" + (checkpoint.complete ? "true" : "false") +
+            ",\"out_offset\":" + std::to_string(checkpoint.out_offset) +
+            ",\"failed\":" + std::to_string(checkpoint.n_failed) +
+            ",\"compress\":" + std::to_string(checkpoint.compression) +
+            ",\"score\":{\"tp\":" + countsToJson(score.tp) +
+            ",\"fp\":" + countsToJson(score.fp) +
+            ",\"fn\":" + countsToJson(score.fn) +
+            ",\"tn\":" + countsToJson(score.tn) +
+            ",\"n_samples\":" + std::to_string(score.n_samples) +
+            ",\"n_exact\":" + std::to_string(score.n_exact) + "}}\n";
+
+    // A crash mid-write must leave the previous checkpoint intact
+    const std::string tmp_path = path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+    ok = fclose(file) == 0 && ok;
+    return ok && rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool loadCheckpoint(const std::string& path, EvalCheckpoint& checkpoint) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+
+    JsonValue root;
+    if (!parseJson(buffer.str(), root) || root.type != JsonValue::Type::Object) {
+        return false;
+    }
+
+    checkpoint = EvalCheckpoint();
+    checkpoint.model_path = root.getString("model");
+    checkpoint.dataset_path = root.getString("dataset");
+    checkpoint.n_done = (long) root.getNumber("done");
+    checkpoint.complete = root.getBool("complete");
+    checkpoint.out_offset = (long) root.getNumber("out_offset");
+    checkpoint.n_failed = (long) root.getNumber("failed");
+    checkpoint.compression = (int) root.getNumber("compress");
+
+    const JsonValue* score = root.get("score");
+    if (score) {
+        countsFromJson(score->get("tp"), checkpoint.score.tp);
+        countsFromJson(score->get("fp"), checkpoint.score.fp);
+        countsFromJson(score->get("fn"), checkpoint.score.fn);
+        countsFromJson(score->get("tn"), checkpoint.score.tn);
+        checkpoint.score.n_samples = (long) score->getNumber("n_samples");
+        checkpoint.score.n_exact = (long) score->getNumber("n_exact");
+    }
+    return true;
+}
+
+bool resumeEvaluation(const EvalCheckpoint& checkpoint,
+                      const std::string& dataset_path,
+                      int compression,
+                      const std::vector<std::string>& model_paths,
+                      size_t& first_model,
+                      EvalCheckpoint& resume,
+                      std::string& error) {
+    if (checkpoint.dataset_path != dataset_path) {
+        error = "checkpoint belongs to dataset " + checkpoint.dataset_path;
+        return false;
+    }
+    if (checkpoint.compression != compression) {
+        error = "checkpoint was made with --compress " + std::to_string(checkpoint.compression);
+        return false;
+    }
+    first_model = 0;
+    while (first_model < model_paths.size() && model_paths[first_model] != checkpoint.model_path) {
+        first_model++;
+    }
+    if (first_model == model_paths.size()) {
+        error = "checkpoint is for model " + checkpoint.model_path + ", not in the model list";
+        return false;
+    }
+
+    resume = checkpoint;
+    if (checkpoint.complete) {
+        first_model++;
+        resume = EvalCheckpoint();
+        resume.out_offset = checkpoint.out_offset;
+        resume.compression = checkpoint.compression;
+    }
+    return true;
+}
+
+std::string outcomeToJson(const EvalReport& report, const EvalOutcome& outcome) {
+    return "{\"id\":" + std::to_string(outcome.id) +
+           (outcome.code.empty() ? "" : ",\"code\":" + jsonQuote(outcome.code)) +
+           ",\"model\":" + jsonQuote(report.model_path) +
+           ",\"predicted\":" + jsonQuote(formatAllergenMask(outcome.predicted)) +
+           ",\"expected\":" + jsonQuote(formatAllergenMask(outcome.truth)) +
+           ",\"match\":" + (outcome.predicted == outcome.truth ? "true" : "false") +
+           ",\"shard\":" + std::to_string(outcome.shard) +
+           ",\"prompt_tokens\":" + std::to_string(outcome.prompt_tokens) +
+           ",\"stop\":" + jsonQuote(stopReasonName(outcome.stop)) +
+           ",\"result\":" + jsonQuote(outcome.result) + "}";
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "allergens.h"
+#include "dataset.h"
+#include "engine.h"
+#include "stop_controller.h"
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// ================= Sharded evaluation =================
+// Data-parallel evaluation on many-core hosts: one mmap'd llama_model,
+// K contexts on top of it, each driven by its own thread and a threadpool
+// pinned to cores of a single NUMA node. Items are dealt round-robin to
+// shards and merged back in dataset order, so the output does not depend
+// on K or on thread timing.
+//
+// Every shard is a pipeline: prompt building, tokenization, inference and
+// scoring run on their own threads, connected by bounded SPSC queues, and
+// a single persist thread hands finished outcomes to the sink in dataset
+// order. Only the inference stage is on the critical path.
+//
+// runStreamingEvaluation reads the dataset as it goes and keeps no
+// per-item state after an item is persisted, so memory is bounded by the
+// queue depths whatever the dataset size.
+
+struct EvalOutcome;
+
+// Progress of a streaming run: the first n_done items (dataset order)
+// are persisted and score covers exactly those
+struct EvalCheckpoint {
+    std::string model_path;
+    std::string dataset_path;
+    long n_done = 0;
+    bool complete = false;
+    long out_offset = 0;  // size of the JSONL output at n_done
+    long n_failed = 0;    // items among n_done with no output, not in score
+    int compression = 0;  // EngineConfig::compress_ingredients of the run
+    AllergenScore score;
+};
+
+struct ShardedEvalConfig {
+    int n_shards = 1;
+    int threads_per_shard = 0;  // 0 = split the node's cores evenly
+    int queue_depth = 64;       // items buffered between two stages
+    EngineConfig engine;
+
+    // Persist stage, called in dataset order while the run is in progress
+    std::function<void(const EvalOutcome&)> persist;
+
+    // Streaming runs: skip resume.n_done items and continue its score;
+    // checkpoint() is called every checkpoint_every persisted items
+    EvalCheckpoint resume;
+    long checkpoint_every = 0;
+    std::function<void(const EvalCheckpoint&)> checkpoint;
+};
+
+struct EvalOutcome {
+    long seq = 0;             // position in the dataset
+    int id = 0;
+    std::string code;
+    int shard = -1;
+    std::string result;       // formatResult(), "" on failure
+    std::string raw_output;
+    long prompt_tokens = 0;   // as prefilled, after any ingredient compression
+    StopReason stop = StopReason::None;
+    AllergenMask predicted = 0;
+    AllergenMask truth = 0;
+};
+
+struct EvalReport {
+    std::string model_path;
+    std::vector<EvalOutcome> outcomes;  // dataset order, empty for streaming runs
+    long n_items = 0;
+    long n_failed = 0;    // items whose inference failed; excluded from score
+    AllergenScore score;  // over the items that produced an output
+    long wall_ms = 0;
+    long model_ms = 0;  // longest time a shard spent in llama_decode steps
+    long prompt_tokens = 0;  // over the items of this run
+    std::map<StopReason, long> stops;  // why generations ended, over the items of this run
+    ModelLoadStats load;
+    std::vector<std::vector<int>> shard_cpus;
+};
+
+bool runShardedEvaluation(const std::string& model_path,
+                          int template_type,
+                          const std::vector<FoodRecord>& records,
+                          const ShardedEvalConfig& config,
+                          EvalReport& report);
+
+// Bounded-memory variant: outcomes only go to config.persist
+bool runStreamingEvaluation(const std::string& model_path,
+                            int template_type,
+                            DatasetStream& dataset,
+                            const ShardedEvalConfig& config,
+                            EvalReport& report);
+
+// Written atomically (temp file + rename)
+bool saveCheckpoint(const std::string& path, const EvalCheckpoint& checkpoint);
+bool loadCheckpoint(const std::string& path, EvalCheckpoint& checkpoint);
+
+// Where a resumed multi-model run continues: first_model indexes
+// model_paths and resume is the progress to hand to that model's run.
+// A complete checkpoint moves on to the next model with nothing done but
+// keeps out_offset, so the output written so far survives the truncation.
+// Returns false with error set when the checkpoint belongs to another run
+// (dataset, model list or compression mode), so a resumed report never
+// mixes items prompted two different ways.
+bool resumeEvaluation(const EvalCheckpoint& checkpoint,
+                      const std::string& dataset_path,
+                      int compression,
+                      const std::vector<std::string>& model_paths,
+                      size_t& first_model,
+                      EvalCheckpoint& resume,
+                      std::string& error);
+
+// One JSON object per outcome (JSONL)
+std::string outcomeToJson(const EvalReport& report, const EvalOutcome& outcome);
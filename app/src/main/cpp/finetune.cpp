@@ -0,0 +1,220 @@
+#include "finetune.h"
+#include "allergens.h"
+#include "engine.h"
+#include "native-log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ================= Training data =================
+// "Ingredients: ...\nAllergens: milk, wheat\n", the label normalised like
+// the evaluator scores it
+static std::string trainingExample(const FoodRecord& record) {
+    return buildTunedPrompt(record.ingredients) + " " +
+           formatAllergenMask(parseAllergenList(record.allergens_mapped)) + "\n";
+}
+
+// Windows of n_ctx tokens over the packed examples, half overlapping;
+// labels are the same window shifted by one token
+static ggml_opt_dataset_t buildDataset(const std::vector<llama_token>& tokens, int n_ctx) {
+    const int64_t stride = n_ctx / 2;
+    const int64_t n_windows = ((int64_t) tokens.size() - n_ctx - 1) / stride + 1;
+
+    ggml_opt_dataset_t dataset = ggml_opt_dataset_init(
+            GGML_TYPE_I32, GGML_TYPE_I32, n_ctx, n_ctx, n_windows, 1);
+    auto* data = (llama_token*) ggml_opt_dataset_data(dataset)->data;
+    auto* labels = (llama_token*) ggml_opt_dataset_labels(dataset)->data;
+    for (int64_t w = 0; w < n_windows; w++) {
+        memcpy(data + w * n_ctx, tokens.data() + w * stride, n_ctx * sizeof(llama_token));
+        memcpy(labels + w * n_ctx, tokens.data() + w * stride + 1, n_ctx * sizeof(llama_token));
+    }
+    return dataset;
+}
+
+// ================= Trainable tensors =================
+struct TrainableFilter {
+    int first_layer = 0;          // blocks below are frozen
+    std::set<std::string> seen;   // llama_opt_init may ask more than once
+    long n_params = 0;
+};
+
+static bool isTrainable(const ggml_tensor* tensor, void* user_data) {
+    auto* filter = (TrainableFilter*) user_data;
+    if (tensor->type != GGML_TYPE_F32) {
+        return false;
+    }
+    if (filter->first_layer > 0) {
+        int layer = -1;
+        if (sscanf(tensor->name, "blk.%d.", &layer) != 1 || layer < filter->first_layer) {
+            return false;
+        }
+    }
+    if (filter->seen.insert(tensor->name).second) {
+        filter->n_params += (long) ggml_nelements(tensor);
+    }
+    return true;
+}
+
+static ggml_opt_optimizer_params optimizerParams(void* user_data) {
+    const auto* config = (const FinetuneConfig*) user_data;
+    ggml_opt_optimizer_params params = ggml_opt_get_default_optimizer_params(nullptr);
+    params.adamw.alpha = config->learning_rate;
+    params.adamw.wd = config->weight_decay;
+    params.sgd.alpha = config->learning_rate;
+    params.sgd.wd = config->weight_decay;
+    return params;
+}
+
+static void readResult(ggml_opt_result_t result, double& loss, double& accuracy) {
+    ggml_opt_result_loss(result, &loss, nullptr);
+    ggml_opt_result_accuracy(result, &accuracy, nullptr);
+}
+
+bool finetuneModel(const std::string& model_path,
+                   const std::vector<FoodRecord>& records,
+                   const FinetuneConfig& config,
+                   const std::string& out_path,
+                   FinetuneReport& report) {
+    initBackends("");
+
+    // Weights are updated in place: no mmap, no repacked copies
+    llama_model_params model_params = llama_model_default_params();
+    model_params.use_mmap = false;
+    model_params.use_extra_bufts = false;
+    llama_model* model = llama_model_load_from_file(model_path.c_str(), model_params);
+    if (!model) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Failed to load %s", model_path.c_str());
+        return false;
+    }
+
+    // One window per step; gradients need F32 KV and no flash attention
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = config.n_ctx;
+    ctx_params.n_batch = config.n_ctx;
+    ctx_params.n_ubatch = config.n_ctx;
+    ctx_params.n_seq_max = 1;
+    ctx_params.n_threads = config.n_threads;
+    ctx_params.n_threads_batch = config.n_threads;
+    ctx_params.type_k = GGML_TYPE_F32;
+    ctx_params.type_v = GGML_TYPE_F32;
+    ctx_params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_DISABLED;
+
+    llama_context* ctx = llama_init_from_model(model, ctx_params);
+    if (!ctx) {
+        llama_model_free(model);
+        return false;
+    }
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+
+    // ================= Dataset =================
+    std::vector<llama_token> tokens;
+    const llama_token eos = llama_vocab_eos(vocab);
+    for (const FoodRecord& record : records) {
+        std::vector<llama_token> example = tokenize(vocab, trainingExample(record), true);
+        tokens.insert(tokens.end(), example.begin(), example.end());
+        if (eos != LLAMA_TOKEN_NULL) {
+            tokens.push_back(eos);
+        }
+        report.n_examples++;
+    }
+    report.n_tokens = (long) tokens.size();
+
+    if ((long) tokens.size() < config.n_ctx + 1 + config.n_ctx / 2) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "Fine-tuning needs more than %d tokens, the dataset has %zu",
+                            config.n_ctx + config.n_ctx / 2, tokens.size());
+        llama_free(ctx);
+        llama_model_free(model);
+        return false;
+    }
+
+    ggml_opt_dataset_t dataset = buildDataset(tokens, config.n_ctx);
+    report.n_windows = (long) ggml_opt_dataset_ndata(dataset);
+    const int64_t idata_split = std::max<int64_t>(
+            1, (int64_t) (report.n_windows * (1.0f - config.val_split)));
+
+    // ================= Optimiser =================
+    TrainableFilter filter;
+    if (config.n_train_layers > 0) {
+        filter.first_layer = std::max(0, llama_model_n_layer(model) - config.n_train_layers);
+    }
+
+    llama_opt_params opt_params = {};
+    opt_params.n_ctx_train = 0;
+    opt_params.param_filter = isTrainable;
+    opt_params.param_filter_ud = &filter;
+    opt_params.get_opt_pars = optimizerParams;
+    opt_params.get_opt_pars_ud = (void*) &config;
+    opt_params.optimizer_type = config.optimizer;
+    llama_opt_init(ctx, model, opt_params);
+
+    report.n_trainable = filter.n_params;
+    if (report.n_trainable == 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "No F32 tensors to train in %s (convert with --outtype f32)",
+                            model_path.c_str());
+        ggml_opt_dataset_free(dataset);
+        llama_free(ctx);
+        llama_model_free(model);
+        return false;
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "Fine-tuning: %ld examples, %ld tokens, %ld windows (%lld train), "
+                        "%ld trainable parameters, %s",
+                        report.n_examples, report.n_tokens, report.n_windows,
+                        (long long) idata_split, report.n_trainable,
+                        ggml_opt_optimizer_name(config.optimizer));
+
+    // ================= Epochs =================
+    ggml_opt_result_t result_train = ggml_opt_result_init();
+    ggml_opt_result_t result_eval = ggml_opt_result_init();
+    auto t_start = Clock::now();
+
+    for (int epoch = 0; epoch < config.n_epochs; epoch++) {
+        llama_opt_epoch(ctx, dataset, result_train, result_eval, idata_split,
+                        config.progress, config.progress);
+
+        FinetuneEpoch stats;
+        readResult(result_train, stats.train_loss, stats.train_accuracy);
+        if (idata_split < report.n_windows) {
+            readResult(result_eval, stats.val_loss, stats.val_accuracy);
+        }
+        report.epochs.push_back(stats);
+        __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                            "Epoch %d: train loss=%.4f acc=%.3f, val loss=%.4f acc=%.3f",
+                            epoch + 1, stats.train_loss, stats.train_accuracy,
+                            stats.val_loss, stats.val_accuracy);
+
+        ggml_opt_result_reset(result_train);
+        ggml_opt_result_reset(result_eval);
+    }
+    report.train_ms = elapsedMs(t_start, Clock::now());
+
+    ggml_opt_result_free(result_train);
+    ggml_opt_result_free(result_eval);
+    ggml_opt_dataset_free(dataset);
+
+    // llama_model_save_to_file reports nothing: write next to the target,
+    // check the file and only then replace out_path
+    const std::string tmp_path = out_path + ".tmp";
+    unlink(tmp_path.c_str());
+    llama_model_save_to_file(model, tmp_path.c_str());
+    llama_free(ctx);
+    llama_model_free(model);
+
+    struct stat st;
+    if (stat(tmp_path.c_str(), &st) != 0 || st.st_size == 0 ||
+        rename(tmp_path.c_str(), out_path.c_str()) != 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot write the fine-tuned model to %s",
+                            out_path.c_str());
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Fine-tuned model written to %s",
+                        out_path.c_str());
+    return true;
+}
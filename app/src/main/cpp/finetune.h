@@ -0,0 +1,68 @@
+#pragma once
+
+#include "dataset.h"
+#include "llama/llama.h"
+#include <string>
+#include <vector>
+
+// ================= Fine-tuning =================
+// Teaches a base model the allergen task so the long zero-shot
+// instruction can be dropped from every prompt. Each labelled record
+// becomes one plain-text example
+//
+//   Ingredients: <ingredients>
+//   Allergens: <ground truth or "none">
+//
+// and the examples are packed into n_ctx-token windows for next-token
+// training with llama_opt_init / llama_opt_epoch on the CPU. The trained
+// weights are written as a merged GGUF, used with TEMPLATE_TUNED
+// (buildTunedPrompt) and quantised like any other model (quantize.h).
+//
+// llama.cpp trains F32 tensors only: start from an F32 GGUF of the base
+// model. With n_train_layers only the last blocks are trained, which cuts
+// the optimiser state to what fits on a phone.
+//
+// The loss covers every token of a window, the ingredient text included:
+// llama_opt_epoch has no per-token loss mask, so the model also learns to
+// continue ingredient lists. The answer is a few tokens per example, so
+// most of the gradient comes from the prompt part; the reported accuracy
+// is next-token accuracy over all tokens, not answer accuracy (compare
+// with --holdout for that).
+struct FinetuneConfig {
+    int n_ctx = 256;            // tokens per training window
+    int n_epochs = 2;
+    float learning_rate = 1e-5f;
+    float weight_decay = 0.0f;
+    float val_split = 0.05f;    // last part of the windows, evaluation only
+    int n_train_layers = 0;     // train blocks [n_layer - N, n_layer), 0 = all tensors
+    int n_threads = 4;
+    ggml_opt_optimizer_type optimizer = GGML_OPT_OPTIMIZER_TYPE_ADAMW;
+
+    // Called after every batch of the training and validation passes
+    // (e.g. ggml_opt_epoch_callback_progress_bar), nullptr = silent
+    ggml_opt_epoch_callback progress = nullptr;
+};
+
+struct FinetuneEpoch {
+    double train_loss = 0.0;
+    double train_accuracy = 0.0;  // next-token accuracy
+    double val_loss = 0.0;
+    double val_accuracy = 0.0;
+};
+
+struct FinetuneReport {
+    long n_examples = 0;
+    long n_tokens = 0;
+    long n_windows = 0;
+    long n_trainable = 0;         // parameters updated by the optimiser
+    std::vector<FinetuneEpoch> epochs;
+    long train_ms = 0;
+};
+
+// False when loading, training or writing out_path fails; out_path is
+// only replaced by a complete file
+bool finetuneModel(const std::string& model_path,
+                   const std::vector<FoodRecord>& records,
+                   const FinetuneConfig& config,
+                   const std::string& out_path,
+                   FinetuneReport& report);
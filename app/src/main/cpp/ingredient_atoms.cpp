@@ -0,0 +1,290 @@
+#include "ingredient_atoms.h"
+#include "checksum.h"
+#include "engine.h"
+#include "native-log.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+// ================= Parser =================
+static bool isSeparator(const std::string& text, size_t i) {
+    switch (text[i]) {
+        case ',': case ';': case ':':
+        case '(': case ')': case '[': case ']': case '{': case '}':
+            return true;
+        case '.':
+            // Sentence dot, not the decimal point of "2.5%"
+            return !(i > 0 && i + 1 < text.size() &&
+                     isdigit((unsigned char) text[i - 1]) && isdigit((unsigned char) text[i + 1]));
+        default:
+            return false;
+    }
+}
+
+// Words starting with a digit are quantities ("45%", "2.5g", "10") and
+// are dropped; emphasis marks go; ASCII is lower-cased, UTF-8 kept as is
+static std::string normalizeAtom(const std::string& raw) {
+    static const char* const LEADING[] = {"and ", "or ", "with "};
+    static const char* const STOP_ATOMS[] = {"ingredients", "ingredient", "contains",
+                                             "may contain", "including", "and", "or"};
+
+    std::string atom;
+    size_t pos = 0;
+    while (pos < raw.size()) {
+        while (pos < raw.size() && isspace((unsigned char) raw[pos])) {
+            pos++;
+        }
+        const size_t start = pos;
+        while (pos < raw.size() && !isspace((unsigned char) raw[pos])) {
+            pos++;
+        }
+        if (start == pos || isdigit((unsigned char) raw[start])) {
+            continue;
+        }
+
+        std::string word;
+        for (size_t i = start; i < pos; i++) {
+            const unsigned char c = (unsigned char) raw[i];
+            if (c != '*' && c != '_' && c != '"' && c != '%') {
+                word += (char) tolower(c);
+            }
+        }
+        while (!word.empty() && strchr("-'.&/+", word.back())) {
+            word.pop_back();
+        }
+        while (!word.empty() && strchr("-'.&/+", word.front())) {
+            word.erase(word.begin());
+        }
+        if (!word.empty()) {
+            atom += atom.empty() ? word : " " + word;
+        }
+    }
+
+    for (const char* leading : LEADING) {
+        const size_t n = strlen(leading);
+        if (atom.compare(0, n, leading) == 0) {
+            atom.erase(0, n);
+        }
+    }
+    for (const char* stop : STOP_ATOMS) {
+        if (atom == stop) {
+            return "";
+        }
+    }
+    for (unsigned char c : atom) {
+        if (isalpha(c) || c >= 0x80) {
+            return atom;
+        }
+    }
+    return "";
+}
+
+std::vector<std::string> parseIngredientAtoms(const std::string& ingredients) {
+    std::vector<std::string> atoms;
+    std::unordered_set<std::string> seen;
+    size_t start = 0;
+    for (size_t i = 0; i <= ingredients.size(); i++) {
+        if (i < ingredients.size() && !isSeparator(ingredients, i)) {
+            continue;
+        }
+        std::string atom = normalizeAtom(ingredients.substr(start, i - start));
+        if (!atom.empty() && seen.insert(atom).second) {
+            atoms.push_back(std::move(atom));
+        }
+        start = i + 1;
+    }
+    return atoms;
+}
+
+// ================= Compression =================
+// Common atoms that name no allergen source; matched whole, and only
+// when no allergen keyword occurs in them (allergensMentionedIn)
+static const char* const IRRELEVANT_ATOMS[] = {
+        "water", "salt", "sea salt", "sugar", "cane sugar", "brown sugar", "dextrose",
+        "glucose", "glucose syrup", "fructose", "invert sugar syrup", "citric acid",
+        "ascorbic acid", "lactic acid", "acidity regulator", "acidity regulators",
+        "preservative", "potassium sorbate", "sodium benzoate", "antioxidant",
+        "colour", "colours", "flavouring", "flavourings", "natural flavouring",
+        "natural flavourings", "flavour", "natural flavour", "yeast", "vinegar",
+        "spirit vinegar", "garlic", "onion", "pepper", "black pepper", "paprika",
+        "spices", "spice", "herbs", "tomato", "tomato paste", "sunflower oil",
+        "rapeseed oil", "palm oil", "olive oil", "raising agent", "sodium bicarbonate",
+        "thickener", "xanthan gum", "guar gum", "stabiliser", "gelling agent", "pectin",
+};
+
+static bool isIrrelevantAtom(const std::string& atom) {
+    for (const char* irrelevant : IRRELEVANT_ATOMS) {
+        if (atom == irrelevant) {
+            return allergensMentionedIn(atom) == 0;
+        }
+    }
+    return false;
+}
+
+bool parseCompressionMode(const std::string& text, int& mode) {
+    if (text.size() != 1 || text[0] < '0' + COMPRESS_OFF || text[0] > '0' + COMPRESS_DROP_IRRELEVANT) {
+        return false;
+    }
+    mode = text[0] - '0';
+    return true;
+}
+
+std::string compressIngredients(const std::string& ingredients, int mode) {
+    if (mode == COMPRESS_OFF) {
+        return ingredients;
+    }
+    const std::vector<std::string> atoms = parseIngredientAtoms(ingredients);
+    if (atoms.empty()) {
+        return ingredients;
+    }
+
+    std::string out;
+    for (const std::string& atom : atoms) {
+        if (mode == COMPRESS_DROP_IRRELEVANT && isIrrelevantAtom(atom)) {
+            continue;
+        }
+        out += out.empty() ? atom : ", " + atom;
+    }
+    // Nothing left: keep one atom rather than an empty list
+    return out.empty() ? atoms[0] : out;
+}
+
+std::string compressPromptIngredients(const std::string& prompt, int mode) {
+    static const std::string MARKER = "Ingredients: ";
+    const size_t start = prompt.find(MARKER);
+    if (mode == COMPRESS_OFF || start == std::string::npos) {
+        return prompt;
+    }
+    const size_t begin = start + MARKER.size();
+    const size_t end = std::min(prompt.find('\n', begin), prompt.size());
+    return prompt.substr(0, begin) + compressIngredients(prompt.substr(begin, end - begin), mode) +
+           prompt.substr(end);
+}
+
+// ================= Cache file =================
+static const char CACHE_MAGIC[8] = {'S', 'L', 'A', 'C', 1, 0, 0, 0};  // + version
+
+struct RecordHeader {
+    uint32_t atom_size;
+    uint32_t crc;      // over mask and atom
+    AllergenMask mask;
+    uint8_t pad[2];
+};
+
+static uint32_t recordCrc(const RecordHeader& header, const char* atom) {
+    std::vector<uint8_t> bytes(sizeof(header.mask) + header.atom_size);
+    memcpy(bytes.data(), &header.mask, sizeof(header.mask));
+    memcpy(bytes.data() + sizeof(header.mask), atom, header.atom_size);
+    return crc32Ieee(bytes.data(), bytes.size());
+}
+
+bool openAtomCache(AtomCache& cache, const std::string& path) {
+    closeAtomCache(cache);
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    cache.path = path;
+    cache.fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (cache.fd < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot open atom cache %s", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    fstat(cache.fd, &st);
+    const size_t size = (size_t) st.st_size;
+
+    std::vector<uint8_t> bytes(size);
+    if (size > 0 && pread(cache.fd, bytes.data(), size, 0) != (ssize_t) size) {
+        close(cache.fd);
+        cache.fd = -1;
+        return false;
+    }
+
+    if (size < sizeof(CACHE_MAGIC) || memcmp(bytes.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+        // New, torn before the header was complete, or an older format
+        if (ftruncate(cache.fd, 0) != 0 ||
+            pwrite(cache.fd, CACHE_MAGIC, sizeof(CACHE_MAGIC), 0) != (ssize_t) sizeof(CACHE_MAGIC)) {
+            close(cache.fd);
+            cache.fd = -1;
+            return false;
+        }
+        cache.file_size = sizeof(CACHE_MAGIC);
+        return true;
+    }
+
+    size_t pos = sizeof(CACHE_MAGIC);
+    while (pos + sizeof(RecordHeader) <= size) {
+        RecordHeader header;
+        memcpy(&header, bytes.data() + pos, sizeof(header));
+        const char* atom = (const char*) bytes.data() + pos + sizeof(header);
+        if (header.atom_size > size - pos - sizeof(header) || recordCrc(header, atom) != header.crc) {
+            break;
+        }
+        cache.masks[std::string(atom, header.atom_size)] = header.mask;
+        pos += sizeof(header) + header.atom_size;
+    }
+
+    if (pos < size) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                            "%s: dropping %zu bytes of an incomplete record",
+                            path.c_str(), size - pos);
+        if (ftruncate(cache.fd, (off_t) pos) != 0) {
+            close(cache.fd);
+            cache.fd = -1;
+            cache.masks.clear();
+            return false;
+        }
+    }
+    cache.file_size = (long) pos;
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Atom cache %s: %zu atoms",
+                        path.c_str(), cache.masks.size());
+    return true;
+}
+
+bool lookupAtom(AtomCache& cache, const std::string& atom, AllergenMask& mask) {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.masks.find(atom);
+    if (it == cache.masks.end()) {
+        return false;
+    }
+    mask = it->second;
+    return true;
+}
+
+bool storeAtom(AtomCache& cache, const std::string& atom, AllergenMask mask) {
+    RecordHeader header = {};
+    header.atom_size = (uint32_t) atom.size();
+    header.mask = mask;
+    header.crc = recordCrc(header, atom.data());
+
+    std::vector<uint8_t> record(sizeof(header) + atom.size());
+    memcpy(record.data(), &header, sizeof(header));
+    memcpy(record.data() + sizeof(header), atom.data(), atom.size());
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.masks[atom] = mask;
+    if (cache.fd < 0) {
+        return false;
+    }
+    if (pwrite(cache.fd, record.data(), record.size(), cache.file_size) != (ssize_t) record.size()) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Append to %s failed", cache.path.c_str());
+        return false;
+    }
+    cache.file_size += (long) record.size();
+    return true;
+}
+
+void closeAtomCache(AtomCache& cache) {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.fd >= 0) {
+        close(cache.fd);
+        cache.fd = -1;
+    }
+    cache.masks.clear();
+    cache.file_size = 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "allergens.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ================= Ingredient atoms =================
+// Products share ingredient phrases ("wheat flour", "skimmed milk
+// powder", "rapeseed oil") far more than whole ingredient lists. An
+// ingredient list is split into normalised atoms, the model is asked
+// about each atom once, and an item's allergens are the OR of its atoms'
+// masks. Over a catalogue most items end up needing no model call.
+
+// Splits on , ; : ( ) [ ] { } and sentence dots, at any nesting depth,
+// so "chocolate (sugar, cocoa butter, milk powder)" gives "chocolate",
+// "sugar", "cocoa butter" and "milk powder". Atoms are lower-cased, lose
+// quantities, percentages and emphasis marks ("_milk_", "45%", "*") and
+// are unique within the list, in order of appearance.
+std::vector<std::string> parseIngredientAtoms(const std::string& ingredients);
+
+// Persistent atom -> mask map, one file per model and prompt template
+// (the answers are the model's). Records are appended with their own CRC
+// and no fsync: the cache can always be refilled, so a torn record at the
+// end is simply cut off on open.
+struct AtomCache {
+    std::string path;
+    int fd = -1;
+    long file_size = 0;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, AllergenMask> masks;
+};
+
+// Opens (or creates) the cache and loads its atoms. On failure cache.path
+// is still set and the cache works in memory only (storeAtom keeps the
+// atom but returns false).
+bool openAtomCache(AtomCache& cache, const std::string& path);
+
+bool lookupAtom(AtomCache& cache, const std::string& atom, AllergenMask& mask);
+
+// Adds the atom in memory and appends it to the file
+bool storeAtom(AtomCache& cache, const std::string& atom, AllergenMask mask);
+
+void closeAtomCache(AtomCache& cache);
+
+// ================= Compression =================
+// Ingredient text rewritten before tokenisation to cut prefill tokens.
+// "King Prawn (86%) (King Prawn (Penaeus vannamei) (Crustacean), Salt)"
+// becomes "king prawn, penaeus vannamei, crustacean, salt".
+enum IngredientCompression : int {
+    COMPRESS_OFF = 0,
+    COMPRESS_NORMALIZE = 1,        // the atoms, comma-separated
+    COMPRESS_DROP_IRRELEVANT = 2   // also without atoms that never carry an allergen
+};
+
+// Mode given as text ("0".."2", e.g. a --compress argument); false for
+// anything else
+bool parseCompressionMode(const std::string& text, int& mode);
+
+// Text that yields no atoms is returned unchanged
+std::string compressIngredients(const std::string& ingredients, int mode);
+
+// Compresses the "Ingredients: " line of a prompt built like
+// buildAllergenPrompt / buildTunedPrompt (MainActivity.buildPrompt);
+// other prompts are returned unchanged
+std::string compressPromptIngredients(const std::string& prompt, int mode);
@@ -0,0 +1,143 @@
+#include "ingredient_chunks.h"
+#include "allergens.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+static std::string trim(const std::string& text) {
+    size_t start = 0;
+    size_t end = text.size();
+    while (start < end && isspace((unsigned char) text[start])) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char) text[end - 1])) {
+        end--;
+    }
+    return text.substr(start, end - start);
+}
+
+// Pieces separated by , or ; outside brackets
+static std::vector<std::string> splitTopLevel(const std::string& text) {
+    std::vector<std::string> pieces;
+    int depth = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= text.size(); i++) {
+        const char c = i < text.size() ? text[i] : ',';
+        if (strchr("([{", c)) {
+            depth++;
+        } else if (strchr(")]}", c)) {
+            depth = std::max(0, depth - 1);
+        } else if ((c == ',' || c == ';') && (depth == 0 || i == text.size())) {
+            std::string piece = trim(text.substr(start, i - start));
+            if (!piece.empty()) {
+                pieces.push_back(std::move(piece));
+            }
+            start = i + 1;
+        }
+    }
+    return pieces;
+}
+
+// Position of the bracket closing the one at open, npos if unbalanced
+static size_t matchingClose(const std::string& text, size_t open) {
+    int depth = 0;
+    for (size_t i = open; i < text.size(); i++) {
+        if (strchr("([{", text[i])) {
+            depth++;
+        } else if (strchr(")]}", text[i]) && --depth == 0) {
+            return i;
+        }
+    }
+    return std::string::npos;
+}
+
+static void chunkList(const std::string& text, const std::string& head, int max_chars,
+                      std::vector<std::string>& chunks) {
+    // The head and its brackets are repeated in every chunk
+    const size_t budget = (size_t) std::max(1, max_chars - (head.empty() ? 0 : (int) head.size() + 3));
+    std::string current;
+    auto flush = [&]() {
+        if (!current.empty()) {
+            chunks.push_back(head.empty() ? current : head + " (" + current + ")");
+            current.clear();
+        }
+    };
+
+    for (const std::string& piece : splitTopLevel(text)) {
+        if (piece.size() > budget) {
+            const size_t open = piece.find_first_of("([{");
+            const size_t close = open == std::string::npos ? open : matchingClose(piece, open);
+            if (close == std::string::npos) {
+                // Nothing to split at: an oversized chunk of its own
+                flush();
+                chunks.push_back(head.empty() ? piece : head + " (" + piece + ")");
+                continue;
+            }
+            flush();
+            const std::string name = trim(piece.substr(0, open));
+            chunkList(piece.substr(open + 1, close - open - 1), name.empty() ? head : name,
+                      max_chars, chunks);
+            current = trim(piece.substr(close + 1));
+            continue;
+        }
+        if (!current.empty() && current.size() + 2 + piece.size() > budget) {
+            flush();
+        }
+        current += current.empty() ? piece : ", " + piece;
+    }
+    flush();
+}
+
+std::vector<std::string> chunkIngredients(const std::string& ingredients, int max_chars) {
+    if (max_chars <= 0 || (int) ingredients.size() <= max_chars) {
+        return {ingredients};
+    }
+    std::vector<std::string> chunks;
+    chunkList(ingredients, "", max_chars, chunks);
+    if (chunks.empty()) {
+        return {ingredients};
+    }
+    return chunks;
+}
+
+std::vector<std::string> chunkPromptIngredients(const std::string& prompt, int max_chars) {
+    static const std::string MARKER = "Ingredients: ";
+    const size_t start = prompt.find(MARKER);
+    if (max_chars <= 0 || start == std::string::npos) {
+        return {prompt};
+    }
+    const size_t begin = start + MARKER.size();
+    const size_t end = std::min(prompt.find('\n', begin), prompt.size());
+
+    std::vector<std::string> prompts;
+    for (const std::string& chunk : chunkIngredients(prompt.substr(begin, end - begin), max_chars)) {
+        prompts.push_back(prompt.substr(0, begin) + chunk + prompt.substr(end));
+    }
+    return prompts;
+}
+
+static long latencyOf(const std::string& result) {
+    const size_t pos = result.find("LAT_MS=");
+    return pos == std::string::npos ? 0 : atol(result.c_str() + pos + 7);
+}
+
+std::string mergeChunkResults(const std::vector<std::string>& results) {
+    if (results.size() == 1) {
+        return results[0];
+    }
+    AllergenMask mask = 0;
+    const std::string* slowest = nullptr;
+    for (const std::string& result : results) {
+        const size_t bar = result.find('|');
+        if (bar == std::string::npos) {
+            return "";
+        }
+        mask |= parsePredictedAllergens(result.substr(bar + 1));
+        if (!slowest || latencyOf(result) > latencyOf(*slowest)) {
+            slowest = &result;
+        }
+    }
+    return slowest->substr(0, slowest->find('|')) + ";CHUNKS=" + std::to_string(results.size()) +
+           "|" + formatAllergenMask(mask);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// ================= Ingredient chunks =================
+// A very long ingredient list dominates prefill (attention is quadratic
+// in its length) and sets the context size. It is split into chunks that
+// are asked about as separate prompts, decoded together in one batch;
+// the chunk prompts fork the shared instruction prefix (Request::share_from)
+// and the item's allergens are the union of the chunks' answers.
+
+// Splits at top-level commas and semicolons and packs the pieces into
+// chunks of at most max_chars. A single piece longer than that is split
+// inside its brackets and every part keeps the piece's name:
+// "milk chocolate (sugar, cocoa butter, ...)" gives "milk chocolate (sugar,
+// cocoa butter)", "milk chocolate (...)". Lists no longer than max_chars,
+// or max_chars <= 0, come back as one chunk.
+std::vector<std::string> chunkIngredients(const std::string& ingredients, int max_chars);
+
+// One prompt per chunk of the "Ingredients: " line of a prompt built like
+// buildAllergenPrompt / buildTunedPrompt; other prompts come back alone
+std::vector<std::string> chunkPromptIngredients(const std::string& prompt, int max_chars);
+
+// formatResult() strings of an item's chunks -> the item's result: the
+// slowest chunk's metrics plus CHUNKS=<n>, and the union of the chunks'
+// allergens as the output. "" when a chunk failed; one chunk is returned
+// as is.
+std::string mergeChunkResults(const std::vector<std::string>& results);
@@ -0,0 +1,299 @@
+#include "json.h"
+#include <cstdio>
+#include <cstdlib>
+
+const JsonValue* JsonValue::get(const std::string& key) const {
+    if (type != Type::Object) {
+        return nullptr;
+    }
+    for (const auto& kv : object) {
+        if (kv.first == key) {
+            return &kv.second;
+        }
+    }
+    return nullptr;
+}
+
+std::string JsonValue::getString(const std::string& key, const std::string& fallback) const {
+    const JsonValue* v = get(key);
+    return v && v->type == Type::String ? v->string : fallback;
+}
+
+double JsonValue::getNumber(const std::string& key, double fallback) const {
+    const JsonValue* v = get(key);
+    return v && v->type == Type::Number ? v->number : fallback;
+}
+
+bool JsonValue::getBool(const std::string& key, bool fallback) const {
+    const JsonValue* v = get(key);
+    return v && v->type == Type::Bool ? v->boolean : fallback;
+}
+
+// ================= Parser =================
+namespace {
+
+struct Parser {
+    const std::string& text;
+    size_t pos = 0;
+    std::string error;
+
+    explicit Parser(const std::string& t) : text(t) {}
+
+    bool fail(const char* what) {
+        if (error.empty()) {
+            error = std::string(what) + " at offset " + std::to_string(pos);
+        }
+        return false;
+    }
+
+    void skipSpace() {
+        while (pos < text.size() &&
+               (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t n = 0;
+        while (word[n]) {
+            if (pos + n >= text.size() || text[pos + n] != word[n]) {
+                return false;
+            }
+            n++;
+        }
+        pos += n;
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += (char) cp;
+        } else if (cp < 0x800) {
+            out += (char) (0xC0 | (cp >> 6));
+            out += (char) (0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += (char) (0xE0 | (cp >> 12));
+            out += (char) (0x80 | ((cp >> 6) & 0x3F));
+            out += (char) (0x80 | (cp & 0x3F));
+        } else {
+            out += (char) (0xF0 | (cp >> 18));
+            out += (char) (0x80 | ((cp >> 12) & 0x3F));
+            out += (char) (0x80 | ((cp >> 6) & 0x3F));
+            out += (char) (0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool hex4(unsigned& cp) {
+        if (pos + 4 > text.size()) {
+            return fail("truncated \\u escape");
+        }
+        cp = 0;
+        for (int k = 0; k < 4; k++) {
+            char c = text[pos++];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= c - '0';
+            else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+            else return fail("bad \\u escape");
+        }
+        return true;
+    }
+
+    bool parseString(std::string& out) {
+        pos++;  // opening quote
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size()) {
+                break;
+            }
+            char e = text[pos++];
+            switch (e) {
+                case '"':  out += '"';  break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/';  break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    unsigned cp = 0;
+                    if (!hex4(cp)) {
+                        return false;
+                    }
+                    // Surrogate pair: a high surrogate must be followed by a low one
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        unsigned lo = 0;
+                        if (!literal("\\u") || !hex4(lo)) {
+                            return fail("unpaired surrogate");
+                        }
+                        if (lo < 0xDC00 || lo > 0xDFFF) {
+                            return fail("bad low surrogate");
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                        return fail("unpaired surrogate");
+                    }
+                    appendUtf8(out, cp);
+                    break;
+                }
+                default:
+                    return fail("bad escape");
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    bool parseValue(JsonValue& v, int depth) {
+        if (depth > 64) {
+            return fail("nesting too deep");
+        }
+        skipSpace();
+        if (pos >= text.size()) {
+            return fail("unexpected end");
+        }
+
+        char c = text[pos];
+        if (c == '{') {
+            v.type = JsonValue::Type::Object;
+            pos++;
+            skipSpace();
+            if (pos < text.size() && text[pos] == '}') {
+                pos++;
+                return true;
+            }
+            while (true) {
+                skipSpace();
+                if (pos >= text.size() || text[pos] != '"') {
+                    return fail("expected key");
+                }
+                std::string key;
+                if (!parseString(key)) {
+                    return false;
+                }
+                skipSpace();
+                if (pos >= text.size() || text[pos] != ':') {
+                    return fail("expected ':'");
+                }
+                pos++;
+                v.object.emplace_back(std::move(key), JsonValue());
+                if (!parseValue(v.object.back().second, depth + 1)) {
+                    return false;
+                }
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                if (pos < text.size() && text[pos] == '}') {
+                    pos++;
+                    return true;
+                }
+                return fail("expected ',' or '}'");
+            }
+        }
+        if (c == '[') {
+            v.type = JsonValue::Type::Array;
+            pos++;
+            skipSpace();
+            if (pos < text.size() && text[pos] == ']') {
+                pos++;
+                return true;
+            }
+            while (true) {
+                v.array.emplace_back();
+                if (!parseValue(v.array.back(), depth + 1)) {
+                    return false;
+                }
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                if (pos < text.size() && text[pos] == ']') {
+                    pos++;
+                    return true;
+                }
+                return fail("expected ',' or ']'");
+            }
+        }
+        if (c == '"') {
+            v.type = JsonValue::Type::String;
+            return parseString(v.string);
+        }
+        if (literal("true")) {
+            v.type = JsonValue::Type::Bool;
+            v.boolean = true;
+            return true;
+        }
+        if (literal("false")) {
+            v.type = JsonValue::Type::Bool;
+            v.boolean = false;
+            return true;
+        }
+        if (literal("null")) {
+            v.type = JsonValue::Type::Null;
+            return true;
+        }
+
+        const char* start = text.c_str() + pos;
+        char* end = nullptr;
+        double number = strtod(start, &end);
+        if (end == start) {
+            return fail("unexpected character");
+        }
+        v.type = JsonValue::Type::Number;
+        v.number = number;
+        pos += end - start;
+        return true;
+    }
+};
+
+} // namespace
+
+bool parseJson(const std::string& text, JsonValue& out, std::string* error) {
+    Parser parser(text);
+    out = JsonValue();
+
+    bool ok = parser.parseValue(out, 0);
+    if (ok) {
+        parser.skipSpace();
+        if (parser.pos != text.size()) {
+            ok = parser.fail("trailing characters");
+        }
+    }
+    if (!ok && error) {
+        *error = parser.error;
+    }
+    return ok;
+}
+
+std::string jsonQuote(const std::string& text) {
+    std::string out = "\"";
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += (char) c;
+                }
+        }
+    }
+    out += "\"";
+    return out;
+}
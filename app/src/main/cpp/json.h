@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// ================= Minimal JSON =================
+// Enough of RFC 8259 for food_preprocessed.json and tool I/O; no external
+// dependency so the same code builds with the NDK and on a Linux host.
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    // nullptr when this is not an object or the key is missing
+    const JsonValue* get(const std::string& key) const;
+
+    std::string getString(const std::string& key, const std::string& fallback = "") const;
+    double getNumber(const std::string& key, double fallback = 0.0) const;
+    bool getBool(const std::string& key, bool fallback = false) const;
+};
+
+bool parseJson(const std::string& text, JsonValue& out, std::string* error = nullptr);
+
+// Quoted and escaped JSON string literal
+std::string jsonQuote(const std::string& text);
@@ -0,0 +1,188 @@
+#include "kv_archive.h"
+#include "engine.h"
+#include "native-log.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static const char ENTRY_MAGIC[4] = {'S', 'L', 'K', 'V'};
+static const uint32_t ENTRY_VERSION = 1;
+
+struct EntryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t n_tokens;
+    uint32_t reserved;
+    uint64_t raw_size;
+    uint64_t compressed_size;
+};
+
+// FNV-1a over the token ids
+static uint64_t promptHash(const std::vector<llama_token>& tokens) {
+    uint64_t hash = 1469598103934665603ull;
+    const uint8_t* bytes = (const uint8_t*) tokens.data();
+    for (size_t i = 0; i < tokens.size() * sizeof(llama_token); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string entryPath(const KvArchive& archive, const std::vector<llama_token>& tokens) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".kv", promptHash(tokens));
+    return archive.dir + "/" + name;
+}
+
+static bool writeEntry(KvArchive& archive, const KvArchiveItem& item) {
+    uLongf compressed_size = compressBound(item.state.size());
+    std::vector<uint8_t> compressed(compressed_size);
+    if (compress2(compressed.data(), &compressed_size, item.state.data(), item.state.size(),
+                  Z_BEST_SPEED) != Z_OK) {
+        return false;
+    }
+
+    EntryHeader header = {};
+    memcpy(header.magic, ENTRY_MAGIC, 4);
+    header.version = ENTRY_VERSION;
+    header.n_tokens = (uint32_t) item.tokens.size();
+    header.raw_size = item.state.size();
+    header.compressed_size = compressed_size;
+
+    // Whole entries only: readers never see a partial file
+    const std::string path = entryPath(archive, item.tokens);
+    const std::string tmp_path = path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(item.tokens.data(), sizeof(llama_token), item.tokens.size(), file) == item.tokens.size() &&
+              fwrite(compressed.data(), 1, compressed_size, file) == compressed_size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    archive.n_saved++;
+    archive.bytes_raw += (long) item.state.size();
+    archive.bytes_stored += (long) (sizeof(header) + item.tokens.size() * sizeof(llama_token) +
+                                    compressed_size);
+    return true;
+}
+
+static void writerLoop(KvArchive* archive) {
+    KvArchiveItem item;
+    while (archive->queue.pop(item)) {
+        if (!writeEntry(*archive, item)) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "KV archive write failed in %s",
+                                archive->dir.c_str());
+        }
+    }
+}
+
+KvArchive* openKvArchive(const std::string& root, const std::string& model_path) {
+    const size_t slash = model_path.find_last_of('/');
+    const std::string name = slash == std::string::npos ? model_path : model_path.substr(slash + 1);
+
+    KvArchive* archive = new KvArchive();
+    archive->dir = root + "/" + name;
+    if ((mkdir(root.c_str(), 0755) != 0 && errno != EEXIST) ||
+        (mkdir(archive->dir.c_str(), 0755) != 0 && errno != EEXIST)) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot create KV archive %s",
+                            archive->dir.c_str());
+        delete archive;
+        return nullptr;
+    }
+
+    archive->writer = std::thread(writerLoop, archive);
+    return archive;
+}
+
+void closeKvArchive(KvArchive* archive) {
+    if (!archive) {
+        return;
+    }
+    archive->queue.close();
+    archive->writer.join();
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "KV archive %s: %ld saved (%ld -> %ld bytes), %ld restored",
+                        archive->dir.c_str(), archive->n_saved.load(), archive->bytes_raw.load(),
+                        archive->bytes_stored.load(), archive->n_restored.load());
+    delete archive;
+}
+
+void archiveSeqState(KvArchive& archive, llama_context* ctx, llama_seq_id seq_id,
+                     const std::vector<llama_token>& tokens) {
+    KvArchiveItem item;
+    item.state.resize(llama_state_seq_get_size(ctx, seq_id));
+    if (item.state.empty() ||
+        llama_state_seq_get_data(ctx, item.state.data(), item.state.size(), seq_id) == 0) {
+        return;
+    }
+    item.tokens = tokens;
+
+    // Blocks while the writer is 8 entries behind
+    archive.queue.push(std::move(item));
+}
+
+bool hasSeqState(const KvArchive& archive, const std::vector<llama_token>& tokens) {
+    return access(entryPath(archive, tokens).c_str(), R_OK) == 0;
+}
+
+static bool readEntry(const std::string& path,
+                      const std::vector<llama_token>& tokens,
+                      std::vector<uint8_t>& state) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    EntryHeader header;
+    std::vector<llama_token> stored;
+    std::vector<uint8_t> compressed;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, ENTRY_MAGIC, 4) == 0 &&
+              header.version == ENTRY_VERSION &&
+              header.n_tokens == tokens.size();
+    if (ok) {
+        stored.resize(header.n_tokens);
+        compressed.resize(header.compressed_size);
+        ok = fread(stored.data(), sizeof(llama_token), stored.size(), file) == stored.size() &&
+             fread(compressed.data(), 1, compressed.size(), file) == compressed.size() &&
+             stored == tokens;  // hash collisions
+    }
+    fclose(file);
+    if (!ok) {
+        return false;
+    }
+
+    uLongf raw_size = header.raw_size;
+    state.resize(raw_size);
+    return uncompress(state.data(), &raw_size, compressed.data(), compressed.size()) == Z_OK &&
+           raw_size == header.raw_size;
+}
+
+bool restoreSeqState(KvArchive& archive, llama_context* ctx, llama_seq_id seq_id,
+                     const std::vector<llama_token>& tokens) {
+    llama_memory_t mem = llama_get_memory(ctx);
+    llama_memory_seq_rm(mem, seq_id, -1, -1);
+
+    std::vector<uint8_t> state;
+    if (!readEntry(entryPath(archive, tokens), tokens, state)) {
+        return false;
+    }
+    if (llama_state_seq_set_data(ctx, state.data(), state.size(), seq_id) == 0) {
+        // Archived by another model build or context layout
+        llama_memory_seq_rm(mem, seq_id, -1, -1);
+        return false;
+    }
+
+    archive.n_restored++;
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "llama/llama.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ================= KV archive =================
+// Per-item post-prefill sequence state on disk, so decoding experiments
+// (grammars, thresholds, stop rules) can rerun without prefill. Entries
+// live in <root>/<model file name>/<prompt hash>.kv and hold the prompt
+// tokens plus the zlib-compressed llama_state_seq_get_data of exactly
+// those tokens.
+//
+// The scheduler archives a request right after its prefill and, when a
+// new request finds no better slot in the prefix cache, restores the
+// entry for its prompt into the slot; the last prompt token is decoded
+// again for its logits, as with any prefix-cache hit. Compression and
+// file writes run on a writer thread fed through an SPSC queue, so the
+// stepping thread only pays for the state copy.
+
+struct KvArchiveItem {
+    std::vector<llama_token> tokens;
+    std::vector<uint8_t> state;
+};
+
+struct KvArchive {
+    std::string dir;
+
+    SpscQueue<KvArchiveItem> queue{8};
+    std::thread writer;
+
+    std::atomic<long> n_saved{0};
+    std::atomic<long> n_restored{0};
+    std::atomic<long> bytes_raw{0};
+    std::atomic<long> bytes_stored{0};
+};
+
+// Archive for one model under root; nullptr if the directory is unusable
+KvArchive* openKvArchive(const std::string& root, const std::string& model_path);
+
+// Drains pending writes
+void closeKvArchive(KvArchive* archive);
+
+// Called on the thread driving ctx, while seq_id holds exactly tokens
+void archiveSeqState(KvArchive& archive, llama_context* ctx, llama_seq_id seq_id,
+                     const std::vector<llama_token>& tokens);
+
+bool hasSeqState(const KvArchive& archive, const std::vector<llama_token>& tokens);
+
+// Clears seq_id, then loads the entry for tokens into it. On false the
+// slot is left empty.
+bool restoreSeqState(KvArchive& archive, llama_context* ctx, llama_seq_id seq_id,
+                     const std::vector<llama_token>& tokens);
@@ -0,0 +1,367 @@
+#include "linear_probe.h"
+#include "checksum.h"
+#include "engine.h"
+#include "native-log.h"
+#include "llama/ggml-alloc.h"
+#include "llama/ggml-backend.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+// Two logits (absent, present) per allergen
+static const int N_OUTPUTS = 2 * N_ALLERGENS;
+
+static ggml_opt_optimizer_params optimizerParams(void* user_data) {
+    const auto* config = (const ProbeConfig*) user_data;
+    ggml_opt_optimizer_params params = ggml_opt_get_default_optimizer_params(nullptr);
+    params.adamw.alpha = config->learning_rate;
+    params.adamw.wd = config->weight_decay;
+    params.sgd.alpha = config->learning_rate;
+    params.sgd.wd = config->weight_decay;
+    return params;
+}
+
+static void readResult(ggml_opt_result_t result, double& loss, double& accuracy) {
+    ggml_opt_result_loss(result, &loss, nullptr);
+    ggml_opt_result_accuracy(result, &accuracy, nullptr);
+}
+
+// The CPU backend may be a dynamically loaded variant (backend DL), so
+// its thread setter is looked up rather than linked
+static void setBackendThreads(ggml_backend_t backend, int n_threads) {
+    ggml_backend_dev_t dev = ggml_backend_get_device(backend);
+    ggml_backend_reg_t reg = dev ? ggml_backend_dev_backend_reg(dev) : nullptr;
+    auto set_n_threads = reg ? (ggml_backend_set_n_threads_t) ggml_backend_reg_get_proc_address(
+            reg, "ggml_backend_set_n_threads") : nullptr;
+    if (set_n_threads) {
+        set_n_threads(backend, n_threads);
+    }
+}
+
+// ================= Dataset =================
+// Training rows padded to whole batches by repeating the first ones,
+// validation rows cut to whole batches (ggml_opt_epoch needs both)
+static ggml_opt_dataset_t buildDataset(const std::vector<float>& features,
+                                       const std::vector<AllergenMask>& labels,
+                                       int n_embd, long n_train, long n_val, int n_batch,
+                                       int64_t& idata_split) {
+    const long n_train_pad = (n_train + n_batch - 1) / n_batch * n_batch;
+    const long n_val_cut = n_val / n_batch * n_batch;
+    idata_split = n_train_pad;
+
+    ggml_opt_dataset_t dataset = ggml_opt_dataset_init(
+            GGML_TYPE_F32, GGML_TYPE_F32, n_embd, N_OUTPUTS, n_train_pad + n_val_cut, 1);
+    auto* data = (float*) ggml_opt_dataset_data(dataset)->data;
+    auto* targets = (float*) ggml_opt_dataset_labels(dataset)->data;
+
+    for (long d = 0; d < n_train_pad + n_val_cut; d++) {
+        const long row = d < n_train_pad ? d % n_train : n_train + (d - n_train_pad);
+        memcpy(data + d * n_embd, features.data() + row * n_embd, n_embd * sizeof(float));
+        for (int a = 0; a < N_ALLERGENS; a++) {
+            const bool present = (labels[row] & (1u << a)) != 0;
+            targets[d * N_OUTPUTS + 2 * a] = present ? 0.0f : 1.0f;
+            targets[d * N_OUTPUTS + 2 * a + 1] = present ? 1.0f : 0.0f;
+        }
+    }
+    return dataset;
+}
+
+bool trainLinearProbe(const std::string& model_name,
+                      int n_embd,
+                      const std::vector<float>& vectors,
+                      const std::vector<AllergenMask>& labels,
+                      const ProbeConfig& config,
+                      LinearProbe& probe,
+                      ProbeReport& report) {
+    const long n_rows = (long) labels.size();
+    if (n_rows < 1 || n_embd <= 0 || config.n_batch < 1 ||
+        (long) vectors.size() != n_rows * n_embd) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Linear probe: no training examples");
+        return false;
+    }
+    // At least one training row
+    const long n_val = std::max(0L, std::min(n_rows - 1, (long) (n_rows * config.val_split)));
+    const long n_train = n_rows - n_val;
+    report.n_examples = n_rows;
+    report.n_val = n_val;
+
+    // ================= Standardisation =================
+    std::vector<float> mean(n_embd, 0.0f);
+    std::vector<float> inv_std(n_embd, 0.0f);
+    for (long r = 0; r < n_train; r++) {
+        for (int i = 0; i < n_embd; i++) {
+            mean[i] += vectors[r * n_embd + i];
+        }
+    }
+    for (int i = 0; i < n_embd; i++) {
+        mean[i] /= n_train;
+    }
+    for (long r = 0; r < n_train; r++) {
+        for (int i = 0; i < n_embd; i++) {
+            const float d = vectors[r * n_embd + i] - mean[i];
+            inv_std[i] += d * d;
+        }
+    }
+    for (int i = 0; i < n_embd; i++) {
+        inv_std[i] = 1.0f / std::max(std::sqrt(inv_std[i] / n_train), 1e-6f);
+    }
+    std::vector<float> features(vectors.size());
+    for (long r = 0; r < n_rows; r++) {
+        for (int i = 0; i < n_embd; i++) {
+            features[r * n_embd + i] = (vectors[r * n_embd + i] - mean[i]) * inv_std[i];
+        }
+    }
+
+    // ================= Model =================
+    initBackends("");
+    ggml_backend_t backend = ggml_backend_init_by_type(GGML_BACKEND_DEVICE_TYPE_CPU, nullptr);
+    if (!backend) {
+        return false;
+    }
+    setBackendThreads(backend, config.n_threads);
+
+    // Parameters and the input batch are allocated once; everything else
+    // lives in ctx_compute and is allocated by ggml-opt
+    ggml_init_params static_params = {4 * ggml_tensor_overhead(), nullptr, true};
+    ggml_context* ctx_static = ggml_init(static_params);
+    ggml_tensor* weights = ggml_new_tensor_2d(ctx_static, GGML_TYPE_F32, n_embd, N_OUTPUTS);
+    ggml_tensor* bias = ggml_new_tensor_1d(ctx_static, GGML_TYPE_F32, N_OUTPUTS);
+    ggml_tensor* inputs = ggml_new_tensor_2d(ctx_static, GGML_TYPE_F32, n_embd, config.n_batch);
+    ggml_set_param(weights);
+    ggml_set_param(bias);
+    ggml_set_input(inputs);
+    ggml_backend_buffer_t buffer = ggml_backend_alloc_ctx_tensors(ctx_static, backend);
+    ggml_backend_buffer_clear(buffer, 0);  // the loss is convex, zeros are a fine start
+
+    ggml_init_params compute_params = {
+            GGML_DEFAULT_GRAPH_SIZE * ggml_tensor_overhead() + 3 * ggml_graph_overhead(),
+            nullptr, true};
+    ggml_context* ctx_compute = ggml_init(compute_params);
+    ggml_tensor* logits = ggml_add(ctx_compute, ggml_mul_mat(ctx_compute, weights, inputs), bias);
+    // [2, N_ALLERGENS * n_batch]: one softmax row per allergen decision
+    ggml_tensor* outputs = ggml_reshape_2d(ctx_compute, logits, 2, N_ALLERGENS * config.n_batch);
+    ggml_set_output(outputs);
+
+    ggml_backend_sched_t sched = ggml_backend_sched_new(&backend, nullptr, 1, GGML_DEFAULT_GRAPH_SIZE,
+                                                        false, false);
+    ggml_opt_params opt_params = ggml_opt_default_params(sched, GGML_OPT_LOSS_TYPE_CROSS_ENTROPY);
+    opt_params.ctx_compute = ctx_compute;
+    opt_params.inputs = inputs;
+    opt_params.outputs = outputs;
+    opt_params.get_opt_pars = optimizerParams;
+    opt_params.get_opt_pars_ud = (void*) &config;
+    opt_params.optimizer = config.optimizer;
+    ggml_opt_context_t opt_ctx = ggml_opt_init(opt_params);
+
+    int64_t idata_split = 0;
+    ggml_opt_dataset_t dataset = buildDataset(features, labels, n_embd, n_train, n_val,
+                                              config.n_batch, idata_split);
+    const bool has_val = idata_split < ggml_opt_dataset_ndata(dataset);
+
+    // ================= Epochs =================
+    ggml_opt_result_t result_train = ggml_opt_result_init();
+    ggml_opt_result_t result_eval = ggml_opt_result_init();
+    auto t_start = Clock::now();
+
+    for (int epoch = 0; epoch < config.n_epochs; epoch++) {
+        ggml_opt_dataset_shuffle(opt_ctx, dataset, idata_split);
+        ggml_opt_epoch(opt_ctx, dataset, result_train, result_eval, idata_split, nullptr, nullptr);
+
+        FinetuneEpoch stats;
+        readResult(result_train, stats.train_loss, stats.train_accuracy);
+        if (has_val) {
+            readResult(result_eval, stats.val_loss, stats.val_accuracy);
+        }
+        report.epochs.push_back(stats);
+
+        ggml_opt_result_reset(result_train);
+        ggml_opt_result_reset(result_eval);
+    }
+    report.train_ms = elapsedMs(t_start, Clock::now());
+
+    // ================= Fold into raw-embedding weights =================
+    std::vector<float> trained(n_embd * N_OUTPUTS);
+    float trained_bias[N_OUTPUTS];
+    ggml_backend_tensor_get(weights, trained.data(), 0, ggml_nbytes(weights));
+    ggml_backend_tensor_get(bias, trained_bias, 0, ggml_nbytes(bias));
+
+    probe = LinearProbe();
+    probe.model_name = model_name;
+    probe.n_embd = n_embd;
+    probe.weights.resize(N_ALLERGENS * n_embd);
+    for (int a = 0; a < N_ALLERGENS; a++) {
+        const float* absent = trained.data() + (2 * a) * n_embd;
+        const float* present = trained.data() + (2 * a + 1) * n_embd;
+        float* w = probe.weights.data() + a * n_embd;
+        float b = trained_bias[2 * a + 1] - trained_bias[2 * a];
+        for (int i = 0; i < n_embd; i++) {
+            w[i] = (present[i] - absent[i]) * inv_std[i];
+            b -= w[i] * mean[i];
+        }
+        probe.bias[a] = b;
+    }
+
+    ggml_opt_result_free(result_train);
+    ggml_opt_result_free(result_eval);
+    ggml_opt_dataset_free(dataset);
+    ggml_opt_free(opt_ctx);
+    ggml_backend_sched_free(sched);
+    ggml_free(ctx_compute);
+    ggml_backend_buffer_free(buffer);
+    ggml_free(ctx_static);
+    ggml_backend_free(backend);
+
+    // ================= Thresholds =================
+    const long first = n_val > 0 ? n_train : 0;
+    std::vector<float> probabilities((n_rows - first) * N_ALLERGENS);
+    for (long r = first; r < n_rows; r++) {
+        classifyProbe(probe, vectors.data() + r * n_embd,
+                      probabilities.data() + (r - first) * N_ALLERGENS);
+    }
+    fitThresholds(probabilities.data(), labels.data() + first, n_rows - first, probe.thresholds);
+
+    const FinetuneEpoch last = report.epochs.empty() ? FinetuneEpoch() : report.epochs.back();
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "Linear probe: %ld examples (%ld validation), %d epochs in %ld ms, "
+                        "train loss=%.4f acc=%.3f, val loss=%.4f acc=%.3f",
+                        n_rows, n_val, config.n_epochs, report.train_ms,
+                        last.train_loss, last.train_accuracy, last.val_loss, last.val_accuracy);
+    return true;
+}
+
+bool trainLinearProbe(Embedder& embedder,
+                      const std::vector<FoodRecord>& records,
+                      const ProbeConfig& config,
+                      LinearProbe& probe,
+                      ProbeReport& report) {
+    std::vector<std::string> texts;
+    std::vector<AllergenMask> labels;
+    for (const FoodRecord& record : records) {
+        texts.push_back(record.ingredients);
+        labels.push_back(parseAllergenList(record.allergens_mapped));
+    }
+
+    std::vector<float> vectors;
+    auto t_start = Clock::now();
+    if (!embedTexts(embedder, texts, vectors)) {
+        return false;
+    }
+    report.embed_ms = elapsedMs(t_start, Clock::now());
+
+    return trainLinearProbe(embedder.model_name, embedder.n_embd, vectors, labels,
+                            config, probe, report);
+}
+
+AllergenMask classifyProbe(const LinearProbe& probe, const float* embedding, float* probabilities) {
+    AllergenMask mask = 0;
+    for (int a = 0; a < N_ALLERGENS; a++) {
+        const float z = dotProduct(probe.weights.data() + a * probe.n_embd, embedding, probe.n_embd) +
+                        probe.bias[a];
+        const float p = 1.0f / (1.0f + std::exp(-z));
+        if (probabilities) {
+            probabilities[a] = p;
+        }
+        if (p >= probe.thresholds[a]) {
+            mask |= 1u << a;
+        }
+    }
+    return mask;
+}
+
+// ================= Probe file =================
+// "SLLP" + version, then the header fields and the weights, and a CRC-32
+// of everything after the magic (same layout rules as the index file)
+static const char PROBE_MAGIC[8] = {'S', 'L', 'L', 'P', 1, 0, 0, 0};
+
+template <typename T>
+static void put(std::vector<uint8_t>& bytes, const T* values, size_t count) {
+    const uint8_t* p = (const uint8_t*) values;
+    bytes.insert(bytes.end(), p, p + count * sizeof(T));
+}
+
+template <typename T>
+static bool get(const std::vector<uint8_t>& bytes, size_t& pos, T* values, size_t count) {
+    const size_t size = count * sizeof(T);
+    if (bytes.size() - pos < size) {
+        return false;
+    }
+    memcpy(values, bytes.data() + pos, size);
+    pos += size;
+    return true;
+}
+
+bool saveLinearProbe(const std::string& path, const LinearProbe& probe) {
+    std::vector<uint8_t> bytes;
+    const int32_t n_embd = probe.n_embd;
+    const uint32_t name_len = (uint32_t) probe.model_name.size();
+
+    put(bytes, &n_embd, 1);
+    put(bytes, probe.thresholds, N_ALLERGENS);
+    put(bytes, probe.bias, N_ALLERGENS);
+    put(bytes, &name_len, 1);
+    put(bytes, probe.model_name.data(), name_len);
+    put(bytes, probe.weights.data(), probe.weights.size());
+    const uint32_t crc = crc32Ieee(bytes.data(), bytes.size());
+
+    const std::string tmp_path = path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const bool ok = fwrite(PROBE_MAGIC, sizeof(PROBE_MAGIC), 1, file) == 1 &&
+                    fwrite(bytes.data(), bytes.size(), 1, file) == 1 &&
+                    fwrite(&crc, sizeof(crc), 1, file) == 1;
+    if (fclose(file) != 0 || !ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadLinearProbe(const std::string& path, LinearProbe& probe) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        bytes.insert(bytes.end(), buf, buf + n);
+    }
+    fclose(file);
+
+    uint32_t crc;
+    if (bytes.size() < sizeof(PROBE_MAGIC) + sizeof(crc) ||
+        memcmp(bytes.data(), PROBE_MAGIC, sizeof(PROBE_MAGIC)) != 0) {
+        return false;
+    }
+    memcpy(&crc, bytes.data() + bytes.size() - sizeof(crc), sizeof(crc));
+    bytes.resize(bytes.size() - sizeof(crc));
+    bytes.erase(bytes.begin(), bytes.begin() + sizeof(PROBE_MAGIC));
+    if (crc32Ieee(bytes.data(), bytes.size()) != crc) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Linear probe %s is corrupt", path.c_str());
+        return false;
+    }
+
+    LinearProbe loaded;
+    size_t pos = 0;
+    int32_t n_embd = 0;
+    uint32_t name_len = 0;
+    if (!get(bytes, pos, &n_embd, 1) || !get(bytes, pos, loaded.thresholds, N_ALLERGENS) ||
+        !get(bytes, pos, loaded.bias, N_ALLERGENS) || !get(bytes, pos, &name_len, 1) ||
+        n_embd <= 0) {
+        return false;
+    }
+    loaded.n_embd = n_embd;
+    loaded.model_name.resize(name_len);
+    loaded.weights.resize((size_t) N_ALLERGENS * n_embd);
+    if (!get(bytes, pos, &loaded.model_name[0], name_len) ||
+        !get(bytes, pos, loaded.weights.data(), loaded.weights.size()) || pos != bytes.size()) {
+        return false;
+    }
+    probe = std::move(loaded);
+    return true;
+}
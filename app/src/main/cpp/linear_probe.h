@@ -0,0 +1,67 @@
+#pragma once
+
+#include "allergens.h"
+#include "dataset.h"
+#include "embedding_index.h"
+#include "finetune.h"
+#include <string>
+#include <vector>
+
+// ================= Linear probe =================
+// A trained head instead of neighbours: nine logistic outputs over the
+// mean-pooled embedding (embedding_index.h), so an item costs one prefill
+// and nine dot products. The head is trained with ggml-opt on the CPU as
+// nine two-way softmax classifiers (absent / present), which is exactly
+// a per-allergen sigmoid and uses ggml-opt's built-in cross-entropy loss.
+// Features are standardised for training and the scaling is folded back
+// into the saved weights.
+struct LinearProbe {
+    std::string model_name;
+    int n_embd = 0;
+    std::vector<float> weights;     // N_ALLERGENS x n_embd, over raw embeddings
+    float bias[N_ALLERGENS] = {};
+    float thresholds[N_ALLERGENS] = {0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f};
+};
+
+struct ProbeConfig {
+    int n_epochs = 20;
+    int n_batch = 16;            // examples per optimiser step
+    float learning_rate = 1e-3f;
+    float weight_decay = 1e-4f;
+    float val_split = 0.2f;      // last part of the examples, evaluation and thresholds
+    int n_threads = 4;
+    ggml_opt_optimizer_type optimizer = GGML_OPT_OPTIMIZER_TYPE_ADAMW;
+};
+
+struct ProbeReport {
+    long n_examples = 0;
+    long n_val = 0;
+    std::vector<FinetuneEpoch> epochs;  // accuracy is per allergen decision
+    long embed_ms = 0;
+    long train_ms = 0;
+};
+
+// Embeds the records and trains the head; thresholds are calibrated on
+// the validation part (on everything when it is empty)
+bool trainLinearProbe(Embedder& embedder,
+                      const std::vector<FoodRecord>& records,
+                      const ProbeConfig& config,
+                      LinearProbe& probe,
+                      ProbeReport& report);
+
+// Same, from precomputed embeddings (records.size() x n_embd)
+bool trainLinearProbe(const std::string& model_name,
+                      int n_embd,
+                      const std::vector<float>& vectors,
+                      const std::vector<AllergenMask>& labels,
+                      const ProbeConfig& config,
+                      LinearProbe& probe,
+                      ProbeReport& report);
+
+// probabilities (optional) receives the N_ALLERGENS sigmoid outputs
+AllergenMask classifyProbe(const LinearProbe& probe, const float* embedding,
+                           float* probabilities = nullptr);
+
+// Written atomically (temp file + rename), CRC-checked on load
+bool saveLinearProbe(const std::string& path, const LinearProbe& probe);
+bool loadLinearProbe(const std::string& path, LinearProbe& probe);
@@ -0,0 +1,61 @@
+#include "model_pool.h"
+#include "native-log.h"
+
+static void unloadModel(ResidentModel& model) {
+    freeScheduler(model.scheduler);
+    closeSession(model.session);
+    model.session = nullptr;
+}
+
+ResidentModel* acquireModel(ModelPool& pool, const std::string& model_path, int template_type) {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+
+    const std::string key = model_path + ":" + std::to_string(template_type);
+    auto it = pool.models.find(key);
+    if (it == pool.models.end()) {
+        // Make room: evict the least recently used idle model
+        while (pool.models.size() >= pool.max_models) {
+            auto victim = pool.models.end();
+            for (auto m = pool.models.begin(); m != pool.models.end(); ++m) {
+                if (m->second->in_flight == 0 &&
+                    (victim == pool.models.end() ||
+                     m->second->last_used < victim->second->last_used)) {
+                    victim = m;
+                }
+            }
+            if (victim == pool.models.end()) {
+                break;  // everything is busy, go over the limit
+            }
+            __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                                "Evicting %s", victim->first.c_str());
+            unloadModel(*victim->second);
+            pool.models.erase(victim);
+        }
+
+        std::unique_ptr<ResidentModel> model(new ResidentModel());
+        model->session = openSession(model_path, template_type, pool.config);
+        if (!model->session) {
+            return nullptr;
+        }
+        initScheduler(model->scheduler, model->session);
+        startScheduler(model->scheduler);
+        it = pool.models.emplace(key, std::move(model)).first;
+    }
+
+    it->second->in_flight++;
+    it->second->last_used = ++pool.use_counter;
+    return it->second.get();
+}
+
+void releaseModel(ModelPool& pool, ResidentModel* model) {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    model->in_flight--;
+}
+
+void freeModelPool(ModelPool& pool) {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    for (auto& m : pool.models) {
+        unloadModel(*m.second);
+    }
+    pool.models.clear();
+}
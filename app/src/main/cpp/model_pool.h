@@ -0,0 +1,35 @@
+#pragma once
+
+#include "engine.h"
+#include "scheduler.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// ================= Model pool =================
+// Resident sessions for the long-running host processes (daemon, HTTP
+// server). Each model keeps its own started scheduler; at most max_models
+// stay loaded and the least recently used idle one makes room.
+struct ResidentModel {
+    Session* session = nullptr;
+    Scheduler scheduler;
+    int in_flight = 0;
+    long last_used = 0;
+};
+
+struct ModelPool {
+    EngineConfig config;
+    size_t max_models = 1;
+
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<ResidentModel>> models;
+    long use_counter = 0;
+};
+
+// Loads on first use. The returned model is pinned until releaseModel;
+// nullptr if it cannot be loaded.
+ResidentModel* acquireModel(ModelPool& pool, const std::string& model_path, int template_type);
+void releaseModel(ModelPool& pool, ResidentModel* model);
+
+void freeModelPool(ModelPool& pool);
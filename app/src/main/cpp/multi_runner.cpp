@@ -0,0 +1,231 @@
+#include "multi_runner.h"
+#include "cpu_topology.h"
+#include "scheduler.h"
+#include "native-log.h"
+#include <algorithm>
+#include <numeric>
+#include <thread>
+
+// Sequence slots per model session
+static const int CONCURRENT_SEQS = 2;
+
+// Runs prompts[begin, end) to completion on the calling thread and returns
+// the number of tokens processed (prompt + generated).
+static long runPromptRange(Session* session,
+                           const std::vector<std::string>& prompts,
+                           size_t begin,
+                           size_t end,
+                           std::vector<std::string>& results) {
+    Scheduler scheduler;
+    initScheduler(scheduler, session);
+
+    std::vector<Request> requests(end - begin);
+    for (size_t i = begin; i < end; i++) {
+        Request& request = requests[i - begin];
+        request.id = (int) i;
+        request.prompt_tokens = tokenize(session->vocab,
+                                         formatPrompt(prompts[i], session->template_type), true);
+        request.max_tokens = session->config.max_tokens;
+        submitRequest(scheduler, &request);
+    }
+
+    runUntilIdle(scheduler);
+    freeScheduler(scheduler);
+
+    long n_tokens = 0;
+    for (const Request& request : requests) {
+        results[request.id] = request.failed ? "" : formatResult(request);
+        n_tokens += request.n_prefilled + request.generated_tokens;
+    }
+    return n_tokens;
+}
+
+// Interleave cores so every model sees a similar mix of big and little cores
+static std::vector<std::vector<int>> splitEvenly(const std::vector<int>& cores, size_t n_models) {
+    std::vector<std::vector<int>> split(n_models);
+    for (size_t k = 0; k < std::max(cores.size(), n_models); k++) {
+        split[k % n_models].push_back(cores[k % cores.size()]);
+    }
+    return split;
+}
+
+// Cores proportional to time per token: the slower model gets more of them,
+// handed out in contiguous blocks starting from the fastest cluster.
+static std::vector<std::vector<int>> splitByThroughput(const std::vector<int>& cores,
+                                                       const std::vector<double>& tps) {
+    const size_t n_models = tps.size();
+    if (cores.size() <= n_models) {
+        return splitEvenly(cores, n_models);
+    }
+
+    std::vector<double> weight(n_models);
+    for (size_t m = 0; m < n_models; m++) {
+        weight[m] = tps[m] > 0.0 ? 1.0 / tps[m] : 1.0;
+    }
+    const double total = std::accumulate(weight.begin(), weight.end(), 0.0);
+
+    std::vector<int> share(n_models);
+    int assigned = 0;
+    for (size_t m = 0; m < n_models; m++) {
+        share[m] = std::max(1, (int) (cores.size() * weight[m] / total));
+        assigned += share[m];
+    }
+
+    // Settle rounding on the heaviest model
+    const size_t heaviest = std::max_element(weight.begin(), weight.end()) - weight.begin();
+    share[heaviest] += (int) cores.size() - assigned;
+    if (share[heaviest] < 1) {
+        return splitEvenly(cores, n_models);
+    }
+
+    std::vector<size_t> order(n_models);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&share](size_t a, size_t b) { return share[a] > share[b]; });
+
+    std::vector<std::vector<int>> split(n_models);
+    size_t next = 0;
+    for (size_t m : order) {
+        for (int k = 0; k < share[m]; k++) {
+            split[m].push_back(cores[next++]);
+        }
+    }
+    return split;
+}
+
+std::vector<ModelRunResult> runModelsConcurrently(const std::vector<ModelJob>& jobs,
+                                                  const std::vector<std::string>& prompts,
+                                                  int n_calibration_prompts) {
+
+    const size_t n_models = jobs.size();
+    std::vector<ModelRunResult> runs(n_models);
+    if (n_models == 0) {
+        return runs;
+    }
+
+    const std::vector<int> cores = detectCoresByCluster();
+    if (cores.size() < n_models) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                            "Only %zu cores for %zu models: core sets will overlap",
+                            cores.size(), n_models);
+    }
+
+    // ================= Load sessions =================
+    std::vector<Session*> sessions(n_models, nullptr);
+    for (size_t m = 0; m < n_models; m++) {
+        runs[m].name = jobs[m].name;
+        runs[m].results.assign(prompts.size(), "");
+
+        // Every model holds its own KV cache: two slots each instead of the
+        // resident session's five keeps two or three models within a
+        // phone's memory, and the runner has no interactive requests
+        EngineConfig config;
+        config.n_seq_max = CONCURRENT_SEQS;
+        config.n_interactive_seqs = 0;
+        sessions[m] = openSession(jobs[m].model_path, jobs[m].template_type, config);
+        if (!sessions[m]) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "Skipping %s: failed to open session", jobs[m].name.c_str());
+        }
+    }
+
+    std::vector<ggml_threadpool*> pools(n_models, nullptr);
+    auto attachCores = [&](const std::vector<std::vector<int>>& split) {
+        for (size_t m = 0; m < n_models; m++) {
+            if (!sessions[m]) {
+                continue;
+            }
+            if (pools[m]) {
+                llama_detach_threadpool(sessions[m]->ctx);
+                freeThreadpool(pools[m]);
+            }
+            pools[m] = createPinnedThreadpool(split[m]);
+            llama_attach_threadpool(sessions[m]->ctx, pools[m], pools[m]);
+            // The context splits work into n_threads chunks whatever the pool size
+            const int n_threads = (int) split[m].size();
+            llama_set_n_threads(sessions[m]->ctx, n_threads, n_threads);
+        }
+    };
+
+    const size_t n_calibration = std::min(prompts.size(), (size_t) std::max(0, n_calibration_prompts));
+
+    // ================= Calibration: equal core split =================
+    std::vector<std::vector<int>> split = splitEvenly(cores, n_models);
+    attachCores(split);
+
+    std::vector<double> tps(n_models, 0.0);
+    std::vector<long> calibration_ms(n_models, 0);
+    {
+        std::vector<std::thread> threads;
+        for (size_t m = 0; m < n_models; m++) {
+            runs[m].calibration_cpus = split[m];
+            if (!sessions[m]) {
+                continue;
+            }
+            threads.emplace_back([&, m] {
+                auto t_start = Clock::now();
+                long n_tokens = runPromptRange(sessions[m], prompts, 0, n_calibration, runs[m].results);
+                calibration_ms[m] = elapsedMs(t_start, Clock::now());
+                if (calibration_ms[m] > 0) {
+                    tps[m] = n_tokens * 1000.0 / calibration_ms[m];
+                }
+            });
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    // ================= Rebalance by measured tokens/s =================
+    split = splitByThroughput(cores, tps);
+    attachCores(split);
+
+    {
+        std::vector<std::thread> threads;
+        for (size_t m = 0; m < n_models; m++) {
+            runs[m].calibration_tps = tps[m];
+            runs[m].cpus = split[m];
+            if (!sessions[m]) {
+                continue;
+            }
+            threads.emplace_back([&, m] {
+                auto t_start = Clock::now();
+                runPromptRange(sessions[m], prompts, n_calibration, prompts.size(), runs[m].results);
+                runs[m].wall_ms = calibration_ms[m] + elapsedMs(t_start, Clock::now());
+            });
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    // ================= Record core assignment =================
+    for (size_t m = 0; m < n_models; m++) {
+        const std::string cores_field = ";CORES=" + joinCpus(runs[m].cpus);
+        for (size_t i = 0; i < runs[m].results.size(); i++) {
+            std::string& result = runs[m].results[i];
+            const size_t bar = result.find('|');
+            if (bar != std::string::npos) {
+                result.insert(bar, i < n_calibration
+                                   ? ";CORES=" + joinCpus(runs[m].calibration_cpus)
+                                   : cores_field);
+            }
+        }
+
+        __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                            "Model %s: calibration %.1f tok/s on [%s], ran on [%s], wall %ld ms",
+                            runs[m].name.c_str(), runs[m].calibration_tps,
+                            joinCpus(runs[m].calibration_cpus).c_str(),
+                            joinCpus(runs[m].cpus).c_str(), runs[m].wall_ms);
+
+        if (sessions[m]) {
+            llama_detach_threadpool(sessions[m]->ctx);
+            closeSession(sessions[m]);
+        }
+        if (pools[m]) {
+            freeThreadpool(pools[m]);
+        }
+    }
+
+    return runs;
+}
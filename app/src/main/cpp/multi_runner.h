@@ -0,0 +1,32 @@
+#pragma once
+
+#include "engine.h"
+#include <string>
+#include <vector>
+
+// ================= Multi-model runner =================
+// Runs several models over the same prompts at the same time. Every model
+// gets its own Session and a ggml threadpool pinned to a disjoint set of
+// cores; after a short calibration the cores are redistributed so that the
+// slower model gets more of them and all models finish together.
+// Driven by slm-eval --concurrent. Each model keeps its own weights and a
+// two-slot KV cache.
+
+struct ModelJob {
+    std::string name;
+    std::string model_path;
+    int template_type = 0;
+};
+
+struct ModelRunResult {
+    std::string name;
+    std::vector<int> calibration_cpus;
+    std::vector<int> cpus;            // assignment after rebalancing
+    double calibration_tps = 0.0;     // tokens/s measured during calibration
+    long wall_ms = 0;
+    std::vector<std::string> results; // formatResult() per prompt, "" on failure
+};
+
+std::vector<ModelRunResult> runModelsConcurrently(const std::vector<ModelJob>& jobs,
+                                                  const std::vector<std::string>& prompts,
+                                                  int n_calibration_prompts);
@@ -1,4 +1,12 @@
 #include "llama/llama.h"
+#include "cascade.h"
+#include "daemon_client.h"
+#include "engine.h"
+#include "ingredient_atoms.h"
+#include "ingredient_chunks.h"
+#include "result_store.h"
+#include "run_journal.h"
+#include "scheduler.h"
 #include <vector>
 #include <jni.h>
 #include <string>
@@ -6,12 +14,16 @@
 #include <algorithm>
 #include <android/log.h>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 
 
-#define LOG_TAG "SLM_NATIVE"
-
 /*llama_batch make_batch(
         const std::vector<llama_token>& tokens,
         int n_ctx) {
@@ -39,236 +51,315 @@
         "wheat", "soy", "fish", "shellfish", "sesame"
 };*/
 
-std::string runModel(const std::string& prompt,
-                     const std::string& model_path,
-                     int template_type) {
-
-    // ================= Metrics =================
-    auto t_start = std::chrono::high_resolution_clock::now();
-    bool first_token_seen = false;
-
-    long ttft_ms = -1;
-    long itps = -1;
-    long otps = -1;
-    long oet_ms = -1;
-
-    int generated_tokens = 0;
-
-    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
-                        "runModel() started");
+// ================= Resident engine =================
+// The model stays loaded between calls; it is only reopened when the
+// caller switches to a different GGUF file. Requests from any JNI thread
+// go to one scheduler worker, so an interactive item submitted during a
+// Run All is served between two decode steps of the batch.
+static std::mutex g_engine_mutex;
+static std::condition_variable g_engine_idle;
+static int g_in_flight = 0;
+// Set while a call runs models of its own instead of the resident session
+// (acquireExclusiveEngine); g_engine_mutex is not held meanwhile
+static bool g_engine_exclusive = false;
+static Session* g_session = nullptr;
+static Scheduler g_scheduler;
+
+// Optional out-of-process engine (tools/slm-daemon.cpp). When connected,
+// prompts go to the daemon and the model is never loaded in the app.
+// Every batch in flight has a connection of its own, which the daemon
+// serves on its own thread, so an interactive item is not queued behind a
+// Run All. Idle connections are kept for reuse; g_daemon_socket is ""
+// until connectInferenceDaemon succeeds and again once the daemon is gone.
+// Guarded by g_daemon_mutex, which is never held while a batch runs.
+static std::mutex g_daemon_mutex;
+static std::string g_daemon_socket;
+static std::vector<std::unique_ptr<DaemonClient>> g_daemon_idle;
+
+// An idle connection or a new one; nullptr when no daemon is in use
+static std::unique_ptr<DaemonClient> takeDaemonClient() {
+    std::string socket_path;
+    {
+        std::lock_guard<std::mutex> lock(g_daemon_mutex);
+        if (!g_daemon_idle.empty()) {
+            std::unique_ptr<DaemonClient> client = std::move(g_daemon_idle.back());
+            g_daemon_idle.pop_back();
+            return client;
+        }
+        socket_path = g_daemon_socket;
+    }
+    if (socket_path.empty()) {
+        return nullptr;
+    }
 
-    // ================= Apply chat template based on model type =================
-    // Template types: 0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3, 3 = Phi
-    std::string formatted_prompt;
-    switch (template_type) {
-        case 1:
-            // Gemma format (Vikhr-Gemma-2B)
-            formatted_prompt = "<start_of_turn>user\n" + prompt + "<end_of_turn>\n<start_of_turn>model\n";
-            __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Using Gemma chat template");
-            break;
-        case 2:
-            // Llama 3 format (Llama-3.2-1B, Llama-3.2-3B)
-            formatted_prompt = "<|begin_of_text|><|start_header_id|>user<|end_header_id|>\n\n" + prompt + "<|eot_id|><|start_header_id|>assistant<|end_header_id|>\n\n";
-            __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Using Llama 3 chat template");
-            break;
-        case 3:
-            // Phi format (Phi-3.5-mini, Phi-3-mini-4k)
-            formatted_prompt = "<|user|>\n" + prompt + "<|end|>\n<|assistant|>\n";
-            __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Using Phi chat template");
-            break;
-        default:
-            // ChatML format (Qwen 2.5) - templateType=0 or default
-            formatted_prompt = "<|im_start|>user\n" + prompt + "<|im_end|>\n<|im_start|>assistant\n";
-            __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Using ChatML chat template");
-            break;
-    }
-
-    // ================= Backend =================
-    llama_backend_init();
-
-    // ================= Load model =================
-    llama_model_params model_params = llama_model_default_params();
-
-    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Loading model from: %s", model_path.c_str());
-
-    llama_model* model = llama_model_load_from_file(model_path.c_str(), model_params);
-    if (!model) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "Failed to load model");
-        return "";
-    }
-
-    const llama_vocab* vocab = llama_model_get_vocab(model);
-
-    // ================= Context =================
-    llama_context_params ctx_params = llama_context_default_params();
-    ctx_params.n_ctx = 2048;  // Increased from 512 to handle long ingredient lists
-    ctx_params.n_threads = 4;
-
-    llama_context* ctx = llama_init_from_model(model, ctx_params);
-    if (!ctx) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "Failed to create context");
-        return "";
-    }
-
-    // ================= Tokenize prompt =================
-    // Use the formatted prompt with Qwen chat template
-    std::vector<llama_token> prompt_tokens(formatted_prompt.size() + 64);
-
-    int n_prompt = llama_tokenize(
-            vocab,
-            formatted_prompt.c_str(),
-            formatted_prompt.size(),
-            prompt_tokens.data(),
-            prompt_tokens.size(),
-            true,   // add BOS
-            false
-    );
+    std::unique_ptr<DaemonClient> client(new DaemonClient());
+    if (!connectDaemon(*client, socket_path)) {
+        return nullptr;
+    }
+    return client;
+}
 
-    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
-                        "Formatted prompt: %s", formatted_prompt.c_str());
+static void returnDaemonClient(std::unique_ptr<DaemonClient> client) {
+    {
+        std::lock_guard<std::mutex> lock(g_daemon_mutex);
+        if (!g_daemon_socket.empty()) {
+            g_daemon_idle.push_back(std::move(client));
+            return;
+        }
+    }
+    disconnectDaemon(*client);
+}
 
-    if (n_prompt <= 0) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "Tokenization failed");
-        return "";
+// The daemon went away: run in-process until the app connects again
+static void dropDaemon() {
+    std::vector<std::unique_ptr<DaemonClient>> idle;
+    {
+        std::lock_guard<std::mutex> lock(g_daemon_mutex);
+        g_daemon_socket.clear();
+        idle.swap(g_daemon_idle);
+    }
+    for (auto& client : idle) {
+        disconnectDaemon(*client);
     }
+}
 
-    prompt_tokens.resize(n_prompt);
+// Resumable Run All (see run_journal.h). Prefix snapshots live next to the
+// journal, one per model and template; guarded by g_engine_mutex.
+static RunJournal g_journal;
+static std::string g_snapshot_dir;
+static bool g_prefix_saved = false;
 
-    // ================= Initial batch (prompt) =================
-    llama_batch batch = llama_batch_init(n_prompt, 0, ctx_params.n_ctx);
-    batch.n_tokens = n_prompt;
+static std::string prefixSnapshotPath(const std::string& model_path, int template_type) {
+    const size_t slash = model_path.find_last_of('/');
+    const std::string name = slash == std::string::npos ? model_path : model_path.substr(slash + 1);
+    return g_snapshot_dir + "/" + name + ".t" + std::to_string(template_type) + ".prefix";
+}
 
-    for (int i = 0; i < n_prompt; i++) {
-        batch.token[i] = prompt_tokens[i];
-        batch.pos[i]   = i;
-        batch.seq_id[i][0] = 0;
-        batch.n_seq_id[i]  = 1;
-        batch.logits[i]    = false;
-    }
+// Task adapter selected for the next requests ("" = base model), loaded
+// into the resident session on first use; guarded by g_engine_mutex
+static std::string g_adapter_path;
 
-    // 🔑 logits only on LAST prompt token
-    batch.logits[n_prompt - 1] = true;
+// IngredientCompression applied to the prompts of the next requests;
+// guarded by g_engine_mutex
+static int g_compression = COMPRESS_OFF;
 
-    // ================= Prefill =================
-    auto t_prefill_start = std::chrono::high_resolution_clock::now();
+// Ingredient lists longer than this many characters are split into chunks
+// asked about separately (ingredient_chunks.h), 0 = never; guarded by
+// g_engine_mutex
+static int g_chunk_chars = 0;
 
-    if (llama_decode(ctx, batch) != 0) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "Prompt decode failed");
-        return "";
+// Caller holds g_engine_mutex and nothing is in flight
+static void closeResidentSession() {
+    if (!g_session) {
+        return;
     }
+    freeScheduler(g_scheduler);
+    closeSession(g_session);
+    g_session = nullptr;
+}
 
-    auto t_prefill_end = std::chrono::high_resolution_clock::now();
-    long prefill_ms =
-            std::chrono::duration_cast<std::chrono::milliseconds>(
-                    t_prefill_end - t_prefill_start
-            ).count();
+// For callers that load their own models (the cascade): waits until
+// nothing is in flight, drops the resident session and keeps
+// acquireSession waiting until releaseExclusiveEngine. Other entry points
+// stay responsive because the mutex is not held while the caller runs.
+static void acquireExclusiveEngine() {
+    std::unique_lock<std::mutex> lock(g_engine_mutex);
+    g_engine_idle.wait(lock, [] { return g_in_flight == 0 && !g_engine_exclusive; });
+    closeResidentSession();
+    g_engine_exclusive = true;
+}
 
-    if (prefill_ms > 0) {
-        itps = (n_prompt * 1000L) / prefill_ms;
+static void releaseExclusiveEngine() {
+    {
+        std::lock_guard<std::mutex> lock(g_engine_mutex);
+        g_engine_exclusive = false;
     }
+    g_engine_idle.notify_all();
+}
 
-    // ================= Sampler =================
-    llama_sampler* sampler = llama_sampler_init_greedy();
-
-    // ================= Generation =================
-    std::string output;
-    const int max_tokens = 32;  // Increased for longer allergen lists
-
-    int n_pos = 0;
-    int n_predict = max_tokens;
-
-    auto t_gen_start = std::chrono::high_resolution_clock::now();
+// Caller holds g_engine_mutex
+static Session* acquireSession(std::unique_lock<std::mutex>& lock,
+                               const std::string& model_path,
+                               int template_type) {
+    g_engine_idle.wait(lock, [] { return !g_engine_exclusive; });
+    if (g_session && g_session->model_path == model_path &&
+        g_session->template_type == template_type) {
+        return g_session;
+    }
 
-    while (n_pos + batch.n_tokens < n_prompt + n_predict) {
+    // Switching models: wait for the requests on the old one to drain
+    g_engine_idle.wait(lock, [] { return g_in_flight == 0 && !g_engine_exclusive; });
 
-        // ---- sample token (AFTER decode) ----
-        llama_token token = llama_sampler_sample(sampler, ctx, -1);
+    closeResidentSession();
 
-        if (llama_vocab_is_eog(vocab, token)) {
-            break;
+    EngineConfig config;
+    g_session = openSession(model_path, template_type, config);
+    g_prefix_saved = false;
+    if (g_session) {
+        initScheduler(g_scheduler, g_session);
+        // Warm the shared instruction prefix from the last interrupted run
+        if (!g_snapshot_dir.empty()) {
+            g_prefix_saved = loadPrefixSnapshot(
+                    g_scheduler, prefixSnapshotPath(model_path, template_type));
         }
+        startScheduler(g_scheduler);
+    }
+    return g_session;
+}
 
-        // ---- TTFT ----
-        if (!first_token_seen) {
-            auto t_first = std::chrono::high_resolution_clock::now();
-            ttft_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    t_first - t_start
-            ).count();
-            first_token_seen = true;
+// Index of the selected adapter in the session, -1 for the base model.
+// Returns false when it cannot be loaded. Caller holds g_engine_mutex.
+static bool acquireAdapter(std::unique_lock<std::mutex>& lock, Session* session, int& adapter) {
+    adapter = -1;
+    if (g_adapter_path.empty()) {
+        return true;
+    }
+    for (size_t i = 0; i < session->adapters.size(); i++) {
+        if (session->adapters[i].path == g_adapter_path) {
+            adapter = (int) i;
+            return true;
         }
+    }
 
-        // ---- token → text ----
-        char buf[128];
-        int n = llama_token_to_piece(
-                vocab, token, buf, sizeof(buf), 0, true);
-
-        if (n > 0) {
-            output.append(buf, n);
+    // First use: loading touches the model, wait until nothing decodes
+    g_engine_idle.wait(lock, [] { return g_in_flight == 0; });
+    if (g_session != session) {
+        return false;
+    }
+    adapter = loadLoraAdapter(session, g_adapter_path);
+    return adapter >= 0;
+}
 
-            // Rule 1: stop at first newline (ONLY comma-separated list)
-            if (output.find('\n') != std::string::npos) {
-                break;
-            }
-        }
+// on_item_done(i, result) is called as soon as prompt i has its result
+using ItemDoneFn = std::function<void(size_t, const std::string&)>;
 
-        generated_tokens++;
+std::vector<std::string> runModelBatch(const std::vector<std::string>& prompts,
+                                       const std::string& model_path,
+                                       int template_type,
+                                       RequestPriority priority,
+                                       const ItemDoneFn& on_item_done = nullptr) {
 
-        // ---- prepare next batch (REFERENCE CORRECT) ----
-        batch = llama_batch_get_one(&token, 1);
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "runModelBatch() started: %zu prompts, priority=%s", prompts.size(),
+                        priority == RequestPriority::Interactive ? "interactive" : "batch");
+
+    bool base_model;
+    int compression;
+    int chunk_chars;
+    {
+        std::lock_guard<std::mutex> lock(g_engine_mutex);
+        base_model = g_adapter_path.empty();
+        compression = g_compression;
+        chunk_chars = g_chunk_chars;
+    }
 
-        // ---- advance model ----
-        if (llama_decode(ctx, batch) != 0) {
-            break;
+    // Before tokenisation, so the daemon gets the compressed prompts too.
+    // A long ingredient list becomes one prompt per chunk: prompt i owns
+    // inputs [first[i], first[i + 1]).
+    std::vector<std::string> inputs;
+    std::vector<size_t> first = {0};
+    for (const std::string& prompt : prompts) {
+        for (std::string& chunk : chunkPromptIngredients(
+                compressPromptIngredients(prompt, compression), chunk_chars)) {
+            inputs.push_back(std::move(chunk));
         }
+        first.push_back(inputs.size());
+    }
+    auto itemResult = [&first](const std::vector<std::string>& results, size_t i) {
+        return mergeChunkResults(std::vector<std::string>(results.begin() + first[i],
+                                                          results.begin() + first[i + 1]));
+    };
+
+    // The daemon serves base models only
+    std::unique_ptr<DaemonClient> daemon = base_model ? takeDaemonClient() : nullptr;
+    if (daemon) {
+        std::vector<std::string> results;
+        if (daemonRunBatch(*daemon, inputs, model_path, template_type, priority, results)) {
+            returnDaemonClient(std::move(daemon));
+            std::vector<std::string> merged(prompts.size());
+            for (size_t i = 0; i < prompts.size(); i++) {
+                merged[i] = itemResult(results, i);
+                if (on_item_done) {
+                    on_item_done(i, merged[i]);
+                }
+            }
+            return merged;
+        }
+        // Daemon went away: fall back to the in-process engine
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                            "Daemon failed, running in-process");
+        dropDaemon();
+    }
 
-        n_pos += batch.n_tokens;
+    Session* session;
+    int adapter;
+    {
+        std::unique_lock<std::mutex> lock(g_engine_mutex);
+        session = acquireSession(lock, model_path, template_type);
+        if (!session || !acquireAdapter(lock, session, adapter)) {
+            return std::vector<std::string>(prompts.size(), "");
+        }
+        g_in_flight++;
     }
 
-    auto t_gen_end = std::chrono::high_resolution_clock::now();
-    long gen_ms =
-            std::chrono::duration_cast<std::chrono::milliseconds>(
-                    t_gen_end - t_gen_start
-            ).count();
+    // ================= Tokenize prompts =================
+    std::vector<Request> requests(inputs.size());
+    for (size_t r = 0; r < inputs.size(); r++) {
+        std::string formatted_prompt = formatPrompt(inputs[r], template_type);
 
-    if (gen_ms > 0) {
-        otps = (generated_tokens * 1000L) / gen_ms;
+        requests[r].id = (int) r;
+        requests[r].prompt_tokens = tokenize(session->vocab, formatted_prompt, true);
+        requests[r].max_tokens = session->config.max_tokens;
+        requests[r].priority = priority;
+        requests[r].adapter = adapter;
+    }
+    // The chunks of a prompt share its instruction prefix
+    for (size_t i = 0; i < prompts.size(); i++) {
+        sharePromptPrefix(&requests[first[i]], (int) (first[i + 1] - first[i]));
+    }
+    for (Request& request : requests) {
+        submitRequest(g_scheduler, &request);
     }
 
-    oet_ms = gen_ms;
+    // ================= Prefill + generation =================
+    std::vector<std::string> chunk_results(requests.size());
+    std::vector<std::string> results(prompts.size());
+    for (size_t i = 0; i < prompts.size(); i++) {
+        for (size_t r = first[i]; r < first[i + 1]; r++) {
+            waitForRequest(g_scheduler, &requests[r]);
+            chunk_results[r] = requests[r].failed ? "" : formatResult(requests[r]);
+        }
+        results[i] = itemResult(chunk_results, i);
+        if (on_item_done) {
+            on_item_done(i, results[i]);
+        }
+    }
 
-    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
-                        "Raw model output: %s", output.c_str());
+    {
+        std::lock_guard<std::mutex> lock(g_engine_mutex);
+        g_in_flight--;
+    }
+    g_engine_idle.notify_all();
 
     // NOTE: Filtering/mapping is now done in Kotlin (MainActivity.kt)
     // This allows mapping terms like "Crustaceans" -> "shellfish", "Gluten" -> "wheat"
-    // The raw output is passed directly to Kotlin for processing
-
-
-    // ================= Cleanup =================
-    llama_sampler_free(sampler);
-    //llama_batch_free(batch);
-    llama_free(ctx);
-    llama_free_model(model);
-
+    // The raw output is passed directly to Kotlin for processing; a chunked
+    // item's output is the union of its chunks' parsed allergens
 
-
-    // ================= Return =================
-    std::string result =
-            "TTFT_MS=" + std::to_string(ttft_ms) +
-            ";ITPS=" + std::to_string(itps) +
-            ";OTPS=" + std::to_string(otps) +
-            ";OET_MS=" + std::to_string(oet_ms) +
-            "|" + output;
-
-    return result;
+    return results;
 }
 
+std::string runModel(const std::string& prompt,
+                     const std::string& model_path,
+                     int template_type) {
 
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "runModel() started");
 
+    // A single item is something the user is waiting on
+    return runModelBatch({prompt}, model_path, template_type,
+                         RequestPriority::Interactive)[0];
+}
 
 extern "C"
 JNIEXPORT jstring JNICALL
@@ -305,3 +396,567 @@ Java_com_mad_assignment_MainActivity_inferAllergens(
 
     return env->NewStringUTF(output.c_str());
 }
+
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_mad_assignment_MainActivity_inferAllergensBatch(
+        JNIEnv *env,
+        jobject,
+        jobjectArray inputPrompts,
+        jstring modelPath,
+        jint templateType) {
+
+    const char* pathCstr = env->GetStringUTFChars(modelPath, nullptr);
+    std::string model_path(pathCstr);
+    env->ReleaseStringUTFChars(modelPath, pathCstr);
+
+    // Extract prompts from Java string array
+    jsize n_prompts = env->GetArrayLength(inputPrompts);
+    std::vector<std::string> prompts;
+    prompts.reserve(n_prompts);
+    for (jsize i = 0; i < n_prompts; i++) {
+        jstring jprompt = (jstring) env->GetObjectArrayElement(inputPrompts, i);
+        const char* cstr = env->GetStringUTFChars(jprompt, nullptr);
+        prompts.emplace_back(cstr);
+        env->ReleaseStringUTFChars(jprompt, cstr);
+        env->DeleteLocalRef(jprompt);
+    }
+
+    // All prompts share one context and are decoded together
+    std::vector<std::string> outputs = runModelBatch(prompts, model_path, templateType,
+                                                     RequestPriority::Batch);
+
+    jobjectArray result = env->NewObjectArray(
+            n_prompts, env->FindClass("java/lang/String"), nullptr);
+    for (jsize i = 0; i < n_prompts; i++) {
+        jstring joutput = env->NewStringUTF(outputs[i].c_str());
+        env->SetObjectArrayElement(result, i, joutput);
+        env->DeleteLocalRef(joutput);
+    }
+
+    return result;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_mad_assignment_MainActivity_initNativeBackends(
+        JNIEnv *env,
+        jobject,
+        jstring nativeLibDir) {
+
+    const char* cstr = env->GetStringUTFChars(nativeLibDir, nullptr);
+    initBackends(cstr);
+    env->ReleaseStringUTFChars(nativeLibDir, cstr);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_mad_assignment_MainActivity_selectLoraAdapter(
+        JNIEnv *env,
+        jobject,
+        jstring adapterPath) {
+
+    const char* cstr = env->GetStringUTFChars(adapterPath, nullptr);
+    std::lock_guard<std::mutex> lock(g_engine_mutex);
+    g_adapter_path = cstr;
+    env->ReleaseStringUTFChars(adapterPath, cstr);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_mad_assignment_MainActivity_setIngredientCompression(
+        JNIEnv *,
+        jobject,
+        jint mode) {
+
+    std::lock_guard<std::mutex> lock(g_engine_mutex);
+    g_compression = std::max((int) COMPRESS_OFF, std::min((int) mode, (int) COMPRESS_DROP_IRRELEVANT));
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_mad_assignment_MainActivity_setIngredientChunking(
+        JNIEnv *,
+        jobject,
+        jint maxChars) {
+
+    std::lock_guard<std::mutex> lock(g_engine_mutex);
+    g_chunk_chars = std::max(0, (int) maxChars);
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_mad_assignment_MainActivity_connectInferenceDaemon(
+        JNIEnv *env,
+        jobject,
+        jstring socketPath) {
+
+    const char* cstr = env->GetStringUTFChars(socketPath, nullptr);
+    std::string socket_path(cstr);
+    env->ReleaseStringUTFChars(socketPath, cstr);
+
+    dropDaemon();
+    std::unique_ptr<DaemonClient> client(new DaemonClient());
+    if (!connectDaemon(*client, socket_path)) {
+        return JNI_FALSE;
+    }
+    std::lock_guard<std::mutex> lock(g_daemon_mutex);
+    g_daemon_socket = socket_path;
+    g_daemon_idle.push_back(std::move(client));
+    return JNI_TRUE;
+}
+
+// ================= Resumable Run All =================
+static std::string jstringToString(JNIEnv* env, jstring jstr) {
+    const char* cstr = env->GetStringUTFChars(jstr, nullptr);
+    std::string out(cstr);
+    env->ReleaseStringUTFChars(jstr, cstr);
+    return out;
+}
+
+static jobjectArray toJavaStrings(JNIEnv* env, const std::vector<std::string>& values) {
+    jobjectArray result = env->NewObjectArray(
+            (jsize) values.size(), env->FindClass("java/lang/String"), nullptr);
+    for (size_t i = 0; i < values.size(); i++) {
+        jstring jvalue = env->NewStringUTF(values[i].c_str());
+        env->SetObjectArrayElement(result, (jsize) i, jvalue);
+        env->DeleteLocalRef(jvalue);
+    }
+    return result;
+}
+
+static std::vector<std::string> fromJavaStrings(JNIEnv* env, jobjectArray array) {
+    std::vector<std::string> out;
+    const jsize n = env->GetArrayLength(array);
+    for (jsize i = 0; i < n; i++) {
+        jstring jstr = (jstring) env->GetObjectArrayElement(array, i);
+        out.push_back(jstringToString(env, jstr));
+        env->DeleteLocalRef(jstr);
+    }
+    return out;
+}
+
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_mad_assignment_MainActivity_openRunJournal(
+        JNIEnv *env,
+        jobject,
+        jstring journalPath,
+        jstring snapshotDir) {
+
+    {
+        std::lock_guard<std::mutex> lock(g_engine_mutex);
+        g_snapshot_dir = jstringToString(env, snapshotDir);
+    }
+
+    // Flattened: itemId, result, memory
+    std::vector<std::string> fields;
+    if (openRunJournal(g_journal, jstringToString(env, journalPath))) {
+        std::lock_guard<std::mutex> lock(g_journal.mutex);
+        for (const auto& entry : g_journal.entries) {
+            if (entry.second.result.empty()) {
+                continue;
+            }
+            fields.push_back(std::to_string(entry.first));
+            fields.push_back(entry.second.result);
+            fields.push_back(entry.second.memory);
+        }
+    }
+    return toJavaStrings(env, fields);
+}
+
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_mad_assignment_MainActivity_inferAllergensBatchJournaled(
+        JNIEnv *env,
+        jobject,
+        jobjectArray inputPrompts,
+        jintArray itemIds,
+        jstring modelPath,
+        jint templateType) {
+
+    const std::string model_path = jstringToString(env, modelPath);
+
+    jsize n_prompts = env->GetArrayLength(inputPrompts);
+    std::vector<std::string> prompts;
+    prompts.reserve(n_prompts);
+    for (jsize i = 0; i < n_prompts; i++) {
+        jstring jprompt = (jstring) env->GetObjectArrayElement(inputPrompts, i);
+        prompts.push_back(jstringToString(env, jprompt));
+        env->DeleteLocalRef(jprompt);
+    }
+
+    std::vector<int32_t> ids(n_prompts);
+    env->GetIntArrayRegion(itemIds, 0, n_prompts, ids.data());
+
+    // Each item is on disk the moment it finishes; failed ones are retried
+    std::vector<std::string> outputs = runModelBatch(
+            prompts, model_path, templateType, RequestPriority::Batch,
+            [&ids](size_t i, const std::string& result) {
+                if (!result.empty()) {
+                    journalItem(g_journal, ids[i], JOURNAL_RESULT, result);
+                }
+            });
+
+    {
+        // The first batch left the instruction prefix in a slot
+        std::lock_guard<std::mutex> lock(g_engine_mutex);
+        if (!g_prefix_saved && g_session && !g_snapshot_dir.empty()) {
+            g_prefix_saved = savePrefixSnapshot(
+                    g_scheduler, prefixSnapshotPath(model_path, templateType));
+        }
+    }
+
+    return toJavaStrings(env, outputs);
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_mad_assignment_MainActivity_journalRunMemory(
+        JNIEnv *env,
+        jobject,
+        jintArray itemIds,
+        jstring memory) {
+
+    const std::string payload = jstringToString(env, memory);
+    const jsize n = env->GetArrayLength(itemIds);
+    std::vector<int32_t> ids(n);
+    env->GetIntArrayRegion(itemIds, 0, n, ids.data());
+
+    bool ok = true;
+    for (int32_t id : ids) {
+        ok = journalItem(g_journal, id, JOURNAL_MEMORY, payload) && ok;
+    }
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_mad_assignment_MainActivity_closeRunJournal(
+        JNIEnv *,
+        jobject,
+        jboolean discard) {
+
+    if (discard) {
+        discardRunJournal(g_journal);
+    } else {
+        closeRunJournal(g_journal);
+    }
+}
+
+// ================= Ingredient atoms =================
+// g_atoms_mutex serialises atom runs and guards which cache file is open;
+// the cache locks itself for lookups and stores
+static std::mutex g_atoms_mutex;
+static AtomCache g_atom_cache;
+
+// Ingredient lists in, results in the formatResult layout out. Only atoms
+// missing from the cache go to the model (one short prompt each, batched
+// through runModelBatch); an item fails when one of its atoms did.
+// ATOMS= and ATOM_CALLS= report the item's atoms and how many of them
+// needed the model in this call. LAT_MS is the item's own parse and
+// lookup time plus an equal share of the model time per call it needed,
+// so fully cached items show what the cache saves; TTFT_MS is -1 like
+// ITPS and OTPS, as nothing is generated for the item itself.
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_mad_assignment_MainActivity_inferAllergensAtoms(
+        JNIEnv *env,
+        jobject,
+        jobjectArray ingredients,
+        jstring modelPath,
+        jint templateType,
+        jstring cachePath) {
+
+    const std::vector<std::string> texts = fromJavaStrings(env, ingredients);
+    const std::string model_path = jstringToString(env, modelPath);
+    const std::string cache_path = jstringToString(env, cachePath);
+
+    std::lock_guard<std::mutex> atoms_lock(g_atoms_mutex);
+    if (g_atom_cache.path != cache_path) {
+        // A failed open keeps the path and leaves the cache in memory only;
+        // retrying on every call would throw away what it learned
+        openAtomCache(g_atom_cache, cache_path);
+    }
+    using Ms = std::chrono::duration<double, std::milli>;
+
+    // ================= Atoms the cache does not know =================
+    std::vector<std::vector<std::string>> item_atoms(texts.size());
+    std::vector<Ms> item_time(texts.size(), Ms(0));
+    std::vector<std::string> missing;
+    std::set<std::string> queued;
+    for (size_t i = 0; i < texts.size(); i++) {
+        const auto t_item = Clock::now();
+        item_atoms[i] = parseIngredientAtoms(texts[i]);
+        for (const std::string& atom : item_atoms[i]) {
+            AllergenMask mask;
+            if (!lookupAtom(g_atom_cache, atom, mask) && queued.insert(atom).second) {
+                missing.push_back(atom);
+            }
+        }
+        item_time[i] += Clock::now() - t_item;
+    }
+
+    Ms call_time(0);
+    if (!missing.empty()) {
+        const auto t_calls = Clock::now();
+        std::vector<std::string> prompts;
+        for (const std::string& atom : missing) {
+            prompts.push_back(templateType == TEMPLATE_TUNED ? buildTunedPrompt(atom)
+                                                             : buildAllergenPrompt(atom));
+        }
+        const std::vector<std::string> outputs = runModelBatch(prompts, model_path, templateType,
+                                                               RequestPriority::Batch);
+        for (size_t a = 0; a < missing.size(); a++) {
+            const size_t bar = outputs[a].find('|');
+            if (bar != std::string::npos) {
+                storeAtom(g_atom_cache, missing[a], parsePredictedAllergens(outputs[a].substr(bar + 1)));
+            }
+        }
+        call_time = (Clock::now() - t_calls) / (double) missing.size();
+    }
+
+    // ================= Items =================
+    std::vector<std::string> results(texts.size());
+    long n_cached_items = 0;
+    for (size_t i = 0; i < texts.size(); i++) {
+        const auto t_item = Clock::now();
+        AllergenMask mask = 0;
+        long n_calls = 0;
+        bool ok = true;
+        for (const std::string& atom : item_atoms[i]) {
+            AllergenMask atom_mask;
+            ok = ok && lookupAtom(g_atom_cache, atom, atom_mask);
+            mask |= ok ? atom_mask : 0;
+            n_calls += queued.count(atom);
+        }
+        n_cached_items += n_calls == 0;
+        item_time[i] += Clock::now() - t_item;
+        if (ok) {
+            const long latency_ms = std::lround((item_time[i] + call_time * (double) n_calls).count());
+            results[i] = "TTFT_MS=-1;ITPS=-1;OTPS=-1;OET_MS=0;LAT_MS=" + std::to_string(latency_ms) +
+                         ";ATOMS=" + std::to_string(item_atoms[i].size()) +
+                         ";ATOM_CALLS=" + std::to_string(n_calls) +
+                         "|" + formatAllergenMask(mask);
+        }
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "Atoms: %zu items, %zu model calls, %ld items fully cached, %zu atoms known",
+                        texts.size(), missing.size(), n_cached_items, g_atom_cache.masks.size());
+    return toJavaStrings(env, results);
+}
+
+// ================= Cascade =================
+// Small model first, large model for the answers it is unsure of
+// (cascade.h). Both models are loaded by the cascade, one after the other,
+// so it runs with the engine to itself (acquireExclusiveEngine).
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_mad_assignment_MainActivity_inferAllergensCascade(
+        JNIEnv *env,
+        jobject,
+        jobjectArray ingredients,
+        jstring smallPath,
+        jint smallTemplate,
+        jstring largePath,
+        jint largeTemplate,
+        jfloat minConfidence) {
+
+    const std::vector<std::string> texts = fromJavaStrings(env, ingredients);
+
+    CascadeConfig config;
+    config.small_path = jstringToString(env, smallPath);
+    config.small_template = smallTemplate;
+    config.large_path = jstringToString(env, largePath);
+    config.large_template = largeTemplate;
+    config.min_confidence = minConfidence;
+
+    acquireExclusiveEngine();
+    {
+        std::lock_guard<std::mutex> lock(g_engine_mutex);
+        config.engine.compress_ingredients = g_compression;
+    }
+    CascadeReport report;
+    const bool ok = runCascade(config, texts, report);
+    releaseExclusiveEngine();
+    if (!ok) {
+        return toJavaStrings(env, std::vector<std::string>(texts.size()));
+    }
+
+    std::vector<std::string> results;
+    results.reserve(report.outcomes.size());
+    for (const CascadeOutcome& outcome : report.outcomes) {
+        results.push_back(outcome.result);
+    }
+    return toJavaStrings(env, results);
+}
+
+// ================= Local result store =================
+// One ResultStore per model key, opened on first use
+static std::mutex g_stores_mutex;
+static std::string g_store_dir;
+static std::map<std::string, std::unique_ptr<ResultStore>> g_stores;
+
+static ResultStore* resultStoreFor(const std::string& key) {
+    std::lock_guard<std::mutex> lock(g_stores_mutex);
+    auto it = g_stores.find(key);
+    if (it != g_stores.end()) {
+        return it->second.get();
+    }
+    if (g_store_dir.empty()) {
+        return nullptr;
+    }
+
+    std::unique_ptr<ResultStore> store(new ResultStore());
+    if (!openResultStore(*store, g_store_dir, key)) {
+        return nullptr;
+    }
+    return g_stores.emplace(key, std::move(store)).first->second.get();
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_mad_assignment_LocalResultStore_nativeInit(
+        JNIEnv *env,
+        jobject,
+        jstring dir) {
+
+    std::lock_guard<std::mutex> lock(g_stores_mutex);
+    g_store_dir = jstringToString(env, dir);
+    return JNI_TRUE;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_mad_assignment_LocalResultStore_nativeAppend(
+        JNIEnv *env,
+        jobject,
+        jstring modelKey,
+        jintArray dataIds,
+        jintArray datasetNumbers,
+        jlongArray timestampsMs,
+        jlongArray metrics,
+        jbooleanArray matches,
+        jobjectArray names,
+        jobjectArray ingredients,
+        jobjectArray allergens,
+        jobjectArray mappedAllergens,
+        jobjectArray predictedAllergens) {
+
+    ResultStore* store = resultStoreFor(jstringToString(env, modelKey));
+    if (!store) {
+        return JNI_FALSE;
+    }
+
+    const jsize n = env->GetArrayLength(dataIds);
+    std::vector<ResultRow> rows(n);
+
+    jint* ids = env->GetIntArrayElements(dataIds, nullptr);
+    jint* datasets = env->GetIntArrayElements(datasetNumbers, nullptr);
+    jlong* timestamps = env->GetLongArrayElements(timestampsMs, nullptr);
+    jlong* values = env->GetLongArrayElements(metrics, nullptr);
+    jboolean* match = env->GetBooleanArrayElements(matches, nullptr);
+    for (jsize i = 0; i < n; i++) {
+        rows[i].data_id = ids[i];
+        rows[i].dataset_number = datasets[i];
+        rows[i].timestamp_ms = timestamps[i];
+        for (int m = 0; m < N_RESULT_METRICS; m++) {
+            rows[i].metrics[m] = values[i * N_RESULT_METRICS + m];
+        }
+        rows[i].is_match = match[i] == JNI_TRUE;
+    }
+    env->ReleaseIntArrayElements(dataIds, ids, JNI_ABORT);
+    env->ReleaseIntArrayElements(datasetNumbers, datasets, JNI_ABORT);
+    env->ReleaseLongArrayElements(timestampsMs, timestamps, JNI_ABORT);
+    env->ReleaseLongArrayElements(metrics, values, JNI_ABORT);
+    env->ReleaseBooleanArrayElements(matches, match, JNI_ABORT);
+
+    auto readColumn = [&](jobjectArray array, std::string ResultRow::*field) {
+        for (jsize i = 0; i < n; i++) {
+            jstring jstr = (jstring) env->GetObjectArrayElement(array, i);
+            rows[i].*field = jstringToString(env, jstr);
+            env->DeleteLocalRef(jstr);
+        }
+    };
+    readColumn(names, &ResultRow::name);
+    readColumn(ingredients, &ResultRow::ingredients);
+    readColumn(allergens, &ResultRow::allergens_raw);
+    readColumn(mappedAllergens, &ResultRow::mapped_allergens);
+    readColumn(predictedAllergens, &ResultRow::predicted_allergens);
+
+    return appendResults(*store, rows) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT jdoubleArray JNICALL
+Java_com_mad_assignment_LocalResultStore_nativeAggregate(
+        JNIEnv *env,
+        jobject,
+        jstring modelKey) {
+
+    ResultAggregate a;
+    ResultStore* store = resultStoreFor(jstringToString(env, modelKey));
+    if (store) {
+        a = getResultAggregate(*store);
+    }
+
+    long tp = 0, fp = 0, fn = 0, tn = 0;
+    for (int i = 0; i < N_ALLERGENS; i++) {
+        tp += a.score.tp[i];
+        fp += a.score.fp[i];
+        fn += a.score.fn[i];
+        tn += a.score.tn[i];
+    }
+
+    // Layout mirrored by the AGG_* constants in LocalResultStore.kt
+    const double values[] = {
+            (double) a.count, (double) a.n_match,
+            a.metric_sums[METRIC_LATENCY_MS], a.metric_sums[METRIC_JAVA_HEAP_KB],
+            a.metric_sums[METRIC_NATIVE_HEAP_KB], a.metric_sums[METRIC_TOTAL_PSS_KB],
+            a.metric_sums[METRIC_TTFT_MS], a.metric_sums[METRIC_ITPS],
+            a.metric_sums[METRIC_OTPS], a.metric_sums[METRIC_OET_MS],
+            (double) tp, (double) fp, (double) fn, (double) tn,
+            a.score.precision(), a.score.recall(), a.score.microF1(), a.score.macroF1(),
+            a.score.hammingLoss(), a.score.falseNegativeRate(),
+            (double) a.n_hallucination, (double) a.n_over_prediction,
+            (double) a.n_abstention_total, (double) a.n_abstention_correct,
+    };
+    const jsize n = (jsize) (sizeof(values) / sizeof(values[0]));
+
+    jdoubleArray result = env->NewDoubleArray(n);
+    env->SetDoubleArrayRegion(result, 0, n, values);
+    return result;
+}
+
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_mad_assignment_LocalResultStore_nativeRecords(
+        JNIEnv *env,
+        jobject,
+        jstring modelKey) {
+
+    std::vector<ResultRow> rows;
+    ResultStore* store = resultStoreFor(jstringToString(env, modelKey));
+    if (store) {
+        readResultRows(*store, rows);
+    }
+
+    // Flattened: dataId, name, ingredients, mapped, predicted, isMatch
+    const int n_fields = 6;
+    jobjectArray result = env->NewObjectArray(
+            (jsize) (rows.size() * n_fields), env->FindClass("java/lang/String"), nullptr);
+    for (size_t i = 0; i < rows.size(); i++) {
+        const ResultRow& row = rows[i];
+        const std::string fields[n_fields] = {
+                std::to_string(row.data_id), row.name, row.ingredients,
+                row.mapped_allergens, row.predicted_allergens, row.is_match ? "1" : "0"
+        };
+        for (int f = 0; f < n_fields; f++) {
+            jstring jfield = env->NewStringUTF(fields[f].c_str());
+            env->SetObjectArrayElement(result, (jsize) (i * n_fields + f), jfield);
+            env->DeleteLocalRef(jfield);
+        }
+    }
+    return result;
+}
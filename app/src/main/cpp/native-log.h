@@ -0,0 +1,22 @@
+#pragma once
+
+// __android_log_print on Android; stderr when the engine is built for a
+// Linux host (tools/), so the same sources compile in both places.
+#ifdef __ANDROID__
+#include <android/log.h>
+#else
+#include <cstdio>
+
+enum {
+    ANDROID_LOG_DEBUG = 3,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR
+};
+
+#define __android_log_print(prio, tag, ...)                       \
+    ((prio) >= ANDROID_LOG_INFO                                   \
+         ? (fprintf(stderr, "%s: ", tag),                         \
+            fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))    \
+         : 0)
+#endif
@@ -0,0 +1,34 @@
+#include "prompt_styles.h"
+#include "allergens.h"
+#include "engine.h"
+
+const PromptStyle PROMPT_STYLES[N_PROMPT_STYLES] = {
+        // MainActivity.buildPrompt() with the ingredients moved up
+        {"list",
+         "Detect allergens in the ingredients. Output only allergens from this list: "
+         "milk, egg, peanut, tree nut, wheat, soy, fish, shellfish, sesame"},
+        {"strict",
+         "Which of these allergens do the ingredients contain: milk, egg, peanut, tree nut, "
+         "wheat, soy, fish, shellfish, sesame? Count an allergen whenever an ingredient is "
+         "made from it. Answer with the names only, comma-separated, or none."},
+        {"hints",
+         "List the allergens the ingredients come from. Allowed: milk (butter, cheese, whey, "
+         "cream), egg, peanut, tree nut (almond, hazelnut, cashew, walnut), wheat (flour, "
+         "semolina, spelt), soy (lecithin, tofu), fish (anchovy), shellfish (prawn, crustacean), "
+         "sesame (tahini). Output only allergen names, comma-separated."},
+};
+
+std::string buildStylePrompt(const std::string& ingredients, int style) {
+    return "Ingredients: " + ingredients + "\n"
+           "\n" +
+           std::string(PROMPT_STYLES[style].instruction) + "\n"
+           "\n"
+           "Allergens:";
+}
+
+std::string formatStylePrompt(const std::string& ingredients, int style, int template_type) {
+    if (template_type == TEMPLATE_TUNED) {
+        return buildTunedPrompt(ingredients);
+    }
+    return formatPrompt(buildStylePrompt(ingredients, style), template_type);
+}
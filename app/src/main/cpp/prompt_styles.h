@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+// ================= Prompt styles =================
+// Safety metrics are reported per model and per prompt style. Every style
+// puts the ingredients first and its instruction after them, so the P
+// prompts of one item share the ingredient tokens: the first request
+// prefills them and the other P - 1 fork its KV cells (sharePromptPrefix)
+// and only prefill their instruction.
+struct PromptStyle {
+    const char* name;
+    const char* instruction;
+};
+
+constexpr int N_PROMPT_STYLES = 3;
+extern const PromptStyle PROMPT_STYLES[N_PROMPT_STYLES];
+
+// The style's user turn: "Ingredients: ...", instruction, "Allergens:"
+std::string buildStylePrompt(const std::string& ingredients, int style);
+
+// buildStylePrompt in the template's chat turns. A TEMPLATE_TUNED model has
+// its instruction in the weights, so every style is buildTunedPrompt().
+std::string formatStylePrompt(const std::string& ingredients, int style, int template_type);
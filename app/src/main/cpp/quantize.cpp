@@ -0,0 +1,167 @@
+#include "quantize.h"
+#include "allergens.h"
+#include "engine.h"
+#include "native-log.h"
+#include "llama/ggml-backend.h"
+#include <algorithm>
+#include <cstring>
+
+// ================= Activation statistics =================
+struct ActivationStats {
+    std::unordered_map<std::string, std::vector<double>> sums;  // per column
+    std::unordered_map<std::string, long> rows;
+    std::vector<float> host;  // staging for activations off the CPU
+};
+
+// ggml_backend_sched_eval_callback: ask for every mat-mul against a
+// model weight, then accumulate x^2 of its input rows
+static bool collectActivations(ggml_tensor* t, bool ask, void* user_data) {
+    if (t->op != GGML_OP_MUL_MAT) {
+        return ask ? false : true;
+    }
+    const ggml_tensor* weight = t->src[0];
+    const ggml_tensor* input = t->src[1];
+    const size_t name_len = strlen(weight->name);
+    const bool is_weight = name_len > 7 && strcmp(weight->name + name_len - 7, ".weight") == 0;
+    if (ask) {
+        return is_weight && input->type == GGML_TYPE_F32;
+    }
+
+    ActivationStats& stats = *(ActivationStats*) user_data;
+    const uint8_t* data = (const uint8_t*) input->data;
+    if (!ggml_backend_buffer_is_host(input->buffer)) {
+        stats.host.resize(ggml_nbytes(input) / sizeof(float));
+        ggml_backend_tensor_get(input, stats.host.data(), 0, ggml_nbytes(input));
+        data = (const uint8_t*) stats.host.data();
+    }
+
+    const int64_t n_cols = input->ne[0];
+    std::vector<double>& sums = stats.sums[weight->name];
+    sums.resize(n_cols, 0.0);
+    long& n_rows = stats.rows[weight->name];
+
+    for (int64_t i3 = 0; i3 < input->ne[3]; i3++) {
+        for (int64_t i2 = 0; i2 < input->ne[2]; i2++) {
+            for (int64_t i1 = 0; i1 < input->ne[1]; i1++) {
+                const float* row = (const float*) (data + i1 * input->nb[1] + i2 * input->nb[2] +
+                                                   i3 * input->nb[3]);
+                for (int64_t j = 0; j < n_cols; j++) {
+                    sums[j] += (double) row[j] * row[j];
+                }
+                n_rows++;
+            }
+        }
+    }
+    return true;
+}
+
+bool computeImportanceMatrix(const std::string& model_path,
+                             int template_type,
+                             const std::vector<FoodRecord>& records,
+                             int n_threads,
+                             ImportanceMatrix& imatrix) {
+    // Plain layout: the callback reads activations, not repacked weights
+    llama_model* model = loadModel(model_path, false);
+    if (!model) {
+        return false;
+    }
+
+    ActivationStats stats;
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = 2048;
+    ctx_params.n_batch = 512;
+    ctx_params.n_ubatch = 512;
+    ctx_params.n_seq_max = 1;
+    ctx_params.n_threads = n_threads;
+    ctx_params.n_threads_batch = n_threads;
+    ctx_params.cb_eval = collectActivations;
+    ctx_params.cb_eval_user_data = &stats;
+
+    llama_context* ctx = llama_init_from_model(model, ctx_params);
+    if (!ctx) {
+        llama_model_free(model);
+        return false;
+    }
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    const int n_ctx = (int) llama_n_ctx(ctx);
+    const int n_batch = (int) llama_n_batch(ctx);
+
+    for (const FoodRecord& record : records) {
+        std::vector<llama_token> tokens = tokenize(
+                vocab, formatAllergenPrompt(record.ingredients, template_type), true);
+        if ((int) tokens.size() > n_ctx) {
+            tokens.resize(n_ctx);
+        }
+
+        llama_memory_clear(llama_get_memory(ctx), true);
+        for (int i = 0; i < (int) tokens.size(); i += n_batch) {
+            const int n = std::min(n_batch, (int) tokens.size() - i);
+            if (llama_decode(ctx, llama_batch_get_one(tokens.data() + i, n)) != 0) {
+                __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "imatrix decode failed");
+                llama_free(ctx);
+                llama_model_free(model);
+                return false;
+            }
+        }
+
+        imatrix.n_prompts++;
+        imatrix.n_tokens += (long) tokens.size();
+    }
+
+    llama_free(ctx);
+    llama_model_free(model);
+
+    imatrix.values.clear();
+    for (const auto& entry : stats.sums) {
+        const long n_rows = std::max(stats.rows[entry.first], 1L);
+        std::vector<float>& values = imatrix.values[entry.first];
+        values.resize(entry.second.size());
+        for (size_t j = 0; j < values.size(); j++) {
+            values[j] = (float) (entry.second[j] / n_rows);
+        }
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "imatrix: %zu tensors from %ld prompts (%ld tokens)",
+                        imatrix.values.size(), imatrix.n_prompts, imatrix.n_tokens);
+    return !imatrix.values.empty();
+}
+
+bool quantizeModel(const std::string& in_path,
+                   const std::string& out_path,
+                   llama_ftype ftype,
+                   const ImportanceMatrix* imatrix,
+                   int n_threads) {
+    llama_model_quantize_params params = llama_model_quantize_default_params();
+    params.ftype = ftype;
+    params.nthread = n_threads;
+    params.imatrix = imatrix ? (void*) &imatrix->values : nullptr;
+
+    if (llama_model_quantize(in_path.c_str(), out_path.c_str(), &params) != 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Quantising %s -> %s failed",
+                            in_path.c_str(), out_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool parseFtype(const std::string& name, llama_ftype& ftype) {
+    static const struct {
+        const char* name;
+        llama_ftype ftype;
+    } FTYPES[] = {
+            {"q4_0",   LLAMA_FTYPE_MOSTLY_Q4_0},
+            {"q4_k_m", LLAMA_FTYPE_MOSTLY_Q4_K_M},
+            {"iq4_nl", LLAMA_FTYPE_MOSTLY_IQ4_NL},
+            {"iq4_xs", LLAMA_FTYPE_MOSTLY_IQ4_XS},
+            {"q3_k_m", LLAMA_FTYPE_MOSTLY_Q3_K_M},
+            {"q5_k_m", LLAMA_FTYPE_MOSTLY_Q5_K_M},
+            {"q8_0",   LLAMA_FTYPE_MOSTLY_Q8_0},
+    };
+    for (const auto& entry : FTYPES) {
+        if (name == entry.name) {
+            ftype = entry.ftype;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "dataset.h"
+#include "llama/llama.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ================= Quantisation =================
+// Importance matrix from our own workload: the allergen prompts are run
+// through the full-precision model and, for every weight matrix, the
+// mean squared input activation of each column is recorded. Quantising
+// with it spends precision on the columns these prompts actually use,
+// instead of on a generic text corpus.
+struct ImportanceMatrix {
+    // Weight tensor name -> one value per column, the layout
+    // llama_model_quantize_params::imatrix expects
+    std::unordered_map<std::string, std::vector<float>> values;
+
+    long n_prompts = 0;
+    long n_tokens = 0;
+};
+
+bool computeImportanceMatrix(const std::string& model_path,
+                             int template_type,
+                             const std::vector<FoodRecord>& records,
+                             int n_threads,
+                             ImportanceMatrix& imatrix);
+
+// imatrix may be nullptr
+bool quantizeModel(const std::string& in_path,
+                   const std::string& out_path,
+                   llama_ftype ftype,
+                   const ImportanceMatrix* imatrix,
+                   int n_threads);
+
+// "q4_0", "iq4_nl", "q3_k_m", "q5_k_m", ... -> ftype; false if unknown
+bool parseFtype(const std::string& name, llama_ftype& ftype);
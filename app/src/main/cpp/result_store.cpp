@@ -0,0 +1,405 @@
+#include "result_store.h"
+#include "checksum.h"
+#include "engine.h"
+#include "native-log.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char STORE_MAGIC[4] = {'S', 'L', 'R', 'S'};
+static const uint32_t STORE_VERSION = 1;
+static const uint32_t BLOCK_MAGIC = 0x314b4c42;  // "BLK1"
+static const size_t HEADER_SIZE = 64;
+static const size_t MAX_KEY = HEADER_SIZE - 16;
+
+enum StringColumn {
+    COL_NAME,
+    COL_INGREDIENTS,
+    COL_ALLERGENS_RAW,
+    COL_MAPPED,
+    COL_PREDICTED,
+    N_STRING_COLUMNS
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t n_rows;
+    uint32_t payload_size;
+    uint32_t crc;
+};
+
+// ================= Block layout =================
+// Fixed-width columns first so a replay touches only the start of each
+// block; string columns are u32 end offsets followed by the bytes
+struct BlockLayout {
+    size_t data_id;
+    size_t dataset_number;
+    size_t timestamp;
+    size_t metrics;     // N_RESULT_METRICS columns of int64
+    size_t predicted;
+    size_t truth;
+    size_t flags;
+    size_t strings;     // first string column
+};
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t) 7;
+}
+
+static BlockLayout layoutFor(uint32_t n) {
+    BlockLayout l;
+    l.timestamp = 0;
+    l.metrics = l.timestamp + 8 * n;
+    l.data_id = l.metrics + 8 * n * N_RESULT_METRICS;
+    l.dataset_number = l.data_id + 4 * n;
+    l.predicted = l.dataset_number + 4 * n;
+    l.truth = l.predicted + 2 * n;
+    l.flags = l.truth + 2 * n;
+    l.strings = align8(l.flags + n);
+    return l;
+}
+
+template <typename T>
+static T load(const uint8_t* p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template <typename T>
+static void store(std::vector<uint8_t>& out, size_t offset, T value) {
+    memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+static const std::string& stringColumn(const ResultRow& row, int column) {
+    switch (column) {
+        case COL_NAME:          return row.name;
+        case COL_INGREDIENTS:   return row.ingredients;
+        case COL_ALLERGENS_RAW: return row.allergens_raw;
+        case COL_MAPPED:        return row.mapped_allergens;
+        default:                return row.predicted_allergens;
+    }
+}
+
+static std::string& stringColumn(ResultRow& row, int column) {
+    return const_cast<std::string&>(stringColumn((const ResultRow&) row, column));
+}
+
+static ResultStats statsFor(const ResultRow& row) {
+    ResultStats stats;
+    memcpy(stats.metrics, row.metrics, sizeof(stats.metrics));
+    stats.predicted = parseAllergenList(row.predicted_allergens);
+    stats.truth = parseAllergenList(row.mapped_allergens);
+    if (row.is_match) {
+        stats.flags |= RESULT_FLAG_MATCH;
+    }
+    if (stats.predicted & ~allergensMentionedIn(row.ingredients)) {
+        stats.flags |= RESULT_FLAG_HALLUCINATION;
+    }
+    return stats;
+}
+
+static std::vector<uint8_t> encodeBlock(const std::vector<ResultRow>& rows,
+                                        const std::vector<ResultStats>& stats) {
+    const uint32_t n = (uint32_t) rows.size();
+    const BlockLayout l = layoutFor(n);
+
+    size_t size = l.strings;
+    for (int c = 0; c < N_STRING_COLUMNS; c++) {
+        size_t bytes = 0;
+        for (const ResultRow& row : rows) {
+            bytes += stringColumn(row, c).size();
+        }
+        size = align8(size + 4 * n + bytes);
+    }
+
+    std::vector<uint8_t> payload(size, 0);
+    for (uint32_t i = 0; i < n; i++) {
+        store<int64_t>(payload, l.timestamp + 8 * i, rows[i].timestamp_ms);
+        for (int m = 0; m < N_RESULT_METRICS; m++) {
+            store<int64_t>(payload, l.metrics + 8 * ((size_t) m * n + i), rows[i].metrics[m]);
+        }
+        store<int32_t>(payload, l.data_id + 4 * i, rows[i].data_id);
+        store<int32_t>(payload, l.dataset_number + 4 * i, rows[i].dataset_number);
+        store<uint16_t>(payload, l.predicted + 2 * i, stats[i].predicted);
+        store<uint16_t>(payload, l.truth + 2 * i, stats[i].truth);
+        payload[l.flags + i] = stats[i].flags;
+    }
+
+    size_t pos = l.strings;
+    for (int c = 0; c < N_STRING_COLUMNS; c++) {
+        const size_t offsets = pos;
+        size_t bytes = offsets + 4 * n;
+        for (uint32_t i = 0; i < n; i++) {
+            const std::string& value = stringColumn(rows[i], c);
+            memcpy(payload.data() + bytes, value.data(), value.size());
+            bytes += value.size();
+            store<uint32_t>(payload, offsets + 4 * i, (uint32_t) (bytes - offsets - 4 * n));
+        }
+        pos = align8(bytes);
+    }
+    return payload;
+}
+
+// Calls visit(block payload, n_rows) for every valid block; returns the end
+// of the last valid block
+template <typename Visit>
+static size_t scanBlocks(const uint8_t* map, size_t size, Visit visit) {
+    size_t pos = HEADER_SIZE;
+    while (pos + sizeof(BlockHeader) <= size) {
+        const BlockHeader header = load<BlockHeader>(map + pos);
+        const uint8_t* payload = map + pos + sizeof(BlockHeader);
+        if (header.magic != BLOCK_MAGIC ||
+            header.payload_size > size - pos - sizeof(BlockHeader) ||
+            header.payload_size < layoutFor(header.n_rows).strings ||
+            crc32Ieee(payload, header.payload_size) != header.crc) {
+            break;
+        }
+        visit(payload, header.n_rows);
+        pos += sizeof(BlockHeader) + header.payload_size;
+    }
+    return pos;
+}
+
+static void applyStats(ResultAggregate& aggregate, const ResultStats& stats, int sign) {
+    aggregate.count += sign;
+    if (stats.flags & RESULT_FLAG_MATCH) {
+        aggregate.n_match += sign;
+    }
+    for (int m = 0; m < N_RESULT_METRICS; m++) {
+        aggregate.metric_sums[m] += sign * (double) stats.metrics[m];
+    }
+    if (sign > 0) {
+        aggregate.score.add(stats.predicted, stats.truth);
+    } else {
+        aggregate.score.remove(stats.predicted, stats.truth);
+    }
+
+    if (stats.flags & RESULT_FLAG_HALLUCINATION) {
+        aggregate.n_hallucination += sign;
+    }
+    if (stats.predicted & ~stats.truth) {
+        aggregate.n_over_prediction += sign;
+    }
+    if (stats.truth == 0) {
+        aggregate.n_abstention_total += sign;
+        if (stats.predicted == 0) {
+            aggregate.n_abstention_correct += sign;
+        }
+    }
+}
+
+// Caller holds store.mutex
+static void upsert(ResultStore& store, int32_t data_id, const ResultStats& stats) {
+    auto it = store.current.find(data_id);
+    if (it != store.current.end()) {
+        applyStats(store.aggregate, it->second, -1);
+        it->second = stats;
+    } else {
+        store.current.emplace(data_id, stats);
+    }
+    applyStats(store.aggregate, stats, +1);
+    store.n_rows_logged++;
+}
+
+// ================= Store =================
+bool openResultStore(ResultStore& store, const std::string& dir, const std::string& key) {
+    closeResultStore(store);
+    std::lock_guard<std::mutex> lock(store.mutex);
+
+    store.key = key.substr(0, MAX_KEY);
+    store.path = dir + "/" + key + ".slr";
+    store.fd = open(store.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (store.fd < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot open %s", store.path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    fstat(store.fd, &st);
+    size_t size = (size_t) st.st_size;
+
+    if (size < HEADER_SIZE) {
+        // New (or torn before the header was complete)
+        uint8_t header[HEADER_SIZE] = {};
+        memcpy(header, STORE_MAGIC, 4);
+        memcpy(header + 4, &STORE_VERSION, 4);
+        const uint32_t key_len = (uint32_t) store.key.size();
+        memcpy(header + 8, &key_len, 4);
+        memcpy(header + 16, store.key.data(), key_len);
+        if (ftruncate(store.fd, 0) != 0 ||
+            pwrite(store.fd, header, HEADER_SIZE, 0) != (ssize_t) HEADER_SIZE ||
+            fdatasync(store.fd) != 0) {
+            close(store.fd);
+            store.fd = -1;
+            return false;
+        }
+        store.file_size = HEADER_SIZE;
+        return true;
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, store.fd, 0);
+    if (map == MAP_FAILED) {
+        close(store.fd);
+        store.fd = -1;
+        return false;
+    }
+    const uint8_t* bytes = (const uint8_t*) map;
+
+    if (memcmp(bytes, STORE_MAGIC, 4) != 0 || load<uint32_t>(bytes + 4) != STORE_VERSION) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "%s is not a result store",
+                            store.path.c_str());
+        munmap(map, size);
+        close(store.fd);
+        store.fd = -1;
+        return false;
+    }
+
+    // Replay the fixed-width columns only
+    const size_t valid_end = scanBlocks(bytes, size, [&](const uint8_t* payload, uint32_t n) {
+        const BlockLayout l = layoutFor(n);
+        for (uint32_t i = 0; i < n; i++) {
+            ResultStats stats;
+            for (int m = 0; m < N_RESULT_METRICS; m++) {
+                stats.metrics[m] = load<int64_t>(payload + l.metrics + 8 * ((size_t) m * n + i));
+            }
+            stats.predicted = load<uint16_t>(payload + l.predicted + 2 * i);
+            stats.truth = load<uint16_t>(payload + l.truth + 2 * i);
+            stats.flags = payload[l.flags + i];
+            upsert(store, load<int32_t>(payload + l.data_id + 4 * i), stats);
+        }
+    });
+    munmap(map, size);
+
+    if (valid_end < size) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                            "%s: dropping %zu bytes of an incomplete append",
+                            store.path.c_str(), size - valid_end);
+        if (ftruncate(store.fd, (off_t) valid_end) != 0) {
+            close(store.fd);
+            store.fd = -1;
+            store.current.clear();
+            store.aggregate = ResultAggregate();
+            return false;
+        }
+    }
+    store.file_size = (long) valid_end;
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Result store %s: %ld records (%ld logged)",
+                        store.key.c_str(), store.aggregate.count, store.n_rows_logged);
+    return true;
+}
+
+void closeResultStore(ResultStore& store) {
+    std::lock_guard<std::mutex> lock(store.mutex);
+    if (store.fd >= 0) {
+        close(store.fd);
+        store.fd = -1;
+    }
+    store.current.clear();
+    store.aggregate = ResultAggregate();
+    store.file_size = 0;
+    store.n_rows_logged = 0;
+}
+
+bool appendResults(ResultStore& store, const std::vector<ResultRow>& rows) {
+    if (rows.empty()) {
+        return true;
+    }
+
+    std::vector<ResultStats> stats;
+    stats.reserve(rows.size());
+    for (const ResultRow& row : rows) {
+        stats.push_back(statsFor(row));
+    }
+
+    std::vector<uint8_t> payload = encodeBlock(rows, stats);
+    BlockHeader header;
+    header.magic = BLOCK_MAGIC;
+    header.n_rows = (uint32_t) rows.size();
+    header.payload_size = (uint32_t) payload.size();
+    header.crc = crc32Ieee(payload.data(), payload.size());
+
+    std::vector<uint8_t> block(sizeof(header) + payload.size());
+    memcpy(block.data(), &header, sizeof(header));
+    memcpy(block.data() + sizeof(header), payload.data(), payload.size());
+
+    std::lock_guard<std::mutex> lock(store.mutex);
+    if (store.fd < 0) {
+        return false;
+    }
+
+    if (pwrite(store.fd, block.data(), block.size(), store.file_size) != (ssize_t) block.size() ||
+        fdatasync(store.fd) != 0) {
+        // Whatever made it to disk fails its CRC and is cut on the next open
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Append to %s failed", store.path.c_str());
+        return false;
+    }
+    store.file_size += (long) block.size();
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        upsert(store, rows[i].data_id, stats[i]);
+    }
+    return true;
+}
+
+ResultAggregate getResultAggregate(ResultStore& store) {
+    std::lock_guard<std::mutex> lock(store.mutex);
+    return store.aggregate;
+}
+
+bool readResultRows(ResultStore& store, std::vector<ResultRow>& rows) {
+    std::lock_guard<std::mutex> lock(store.mutex);
+    rows.clear();
+    if (store.fd < 0) {
+        return false;
+    }
+
+    const size_t size = (size_t) store.file_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, store.fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    std::map<int32_t, ResultRow> latest;
+    scanBlocks((const uint8_t*) map, size, [&](const uint8_t* payload, uint32_t n) {
+        const BlockLayout l = layoutFor(n);
+        std::vector<ResultRow> block(n);
+        for (uint32_t i = 0; i < n; i++) {
+            ResultRow& row = block[i];
+            row.data_id = load<int32_t>(payload + l.data_id + 4 * i);
+            row.dataset_number = load<int32_t>(payload + l.dataset_number + 4 * i);
+            row.timestamp_ms = load<int64_t>(payload + l.timestamp + 8 * i);
+            for (int m = 0; m < N_RESULT_METRICS; m++) {
+                row.metrics[m] = load<int64_t>(payload + l.metrics + 8 * ((size_t) m * n + i));
+            }
+            row.is_match = payload[l.flags + i] & RESULT_FLAG_MATCH;
+        }
+
+        size_t pos = l.strings;
+        for (int c = 0; c < N_STRING_COLUMNS; c++) {
+            const uint8_t* offsets = payload + pos;
+            const char* bytes = (const char*) offsets + 4 * n;
+            uint32_t begin = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                const uint32_t end = load<uint32_t>(offsets + 4 * i);
+                stringColumn(block[i], c).assign(bytes + begin, end - begin);
+                begin = end;
+            }
+            pos = align8(pos + 4 * n + begin);
+        }
+
+        for (ResultRow& row : block) {
+            latest[row.data_id] = std::move(row);
+        }
+    });
+    munmap(map, size);
+
+    rows.reserve(latest.size());
+    for (auto& kv : latest) {
+        rows.push_back(std::move(kv.second));
+    }
+    return true;
+}
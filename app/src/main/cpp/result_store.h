@@ -0,0 +1,94 @@
+#pragma once
+
+#include "allergens.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ================= Local result store =================
+// One append-only file per model key (<dir>/<key>.slr). Every append is a
+// CRC-checked block laid out column by column: the fixed-width columns
+// (ids, metrics, allergen masks, flags) come first, then the string
+// columns. Opening a store mmaps the file and replays only the
+// fixed-width columns. A torn block at the end (crash during append) is
+// cut off.
+//
+// Like the Firestore layout, the latest record per data id wins.
+// Aggregates are kept up to date on every append by subtracting the
+// replaced record and adding the new one, so the comparison screen never
+// rescans the predictions.
+
+enum ResultMetric {
+    METRIC_LATENCY_MS,
+    METRIC_JAVA_HEAP_KB,
+    METRIC_NATIVE_HEAP_KB,
+    METRIC_TOTAL_PSS_KB,
+    METRIC_TTFT_MS,
+    METRIC_ITPS,
+    METRIC_OTPS,
+    METRIC_OET_MS,
+    N_RESULT_METRICS
+};
+
+struct ResultRow {
+    int32_t data_id = 0;
+    int32_t dataset_number = 0;
+    int64_t timestamp_ms = 0;
+    int64_t metrics[N_RESULT_METRICS] = {};
+    bool is_match = false;
+
+    std::string name;
+    std::string ingredients;
+    std::string allergens_raw;
+    std::string mapped_allergens;     // ground truth
+    std::string predicted_allergens;
+};
+
+constexpr uint8_t RESULT_FLAG_MATCH = 1;
+constexpr uint8_t RESULT_FLAG_HALLUCINATION = 2;  // predicted an allergen absent from the ingredients
+
+// Per-row values the aggregates are built from
+struct ResultStats {
+    int64_t metrics[N_RESULT_METRICS] = {};
+    AllergenMask predicted = 0;
+    AllergenMask truth = 0;
+    uint8_t flags = 0;  // RESULT_FLAG_*
+};
+
+struct ResultAggregate {
+    long count = 0;
+    long n_match = 0;
+    double metric_sums[N_RESULT_METRICS] = {};
+    AllergenScore score;
+
+    // Safety-oriented metrics (Table 3)
+    long n_hallucination = 0;
+    long n_over_prediction = 0;
+    long n_abstention_total = 0;
+    long n_abstention_correct = 0;
+};
+
+struct ResultStore {
+    std::string path;
+    std::string key;
+    int fd = -1;
+    long file_size = 0;  // end of the last valid block
+
+    std::mutex mutex;
+    std::map<int32_t, ResultStats> current;  // latest stats per data id
+    ResultAggregate aggregate;
+    long n_rows_logged = 0;                  // including replaced rows
+};
+
+bool openResultStore(ResultStore& store, const std::string& dir, const std::string& key);
+void closeResultStore(ResultStore& store);
+
+// Durable (fdatasync) before returning true
+bool appendResults(ResultStore& store, const std::vector<ResultRow>& rows);
+
+ResultAggregate getResultAggregate(ResultStore& store);
+
+// Latest row per data id, sorted by data id
+bool readResultRows(ResultStore& store, std::vector<ResultRow>& rows);
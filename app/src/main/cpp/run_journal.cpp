@@ -0,0 +1,150 @@
+#include "run_journal.h"
+#include "checksum.h"
+#include "engine.h"
+#include "native-log.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static const char JOURNAL_MAGIC[8] = {'S', 'L', 'R', 'J', 1, 0, 0, 0};  // + version
+
+struct RecordHeader {
+    uint32_t payload_size;
+    uint32_t crc;      // over item_id, kind and payload
+    int32_t item_id;
+    uint8_t kind;
+    uint8_t pad[3];
+};
+
+static uint32_t recordCrc(const RecordHeader& header, const uint8_t* payload) {
+    std::vector<uint8_t> bytes(5 + header.payload_size);
+    memcpy(bytes.data(), &header.item_id, 4);
+    bytes[4] = header.kind;
+    memcpy(bytes.data() + 5, payload, header.payload_size);
+    return crc32Ieee(bytes.data(), bytes.size());
+}
+
+// Caller holds journal.mutex
+static void applyRecord(RunJournal& journal, int32_t item_id, uint8_t kind, std::string payload) {
+    JournalEntry& entry = journal.entries[item_id];
+    if (kind == JOURNAL_RESULT) {
+        entry.result = std::move(payload);
+    } else if (kind == JOURNAL_MEMORY) {
+        entry.memory = std::move(payload);
+    }
+}
+
+bool openRunJournal(RunJournal& journal, const std::string& path) {
+    closeRunJournal(journal);
+    std::lock_guard<std::mutex> lock(journal.mutex);
+
+    journal.path = path;
+    journal.fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (journal.fd < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot open journal %s", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    fstat(journal.fd, &st);
+    const size_t size = (size_t) st.st_size;
+
+    std::vector<uint8_t> bytes(size);
+    if (size > 0 && pread(journal.fd, bytes.data(), size, 0) != (ssize_t) size) {
+        close(journal.fd);
+        journal.fd = -1;
+        return false;
+    }
+
+    if (size < sizeof(JOURNAL_MAGIC) || memcmp(bytes.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+        // New, torn before the header was complete, or an older format
+        if (ftruncate(journal.fd, 0) != 0 ||
+            pwrite(journal.fd, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 0) != (ssize_t) sizeof(JOURNAL_MAGIC) ||
+            fdatasync(journal.fd) != 0) {
+            close(journal.fd);
+            journal.fd = -1;
+            return false;
+        }
+        journal.file_size = sizeof(JOURNAL_MAGIC);
+        return true;
+    }
+
+    size_t pos = sizeof(JOURNAL_MAGIC);
+    while (pos + sizeof(RecordHeader) <= size) {
+        RecordHeader header;
+        memcpy(&header, bytes.data() + pos, sizeof(header));
+        const uint8_t* payload = bytes.data() + pos + sizeof(header);
+        if (header.payload_size > size - pos - sizeof(header) ||
+            recordCrc(header, payload) != header.crc) {
+            break;
+        }
+        applyRecord(journal, header.item_id, header.kind,
+                    std::string((const char*) payload, header.payload_size));
+        pos += sizeof(header) + header.payload_size;
+    }
+
+    if (pos < size) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                            "%s: dropping %zu bytes of an incomplete record",
+                            path.c_str(), size - pos);
+        if (ftruncate(journal.fd, (off_t) pos) != 0) {
+            close(journal.fd);
+            journal.fd = -1;
+            journal.entries.clear();
+            return false;
+        }
+    }
+    journal.file_size = (long) pos;
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Run journal %s: %zu items to resume",
+                        path.c_str(), journal.entries.size());
+    return true;
+}
+
+bool journalItem(RunJournal& journal, int32_t item_id, JournalRecordKind kind,
+                 const std::string& payload) {
+    RecordHeader header = {};
+    header.payload_size = (uint32_t) payload.size();
+    header.item_id = item_id;
+    header.kind = kind;
+    header.crc = recordCrc(header, (const uint8_t*) payload.data());
+
+    std::vector<uint8_t> record(sizeof(header) + payload.size());
+    memcpy(record.data(), &header, sizeof(header));
+    memcpy(record.data() + sizeof(header), payload.data(), payload.size());
+
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    if (journal.fd < 0) {
+        return false;
+    }
+
+    if (pwrite(journal.fd, record.data(), record.size(), journal.file_size) != (ssize_t) record.size() ||
+        fdatasync(journal.fd) != 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Append to %s failed", journal.path.c_str());
+        return false;
+    }
+    journal.file_size += (long) record.size();
+
+    applyRecord(journal, item_id, kind, payload);
+    return true;
+}
+
+void closeRunJournal(RunJournal& journal) {
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    if (journal.fd >= 0) {
+        close(journal.fd);
+        journal.fd = -1;
+    }
+    journal.entries.clear();
+    journal.file_size = 0;
+}
+
+void discardRunJournal(RunJournal& journal) {
+    const std::string path = journal.path;
+    closeRunJournal(journal);
+    if (!path.empty()) {
+        unlink(path.c_str());
+    }
+}
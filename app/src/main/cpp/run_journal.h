@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// ================= Run journal =================
+// Append-only log of the items a long run (Run All) has finished, so a
+// cancelled or killed run resumes where it stopped. Each record is
+// written with pwrite + fdatasync as soon as its item completes and
+// carries its own CRC; a torn record at the end is cut off on open.
+//
+// Two record kinds per item: the raw engine result (formatResult) written
+// by the engine the moment the request finishes, and the memory deltas
+// the app measured around the native batch, written once that batch
+// returns. An item killed mid-batch resumes without the latter.
+
+enum JournalRecordKind : uint8_t {
+    JOURNAL_RESULT = 1,
+    JOURNAL_MEMORY = 2
+};
+
+struct JournalEntry {
+    std::string result;  // JOURNAL_RESULT payload
+    std::string memory;  // JOURNAL_MEMORY payload, empty if not written
+};
+
+struct RunJournal {
+    std::string path;
+    int fd = -1;
+    long file_size = 0;
+
+    std::mutex mutex;
+    std::map<int32_t, JournalEntry> entries;  // by item id
+};
+
+// Opens (or creates) the journal and replays the finished items
+bool openRunJournal(RunJournal& journal, const std::string& path);
+
+// Durable before returning true
+bool journalItem(RunJournal& journal, int32_t item_id, JournalRecordKind kind,
+                 const std::string& payload);
+
+void closeRunJournal(RunJournal& journal);
+
+// Close and delete: the run completed and its results are stored
+void discardRunJournal(RunJournal& journal);
@@ -0,0 +1,730 @@
+#include "scheduler.h"
+#include "argmax_sampler.h"
+#include "native-log.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+// log softmax(logits)[token], over the whole vocabulary
+static float tokenLogprob(const float* logits, int n_vocab, llama_token token) {
+    float max_logit = logits[0];
+    for (int i = 1; i < n_vocab; i++) {
+        max_logit = std::max(max_logit, logits[i]);
+    }
+    double sum = 0.0;
+    for (int i = 0; i < n_vocab; i++) {
+        sum += std::exp((double) (logits[i] - max_logit));
+    }
+    return logits[token] - max_logit - (float) std::log(sum);
+}
+
+static void addToBatch(llama_batch& batch,
+                       llama_token token,
+                       llama_pos pos,
+                       llama_seq_id seq_id,
+                       bool logits) {
+    const int i = batch.n_tokens;
+    batch.token[i] = token;
+    batch.pos[i] = pos;
+    batch.seq_id[i][0] = seq_id;
+    batch.n_seq_id[i] = 1;
+    batch.logits[i] = logits;
+    batch.n_tokens++;
+}
+
+void initScheduler(Scheduler& scheduler, Session* session) {
+    scheduler.session = session;
+    scheduler.batch = llama_batch_init(session->config.n_ubatch, 0, 1);
+    scheduler.sampler = initArgmaxSampler();
+    scheduler.end_of_turn = endOfTurnText(session->template_type);
+    scheduler.stop = false;
+
+    // Seq ids [0, n_interactive_seqs) are reserved for interactive requests
+    scheduler.n_interactive_seqs = std::max(0, std::min(session->config.n_interactive_seqs,
+                                                        session->config.n_seq_max - 1));
+    scheduler.free_seqs.clear();
+    scheduler.free_interactive_seqs.clear();
+    scheduler.seq_tokens.assign(session->config.n_seq_max, {});
+    scheduler.seq_adapter.assign(session->config.n_seq_max, -1);
+    scheduler.seq_adapter_from.assign(session->config.n_seq_max, 0);
+    llama_clear_adapter_lora(session->ctx);
+    scheduler.applied_adapter = -1;
+    scheduler.kv_archive = session->config.kv_archive_dir.empty()
+                           ? nullptr
+                           : openKvArchive(session->config.kv_archive_dir, session->model_path);
+    for (int s = session->config.n_seq_max - 1; s >= 0; s--) {
+        if (s < scheduler.n_interactive_seqs) {
+            scheduler.free_interactive_seqs.push_back(s);
+        } else {
+            scheduler.free_seqs.push_back(s);
+        }
+    }
+}
+
+static void schedulerLoop(Scheduler* scheduler) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(scheduler->mutex);
+            scheduler->cv_work.wait(lock, [scheduler] {
+                return scheduler->stop ||
+                       !scheduler->active.empty() ||
+                       !scheduler->waiting.empty() ||
+                       !scheduler->waiting_interactive.empty();
+            });
+            if (scheduler->stop) {
+                return;
+            }
+        }
+
+        stepScheduler(*scheduler);
+    }
+}
+
+void startScheduler(Scheduler& scheduler) {
+    scheduler.stop = false;
+    scheduler.worker = std::thread(schedulerLoop, &scheduler);
+}
+
+void freeScheduler(Scheduler& scheduler) {
+    if (scheduler.worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(scheduler.mutex);
+            scheduler.stop = true;
+        }
+        scheduler.cv_work.notify_all();
+        scheduler.worker.join();
+    }
+
+    closeKvArchive(scheduler.kv_archive);
+    scheduler.kv_archive = nullptr;
+
+    if (scheduler.sampler) {
+        llama_sampler_free(scheduler.sampler);
+        scheduler.sampler = nullptr;
+    }
+    if (scheduler.session) {
+        llama_batch_free(scheduler.batch);
+        scheduler.session = nullptr;
+    }
+    scheduler.waiting.clear();
+    scheduler.waiting_interactive.clear();
+    scheduler.active.clear();
+    scheduler.free_seqs.clear();
+    scheduler.free_interactive_seqs.clear();
+    scheduler.seq_tokens.clear();
+    scheduler.seq_adapter.clear();
+    scheduler.seq_adapter_from.clear();
+}
+
+void submitRequest(Scheduler& scheduler, Request* request) {
+    {
+        std::lock_guard<std::mutex> lock(scheduler.mutex);
+        request->state = RequestState::Queued;
+        request->t_submit = Clock::now();
+        if (request->priority == RequestPriority::Interactive) {
+            scheduler.waiting_interactive.push_back(request);
+        } else {
+            scheduler.waiting.push_back(request);
+        }
+    }
+    scheduler.cv_work.notify_one();
+}
+
+void waitForRequest(Scheduler& scheduler, Request* request) {
+    std::unique_lock<std::mutex> lock(scheduler.mutex);
+    scheduler.cv_done.wait(lock, [request] {
+        return request->state == RequestState::Done;
+    });
+}
+
+bool waitForOutput(Scheduler& scheduler, Request* request, size_t n_seen, std::string& delta) {
+    std::unique_lock<std::mutex> lock(scheduler.mutex);
+    scheduler.cv_done.wait(lock, [request, n_seen] {
+        return request->state == RequestState::Done || request->output.size() > n_seen;
+    });
+    if (request->output.size() > n_seen) {
+        delta.append(request->output, n_seen, std::string::npos);
+    }
+    return request->state == RequestState::Done;
+}
+
+// Caller holds scheduler.mutex
+static void finishRequest(Scheduler& scheduler, Request* request) {
+    if (request->seq_id >= 0) {
+        llama_memory_t mem = llama_get_memory(scheduler.session->ctx);
+        std::vector<llama_token>& cached = scheduler.seq_tokens[request->seq_id];
+        cached.clear();
+        scheduler.seq_adapter[request->seq_id] = request->adapter;
+        scheduler.seq_adapter_from[request->seq_id] = request->adapter_from;
+
+        // Keep the prompt, drop the generated tokens
+        const int n_keep = request->failed ? 0 : request->n_prefilled;
+        if (scheduler.session->config.prefix_cache && n_keep > 0 &&
+            llama_memory_seq_rm(mem, request->seq_id, n_keep, -1)) {
+            cached.assign(request->prompt_tokens.begin(),
+                          request->prompt_tokens.begin() + n_keep);
+        } else {
+            llama_memory_seq_rm(mem, request->seq_id, -1, -1);
+        }
+
+        if (request->seq_id < scheduler.n_interactive_seqs) {
+            scheduler.free_interactive_seqs.push_back(request->seq_id);
+        } else {
+            scheduler.free_seqs.push_back(request->seq_id);
+        }
+    }
+
+    request->state = RequestState::Done;
+    request->t_done = Clock::now();
+    request->i_batch = -1;
+}
+
+static int commonPrefix(const std::vector<llama_token>& a, const std::vector<llama_token>& b) {
+    size_t n = 0;
+    while (n < a.size() && n < b.size() && a[n] == b[n]) {
+        n++;
+    }
+    return (int) n;
+}
+
+// Number of leading positions two sequences computed with the same
+// weights: adapter a applies from position `from` on, -1 is the base model
+static int sameWeightsPrefix(int a1, int from1, int a2, int from2) {
+    const int f1 = a1 >= 0 ? from1 : INT_MAX;
+    const int f2 = a2 >= 0 ? from2 : INT_MAX;
+    if (a1 == a2 && f1 == f2) {
+        return INT_MAX;
+    }
+    return std::min(f1, f2);
+}
+
+// Pops the free slot whose cached prompt shares the longest prefix with
+// the request, trims the rest of that cache and returns the reusable length
+static int takeSlot(Scheduler& scheduler, Request* request, std::vector<llama_seq_id>& slots) {
+    size_t best = slots.size() - 1;
+    int n_best = 0;
+    for (size_t k = 0; k < slots.size(); k++) {
+        const llama_seq_id s = slots[k];
+        const int n = std::min(commonPrefix(scheduler.seq_tokens[s], request->prompt_tokens),
+                               sameWeightsPrefix(scheduler.seq_adapter[s],
+                                                 scheduler.seq_adapter_from[s],
+                                                 request->adapter, request->adapter_from));
+        if (n > n_best) {
+            best = k;
+            n_best = n;
+        }
+    }
+
+    request->seq_id = slots[best];
+    slots.erase(slots.begin() + best);
+
+    // The last prompt token is always decoded again for its logits
+    const int n_full = (int) request->prompt_tokens.size() - 1;
+    int n_reuse = std::min(n_best, n_full);
+
+    // Not cached in any slot: try the archived post-prefill state (the
+    // archive only holds base-model states)
+    KvArchive* archive = scheduler.kv_archive;
+    if (archive && request->adapter < 0 && n_reuse < n_full &&
+        hasSeqState(*archive, request->prompt_tokens)) {
+        request->kv_restored = restoreSeqState(*archive, scheduler.session->ctx,
+                                               request->seq_id, request->prompt_tokens);
+        n_reuse = request->kv_restored ? n_full : 0;
+    }
+
+    llama_memory_t mem = llama_get_memory(scheduler.session->ctx);
+    if (!llama_memory_seq_rm(mem, request->seq_id, n_reuse, -1)) {
+        // Partial removal unsupported (recurrent state): start over
+        llama_memory_seq_rm(mem, request->seq_id, -1, -1);
+        n_reuse = 0;
+    }
+    scheduler.seq_tokens[request->seq_id].clear();
+    scheduler.seq_adapter[request->seq_id] = -1;
+    return n_reuse;
+}
+
+// aLoRA: the adapter applies from the last occurrence of its invocation
+// sequence on, -1 when the prompt does not contain it
+static int invocationStart(const std::vector<llama_token>& prompt,
+                           const std::vector<llama_token>& invocation) {
+    for (int i = (int) prompt.size() - (int) invocation.size(); i >= 0; i--) {
+        if (std::equal(invocation.begin(), invocation.end(), prompt.begin() + i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Resolves Request::adapter_from; false for an unknown adapter
+static bool resolveAdapter(const Session* session, Request* request) {
+    request->adapter_from = 0;
+    if (request->adapter < 0) {
+        return true;
+    }
+    if (request->adapter >= (int) session->adapters.size()) {
+        return false;
+    }
+
+    const std::vector<llama_token>& invocation = session->adapters[request->adapter].invocation;
+    if (!invocation.empty()) {
+        const int start = invocationStart(request->prompt_tokens, invocation);
+        if (start < 0) {
+            // Never activated: the request is a plain base-model one
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                                "Request %d: aLoRA invocation not in prompt, using base model",
+                                request->id);
+            request->adapter = -1;
+        } else {
+            request->adapter_from = start;
+        }
+    }
+    return true;
+}
+
+// Adapter the request's next tokens are computed with
+static int nextTokensAdapter(const Request* request) {
+    if (request->state == RequestState::Prefill && request->n_prefilled < request->adapter_from) {
+        return -1;
+    }
+    return request->adapter;
+}
+
+// Runs on the stepping thread, between two llama_decode calls
+static void applyAdapter(Scheduler& scheduler, int adapter) {
+    if (adapter == scheduler.applied_adapter) {
+        return;
+    }
+
+    Session* session = scheduler.session;
+    if (scheduler.applied_adapter >= 0) {
+        llama_rm_adapter_lora(session->ctx, session->adapters[scheduler.applied_adapter].adapter);
+    }
+    if (adapter >= 0) {
+        const LoraAdapter& lora = session->adapters[adapter];
+        llama_set_adapter_lora(session->ctx, lora.adapter, lora.scale);
+    }
+    scheduler.applied_adapter = adapter;
+    scheduler.n_adapter_switches++;
+}
+
+// Caller holds scheduler.mutex. A fork is only worth waiting for when it
+// covers more than the slot already reuses.
+static void checkFork(Request* request) {
+    Request* parent = request->share_from;
+    if (!parent) {
+        return;
+    }
+    request->n_shared = std::min({request->n_shared,
+                                  commonPrefix(parent->prompt_tokens, request->prompt_tokens),
+                                  (int) request->prompt_tokens.size() - 1});
+    if (request->n_shared <= request->n_prefilled || parent->state == RequestState::Done) {
+        request->share_from = nullptr;
+    }
+}
+
+// Copies the shared prefix into the sequences of waiting requests whose
+// source has computed it. Runs on the stepping thread between two
+// llama_decode calls, so every counted prompt token is in the KV cache.
+static void forkShared(Scheduler& scheduler) {
+    llama_memory_t mem = llama_get_memory(scheduler.session->ctx);
+    for (Request* request : scheduler.active) {
+        Request* parent = request->share_from;
+        if (!parent || parent->state == RequestState::Queued) {
+            continue;
+        }
+        // A finished source may have lost its cells to the next request;
+        // the waiting request then prefills the prefix itself
+        if (parent->state == RequestState::Done ||
+            sameWeightsPrefix(parent->adapter, parent->adapter_from,
+                              request->adapter, request->adapter_from) < request->n_shared) {
+            request->share_from = nullptr;
+            continue;
+        }
+        if (parent->n_prefilled < request->n_shared) {
+            continue;
+        }
+
+        llama_memory_seq_rm(mem, request->seq_id, -1, -1);
+        llama_memory_seq_cp(mem, parent->seq_id, request->seq_id, 0, request->n_shared);
+        scheduler.n_cached_tokens += request->n_shared - request->n_cached;
+        scheduler.n_forked_tokens += request->n_shared;
+        request->n_prefilled = request->n_shared;
+        request->n_cached = request->n_shared;
+        request->n_forked = request->n_shared;
+        request->n_past = request->n_shared;
+        request->share_from = nullptr;
+    }
+}
+
+// Move queued requests into free sequence slots. Caller holds scheduler.mutex
+static void admitFrom(Scheduler& scheduler,
+                      std::deque<Request*>& queue,
+                      std::vector<llama_seq_id>& slots) {
+    const int n_ctx_seq = scheduler.session->config.n_ctx_seq;
+
+    while (!slots.empty() && !queue.empty()) {
+        Request* request = queue.front();
+        queue.pop_front();
+
+        const int n_prompt = (int) request->prompt_tokens.size();
+        if (n_prompt == 0 || n_prompt >= n_ctx_seq) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "Request %d rejected: %d prompt tokens (n_ctx_seq=%d)",
+                                request->id, n_prompt, n_ctx_seq);
+            request->failed = true;
+            finishRequest(scheduler, request);
+            continue;
+        }
+        if (!resolveAdapter(scheduler.session, request)) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "Request %d rejected: unknown adapter %d",
+                                request->id, request->adapter);
+            request->failed = true;
+            finishRequest(scheduler, request);
+            continue;
+        }
+
+        const int n_reuse = takeSlot(scheduler, request, slots);
+        request->state = RequestState::Prefill;
+        request->n_prefilled = n_reuse;
+        request->n_cached = n_reuse;
+        request->n_past = n_reuse;
+        checkFork(request);
+        scheduler.active.push_back(request);
+
+        scheduler.n_prompt_tokens += n_prompt;
+        scheduler.n_cached_tokens += n_reuse;
+    }
+}
+
+static void admitRequests(Scheduler& scheduler) {
+    // Interactive first: reserved slots, then any general slot left over
+    admitFrom(scheduler, scheduler.waiting_interactive, scheduler.free_interactive_seqs);
+    admitFrom(scheduler, scheduler.waiting_interactive, scheduler.free_seqs);
+    admitFrom(scheduler, scheduler.waiting, scheduler.free_seqs);
+}
+
+// Batch work is held back while an interactive request is in flight
+static bool isRunnable(const Request* request, bool interactive_active) {
+    return !interactive_active || request->priority == RequestPriority::Interactive;
+}
+
+bool stepScheduler(Scheduler& scheduler) {
+    {
+        std::lock_guard<std::mutex> lock(scheduler.mutex);
+        admitRequests(scheduler);
+    }
+    scheduler.cv_done.notify_all();
+
+    if (scheduler.active.empty()) {
+        return false;
+    }
+
+    Session* session = scheduler.session;
+    llama_batch& batch = scheduler.batch;
+    const int n_ubatch = session->config.n_ubatch;
+
+    forkShared(scheduler);
+
+    const bool interactive_active = std::any_of(
+            scheduler.active.begin(), scheduler.active.end(),
+            [](const Request* r) { return r->priority == RequestPriority::Interactive; });
+    if (interactive_active && scheduler.active.size() > 1) {
+        scheduler.n_preempted_steps++;
+    }
+
+    // ---- one adapter per step, chosen by the oldest runnable request ----
+    int adapter = -1;
+    for (const Request* request : scheduler.active) {
+        if (isRunnable(request, interactive_active)) {
+            adapter = nextTokensAdapter(request);
+            break;
+        }
+    }
+    applyAdapter(scheduler, adapter);
+
+    batch.n_tokens = 0;
+
+    // ---- decode tokens first: one per generating sequence ----
+    for (Request* request : scheduler.active) {
+        request->i_batch = -1;
+        if (request->state != RequestState::Decode || batch.n_tokens >= n_ubatch ||
+            !isRunnable(request, interactive_active) || nextTokensAdapter(request) != adapter) {
+            continue;
+        }
+        request->i_batch = batch.n_tokens;
+        addToBatch(batch, request->last_token, request->n_past, request->seq_id, true);
+        request->n_past++;
+    }
+
+    // ---- prefill chunks fill the remaining budget (FIFO) ----
+    for (Request* request : scheduler.active) {
+        if (request->state != RequestState::Prefill || request->share_from ||
+            !isRunnable(request, interactive_active) || nextTokensAdapter(request) != adapter) {
+            continue;
+        }
+
+        const int budget = n_ubatch - batch.n_tokens;
+        if (budget <= 0) {
+            break;
+        }
+
+        // An aLoRA prefill under the base model stops at the invocation
+        const int n_prompt = (int) request->prompt_tokens.size();
+        const int n_end = adapter != request->adapter ? request->adapter_from : n_prompt;
+        const int n_chunk = std::min(budget, n_end - request->n_prefilled);
+
+        if (request->n_prefilled == request->n_cached) {
+            request->t_prefill_start = Clock::now();
+        }
+
+        for (int k = 0; k < n_chunk; k++) {
+            const int i = request->n_prefilled + k;
+            // 🔑 logits only on LAST prompt token
+            const bool is_last = (i == n_prompt - 1);
+            if (is_last) {
+                request->i_batch = batch.n_tokens;
+            }
+            addToBatch(batch, request->prompt_tokens[i], request->n_past, request->seq_id, is_last);
+            request->n_past++;
+        }
+        request->n_prefilled += n_chunk;
+    }
+
+    // ================= Decode step =================
+    auto t_step_start = Clock::now();
+
+    if (llama_decode(session->ctx, batch) != 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "Scheduler step decode failed (%d tokens)", batch.n_tokens);
+        {
+            std::lock_guard<std::mutex> lock(scheduler.mutex);
+            for (Request* request : scheduler.active) {
+                request->failed = true;
+                finishRequest(scheduler, request);
+            }
+            scheduler.active.clear();
+        }
+        scheduler.cv_done.notify_all();
+        return true;
+    }
+
+    auto t_step_end = Clock::now();
+    const long step_ms = elapsedMs(t_step_start, t_step_end);
+    scheduler.n_steps++;
+    scheduler.max_step_ms = std::max(scheduler.max_step_ms, step_ms);
+
+    // Before sampling can finish a source request and release its cells
+    forkShared(scheduler);
+
+    // ================= Sample =================
+    std::unique_lock<std::mutex> lock(scheduler.mutex);
+
+    for (Request* request : scheduler.active) {
+        if (request->i_batch < 0) {
+            continue;
+        }
+
+        if (request->state == RequestState::Prefill) {
+            request->t_prefill_end = t_step_end;
+            request->state = RequestState::Decode;
+
+            // The sequence holds exactly the prompt until the first sample
+            if (scheduler.kv_archive && !request->kv_restored && request->adapter < 0) {
+                archiveSeqState(*scheduler.kv_archive, session->ctx, request->seq_id,
+                                request->prompt_tokens);
+            }
+        }
+
+        llama_token token = argmaxSample(scheduler.sampler, session->ctx, request->i_batch);
+
+        if (request->logprobs) {
+            const float logprob = tokenLogprob(llama_get_logits_ith(session->ctx, request->i_batch),
+                                               llama_vocab_n_tokens(session->vocab), token);
+            request->min_logprob = request->n_logprobs == 0 ? logprob
+                                                            : std::min(request->min_logprob, logprob);
+            request->sum_logprob += logprob;
+            request->n_logprobs++;
+        }
+
+        if (llama_vocab_is_eog(session->vocab, token)) {
+            request->stop_reason = StopReason::EndOfGeneration;
+            finishRequest(scheduler, request);
+            continue;
+        }
+
+        // ---- TTFT ----
+        if (!request->first_token_seen) {
+            request->ttft_ms = elapsedMs(request->t_submit, Clock::now());
+            request->first_token_seen = true;
+        }
+
+        // ---- token → text ----
+        std::string piece = tokenToPiece(session->vocab, token);
+        if (!piece.empty()) {
+            request->output.append(piece);
+
+            // Rule 1: stop at first newline (ONLY comma-separated list)
+            if (request->stop_at_newline && piece.find('\n') != std::string::npos) {
+                request->stop_reason = StopReason::Newline;
+                finishRequest(scheduler, request);
+                continue;
+            }
+
+            // End of turn spelled out as text, possibly over several pieces
+            if (!scheduler.end_of_turn.empty()) {
+                const size_t overlap = scheduler.end_of_turn.size() - 1;
+                const size_t eot = request->output.find(
+                        scheduler.end_of_turn,
+                        request->eot_scan > overlap ? request->eot_scan - overlap : 0);
+                request->eot_scan = request->output.size();
+                if (eot != std::string::npos) {
+                    request->output.resize(eot);
+                    request->stop_reason = StopReason::EndOfTurn;
+                    finishRequest(scheduler, request);
+                    continue;
+                }
+            }
+
+            if (request->stop_at_labels && labelListEnded(request->label_scan, request->output)) {
+                request->stop_reason = StopReason::LabelsComplete;
+                finishRequest(scheduler, request);
+                continue;
+            }
+        }
+
+        request->generated_tokens++;
+
+        if (request->generated_tokens >= request->max_tokens) {
+            request->stop_reason = StopReason::Budget;
+            finishRequest(scheduler, request);
+            continue;
+        }
+        if (request->n_past + 1 >= session->config.n_ctx_seq) {
+            request->stop_reason = StopReason::Context;
+            finishRequest(scheduler, request);
+            continue;
+        }
+
+        request->last_token = token;
+    }
+
+    scheduler.active.erase(
+            std::remove_if(scheduler.active.begin(), scheduler.active.end(),
+                           [](Request* r) { return r->state == RequestState::Done; }),
+            scheduler.active.end());
+
+    lock.unlock();
+    scheduler.cv_done.notify_all();
+
+    return true;
+}
+
+void sharePromptPrefix(Request* requests, int n) {
+    for (int k = 1; k < n; k++) {
+        // Trimmed to the common token prefix at admission
+        requests[k].share_from = &requests[0];
+        requests[k].n_shared = (int) requests[k].prompt_tokens.size();
+    }
+}
+
+void runUntilIdle(Scheduler& scheduler) {
+    while (stepScheduler(scheduler)) {
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG,
+                        "Scheduler idle: steps=%ld max_step_ms=%ld preempted_steps=%ld "
+                        "prefix_cache=%ld/%ld tokens (forked %ld) adapter_switches=%ld",
+                        scheduler.n_steps, scheduler.max_step_ms, scheduler.n_preempted_steps,
+                        scheduler.n_cached_tokens, scheduler.n_prompt_tokens,
+                        scheduler.n_forked_tokens, scheduler.n_adapter_switches);
+}
+
+// Caller holds scheduler.mutex
+static bool isIdle(const Scheduler& scheduler) {
+    return scheduler.active.empty() && scheduler.waiting.empty() &&
+           scheduler.waiting_interactive.empty();
+}
+
+bool savePrefixSnapshot(Scheduler& scheduler, const std::string& path) {
+    std::lock_guard<std::mutex> lock(scheduler.mutex);
+    if (!scheduler.session || !isIdle(scheduler)) {
+        return false;
+    }
+
+    llama_seq_id best = -1;
+    for (llama_seq_id s = 0; s < (llama_seq_id) scheduler.seq_tokens.size(); s++) {
+        if (!scheduler.seq_tokens[s].empty() && scheduler.seq_adapter[s] < 0 &&
+            (best < 0 || scheduler.seq_tokens[s].size() > scheduler.seq_tokens[best].size())) {
+            best = s;
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+
+    const std::vector<llama_token>& tokens = scheduler.seq_tokens[best];
+    const size_t n_bytes = llama_state_seq_save_file(scheduler.session->ctx, path.c_str(), best,
+                                                     tokens.data(), tokens.size());
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Prefix snapshot: %zu tokens, %zu bytes -> %s",
+                        tokens.size(), n_bytes, path.c_str());
+    return n_bytes > 0;
+}
+
+bool loadPrefixSnapshot(Scheduler& scheduler, const std::string& path) {
+    std::lock_guard<std::mutex> lock(scheduler.mutex);
+    if (!scheduler.session || !isIdle(scheduler) || scheduler.free_seqs.empty()) {
+        return false;
+    }
+
+    // An empty batch slot; interactive slots keep their own prefixes
+    const llama_seq_id seq_id = scheduler.free_seqs.back();
+    std::vector<llama_token> tokens(scheduler.session->config.n_ctx_seq);
+    size_t n_tokens = 0;
+
+    llama_memory_t mem = llama_get_memory(scheduler.session->ctx);
+    llama_memory_seq_rm(mem, seq_id, -1, -1);
+    if (llama_state_seq_load_file(scheduler.session->ctx, path.c_str(), seq_id,
+                                  tokens.data(), tokens.size(), &n_tokens) == 0) {
+        // Missing, from another model or larger than a slot
+        llama_memory_seq_rm(mem, seq_id, -1, -1);
+        scheduler.seq_tokens[seq_id].clear();
+        return false;
+    }
+
+    tokens.resize(n_tokens);
+    scheduler.seq_tokens[seq_id] = std::move(tokens);
+    scheduler.seq_adapter[seq_id] = -1;
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Prefix snapshot restored: %zu tokens in seq %d",
+                        n_tokens, seq_id);
+    return true;
+}
+
+std::string formatResult(const Request& request) {
+    long itps = -1;
+    long otps = -1;
+    long oet_ms = -1;
+    long latency_ms = elapsedMs(request.t_submit, request.t_done);
+
+    if (!request.failed && request.n_prefilled > 0) {
+        // Only tokens actually run through the model count towards ITPS
+        long prefill_ms = elapsedMs(request.t_prefill_start, request.t_prefill_end);
+        if (prefill_ms > 0) {
+            itps = ((request.n_prefilled - request.n_cached) * 1000L) / prefill_ms;
+        }
+
+        long gen_ms = elapsedMs(request.t_prefill_end, request.t_done);
+        if (gen_ms > 0) {
+            otps = (request.generated_tokens * 1000L) / gen_ms;
+        }
+        oet_ms = gen_ms;
+    }
+
+    return "TTFT_MS=" + std::to_string(request.ttft_ms) +
+           ";ITPS=" + std::to_string(itps) +
+           ";OTPS=" + std::to_string(otps) +
+           ";OET_MS=" + std::to_string(oet_ms) +
+           ";LAT_MS=" + std::to_string(latency_ms) +
+           ";STOP=" + stopReasonName(request.stop_reason) +
+           "|" + request.output;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "engine.h"
+#include "kv_archive.h"
+#include "stop_controller.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ================= Request =================
+enum class RequestPriority {
+    Interactive,  // a single item the user is looking at
+    Batch         // background Run All / dataset work
+};
+
+enum class RequestState {
+    Queued,   // waiting for a free sequence slot
+    Prefill,  // prompt is being ingested chunk by chunk
+    Decode,   // generating one token per scheduler step
+    Done
+};
+
+struct Request {
+    int id = 0;
+    std::vector<llama_token> prompt_tokens;
+    int max_tokens = 32;
+    RequestPriority priority = RequestPriority::Batch;
+    bool stop_at_newline = true;  // the allergen answer is a single line
+    bool stop_at_labels = true;   // ... and ends with its label list (labelListEnded)
+    int adapter = -1;          // Session::adapters index, -1 = base model
+    bool logprobs = false;     // track the sampled tokens' log-probabilities
+
+    // Prompt forking: the first n_shared prompt tokens are copied from
+    // share_from's sequence (llama_memory_seq_cp) once it has computed
+    // them instead of being prefilled again. share_from must be submitted
+    // first and outlive the fork; the scheduler clears it when the fork is
+    // done or cannot happen, and the request then prefills them itself.
+    Request* share_from = nullptr;
+    int n_shared = 0;
+
+    RequestState state = RequestState::Queued;
+    llama_seq_id seq_id = -1;
+    int n_prefilled = 0;       // prompt tokens already in the KV cache
+    int n_cached = 0;          // of which reused from the prefix cache or forked
+    int n_forked = 0;          // of which copied from share_from
+    bool kv_restored = false;  // prompt state came from the KV archive
+    int adapter_from = 0;      // first prompt token computed with the adapter (aLoRA)
+    llama_pos n_past = 0;      // next position in this sequence
+    llama_token last_token = -1;
+    int i_batch = -1;          // logits row in the current step, -1 = none
+
+    std::string output;
+    int generated_tokens = 0;
+    bool failed = false;
+    StopReason stop_reason = StopReason::None;
+    LabelScan label_scan;
+    size_t eot_scan = 0;       // output bytes already searched for the end-of-turn text
+
+    // With logprobs: over every sampled token, end of generation included
+    float sum_logprob = 0.0f;
+    float min_logprob = 0.0f;
+    int n_logprobs = 0;
+
+    // Timing
+    Clock::time_point t_submit;
+    Clock::time_point t_prefill_start;
+    Clock::time_point t_prefill_end;
+    Clock::time_point t_done;
+    bool first_token_seen = false;
+    long ttft_ms = -1;
+};
+
+// ================= Scheduler =================
+// Continuous batching over one Session. Each step packs one decode token
+// for every generating sequence, then fills the remaining n_ubatch budget
+// with prefill chunks, so a long prompt never stalls the other sequences
+// for more than one bounded llama_decode.
+//
+// Interactive requests jump the queue and own the first
+// n_interactive_seqs sequence slots. While one is in flight, batch
+// sequences are left out of the step (their KV cells stay untouched) and
+// continue where they stopped once the interactive request finishes.
+//
+// With EngineConfig::prefix_cache a finished request leaves its prompt in
+// the slot. A new request takes the free slot sharing the longest prefix
+// with it and only prefills the rest - every allergen prompt starts with
+// the same instruction block. With EngineConfig::kv_archive_dir prompts
+// the cache cannot serve are restored from the KV archive when present.
+//
+// LoRA adapters apply to the whole context, so every step runs under one
+// adapter: the oldest runnable request picks it and only requests whose
+// next tokens use the same weights join the step. Slots remember which
+// adapter computed their cached prompt and only the part computed with
+// the same weights is reused; for an aLoRA that includes the base-model
+// prefix in front of its invocation sequence.
+//
+// Requests submitted together that share a prompt prefix (one item asked
+// in several prompt styles, prompt_styles.h) can fork instead: they hold
+// their slot without prefilling until the first one has computed the
+// shared part, then take its KV cells into their own sequence. The
+// unified KV cache stores those cells once.
+struct Scheduler {
+    Session* session = nullptr;
+    llama_batch batch{};
+    llama_sampler* sampler = nullptr;  // initArgmaxSampler, sampled with argmaxSample
+    std::string end_of_turn;           // endOfTurnText() of the session's template
+
+    // Guarded by mutex: queues, free slots and request states
+    std::mutex mutex;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+    std::deque<Request*> waiting_interactive;
+    std::deque<Request*> waiting;
+    std::vector<llama_seq_id> free_seqs;
+    std::vector<llama_seq_id> free_interactive_seqs;
+    int n_interactive_seqs = 0;  // config.n_interactive_seqs clamped to n_seq_max - 1
+
+    // Prompt tokens left in each idle slot, indexed by seq id, and the
+    // adapter that computed them from seq_adapter_from on (-1 = base model)
+    std::vector<std::vector<llama_token>> seq_tokens;
+    std::vector<int> seq_adapter;
+    std::vector<int> seq_adapter_from;
+
+    // Owned by the stepping thread: adapter currently set on the context
+    int applied_adapter = -1;
+
+    // Owned; set when EngineConfig::kv_archive_dir is
+    KvArchive* kv_archive = nullptr;
+
+    // Owned by the stepping thread
+    std::vector<Request*> active;
+
+    // Background worker (optional, see startScheduler)
+    std::thread worker;
+    bool stop = false;
+
+    // Step statistics
+    long n_steps = 0;
+    long max_step_ms = 0;
+    long n_preempted_steps = 0;
+    long n_prompt_tokens = 0;
+    long n_cached_tokens = 0;
+    long n_forked_tokens = 0;
+    long n_adapter_switches = 0;
+};
+
+void initScheduler(Scheduler& scheduler, Session* session);
+void freeScheduler(Scheduler& scheduler);
+
+// Run steps on a background thread until freeScheduler
+void startScheduler(Scheduler& scheduler);
+
+void submitRequest(Scheduler& scheduler, Request* request);
+
+// Blocks until the request is Done (requires startScheduler)
+void waitForRequest(Scheduler& scheduler, Request* request);
+
+// Streaming: blocks until the request has text beyond the first n_seen
+// bytes of its output or is Done, and appends the new text to delta.
+// Returns true once the request is Done.
+bool waitForOutput(Scheduler& scheduler, Request* request, size_t n_seen, std::string& delta);
+
+// Runs one llama_decode. Returns false when there is no work left.
+bool stepScheduler(Scheduler& scheduler);
+
+// Lets requests[1..n) fork the prompt prefix they share with requests[0]
+// (Request::share_from). Call after tokenising; the requests must be
+// submitted in order and stay alive until all are done.
+void sharePromptPrefix(Request* requests, int n);
+
+// Synchronous driver for callers without a worker thread
+void runUntilIdle(Scheduler& scheduler);
+
+// Prefix snapshots (llama_state_seq_save_file): the idle slot holding the
+// longest cached base-model prompt is written to path with its tokens. Loading puts it
+// back into a free batch slot, so after a restart the first request sharing
+// that prefix skips its prefill. Both return false while requests are in
+// flight - the KV cache is only touched when the worker is not decoding.
+bool savePrefixSnapshot(Scheduler& scheduler, const std::string& path);
+bool loadPrefixSnapshot(Scheduler& scheduler, const std::string& path);
+
+// TTFT_MS=<val>;ITPS=<val>;OTPS=<val>;OET_MS=<val>;LAT_MS=<val>|<output>
+std::string formatResult(const Request& request);
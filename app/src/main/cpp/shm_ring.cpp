@@ -0,0 +1,148 @@
+#include "shm_ring.h"
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static size_t align4(size_t n) {
+    return (n + 3) & ~(size_t) 3;
+}
+
+// memfd_create is only in bionic from API 30; the syscall exists on every
+// kernel the app supports
+static int createMemfd(const char* name) {
+    return (int) syscall(__NR_memfd_create, name, 1u /* MFD_CLOEXEC */);
+}
+
+static bool mapRing(ShmRing& ring, int fd, size_t map_size) {
+    void* addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    ring.fd = fd;
+    ring.map_size = map_size;
+    ring.header = static_cast<ShmRingHeader*>(addr);
+    ring.data = static_cast<uint8_t*>(addr) + align4(sizeof(ShmRingHeader));
+    return true;
+}
+
+bool createShmRing(ShmRing& ring, uint32_t capacity, const char* name) {
+    capacity = (uint32_t) align4(capacity);
+    const size_t map_size = align4(sizeof(ShmRingHeader)) + capacity;
+
+    int fd = createMemfd(name);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, (off_t) map_size) != 0 || !mapRing(ring, fd, map_size)) {
+        close(fd);
+        return false;
+    }
+
+    ring.header->magic = RING_MAGIC;
+    ring.header->capacity = capacity;
+    ring.capacity = capacity;
+    ring.header->head.store(0, std::memory_order_relaxed);
+    ring.header->tail.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+bool mapShmRing(ShmRing& ring, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ShmRingHeader) ||
+        !mapRing(ring, fd, (size_t) st.st_size)) {
+        close(fd);
+        return false;
+    }
+
+    const uint32_t capacity = ring.header->capacity;
+    if (ring.header->magic != RING_MAGIC || capacity < 8 || capacity % 4 != 0 ||
+        align4(sizeof(ShmRingHeader)) + capacity > ring.map_size) {
+        closeShmRing(ring);
+        return false;
+    }
+    ring.capacity = capacity;
+    return true;
+}
+
+void closeShmRing(ShmRing& ring) {
+    if (ring.header) {
+        munmap(ring.header, ring.map_size);
+    }
+    if (ring.fd >= 0) {
+        close(ring.fd);
+    }
+    ring = ShmRing();
+}
+
+bool ringPush(ShmRing& ring, const std::string& message) {
+    const uint64_t capacity = ring.capacity;
+    const uint64_t head = ring.header->head.load(std::memory_order_relaxed);
+    const uint64_t tail = ring.header->tail.load(std::memory_order_acquire);
+
+    const uint64_t record = 4 + align4(message.size());
+    const uint64_t pos = head % capacity;
+    const uint64_t to_end = capacity - pos;
+    const uint64_t skip = to_end < record ? to_end : 0;
+
+    if (head - tail > capacity || pos % 4 != 0 || record > capacity || skip + record > capacity - (head - tail)) {
+        return false;
+    }
+
+    uint64_t write_pos = pos;
+    if (skip > 0) {
+        const uint32_t wrap = RING_WRAP;
+        memcpy(ring.data + pos, &wrap, 4);
+        write_pos = 0;
+    }
+
+    const uint32_t length = (uint32_t) message.size();
+    memcpy(ring.data + write_pos, &length, 4);
+    memcpy(ring.data + write_pos + 4, message.data(), message.size());
+
+    ring.header->head.store(head + skip + record, std::memory_order_release);
+    return true;
+}
+
+bool ringPop(ShmRing& ring, std::string& message) {
+    const uint64_t capacity = ring.capacity;
+    uint64_t tail = ring.header->tail.load(std::memory_order_relaxed);
+    const uint64_t head = ring.header->head.load(std::memory_order_acquire);
+
+    if (tail == head) {
+        return false;
+    }
+
+    // Both counters live in memory the other process can write: every
+    // length is checked against what was published and against the end of
+    // the data area before anything is read
+    uint64_t available = head - tail;
+    uint64_t pos = tail % capacity;
+    bool valid = available <= capacity && available >= 4 && pos % 4 == 0;
+
+    uint32_t length = 0;
+    if (valid) {
+        memcpy(&length, ring.data + pos, 4);
+        if (length == RING_WRAP) {
+            const uint64_t skip = capacity - pos;
+            valid = skip + 4 <= available;
+            tail += skip;
+            available -= skip;
+            pos = 0;
+            if (valid) {
+                memcpy(&length, ring.data, 4);
+            }
+        }
+    }
+    const uint64_t record = 4 + align4(length);
+    if (!valid || length == RING_WRAP || record > capacity - pos || record > available) {
+        // Corrupt ring: drop everything rather than read out of bounds
+        ring.header->tail.store(head, std::memory_order_release);
+        return false;
+    }
+
+    message.assign(reinterpret_cast<const char*>(ring.data + pos + 4), length);
+    ring.header->tail.store(tail + record, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ================= Shared-memory ring =================
+// Single-producer / single-consumer byte ring in a memfd mapping, shared
+// between the app and the inference daemon. Messages are framed as
+// [u32 length][payload] on 4-byte boundaries; a length of RING_WRAP means
+// "continue at offset 0". head/tail only ever grow, the position is
+// offset % capacity.
+
+constexpr uint32_t RING_MAGIC = 0x534c4d52;  // "SLMR"
+constexpr uint32_t RING_WRAP = 0xFFFFFFFFu;
+
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t capacity;
+    std::atomic<uint64_t> head;  // written by the producer
+    std::atomic<uint64_t> tail;  // written by the consumer
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "ring counters must be lock-free to live in shared memory");
+
+struct ShmRing {
+    int fd = -1;
+    ShmRingHeader* header = nullptr;
+    uint8_t* data = nullptr;
+    size_t map_size = 0;
+    uint32_t capacity = 0;  // validated copy: the header is writable by the peer
+};
+
+// Creates and maps a new ring; capacity is rounded up to a multiple of 4
+bool createShmRing(ShmRing& ring, uint32_t capacity, const char* name);
+
+// Maps a ring received from the other process (takes ownership of fd)
+bool mapShmRing(ShmRing& ring, int fd);
+
+void closeShmRing(ShmRing& ring);
+
+// false when the message does not fit right now (or can never fit)
+bool ringPush(ShmRing& ring, const std::string& message);
+
+// false when the ring is empty; a record that does not fit the ring
+// (corrupt or hostile peer) empties it
+bool ringPop(ShmRing& ring, std::string& message);
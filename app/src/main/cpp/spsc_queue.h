@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// ================= SPSC queue =================
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread. push() blocks while the queue is full (backpressure),
+// pop() blocks while it is empty and returns false once the producer has
+// called close() and everything was drained.
+
+inline void spscBackoff(int& spins) {
+    if (spins < 64) {
+        spins++;
+    } else if (spins < 128) {
+        spins++;
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+template <typename T>
+struct SpscQueue {
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    // Moves from value only on success
+    bool tryPush(T& value) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail_cache > mask) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h - tail_cache > mask) {
+                return false;
+            }
+        }
+        slots[h & mask] = std::move(value);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head_cache) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (t == head_cache) {
+                return false;
+            }
+        }
+        out = std::move(slots[t & mask]);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(T value) {
+        int spins = 0;
+        while (!tryPush(value)) {
+            spscBackoff(spins);
+        }
+    }
+
+    bool pop(T& out) {
+        int spins = 0;
+        while (!tryPop(out)) {
+            if (isClosed()) {
+                // Everything pushed before close() is visible now
+                return tryPop(out);
+            }
+            spscBackoff(spins);
+        }
+        return true;
+    }
+
+    // Producer side: no more items will follow
+    void close() {
+        closed.store(true, std::memory_order_release);
+    }
+
+    bool isClosed() const {
+        return closed.load(std::memory_order_acquire);
+    }
+
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    // Producer and consumer counters on separate cache lines
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tail_cache = 0;   // producer's view of tail
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t head_cache = 0;   // consumer's view of head
+    alignas(64) std::atomic<bool> closed{false};
+};
@@ -0,0 +1,96 @@
+#include "stop_controller.h"
+#include "engine.h"
+#include <cctype>
+
+const char* stopReasonName(StopReason reason) {
+    switch (reason) {
+        case StopReason::EndOfGeneration: return "eog";
+        case StopReason::Newline: return "newline";
+        case StopReason::EndOfTurn: return "eot";
+        case StopReason::LabelsComplete: return "labels";
+        case StopReason::Budget: return "budget";
+        case StopReason::Context: return "ctx";
+        default: return "none";
+    }
+}
+
+const char* endOfTurnText(int template_type) {
+    switch (template_type) {
+        case 0: return "<|im_end|>";
+        case 1: return "<end_of_turn>";
+        case 2: return "<|eot_id|>";
+        case 3: return "<|end|>";
+        default: return "";
+    }
+}
+
+// ================= Label lists =================
+// Longer than any label or alias, "tree nuts" included; a lead-in such as
+// "contains milk" still fits
+static constexpr size_t MAX_ITEM_CHARS = 32;
+static constexpr int MAX_ITEM_WORDS = 4;
+
+static bool itemTooLong(const std::string& item) {
+    if (item.size() > MAX_ITEM_CHARS) {
+        return true;
+    }
+    int n_words = 0;
+    for (size_t i = 0; i < item.size(); i++) {
+        n_words += item[i] != ' ' && (i == 0 || item[i - 1] == ' ');
+    }
+    return n_words > MAX_ITEM_WORDS;
+}
+
+static void closeItem(LabelScan& scan) {
+    size_t start = scan.item.find_first_not_of(' ');
+    size_t end = scan.item.find_last_not_of(' ');
+    const std::string item = start == std::string::npos ? ""
+                                                        : scan.item.substr(start, end - start + 1);
+    scan.none = scan.none || item == "none";
+    scan.mask |= parsePredictedAllergens(item);
+    scan.item.clear();
+}
+
+static bool hasLabel(const LabelScan& scan) {
+    return scan.mask != 0 || scan.none || parsePredictedAllergens(scan.item) != 0;
+}
+
+bool labelListEnded(LabelScan& scan, const std::string& output) {
+    constexpr AllergenMask ALL = (AllergenMask) ((1u << N_ALLERGENS) - 1);
+    for (; scan.pos < output.size(); scan.pos++) {
+        const unsigned char c = (unsigned char) tolower((unsigned char) output[scan.pos]);
+        if (scan.depth > 0) {
+            scan.depth += (c == '(') - (c == ')');
+            continue;
+        }
+        if (c == '(') {
+            scan.depth++;
+        } else if (c == ',' || c == ';') {
+            closeItem(scan);
+        } else if (isalpha(c) || c == ' ' || c == '-' || c == '\'' || c == '&' || c == '/' ||
+                   c >= 0x80) {
+            scan.item += (char) c;
+            // Prose after the list
+            if (itemTooLong(scan.item) && hasLabel(scan)) {
+                return true;
+            }
+        } else {
+            // A lead-in ("Allergens:") ends without labels and is skipped
+            closeItem(scan);
+            if (scan.mask != 0 || scan.none) {
+                return true;
+            }
+        }
+    }
+    return (AllergenMask) (scan.mask | parsePredictedAllergens(scan.item)) == ALL;
+}
+
+int labelAnswerBudget(const llama_vocab* vocab) {
+    static const char* const LONGEST =
+            " Allergens: milk, eggs, peanuts, tree nuts, wheat, soya, fish, shellfish, crustaceans,"
+            " sesame";
+    // Details such as "milk (whey, butter)" or "wheat (gluten)"
+    static const int DETAILS_TOKENS = 24;
+    // + the newline or end of turn, and one token of slack
+    return (int) tokenize(vocab, LONGEST, false).size() + DETAILS_TOKENS + 2;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "allergens.h"
+#include "llama/llama.h"
+#include <cstdint>
+#include <string>
+
+// ================= Stop controller =================
+// An allergen answer is one short label list. Generation ends at the
+// first point where it is complete rather than at a fixed token count:
+// end of generation, a newline, the template's end-of-turn text written
+// out as plain text, or a complete label list followed by something that
+// cannot continue it ("milk, wheat. The product..."). max_tokens only cuts
+// runaway generations and is never below a full answer (labelAnswerBudget).
+enum class StopReason : uint8_t {
+    None,
+    EndOfGeneration,  // an end-of-generation token
+    Newline,
+    EndOfTurn,        // end-of-turn text, cut from the output
+    LabelsComplete,
+    Budget,           // max_tokens
+    Context           // n_ctx_seq
+};
+
+// Short name for the STOP= result metric: "eog", "newline", "eot", ...
+const char* stopReasonName(StopReason reason);
+
+// The chat template's end-of-turn marker ("<|im_end|>", ...), "" when the
+// template has none (TEMPLATE_TUNED)
+const char* endOfTurnText(int template_type);
+
+// Incremental scan of the generated text as a comma-separated label list.
+// Parenthesised details ("milk (whey)") belong to the list; ".", ":",
+// digits, markup or an item too long to be a label end it.
+struct LabelScan {
+    size_t pos = 0;         // output bytes consumed
+    int depth = 0;          // open parentheses
+    std::string item;       // current item, lower-cased
+    AllergenMask mask = 0;  // labels of the finished items
+    bool none = false;      // a finished "none" item
+};
+
+// Consumes the new output; true once a list with at least one label (or
+// "none") has ended, or every label has been named
+bool labelListEnded(LabelScan& scan, const std::string& output);
+
+// Tokens of a long label-list answer in this vocab: a lead-in, every
+// label in a long spelling, an allowance for bracketed details and the
+// line end
+int labelAnswerBudget(const llama_vocab* vocab);
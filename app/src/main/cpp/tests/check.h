@@ -0,0 +1,38 @@
+#pragma once
+
+// Minimal assertions for the host unit tests (ctest after a host build).
+// A failed CHECK reports and carries on; main returns checkResult().
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+inline int& checkFailures() {
+    static int n_failed = 0;
+    return n_failed;
+}
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+                    #cond);                                                  \
+            checkFailures()++;                                               \
+        }                                                                    \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
+inline int checkResult() {
+    if (checkFailures() > 0) {
+        fprintf(stderr, "%d check(s) failed\n", checkFailures());
+        return 1;
+    }
+    return 0;
+}
+
+// Scratch path under TMPDIR, removed by the caller
+inline std::string tempPath(const char* name) {
+    const char* dir = getenv("TMPDIR");
+    return std::string(dir && *dir ? dir : "/tmp") + "/" + name;
+}
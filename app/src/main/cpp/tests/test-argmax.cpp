@@ -0,0 +1,73 @@
+// Vectorised argmax against the scalar reference, ties included
+#include "../argmax_sampler.h"
+#include "check.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+static void checkBoth(const std::vector<float>& logits, int expected) {
+    const int n = (int) logits.size();
+    CHECK_EQ(argmaxLogitsScalar(logits.data(), n), expected);
+    CHECK_EQ(argmaxLogits(logits.data(), n), expected);
+}
+
+// Every length around the vector widths, so each tail size is covered
+static void testRandomRows() {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0.0f, 4.0f);
+    for (int n = 1; n <= 80; n++) {
+        for (int round = 0; round < 20; round++) {
+            std::vector<float> logits(n);
+            for (float& v : logits) {
+                v = dist(rng);
+            }
+            CHECK_EQ(argmaxLogits(logits.data(), n), argmaxLogitsScalar(logits.data(), n));
+        }
+    }
+    // A real vocabulary row (Qwen 2.5)
+    std::vector<float> logits(152064);
+    for (float& v : logits) {
+        v = dist(rng);
+    }
+    CHECK_EQ(argmaxLogits(logits.data(), (int) logits.size()),
+             argmaxLogitsScalar(logits.data(), (int) logits.size()));
+}
+
+// Ties go to the lowest index, wherever the copies fall in the lanes
+static void testTies() {
+    for (int n = 1; n <= 80; n++) {
+        checkBoth(std::vector<float>(n, 1.5f), 0);
+        for (int first = 0; first < n; first++) {
+            for (int second = first; second < n; second += 3) {
+                std::vector<float> logits(n, -2.0f);
+                logits[first] = 7.0f;
+                logits[second] = 7.0f;
+                checkBoth(logits, first);
+            }
+        }
+    }
+    // Same lane, different vector steps
+    std::vector<float> logits(64, 0.0f);
+    logits[37] = 3.0f;
+    logits[5] = 3.0f;
+    logits[53] = 3.0f;
+    checkBoth(logits, 5);
+}
+
+// Masked-out tokens (-inf) and a single allowed token
+static void testInfinity() {
+    const float inf = INFINITY;
+    for (int n = 1; n <= 40; n++) {
+        std::vector<float> logits(n, -inf);
+        checkBoth(logits, 0);
+        logits[n - 1] = -1000.0f;
+        checkBoth(logits, n - 1);
+    }
+}
+
+int main() {
+    testRandomRows();
+    testTies();
+    testInfinity();
+    return checkResult();
+}
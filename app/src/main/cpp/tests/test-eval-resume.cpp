@@ -0,0 +1,104 @@
+// Checkpoint round trip and where slm-eval --resume continues
+#include "../evaluator.h"
+#include "check.h"
+#include <cstdio>
+#include <unistd.h>
+
+static EvalCheckpoint sampleCheckpoint() {
+    EvalCheckpoint checkpoint;
+    checkpoint.model_path = "a.gguf";
+    checkpoint.dataset_path = "items.jsonl";
+    checkpoint.n_done = 1000;
+    checkpoint.out_offset = 123456;
+    checkpoint.n_failed = 2;
+    checkpoint.score.add(1, 1);  // milk, correct
+    return checkpoint;
+}
+
+static void testRoundTrip() {
+    const std::string path = tempPath("test-eval-resume.ckpt");
+    EvalCheckpoint saved = sampleCheckpoint();
+    saved.complete = true;
+    saved.compression = 1;
+    CHECK(saveCheckpoint(path, saved));
+
+    EvalCheckpoint loaded;
+    CHECK(loadCheckpoint(path, loaded));
+    CHECK_EQ(loaded.model_path, saved.model_path);
+    CHECK_EQ(loaded.dataset_path, saved.dataset_path);
+    CHECK_EQ(loaded.n_done, saved.n_done);
+    CHECK(loaded.complete);
+    CHECK_EQ(loaded.out_offset, saved.out_offset);
+    CHECK_EQ(loaded.n_failed, saved.n_failed);
+    CHECK_EQ(loaded.compression, 1);
+    CHECK_EQ(loaded.score.n_samples, 1);
+    CHECK_EQ(loaded.score.n_exact, 1);
+    unlink(path.c_str());
+}
+
+static void testResumeMidModel() {
+    const std::vector<std::string> models = {"a.gguf", "b.gguf"};
+    size_t first_model = 99;
+    EvalCheckpoint resume;
+    std::string error;
+    CHECK(resumeEvaluation(sampleCheckpoint(), "items.jsonl", 0, models, first_model, resume, error));
+    CHECK_EQ(first_model, 0u);
+    CHECK_EQ(resume.n_done, 1000);
+    CHECK_EQ(resume.out_offset, 123456);
+    CHECK_EQ(resume.score.n_samples, 1);
+}
+
+// A complete checkpoint starts the next model from scratch but must not
+// truncate what the finished model wrote
+static void testResumeAfterComplete() {
+    const std::vector<std::string> models = {"a.gguf", "b.gguf"};
+    EvalCheckpoint checkpoint = sampleCheckpoint();
+    checkpoint.complete = true;
+    checkpoint.compression = 1;
+
+    size_t first_model = 0;
+    EvalCheckpoint resume;
+    std::string error;
+    CHECK(resumeEvaluation(checkpoint, "items.jsonl", 1, models, first_model, resume, error));
+    CHECK_EQ(first_model, 1u);
+    CHECK_EQ(resume.compression, 1);
+    CHECK_EQ(resume.n_done, 0);
+    CHECK(!resume.complete);
+    CHECK_EQ(resume.n_failed, 0);
+    CHECK_EQ(resume.score.n_samples, 0);
+    CHECK_EQ(resume.out_offset, 123456);
+
+    // Last model complete: nothing left to run, output still kept
+    checkpoint.model_path = "b.gguf";
+    CHECK(resumeEvaluation(checkpoint, "items.jsonl", 1, models, first_model, resume, error));
+    CHECK_EQ(first_model, 2u);
+    CHECK_EQ(resume.out_offset, 123456);
+}
+
+static void testResumeMismatch() {
+    const std::vector<std::string> models = {"a.gguf"};
+    size_t first_model = 0;
+    EvalCheckpoint resume;
+    std::string error;
+    CHECK(!resumeEvaluation(sampleCheckpoint(), "other.jsonl", 0, models, first_model, resume, error));
+    CHECK(!error.empty());
+
+    error.clear();
+    CHECK(!resumeEvaluation(sampleCheckpoint(), "items.jsonl", 0, {"c.gguf"}, first_model, resume,
+                            error));
+    CHECK(!error.empty());
+
+    // Items already scored without compression must not be continued with it
+    error.clear();
+    CHECK(!resumeEvaluation(sampleCheckpoint(), "items.jsonl", 2, models, first_model, resume,
+                            error));
+    CHECK(!error.empty());
+}
+
+int main() {
+    testRoundTrip();
+    testResumeMidModel();
+    testResumeAfterComplete();
+    testResumeMismatch();
+    return checkResult();
+}
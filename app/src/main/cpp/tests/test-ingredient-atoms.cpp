@@ -0,0 +1,94 @@
+// Ingredient atom parsing, the atom cache file and prompt compression
+#include "../ingredient_atoms.h"
+#include "check.h"
+#include <unistd.h>
+
+using Atoms = std::vector<std::string>;
+
+static void testParse() {
+    CHECK(parseIngredientAtoms("chocolate (sugar, cocoa butter, milk powder)") ==
+          (Atoms{"chocolate", "sugar", "cocoa butter", "milk powder"}));
+    // Quantities, emphasis and sentence dots
+    CHECK(parseIngredientAtoms("Wheat Flour 45%, _MILK_, *salt.") ==
+          (Atoms{"wheat flour", "milk", "salt"}));
+    // A decimal point does not split
+    CHECK(parseIngredientAtoms("salt 2.5%, pepper") == (Atoms{"salt", "pepper"}));
+    // Unique, in order of appearance
+    CHECK(parseIngredientAtoms("milk; Milk [MILK], egg") == (Atoms{"milk", "egg"}));
+    // Stop atoms and leading conjunctions
+    CHECK(parseIngredientAtoms("Ingredients: water, and sugar, may contain: nuts") ==
+          (Atoms{"water", "sugar", "nuts"}));
+    // Nested brackets
+    CHECK(parseIngredientAtoms("King Prawn (86%) (King Prawn (Penaeus vannamei) (Crustacean), Salt)") ==
+          (Atoms{"king prawn", "penaeus vannamei", "crustacean", "salt"}));
+    CHECK(parseIngredientAtoms("").empty());
+    CHECK(parseIngredientAtoms("*, 10%, ()").empty());
+}
+
+static void testCache() {
+    const std::string path = tempPath("test-atom-cache.slac");
+    unlink(path.c_str());
+
+    AtomCache cache;
+    CHECK(openAtomCache(cache, path));
+    CHECK(storeAtom(cache, "milk powder", 0x0004));
+    CHECK(storeAtom(cache, "salt", 0));
+    CHECK(storeAtom(cache, "salt", 0x0001));  // later record wins
+    closeAtomCache(cache);
+    CHECK(cache.masks.empty());
+
+    CHECK(openAtomCache(cache, path));
+    AllergenMask mask = 0xffff;
+    CHECK(lookupAtom(cache, "milk powder", mask) && mask == 0x0004);
+    CHECK(lookupAtom(cache, "salt", mask) && mask == 0x0001);
+    CHECK(!lookupAtom(cache, "sugar", mask));
+    const long intact = cache.file_size;
+    CHECK(storeAtom(cache, "sugar", 0));
+    closeAtomCache(cache);
+
+    // Torn last record
+    CHECK_EQ(truncate(path.c_str(), intact + 3), 0);
+    CHECK(openAtomCache(cache, path));
+    CHECK(!lookupAtom(cache, "sugar", mask));
+    CHECK_EQ(cache.file_size, intact);
+    closeAtomCache(cache);
+    unlink(path.c_str());
+
+    // Unopenable file: the path is kept and the cache works in memory
+    const std::string missing_dir = tempPath("test-atom-cache-missing/cache.slac");
+    CHECK(!openAtomCache(cache, missing_dir));
+    CHECK(cache.path == missing_dir);
+    CHECK(!storeAtom(cache, "egg", 0x0002));
+    CHECK(lookupAtom(cache, "egg", mask) && mask == 0x0002);
+    closeAtomCache(cache);
+}
+
+static void testCompression() {
+    const std::string prawns = "King Prawn (86%) (King Prawn (Penaeus vannamei) (Crustacean), Salt)";
+    CHECK_EQ(compressIngredients(prawns, COMPRESS_OFF), prawns);
+    CHECK_EQ(compressIngredients(prawns, COMPRESS_NORMALIZE),
+             std::string("king prawn, penaeus vannamei, crustacean, salt"));
+    CHECK_EQ(compressIngredients(prawns, COMPRESS_DROP_IRRELEVANT),
+             std::string("king prawn, penaeus vannamei, crustacean"));
+    // Never an empty list
+    CHECK_EQ(compressIngredients("Water, Salt", COMPRESS_DROP_IRRELEVANT), std::string("water"));
+    CHECK_EQ(compressPromptIngredients("Ingredients: Salt, Wheat Flour\nAllergens:",
+                                       COMPRESS_DROP_IRRELEVANT),
+             std::string("Ingredients: wheat flour\nAllergens:"));
+
+    int mode = -1;
+    CHECK(parseCompressionMode("2", mode) && mode == COMPRESS_DROP_IRRELEVANT);
+    CHECK(parseCompressionMode("0", mode) && mode == COMPRESS_OFF);
+    CHECK(!parseCompressionMode("3", mode));
+    CHECK(!parseCompressionMode("-1", mode));
+    CHECK(!parseCompressionMode("1x", mode));
+    CHECK(!parseCompressionMode("", mode));
+    CHECK_EQ(mode, (int) COMPRESS_OFF);
+}
+
+int main() {
+    testParse();
+    testCache();
+    testCompression();
+    return checkResult();
+}
@@ -0,0 +1,54 @@
+// Ingredient list chunking and merging the chunks' answers
+#include "../ingredient_chunks.h"
+#include "check.h"
+
+using Chunks = std::vector<std::string>;
+
+static void testChunkIngredients() {
+    const std::string list = "wheat flour, sugar, butter (milk), eggs, salt";
+    // Short enough, or chunking off
+    CHECK(chunkIngredients(list, 100) == Chunks{list});
+    CHECK(chunkIngredients(list, 0) == Chunks{list});
+    CHECK(chunkIngredients(list, -1) == Chunks{list});
+
+    // Packed at top-level separators, brackets kept whole
+    CHECK(chunkIngredients(list, 20) ==
+          (Chunks{"wheat flour, sugar", "butter (milk), eggs", "salt"}));
+    CHECK(chunkIngredients("a; b; c; d", 3) == (Chunks{"a", "b", "c", "d"}));
+
+    // A compound ingredient longer than a chunk is split inside its
+    // brackets and every part keeps its name
+    const Chunks chocolate = chunkIngredients(
+            "milk chocolate (sugar, cocoa butter, whole milk powder, cocoa mass), hazelnuts", 40);
+    CHECK(chocolate == (Chunks{"milk chocolate (sugar, cocoa butter)",
+                               "milk chocolate (whole milk powder)",
+                               "milk chocolate (cocoa mass)", "hazelnuts"}));
+    for (const std::string& chunk : chocolate) {
+        CHECK(chunk.size() <= 40);
+    }
+}
+
+static void testChunkPrompt() {
+    const Chunks prompts =
+            chunkPromptIngredients("Answer.\nIngredients: aaa, bbb, ccc\nAllergens:", 8);
+    CHECK(prompts == (Chunks{"Answer.\nIngredients: aaa, bbb\nAllergens:",
+                             "Answer.\nIngredients: ccc\nAllergens:"}));
+    // No ingredient line: the prompt alone
+    CHECK(chunkPromptIngredients("Say hi", 8) == Chunks{"Say hi"});
+}
+
+static void testMerge() {
+    // Union of the answers, metrics of the slowest chunk
+    CHECK_EQ(mergeChunkResults({"TTFT_MS=1;LAT_MS=5|milk", "TTFT_MS=2;LAT_MS=9|eggs, milk"}),
+             std::string("TTFT_MS=2;LAT_MS=9;CHUNKS=2|egg, milk"));
+    CHECK_EQ(mergeChunkResults({"LAT_MS=5|peanuts"}), std::string("LAT_MS=5|peanuts"));
+    // A failed chunk fails the item
+    CHECK_EQ(mergeChunkResults({"LAT_MS=5|milk", ""}), std::string());
+}
+
+int main() {
+    testChunkIngredients();
+    testChunkPrompt();
+    testMerge();
+    return checkResult();
+}
@@ -0,0 +1,76 @@
+// parseJson / jsonQuote, including \u escapes and surrogate pairs
+#include "../json.h"
+#include "check.h"
+
+static bool parses(const std::string& text, JsonValue& value) {
+    return parseJson(text, value);
+}
+
+static std::string parseString(const std::string& literal) {
+    JsonValue value;
+    if (!parseJson(literal, value) || value.type != JsonValue::Type::String) {
+        return "<error>";
+    }
+    return value.string;
+}
+
+static void testValues() {
+    JsonValue root;
+    CHECK(parses("{\"id\": 7, \"name\": \"oat milk\", \"ok\": true, \"tags\": [1, null, \"x\"],"
+                 " \"nested\": {\"f\": -1.5e2}}", root));
+    CHECK(root.type == JsonValue::Type::Object);
+    CHECK_EQ(root.getNumber("id"), 7.0);
+    CHECK_EQ(root.getString("name"), "oat milk");
+    CHECK(root.getBool("ok"));
+    CHECK_EQ(root.getString("missing", "fallback"), "fallback");
+
+    const JsonValue* tags = root.get("tags");
+    CHECK(tags && tags->type == JsonValue::Type::Array && tags->array.size() == 3);
+    if (tags && tags->array.size() == 3) {
+        CHECK(tags->array[1].type == JsonValue::Type::Null);
+        CHECK_EQ(tags->array[2].string, "x");
+    }
+    const JsonValue* nested = root.get("nested");
+    CHECK(nested && nested->getNumber("f") == -150.0);
+}
+
+static void testMalformed() {
+    JsonValue value;
+    std::string error;
+    CHECK(!parseJson("{\"a\": }", value, &error));
+    CHECK(!error.empty());
+    CHECK(!parseJson("[1, 2", value));
+    CHECK(!parseJson("\"unterminated", value));
+    CHECK(!parseJson("\"bad \\q escape\"", value));
+    CHECK(!parseJson("{} trailing", value));
+    CHECK(!parseJson(std::string(100, '['), value));  // nesting limit
+}
+
+static void testEscapes() {
+    CHECK_EQ(parseString("\"a\\\"b\\\\c\\/d\\n\\t\""), "a\"b\\c/d\n\t");
+    CHECK_EQ(parseString("\"\\u00e9\""), "\xc3\xa9");         // é
+    CHECK_EQ(parseString("\"\\u20AC\""), "\xe2\x82\xac");     // €
+    CHECK_EQ(parseString("\"\\ud83e\\udd5c\""), "\xf0\x9f\xa5\x9c");  // U+1F95C peanuts
+    CHECK_EQ(parseString("\"\\u12\""), "<error>");            // truncated
+    CHECK_EQ(parseString("\"\\u12g4\""), "<error>");
+
+    // Surrogates must come as a high/low pair
+    CHECK_EQ(parseString("\"\\ud83e\""), "<error>");
+    CHECK_EQ(parseString("\"\\ud83ex\""), "<error>");
+    CHECK_EQ(parseString("\"\\ud83e\\u0041\""), "<error>");   // low half out of DC00-DFFF
+    CHECK_EQ(parseString("\"\\ud83e\\ud83e\""), "<error>");
+    CHECK_EQ(parseString("\"\\udd5c\""), "<error>");          // lone low half
+}
+
+static void testQuoteRoundTrip() {
+    const std::string text = "line\n\"quoted\"\t\\ \x01 caf\xc3\xa9";
+    CHECK_EQ(parseString(jsonQuote(text)), text);
+}
+
+int main() {
+    testValues();
+    testMalformed();
+    testEscapes();
+    testQuoteRoundTrip();
+    return checkResult();
+}
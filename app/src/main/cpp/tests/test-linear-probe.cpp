@@ -0,0 +1,21 @@
+// Linear probe input validation (training itself needs a model)
+#include "../linear_probe.h"
+#include "check.h"
+
+int main() {
+    ProbeConfig config;
+    LinearProbe probe;
+    ProbeReport report;
+
+    // Empty training set
+    CHECK(!trainLinearProbe("model.gguf", 4, {}, {}, config, probe, report));
+
+    // Vectors and labels disagree
+    const std::vector<float> vectors(3 * 4, 0.5f);
+    const std::vector<AllergenMask> labels = {1, 2};
+    CHECK(!trainLinearProbe("model.gguf", 4, vectors, labels, config, probe, report));
+
+    // No embedding width
+    CHECK(!trainLinearProbe("model.gguf", 0, {}, labels, config, probe, report));
+    return checkResult();
+}
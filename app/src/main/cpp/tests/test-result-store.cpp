@@ -0,0 +1,91 @@
+// Result store replay, latest-row-wins and torn or corrupt tail blocks
+#include "../result_store.h"
+#include "check.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static ResultRow makeRow(int32_t data_id, const std::string& predicted, const std::string& truth) {
+    ResultRow row;
+    row.data_id = data_id;
+    row.dataset_number = 1;
+    row.timestamp_ms = 1700000000000LL + data_id;
+    row.metrics[METRIC_LATENCY_MS] = 100 * data_id;
+    row.is_match = predicted == truth;
+    row.name = "item " + std::to_string(data_id);
+    row.ingredients = "wheat flour, milk";
+    row.allergens_raw = truth;
+    row.mapped_allergens = truth;
+    row.predicted_allergens = predicted;
+    return row;
+}
+
+static long fileSize(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long) st.st_size : -1;
+}
+
+static long reopenCount(const std::string& dir) {
+    ResultStore store;
+    if (!openResultStore(store, dir, "model")) {
+        return -1;
+    }
+    const long count = getResultAggregate(store).count;
+    closeResultStore(store);
+    return count;
+}
+
+int main() {
+    const std::string dir = tempPath("test-result-store");
+    mkdir(dir.c_str(), 0700);
+    const std::string path = dir + "/model.slr";
+    unlink(path.c_str());
+
+    ResultStore store;
+    CHECK(openResultStore(store, dir, "model"));
+    CHECK(appendResults(store, {makeRow(1, "milk", "milk"), makeRow(2, "none", "gluten")}));
+    // Replaces data id 1
+    CHECK(appendResults(store, {makeRow(1, "gluten", "milk"), makeRow(3, "milk", "milk")}));
+    CHECK_EQ(getResultAggregate(store).count, 3);
+    CHECK_EQ(getResultAggregate(store).n_match, 1);
+    closeResultStore(store);
+    const long intact = fileSize(path);
+
+    // Replay after reopening, latest row per id
+    CHECK(openResultStore(store, dir, "model"));
+    CHECK_EQ(getResultAggregate(store).count, 3);
+    std::vector<ResultRow> rows;
+    CHECK(readResultRows(store, rows));
+    CHECK_EQ(rows.size(), 3u);
+    if (rows.size() == 3) {
+        CHECK_EQ(rows[0].data_id, 1);
+        CHECK(rows[0].predicted_allergens == "gluten");
+        CHECK(!rows[0].is_match);
+        CHECK(rows[2].name == "item 3");
+    }
+    CHECK(appendResults(store, {makeRow(4, "milk", "milk")}));
+    closeResultStore(store);
+    const long full = fileSize(path);
+    CHECK(full > intact);
+
+    // Torn append: half of the last block is cut off on open
+    CHECK_EQ(truncate(path.c_str(), intact + (full - intact) / 2), 0);
+    CHECK_EQ(reopenCount(dir), 3);
+    CHECK_EQ(fileSize(path), intact);
+
+    // Corrupt payload: the CRC rejects the last block
+    CHECK(openResultStore(store, dir, "model"));
+    CHECK(appendResults(store, {makeRow(4, "milk", "milk")}));
+    closeResultStore(store);
+    int fd = open(path.c_str(), O_RDWR);
+    CHECK(fd >= 0);
+    const char garbage = 0x5a;
+    CHECK_EQ(pwrite(fd, &garbage, 1, full - 2), 1);
+    close(fd);
+    CHECK_EQ(reopenCount(dir), 3);
+    CHECK_EQ(fileSize(path), intact);
+
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+    return checkResult();
+}
@@ -0,0 +1,73 @@
+// Run journal replay, torn and corrupt records, and the CRC itself
+#include "../run_journal.h"
+#include "../checksum.h"
+#include "check.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static long fileSize(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long) st.st_size : -1;
+}
+
+static void testCrc() {
+    // Reference values of zlib's crc32
+    const std::string check = "123456789";
+    CHECK_EQ(crc32Ieee((const uint8_t*) check.data(), check.size()), 0xCBF43926u);
+    CHECK_EQ(crc32Ieee(nullptr, 0), 0u);
+    const std::string fox = "The quick brown fox jumps over the lazy dog";
+    CHECK_EQ(crc32Ieee((const uint8_t*) fox.data(), fox.size()), 0x414FA339u);
+}
+
+static void testJournal() {
+    const std::string path = tempPath("test-run-journal.slj");
+    unlink(path.c_str());
+
+    RunJournal journal;
+    CHECK(openRunJournal(journal, path));
+    CHECK(journal.entries.empty());
+    CHECK(journalItem(journal, 7, JOURNAL_RESULT, "TTFT_MS=12|milk"));
+    CHECK(journalItem(journal, 7, JOURNAL_MEMORY, "JAVA_KB=1;BATCH_SIZE=2"));
+    CHECK(journalItem(journal, 9, JOURNAL_RESULT, ""));
+    closeRunJournal(journal);
+    const long intact = fileSize(path);
+
+    CHECK(openRunJournal(journal, path));
+    CHECK_EQ(journal.entries.size(), 2u);
+    CHECK(journal.entries[7].result == "TTFT_MS=12|milk");
+    CHECK(journal.entries[7].memory == "JAVA_KB=1;BATCH_SIZE=2");
+    CHECK(journal.entries[9].result.empty());
+    CHECK(journal.entries[9].memory.empty());
+    CHECK(journalItem(journal, 11, JOURNAL_RESULT, "TTFT_MS=3|gluten"));
+    closeRunJournal(journal);
+    const long full = fileSize(path);
+
+    // Torn record: cut off on open, earlier items kept
+    CHECK_EQ(truncate(path.c_str(), full - 3), 0);
+    CHECK(openRunJournal(journal, path));
+    CHECK_EQ(journal.entries.size(), 2u);
+    CHECK(journal.entries.count(11) == 0);
+    CHECK_EQ(fileSize(path), intact);
+
+    // Corrupt payload: rejected by the CRC
+    CHECK(journalItem(journal, 11, JOURNAL_RESULT, "TTFT_MS=3|gluten"));
+    closeRunJournal(journal);
+    int fd = open(path.c_str(), O_RDWR);
+    CHECK(fd >= 0);
+    const char garbage = 'X';
+    CHECK_EQ(pwrite(fd, &garbage, 1, full - 1), 1);
+    close(fd);
+    CHECK(openRunJournal(journal, path));
+    CHECK(journal.entries.count(11) == 0);
+    CHECK_EQ(fileSize(path), intact);
+
+    discardRunJournal(journal);
+    CHECK_EQ(fileSize(path), -1);
+}
+
+int main() {
+    testCrc();
+    testJournal();
+    return checkResult();
+}
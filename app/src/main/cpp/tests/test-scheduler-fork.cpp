@@ -0,0 +1,130 @@
+// Prompt forking (Request::share_from). The decoding checks need a model:
+// SLM_TEST_MODEL=PATH[:TEMPLATE] (as slm-eval --model), skipped without it.
+#include "../scheduler.h"
+#include "../allergens.h"
+#include "../prompt_styles.h"
+#include "../tools/model_arg.h"
+#include "check.h"
+#include <vector>
+
+static const char* const ITEMS[] = {
+        "wheat flour, sugar, butter (milk), eggs, salt",
+        "roasted peanuts, sea salt, sunflower oil",
+};
+static const int N_ITEMS = 2;
+
+static void testSharePromptPrefix() {
+    Request requests[3];
+    requests[0].prompt_tokens = {1, 2, 3, 4};
+    requests[1].prompt_tokens = {1, 2, 3, 9, 9};
+    requests[2].prompt_tokens = {1, 2};
+    sharePromptPrefix(requests, 3);
+    CHECK(requests[0].share_from == nullptr);
+    CHECK(requests[1].share_from == &requests[0]);
+    CHECK(requests[2].share_from == &requests[0]);
+    // Trimmed to the common prefix by the scheduler, not here
+    CHECK_EQ(requests[1].n_shared, 5);
+    CHECK_EQ(requests[2].n_shared, 2);
+}
+
+// Every item in every style, item-major like slm-styles
+static std::vector<Request> styleRequests(Session* session, int template_type) {
+    std::vector<Request> requests(N_ITEMS * N_PROMPT_STYLES);
+    for (int i = 0; i < N_ITEMS; i++) {
+        for (int k = 0; k < N_PROMPT_STYLES; k++) {
+            Request& request = requests[i * N_PROMPT_STYLES + k];
+            request.id = i * N_PROMPT_STYLES + k;
+            request.prompt_tokens =
+                    tokenize(session->vocab, formatStylePrompt(ITEMS[i], k, template_type), true);
+            request.max_tokens = session->config.max_tokens;
+        }
+    }
+    return requests;
+}
+
+static void runAll(Session* session, std::vector<Request>& requests, bool fork, long& n_forked) {
+    Scheduler scheduler;
+    initScheduler(scheduler, session);
+    for (int i = 0; i < N_ITEMS; i++) {
+        Request* item = &requests[i * N_PROMPT_STYLES];
+        if (fork) {
+            sharePromptPrefix(item, N_PROMPT_STYLES);
+        }
+        for (int k = 0; k < N_PROMPT_STYLES; k++) {
+            submitRequest(scheduler, &item[k]);
+        }
+    }
+    runUntilIdle(scheduler);
+    n_forked = scheduler.n_forked_tokens;
+    freeScheduler(scheduler);
+}
+
+static void testForkedDecoding(Session* session, int template_type) {
+    std::vector<Request> forked = styleRequests(session, template_type);
+    std::vector<Request> plain = styleRequests(session, template_type);
+    long n_forked = 0;
+    long n_plain_forked = 0;
+    runAll(session, forked, true, n_forked);
+    runAll(session, plain, false, n_plain_forked);
+
+    long n_request_forked = 0;
+    for (size_t r = 0; r < forked.size(); r++) {
+        CHECK(!forked[r].failed && !plain[r].failed);
+        CHECK(forked[r].state == RequestState::Done);
+        CHECK(forked[r].share_from == nullptr);
+        CHECK_EQ(forked[r].n_prefilled, (int) forked[r].prompt_tokens.size());
+        if (r % N_PROMPT_STYLES == 0) {
+            CHECK_EQ(forked[r].n_forked, 0);
+        } else {
+            // The styles share at least the item's ingredients
+            CHECK(forked[r].n_forked > 0);
+            CHECK(forked[r].n_forked < (int) forked[r].prompt_tokens.size());
+        }
+        n_request_forked += forked[r].n_forked;
+        // Copying the prefix's KV must not change the answer
+        CHECK_EQ(parsePredictedAllergens(forked[r].output),
+                 parsePredictedAllergens(plain[r].output));
+    }
+    CHECK_EQ(n_forked, n_request_forked);
+    CHECK_EQ(n_plain_forked, 0);
+}
+
+// A parent that finished before its fork was admitted has freed its
+// sequence; the child prefills on its own
+static void testParentDone(Session* session, int template_type) {
+    std::vector<Request> requests = styleRequests(session, template_type);
+    Scheduler scheduler;
+    initScheduler(scheduler, session);
+    sharePromptPrefix(&requests[0], 2);
+    submitRequest(scheduler, &requests[0]);
+    runUntilIdle(scheduler);
+    submitRequest(scheduler, &requests[1]);
+    runUntilIdle(scheduler);
+    CHECK(!requests[1].failed);
+    CHECK(requests[1].share_from == nullptr);
+    CHECK_EQ(requests[1].n_forked, 0);
+    CHECK_EQ(requests[1].n_prefilled, (int) requests[1].prompt_tokens.size());
+    freeScheduler(scheduler);
+}
+
+int main() {
+    testSharePromptPrefix();
+
+    const char* model_arg = getenv("SLM_TEST_MODEL");
+    if (!model_arg || !*model_arg) {
+        fprintf(stderr, "SLM_TEST_MODEL not set, decoding checks skipped\n");
+        return checkResult();
+    }
+    const ModelArg model = parseModelArg(model_arg);
+    EngineConfig config;
+    config.n_seq_max = N_ITEMS * N_PROMPT_STYLES;
+    config.n_interactive_seqs = 0;
+    Session* session = openSession(model.path, model.template_type, config);
+    CHECK(session != nullptr);
+    if (session) {
+        testForkedDecoding(session, model.template_type);
+        testParentDone(session, model.template_type);
+        closeSession(session);
+    }
+    return checkResult();
+}
@@ -0,0 +1,114 @@
+// Shared-memory ring framing, wrap-around and corrupt records
+#include "../shm_ring.h"
+#include "check.h"
+#include <cstring>
+#include <unistd.h>
+
+static void testPushPop() {
+    ShmRing ring;
+    CHECK(createShmRing(ring, 64, "test-ring"));
+    if (!ring.header) {
+        return;
+    }
+    std::string message;
+    CHECK(!ringPop(ring, message));
+
+    CHECK(ringPush(ring, "milk"));
+    CHECK(ringPush(ring, ""));
+    CHECK(ringPush(ring, "sesame seeds"));
+    CHECK(ringPop(ring, message) && message == "milk");
+    CHECK(ringPop(ring, message) && message.empty());
+    CHECK(ringPop(ring, message) && message == "sesame seeds");
+    CHECK(!ringPop(ring, message));
+
+    // Never fits
+    CHECK(!ringPush(ring, std::string(64, 'x')));
+    closeShmRing(ring);
+}
+
+static void testWrap() {
+    ShmRing ring;
+    CHECK(createShmRing(ring, 32, "test-ring"));
+    if (!ring.header) {
+        return;
+    }
+    std::string message;
+    // 4 + 8 bytes per record in 32: the end of the ring keeps moving, so
+    // some records are preceded by a wrap marker
+    for (int round = 0; round < 10; round++) {
+        const std::string text = "item-" + std::to_string(round + 100);
+        CHECK(ringPush(ring, text));
+        CHECK(ringPop(ring, message) && message == text);
+    }
+    CHECK(ringPush(ring, std::string(12, 'a')));
+    CHECK(!ringPush(ring, std::string(20, 'b')));  // full until popped
+    CHECK(ringPop(ring, message) && message == std::string(12, 'a'));
+    closeShmRing(ring);
+}
+
+// A peer writing garbage must not make the reader copy past the mapping
+static void testCorruptLength() {
+    ShmRing ring;
+    CHECK(createShmRing(ring, 64, "test-ring"));
+    if (!ring.header) {
+        return;
+    }
+    std::string message;
+
+    CHECK(ringPush(ring, "wheat"));
+    const uint32_t huge = 60;  // fits the ring, not the 12 published bytes
+    memcpy(ring.data, &huge, 4);
+    CHECK(!ringPop(ring, message));
+    CHECK_EQ(ring.header->tail.load(), ring.header->head.load());
+
+    // Record running past the end of the data area
+    ring.header->head.store(48);
+    ring.header->tail.store(40);
+    const uint32_t past_end = 20;
+    memcpy(ring.data + 40, &past_end, 4);
+    CHECK(!ringPop(ring, message));
+
+    // Published more than the capacity
+    ring.header->tail.store(0);
+    ring.header->head.store(1000);
+    CHECK(!ringPop(ring, message));
+    CHECK_EQ(ring.header->tail.load(), 1000u);
+
+    // Misaligned tail
+    ring.header->tail.store(2);
+    ring.header->head.store(20);
+    CHECK(!ringPop(ring, message));
+
+    // Still usable afterwards
+    CHECK(ringPush(ring, "soy"));
+    CHECK(ringPop(ring, message) && message == "soy");
+    closeShmRing(ring);
+}
+
+static void testMapValidation() {
+    ShmRing ring;
+    CHECK(createShmRing(ring, 64, "test-ring"));
+    if (!ring.header) {
+        return;
+    }
+
+    // The peer's view has its own copy of the capacity
+    ShmRing peer;
+    CHECK(mapShmRing(peer, dup(ring.fd)));
+    CHECK_EQ(peer.capacity, 64u);
+    closeShmRing(peer);
+
+    ring.header->capacity = 4096;  // larger than the mapping
+    CHECK(!mapShmRing(peer, dup(ring.fd)));
+    ring.header->capacity = 30;    // not a multiple of 4
+    CHECK(!mapShmRing(peer, dup(ring.fd)));
+    closeShmRing(ring);
+}
+
+int main() {
+    testPushPop();
+    testWrap();
+    testCorruptLength();
+    testMapValidation();
+    return checkResult();
+}
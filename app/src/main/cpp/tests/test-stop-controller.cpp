@@ -0,0 +1,65 @@
+// Where an allergen answer ends (labelListEnded)
+#include "../stop_controller.h"
+#include "check.h"
+
+static bool ended(const std::string& output, AllergenMask* mask = nullptr) {
+    LabelScan scan;
+    const bool done = labelListEnded(scan, output);
+    if (mask) {
+        *mask = scan.mask;
+    }
+    return done;
+}
+
+static void testEnds() {
+    AllergenMask mask = 0;
+    CHECK(ended("milk, wheat.", &mask));
+    CHECK_EQ(mask, (AllergenMask) (1 << 0 | 1 << 4));
+    CHECK(ended("milk, wheat. The product also", &mask));
+    CHECK_EQ(mask, (AllergenMask) (1 << 0 | 1 << 4));
+    CHECK(ended("tree nuts, soy:"));
+    CHECK(ended("milk 2"));
+    CHECK(ended("none."));
+    // Details belong to the list
+    CHECK(ended("milk (whey, butter), eggs.", &mask));
+    CHECK_EQ(mask, (AllergenMask) (1 << 0 | 1 << 1));
+    // Every label named: nothing can follow, even without a separator
+    CHECK(ended("milk, eggs, peanuts, tree nuts, wheat, soy, fish, shellfish, sesame"));
+}
+
+static void testContinues() {
+    // The last item may still grow ("milk" -> "milk chocolate")
+    CHECK(!ended("milk, wheat"));
+    CHECK(!ended("none"));
+    CHECK(!ended(""));
+    // A lead-in is skipped, not taken for an empty list
+    CHECK(!ended("Allergens:"));
+    CHECK(!ended("Allergens: milk"));
+    CHECK(!ended("Allergens: milk,"));
+    CHECK(ended("Allergens: milk."));
+    // An open bracket keeps the list going
+    CHECK(!ended("milk (whey. butter"));
+    // No label yet: generation goes on to the newline or the budget
+    CHECK(!ended("<b>milk"));
+    CHECK(!ended("crustaceans, gluten."));
+}
+
+// The scan resumes where it stopped as the output grows
+static void testIncremental() {
+    LabelScan scan;
+    std::string output;
+    for (const char* piece : {"mi", "lk, wh", "eat"}) {
+        output += piece;
+        CHECK(!labelListEnded(scan, output));
+    }
+    output += ".";
+    CHECK(labelListEnded(scan, output));
+    CHECK_EQ(scan.mask, (AllergenMask) (1 << 0 | 1 << 4));
+}
+
+int main() {
+    testEnds();
+    testContinues();
+    testIncremental();
+    return checkResult();
+}
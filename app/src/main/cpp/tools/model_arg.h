@@ -0,0 +1,30 @@
+#pragma once
+
+// --model PATH[:TEMPLATE] as taken by the host tools. TEMPLATE is the
+// chat template number (0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3,
+// 3 = Phi, 4 = tuned); without it the template is guessed from the file
+// name. A colon not followed by digits only is part of the path.
+
+#include "../engine.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+struct ModelArg {
+    std::string path;
+    int template_type = 0;
+};
+
+inline ModelArg parseModelArg(const std::string& arg) {
+    ModelArg model;
+    model.path = arg;
+    const size_t colon = arg.rfind(':');
+    if (colon != std::string::npos && colon + 1 < arg.size() &&
+        strspn(arg.c_str() + colon + 1, "0123456789") == arg.size() - colon - 1) {
+        model.path = arg.substr(0, colon);
+        model.template_type = atoi(arg.c_str() + colon + 1);
+    } else {
+        model.template_type = guessTemplateType(arg);
+    }
+    return model;
+}
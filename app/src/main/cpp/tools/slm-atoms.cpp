@@ -0,0 +1,162 @@
+// Ingredient-atom classifier: splits every ingredient list into atoms,
+// asks the model only about atoms the cache does not know yet and ORs the
+// atom masks per item (see ingredient_atoms.h).
+//
+//   slm-atoms --dataset food_preprocessed.json
+//             --model qwen2.5-1.5b-instruct-q4_k_m.gguf:0
+//             --cache qwen-atoms.slac --shards 4
+//
+// The cache persists across runs, so a second run over a catalogue (or a
+// new catalogue with the usual ingredients) needs few or no model calls.
+// --parse-only prints the atom statistics without loading a model.
+
+#include "../evaluator.h"
+#include "../ingredient_atoms.h"
+#include "../llama/llama.h"
+#include "model_arg.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --dataset FILE (--model PATH[:TEMPLATE] --cache FILE | --parse-only)\n"
+            "          [--shards K]\n"
+            "  TEMPLATE: 0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3, 3 = Phi, 4 = tuned\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    std::string dataset_path;
+    std::string model_path;
+    int template_type = 0;
+    std::string cache_path;
+    bool parse_only = false;
+    ShardedEvalConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--model") {
+            const ModelArg model = parseModelArg(next());
+            model_path = model.path;
+            template_type = model.template_type;
+        }
+        else if (arg == "--cache") cache_path = next();
+        else if (arg == "--parse-only") parse_only = true;
+        else if (arg == "--shards") config.n_shards = atoi(next());
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (dataset_path.empty() || (!parse_only && (model_path.empty() || cache_path.empty()))) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // ================= Atoms =================
+    std::vector<FoodRecord> records;
+    std::vector<std::vector<std::string>> item_atoms;
+    DatasetStream dataset;
+    if (!openDatasetStream(dataset_path, dataset)) {
+        return 1;
+    }
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        item_atoms.push_back(parseIngredientAtoms(record.ingredients));
+        records.push_back(record);
+    }
+    closeDatasetStream(dataset);
+
+    AtomCache cache;
+    if (!parse_only && !openAtomCache(cache, cache_path)) {
+        return 1;
+    }
+    const size_t n_known = cache.masks.size();
+
+    long n_atoms = 0;
+    std::set<std::string> unique;
+    std::vector<FoodRecord> missing;
+    for (const std::vector<std::string>& atoms : item_atoms) {
+        n_atoms += (long) atoms.size();
+        for (const std::string& atom : atoms) {
+            AllergenMask mask;
+            if (unique.insert(atom).second && !lookupAtom(cache, atom, mask)) {
+                FoodRecord atom_record;
+                atom_record.id = (int) missing.size();
+                atom_record.ingredients = atom;
+                missing.push_back(atom_record);
+            }
+        }
+    }
+
+    long n_cached_items = 0;
+    for (const std::vector<std::string>& atoms : item_atoms) {
+        AllergenMask mask;
+        n_cached_items += std::all_of(atoms.begin(), atoms.end(), [&](const std::string& atom) {
+            return lookupAtom(cache, atom, mask);
+        });
+    }
+
+    printf("%zu items, %ld atoms (%.1f per item), %zu unique, %zu cached, %zu to ask the model\n",
+           records.size(), n_atoms, (double) n_atoms / std::max<size_t>(records.size(), 1),
+           unique.size(), n_known, missing.size());
+    printf("items needing no model call before this run: %ld\n", n_cached_items);
+    if (parse_only) {
+        return 0;
+    }
+
+    // ================= Missing atoms through the model =================
+    EvalReport report;
+    if (!missing.empty()) {
+        if (!runShardedEvaluation(model_path, template_type, missing, config, report)) {
+            fprintf(stderr, "evaluation failed for %s\n", model_path.c_str());
+            closeAtomCache(cache);
+            return 1;
+        }
+        for (const EvalOutcome& outcome : report.outcomes) {
+            if (!outcome.result.empty()) {
+                storeAtom(cache, missing[outcome.seq].ingredients, outcome.predicted);
+            }
+        }
+        printf("%zu model calls in %ld ms\n", missing.size(), report.wall_ms);
+    }
+
+    // ================= Items =================
+    AllergenScore score;
+    long n_failed = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        AllergenMask mask = 0;
+        bool ok = true;
+        for (const std::string& atom : item_atoms[i]) {
+            AllergenMask atom_mask = 0;
+            ok = ok && lookupAtom(cache, atom, atom_mask);
+            mask |= atom_mask;
+        }
+        if (!ok) {
+            n_failed++;
+            continue;
+        }
+        score.add(mask, parseAllergenList(records[i].allergens_mapped));
+    }
+
+    printf("\n%ld items scored, %ld failed\n", score.n_samples, n_failed);
+    printf("%s\n", score.summary().c_str());
+
+    closeAtomCache(cache);
+    llama_backend_free();
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Small-to-large cascade: scores a dataset with the small model, sends the
+// answers below the confidence threshold to the large model and reports
+// the accuracy and latency of the small model alone against the cascade
+// (see cascade.h).
+//
+//   slm-cascade --small Llama-3.2-1B-Instruct-Q4_K_M.gguf:2
+//               --large Llama-3.2-3B-Instruct-Q4_K_M.gguf:2
+//               --dataset food_preprocessed.json --min-confidence 0.6
+
+#include "../allergens.h"
+#include "../cascade.h"
+#include "../dataset.h"
+#include "../ingredient_atoms.h"
+#include "../llama/llama.h"
+#include "model_arg.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --small PATH[:TEMPLATE] --large PATH[:TEMPLATE] --dataset FILE\n"
+            "          [--min-confidence C] [--compress MODE]\n"
+            "  TEMPLATE: 0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3, 3 = Phi, 4 = tuned\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    std::string dataset_path;
+    CascadeConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--small") {
+            const ModelArg model = parseModelArg(next());
+            config.small_path = model.path;
+            config.small_template = model.template_type;
+        }
+        else if (arg == "--large") {
+            const ModelArg model = parseModelArg(next());
+            config.large_path = model.path;
+            config.large_template = model.template_type;
+        }
+        else if (arg == "--min-confidence") config.min_confidence = (float) atof(next());
+        else if (arg == "--compress") {
+            if (!parseCompressionMode(next(), config.engine.compress_ingredients)) {
+                fprintf(stderr, "--compress: MODE must be 0, 1 or 2\n");
+                return 1;
+            }
+        }
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (dataset_path.empty() || config.small_path.empty() || config.large_path.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<FoodRecord> records;
+    DatasetStream dataset;
+    if (!openDatasetStream(dataset_path, dataset)) {
+        return 1;
+    }
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        records.push_back(record);
+    }
+    closeDatasetStream(dataset);
+
+    std::vector<std::string> ingredients;
+    for (const FoodRecord& r : records) {
+        ingredients.push_back(r.ingredients);
+    }
+
+    CascadeReport report;
+    if (!runCascade(config, ingredients, report)) {
+        fprintf(stderr, "cannot load %s\n", config.small_path.c_str());
+        return 1;
+    }
+
+    // Small model alone against the cascade, and how well the confidence
+    // separates right from wrong small answers
+    AllergenScore small_score;
+    AllergenScore cascade_score;
+    long small_ms = 0;
+    long cascade_ms = 0;
+    long n_confident = 0;
+    long n_confident_exact = 0;
+    long n_unsure_exact = 0;
+    long n_changed = 0;
+    long n_failed = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        const CascadeOutcome& outcome = report.outcomes[i];
+        if (outcome.result.empty()) {
+            n_failed++;
+            continue;
+        }
+        const AllergenMask truth = parseAllergenList(records[i].allergens_mapped);
+        small_score.add(outcome.small_predicted, truth);
+        cascade_score.add(outcome.predicted, truth);
+        small_ms += outcome.small_ms;
+        cascade_ms += outcome.small_ms + outcome.large_ms;
+
+        const bool exact = outcome.small_predicted == truth;
+        if (outcome.confidence >= config.min_confidence) {
+            n_confident++;
+            n_confident_exact += exact;
+        } else {
+            n_unsure_exact += exact;
+        }
+        n_changed += outcome.escalated && outcome.predicted != outcome.small_predicted;
+    }
+
+    const long n_scored = std::max<long>(cascade_score.n_samples, 1);
+    const long n_unsure = cascade_score.n_samples - n_confident;
+    printf("%zu items, %ld escalated (%.1f%%) at confidence < %.2f, %ld answers changed, "
+           "%ld failed\n",
+           records.size(), report.n_escalated, 100.0 * report.n_escalated / n_scored,
+           config.min_confidence, n_changed, n_failed);
+    printf("small exact match: %.3f when confident (%ld), %.3f when unsure (%ld)\n",
+           (double) n_confident_exact / std::max<long>(n_confident, 1), n_confident,
+           (double) n_unsure_exact / std::max<long>(n_unsure, 1), n_unsure);
+    printf("wall: small %ld ms, large %ld ms\n\n", report.small_wall_ms, report.large_wall_ms);
+
+    printf("%-8s %9s %9s %9s %9s %11s\n", "", "micro-F1", "macro-F1", "exact", "FNR", "mean lat ms");
+    printf("%-8s %9.4f %9.4f %9.4f %9.4f %11ld\n", "small", small_score.microF1(),
+           small_score.macroF1(), small_score.exactMatchRatio(), small_score.falseNegativeRate(),
+           small_ms / n_scored);
+    printf("%-8s %9.4f %9.4f %9.4f %9.4f %11ld\n", "cascade", cascade_score.microF1(),
+           cascade_score.macroF1(), cascade_score.exactMatchRatio(),
+           cascade_score.falseNegativeRate(), cascade_ms / n_scored);
+    printf("\n%s\n", cascade_score.summary().c_str());
+
+    llama_backend_free();
+    return 0;
+}
@@ -0,0 +1,197 @@
+// Ingredient chunking: scores a dataset with long ingredient lists split
+// into chunks that are decoded together and unioned (see
+// ingredient_chunks.h), optionally against the unsplit prompts.
+//
+//   slm-chunks --model qwen2.5-1.5b-instruct-q4_k_m.gguf:0
+//              --dataset food_preprocessed.json --max-chars 400 --ctx 512
+//              --compare
+//
+// --ctx sets the per-sequence context: chunked prompts fit a much smaller
+// one, unsplit long lists fail in it (counted as failed).
+
+#include "../allergens.h"
+#include "../dataset.h"
+#include "../engine.h"
+#include "../ingredient_chunks.h"
+#include "../scheduler.h"
+#include "../llama/llama.h"
+#include "model_arg.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --model PATH[:TEMPLATE] --dataset FILE [--max-chars N] [--ctx N]\n"
+            "          [--parallel N] [--compare]\n"
+            "  TEMPLATE: 0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3, 3 = Phi, 4 = tuned\n",
+            argv0);
+}
+
+// One dataset item, request k asks about chunk k
+struct ChunkItem {
+    FoodRecord record;
+    int n_chunks = 0;
+    std::unique_ptr<Request[]> requests;
+};
+
+struct PassStats {
+    AllergenScore score;
+    long n_failed = 0;
+    long n_chunked = 0;       // items split into more than one chunk
+    long n_requests = 0;
+    long n_prefilled = 0;     // prompt tokens run through the model
+    long max_prompt = 0;      // longest prompt in tokens
+    long wall_ms = 0;
+};
+
+static PassStats runPass(Session* session, const std::vector<FoodRecord>& records,
+                         int max_chars, int n_parallel) {
+    PassStats stats;
+    Scheduler scheduler;
+    initScheduler(scheduler, session);
+    auto t_start = Clock::now();
+
+    std::vector<std::unique_ptr<ChunkItem>> in_flight;
+    size_t next_record = 0;
+    while (next_record < records.size() || !in_flight.empty()) {
+        while (next_record < records.size() && (int) in_flight.size() < n_parallel) {
+            auto item = std::make_unique<ChunkItem>();
+            item->record = records[next_record++];
+            const std::vector<std::string> chunks = chunkIngredients(item->record.ingredients,
+                                                                     max_chars);
+            item->n_chunks = (int) chunks.size();
+            item->requests.reset(new Request[chunks.size()]);
+            for (size_t k = 0; k < chunks.size(); k++) {
+                Request& request = item->requests[k];
+                request.id = item->record.id;
+                request.prompt_tokens = tokenize(
+                        session->vocab, formatAllergenPrompt(chunks[k], session->template_type), true);
+                request.max_tokens = session->config.max_tokens;
+                stats.max_prompt = std::max(stats.max_prompt, (long) request.prompt_tokens.size());
+            }
+            sharePromptPrefix(item->requests.get(), item->n_chunks);
+            for (int k = 0; k < item->n_chunks; k++) {
+                submitRequest(scheduler, &item->requests[k]);
+            }
+            stats.n_chunked += item->n_chunks > 1;
+            stats.n_requests += item->n_chunks;
+            in_flight.push_back(std::move(item));
+        }
+
+        stepScheduler(scheduler);
+
+        for (auto& item : in_flight) {
+            bool done = true;
+            for (int k = 0; k < item->n_chunks; k++) {
+                done = done && item->requests[k].state == RequestState::Done;
+            }
+            if (!done) {
+                continue;
+            }
+            AllergenMask mask = 0;
+            bool failed = false;
+            for (int k = 0; k < item->n_chunks; k++) {
+                const Request& request = item->requests[k];
+                stats.n_prefilled += request.n_prefilled - request.n_cached;
+                failed = failed || request.failed;
+                mask |= parsePredictedAllergens(request.output);
+            }
+            if (failed) {
+                stats.n_failed++;
+            } else {
+                stats.score.add(mask, parseAllergenList(item->record.allergens_mapped));
+            }
+            item.reset();
+        }
+        in_flight.erase(std::remove(in_flight.begin(), in_flight.end(), nullptr),
+                        in_flight.end());
+    }
+
+    stats.wall_ms = elapsedMs(t_start, Clock::now());
+    freeScheduler(scheduler);
+    return stats;
+}
+
+static void printPass(const char* name, const PassStats& stats) {
+    printf("%-9s %8ld %8ld %10ld %10ld %9ld %9.4f %9.4f %7ld\n", name, stats.n_chunked,
+           stats.n_requests, stats.n_prefilled, stats.max_prompt, stats.wall_ms,
+           stats.score.microF1(), stats.score.falseNegativeRate(), stats.n_failed);
+}
+
+int main(int argc, char** argv) {
+    std::string dataset_path;
+    std::string model_path;
+    int template_type = 0;
+    int max_chars = 400;
+    int n_parallel = 4;
+    bool compare = false;
+    EngineConfig config;
+    config.n_interactive_seqs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--model") {
+            const ModelArg model = parseModelArg(next());
+            model_path = model.path;
+            template_type = model.template_type;
+        }
+        else if (arg == "--max-chars") max_chars = atoi(next());
+        else if (arg == "--ctx") config.n_ctx_seq = std::max(64, atoi(next()));
+        else if (arg == "--parallel") n_parallel = std::max(1, atoi(next()));
+        else if (arg == "--compare") compare = true;
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (dataset_path.empty() || model_path.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<FoodRecord> records;
+    DatasetStream dataset;
+    if (!openDatasetStream(dataset_path, dataset)) {
+        return 1;
+    }
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        records.push_back(record);
+    }
+    closeDatasetStream(dataset);
+
+    // Room for every chunk of the items in flight
+    config.n_seq_max = std::max(config.n_seq_max, 2 * n_parallel);
+    Session* session = openSession(model_path, template_type, config);
+    if (!session) {
+        fprintf(stderr, "cannot load %s\n", model_path.c_str());
+        return 1;
+    }
+
+    printf("%zu items, chunks of at most %d chars, n_ctx_seq %d\n\n", records.size(), max_chars,
+           config.n_ctx_seq);
+    printf("%-9s %8s %8s %10s %10s %9s %9s %9s %7s\n", "", "chunked", "requests", "prefilled",
+           "max prompt", "wall ms", "micro-F1", "FNR", "failed");
+    printPass("chunked", runPass(session, records, max_chars, n_parallel));
+    if (compare) {
+        printPass("unsplit", runPass(session, records, 0, n_parallel));
+    }
+
+    closeSession(session);
+    llama_backend_free();
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Inference daemon: keeps models resident outside the app process so an
+// app restart (or a crash in the UI) does not pay the model load again.
+// The app connects with connectInferenceDaemon(); requests and responses
+// travel through shared-memory rings, the socket only carries wakeups.
+// Every connection is served on its own thread, and the app opens one per
+// batch in flight, so an interactive request is scheduled next to a Run
+// All instead of after it.
+//
+// Rooted or SELinux-permissive devices only: an untrusted_app cannot
+// connect to a socket owned by the adb shell or pass memfds to it. The app
+// only tries when built with -PinferenceDaemon=true.
+//
+//   adb push slm-daemon libllama.so libggml.so libggml-base.so /data/local/tmp/
+//   adb push libggml-cpu-*.so /data/local/tmp/
+//   adb shell LD_LIBRARY_PATH=/data/local/tmp /data/local/tmp/slm-daemon
+//            --socket @slm-daemon --max-models 2
+//
+// Built with -PllamaSourceDir (GGML_BACKEND_DL) the CPU backend is one
+// module per arm64 variant (libggml-cpu-android_armv8.0_1.so,
+// ..._armv8.2_1.so, ..._armv8.6_1.so, ...). ggml loads them from the
+// directory of the executable, so every variant must sit next to
+// slm-daemon: without them no CPU backend registers and model loading
+// fails. With the prebuilt libraries push libggml-cpu.so instead.
+
+#include "../daemon_protocol.h"
+#include "../engine.h"
+#include "../model_pool.h"
+#include "../native-log.h"
+#include "../scheduler.h"
+#include "../shm_ring.h"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static ModelPool g_pool;
+
+// ================= Connections =================
+static bool sendKick(int sock) {
+    const char kick = DAEMON_KICK_RESPONSE;
+    return send(sock, &kick, 1, MSG_NOSIGNAL) == 1;
+}
+
+static bool pushResponse(int sock, ShmRing& responses, const std::string& message) {
+    while (!ringPush(responses, message)) {
+        // Ring full: let the client drain it
+        if (!sendKick(sock)) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+static void serveBatch(int sock, ShmRing& requests_ring, ShmRing& responses_ring) {
+    struct Pending {
+        DaemonRequest request;
+        ResidentModel* model = nullptr;
+        Request request_state;
+    };
+
+    std::vector<std::unique_ptr<Pending>> pending;
+    std::string message;
+    while (ringPop(requests_ring, message)) {
+        std::unique_ptr<Pending> p(new Pending());
+        if (!decodeDaemonRequest(message, p->request)) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Malformed daemon request");
+            continue;
+        }
+        pending.push_back(std::move(p));
+    }
+
+    // Submit everything first so the scheduler batches across requests
+    for (auto& p : pending) {
+        p->model = acquireModel(g_pool, p->request.model_path, p->request.template_type);
+        if (!p->model) {
+            continue;
+        }
+        Session* session = p->model->session;
+        Request& request = p->request_state;
+        request.id = p->request.id;
+        request.prompt_tokens = tokenize(session->vocab,
+                                         formatPrompt(p->request.prompt, p->request.template_type),
+                                         true);
+        request.max_tokens = session->config.max_tokens;
+        request.priority = p->request.priority;
+        submitRequest(p->model->scheduler, &request);
+    }
+
+    for (auto& p : pending) {
+        std::string result;
+        if (p->model) {
+            waitForRequest(p->model->scheduler, &p->request_state);
+            releaseModel(g_pool, p->model);
+            if (!p->request_state.failed) {
+                result = formatResult(p->request_state);
+            }
+        }
+        if (!pushResponse(sock, responses_ring, encodeDaemonResponse(p->request.id, result))) {
+            return;
+        }
+    }
+
+    sendKick(sock);
+}
+
+static void serveConnection(int sock) {
+    char tag;
+    int fds[2] = {-1, -1};
+    if (!recvWithFds(sock, tag, fds, 2) || tag != DAEMON_HELLO || fds[0] < 0 || fds[1] < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Bad client handshake");
+        if (fds[0] >= 0) close(fds[0]);
+        if (fds[1] >= 0) close(fds[1]);
+        close(sock);
+        return;
+    }
+
+    ShmRing requests;
+    ShmRing responses;
+    const bool mapped_requests = mapShmRing(requests, fds[0]);
+    const bool mapped_responses = mapShmRing(responses, fds[1]);
+    if (mapped_requests && mapped_responses) {
+        while (read(sock, &tag, 1) == 1) {
+            if (tag == DAEMON_KICK_REQUEST) {
+                serveBatch(sock, requests, responses);
+            }
+        }
+    }
+
+    if (mapped_requests) closeShmRing(requests);
+    if (mapped_responses) closeShmRing(responses);
+    close(sock);
+}
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [--socket PATH] [--max-models N]\n"
+            "  PATH starting with '@' is an abstract socket (default %s)\n",
+            argv0, DAEMON_DEFAULT_SOCKET);
+}
+
+int main(int argc, char** argv) {
+    std::string socket_path = DAEMON_DEFAULT_SOCKET;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) socket_path = argv[++i];
+        else if (arg == "--max-models" && i + 1 < argc) g_pool.max_models = (size_t) atoi(argv[++i]);
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (g_pool.max_models < 1) {
+        g_pool.max_models = 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    const int listen_sock = listenUnixSocket(socket_path);
+    if (listen_sock < 0) {
+        fprintf(stderr, "cannot listen on %s\n", socket_path.c_str());
+        return 1;
+    }
+    fprintf(stderr, "slm-daemon listening on %s\n", socket_path.c_str());
+
+    while (true) {
+        const int sock = accept(listen_sock, nullptr, nullptr);
+        if (sock < 0) {
+            continue;
+        }
+        std::thread(serveConnection, sock).detach();
+    }
+}
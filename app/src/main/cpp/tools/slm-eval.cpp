@@ -0,0 +1,393 @@
+// Host evaluator: runs the allergen prompt over a dataset for one or more
+// models and writes per-item JSONL plus Table 2 quality metrics.
+//
+//   slm-eval --dataset food_preprocessed.json
+//            --model qwen2.5-1.5b-instruct-q4_k_m.gguf:0
+//            --model Llama-3.2-1B-Instruct-Q4_K_M.gguf:2
+//            --shards 8 --numa --out results.jsonl
+//
+// Datasets may be food_preprocessed.json, JSONL (including Open Food
+// Facts exports) or a binary file made with --compile. They are streamed,
+// so memory does not grow with the dataset. With --out, progress is
+// checkpointed to <out>.ckpt and --resume continues an interrupted run.
+//
+//   slm-eval --dataset off-products.jsonl --compile off-products.slmd
+//   slm-eval --dataset off-products.slmd --model ... --out off.jsonl --resume
+//
+// --kv-archive DIR stores every item's post-prefill KV state; later runs
+// with the same DIR restore it and only decode, which makes trying a new
+// decoding rule several times cheaper than a full evaluation.
+//
+// --repack-compare runs every model with and without the CPU backend's
+// repacked weight layouts and reports load time, extra memory and the
+// speed-up; --no-repack turns repacking off for a normal run.
+//
+// --compress MODE rewrites the ingredient text before tokenisation
+// (1 = normalised atoms, 2 = also without allergen-free atoms, see
+// ingredient_atoms.h); --compress-compare runs every mode and reports
+// prompt tokens saved per item against the F1 change.
+//
+// --concurrent runs all models at the same time, each on its own set of
+// cores rebalanced by measured speed (multi_runner.h), and reports every
+// model's cores, wall time and F1 next to the total wall time.
+
+#include "../cpu_topology.h"
+#include "../evaluator.h"
+#include "../ingredient_atoms.h"
+#include "../llama/llama.h"
+#include "../multi_runner.h"
+#include "model_arg.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --dataset FILE --model PATH[:TEMPLATE] [--model ...]\n"
+            "          [--shards K] [--threads-per-shard T] [--numa] [--out FILE]\n"
+            "          [--checkpoint-every N] [--resume] [--kv-archive DIR]\n"
+            "          [--no-repack] [--repack-compare] [--compress MODE] [--compress-compare]\n"
+            "          [--concurrent]\n"
+            "       %s --dataset FILE --compile OUT.slmd\n"
+            "  TEMPLATE: 0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3, 3 = Phi, 4 = tuned\n",
+            argv0, argv0);
+}
+
+// Each model twice on the same items: plain weights, then repacked
+static int compareRepack(const std::vector<ModelArg>& models,
+                         const std::string& dataset_path,
+                         ShardedEvalConfig config) {
+    printf("%-40s %-6s %8s %9s %8s %9s %8s\n",
+           "model", "repack", "load_ms", "anon_MB", "items/s", "model_ms", "microF1");
+
+    int rc = 0;
+    for (const ModelArg& model : models) {
+        EvalReport reports[2];
+        for (int pass = 0; pass < 2; pass++) {
+            config.engine.repack_weights = pass == 1;
+
+            DatasetStream dataset;
+            if (!openDatasetStream(dataset_path, dataset)) {
+                return 1;
+            }
+            const bool ok = runStreamingEvaluation(model.path, model.template_type, dataset,
+                                                   config, reports[pass]);
+            closeDatasetStream(dataset);
+            if (!ok) {
+                fprintf(stderr, "evaluation failed for %s\n", model.path.c_str());
+                rc = 1;
+                break;
+            }
+
+            const EvalReport& r = reports[pass];
+            const std::string name = model.path.substr(model.path.find_last_of('/') + 1);
+            printf("%-40s %-6s %8ld %9.1f %8.2f %9ld %8.3f\n",
+                   name.c_str(), r.load.repack ? "on" : "off", r.load.load_ms,
+                   r.load.anon_kb / 1024.0,
+                   r.wall_ms > 0 ? r.n_items * 1000.0 / r.wall_ms : 0.0,
+                   r.model_ms, r.score.microF1());
+        }
+
+        if (rc == 0 && reports[1].load.repack && reports[1].model_ms > 0) {
+            printf("  repack: %.2fx model time, +%ld ms load, +%.1f MB\n",
+                   (double) reports[0].model_ms / reports[1].model_ms,
+                   reports[1].load.load_ms - reports[0].load.load_ms,
+                   (reports[1].load.anon_kb - reports[0].load.anon_kb) / 1024.0);
+        } else if (rc == 0) {
+            printf("  repack: no interleaved kernels for this CPU (%s)\n",
+                   reports[1].load.cpu_features.c_str());
+        }
+    }
+    return rc;
+}
+
+// Each model with every compression mode on the same items
+static int compareCompression(const std::vector<ModelArg>& models,
+                              const std::string& dataset_path,
+                              ShardedEvalConfig config) {
+    static const char* const MODE_NAMES[] = {"off", "normalize", "drop"};
+    printf("%-40s %-10s %10s %8s %8s %8s\n",
+           "model", "compress", "tokens/it", "saved", "microF1", "dF1");
+
+    for (const ModelArg& model : models) {
+        EvalReport reports[3];
+        for (int mode = COMPRESS_OFF; mode <= COMPRESS_DROP_IRRELEVANT; mode++) {
+            config.engine.compress_ingredients = mode;
+
+            DatasetStream dataset;
+            if (!openDatasetStream(dataset_path, dataset)) {
+                return 1;
+            }
+            const bool ok = runStreamingEvaluation(model.path, model.template_type, dataset,
+                                                   config, reports[mode]);
+            closeDatasetStream(dataset);
+            if (!ok) {
+                fprintf(stderr, "evaluation failed for %s\n", model.path.c_str());
+                return 1;
+            }
+
+            const EvalReport& r = reports[mode];
+            const EvalReport& base = reports[COMPRESS_OFF];
+            const double n = (double) std::max(r.n_items, 1L);
+            const std::string name = model.path.substr(model.path.find_last_of('/') + 1);
+            printf("%-40s %-10s %10.1f %8.1f %8.3f %+8.3f\n",
+                   name.c_str(), MODE_NAMES[mode], r.prompt_tokens / n,
+                   (base.prompt_tokens - r.prompt_tokens) / n,
+                   r.score.microF1(), r.score.microF1() - base.score.microF1());
+        }
+    }
+    return 0;
+}
+
+// All models at once on disjoint core sets; the dataset is held in memory
+static int compareConcurrent(const std::vector<ModelArg>& models,
+                             const std::string& dataset_path) {
+    DatasetStream dataset;
+    if (!openDatasetStream(dataset_path, dataset)) {
+        return 1;
+    }
+    std::vector<FoodRecord> records;
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        records.push_back(record);
+    }
+    closeDatasetStream(dataset);
+
+    std::vector<std::string> prompts;
+    for (const FoodRecord& r : records) {
+        prompts.push_back(buildAllergenPrompt(r.ingredients));
+    }
+    std::vector<ModelJob> jobs;
+    for (const ModelArg& model : models) {
+        ModelJob job;
+        job.name = model.path.substr(model.path.find_last_of('/') + 1);
+        job.model_path = model.path;
+        job.template_type = model.template_type;
+        jobs.push_back(job);
+    }
+
+    const auto t_start = Clock::now();
+    const std::vector<ModelRunResult> runs = runModelsConcurrently(jobs, prompts, 4);
+    const long wall_ms = elapsedMs(t_start, Clock::now());
+
+    printf("%-40s %-16s %9s %8s %8s %7s\n",
+           "model", "cores", "calib_tps", "wall_ms", "microF1", "failed");
+    for (const ModelRunResult& run : runs) {
+        AllergenScore score;
+        long n_failed = 0;
+        for (size_t i = 0; i < records.size(); i++) {
+            const std::string& result = run.results[i];
+            if (result.empty()) {
+                n_failed++;
+                continue;
+            }
+            score.add(parsePredictedAllergens(result.substr(result.find('|') + 1)),
+                      parseAllergenList(records[i].allergens_mapped));
+        }
+        printf("%-40s %-16s %9.1f %8ld %8.3f %7ld\n",
+               run.name.c_str(), joinCpus(run.cpus).c_str(), run.calibration_tps, run.wall_ms,
+               score.microF1(), n_failed);
+    }
+    printf("all models: %zu items in %ld ms\n", records.size(), wall_ms);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    std::string dataset_path;
+    std::string out_path;
+    std::vector<ModelArg> models;
+    std::string compile_path;
+    ShardedEvalConfig config;
+    config.checkpoint_every = 500;
+    bool numa = false;
+    bool resume = false;
+    bool repack_compare = false;
+    bool compress_compare = false;
+    bool concurrent = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--model") models.push_back(parseModelArg(next()));
+        else if (arg == "--shards") config.n_shards = atoi(next());
+        else if (arg == "--threads-per-shard") config.threads_per_shard = atoi(next());
+        else if (arg == "--numa") numa = true;
+        else if (arg == "--out") out_path = next();
+        else if (arg == "--compile") compile_path = next();
+        else if (arg == "--checkpoint-every") config.checkpoint_every = atol(next());
+        else if (arg == "--resume") resume = true;
+        else if (arg == "--kv-archive") config.engine.kv_archive_dir = next();
+        else if (arg == "--no-repack") config.engine.repack_weights = false;
+        else if (arg == "--repack-compare") repack_compare = true;
+        else if (arg == "--compress") {
+            if (!parseCompressionMode(next(), config.engine.compress_ingredients)) {
+                fprintf(stderr, "--compress: MODE must be 0, 1 or 2\n");
+                return 1;
+            }
+        }
+        else if (arg == "--compress-compare") compress_compare = true;
+        else if (arg == "--concurrent") concurrent = true;
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!compile_path.empty() && !dataset_path.empty()) {
+        long n_records = 0;
+        if (!compileDataset(dataset_path, compile_path, &n_records)) {
+            return 1;
+        }
+        printf("%s: %ld records\n", compile_path.c_str(), n_records);
+        return 0;
+    }
+
+    if (dataset_path.empty() || models.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (repack_compare) {
+        initBackends("");
+        const int rc = compareRepack(models, dataset_path, config);
+        llama_backend_free();
+        return rc;
+    }
+
+    if (concurrent) {
+        initBackends("");
+        const int rc = compareConcurrent(models, dataset_path);
+        llama_backend_free();
+        return rc;
+    }
+
+    if (compress_compare) {
+        initBackends("");
+        const int rc = compareCompression(models, dataset_path, config);
+        llama_backend_free();
+        return rc;
+    }
+
+    // ================= Resume =================
+    const std::string checkpoint_path = out_path.empty() ? "" : out_path + ".ckpt";
+    EvalCheckpoint loaded;
+    EvalCheckpoint checkpoint;
+    size_t first_model = 0;
+    if (resume && !checkpoint_path.empty() && loadCheckpoint(checkpoint_path, loaded)) {
+        std::vector<std::string> model_paths;
+        for (const ModelArg& model : models) {
+            model_paths.push_back(model.path);
+        }
+        std::string error;
+        if (!resumeEvaluation(loaded, dataset_path, config.engine.compress_ingredients, model_paths,
+                              first_model, checkpoint, error)) {
+            fprintf(stderr, "%s: %s\n", checkpoint_path.c_str(), error.c_str());
+            return 1;
+        }
+        fprintf(stderr, "resuming at model %zu, item %ld\n", first_model, checkpoint.n_done);
+    } else {
+        resume = false;
+    }
+
+    initBackends("");
+    if (numa) {
+        // Spread model pages and threads over all nodes
+        llama_numa_init(GGML_NUMA_STRATEGY_DISTRIBUTE);
+    }
+
+    FILE* out = nullptr;
+    if (!out_path.empty()) {
+        out = fopen(out_path.c_str(), resume ? "r+" : "w");
+        if (out && resume) {
+            // Drop lines written after the last checkpoint
+            if (ftruncate(fileno(out), checkpoint.out_offset) != 0) {
+                fclose(out);
+                out = nullptr;
+            } else {
+                fseek(out, 0, SEEK_END);
+            }
+        }
+        if (!out) {
+            fprintf(stderr, "cannot write %s\n", out_path.c_str());
+            return 1;
+        }
+    }
+
+    int rc = 0;
+    for (size_t m = first_model; m < models.size(); m++) {
+        const ModelArg& model = models[m];
+
+        DatasetStream dataset;
+        if (!openDatasetStream(dataset_path, dataset)) {
+            rc = 1;
+            break;
+        }
+
+        EvalReport report;
+
+        // Persist stage: lines are written while later items are still decoding
+        config.persist = [&](const EvalOutcome& outcome) {
+            if (out) {
+                fprintf(out, "%s\n", outcomeToJson(report, outcome).c_str());
+            }
+        };
+
+        config.resume = m == first_model ? checkpoint : EvalCheckpoint();
+        config.checkpoint = nullptr;
+        if (out) {
+            config.checkpoint = [&](const EvalCheckpoint& progress) {
+                EvalCheckpoint saved = progress;
+                saved.model_path = model.path;
+                saved.dataset_path = dataset_path;
+                saved.compression = config.engine.compress_ingredients;
+                fflush(out);
+                saved.out_offset = ftell(out);
+                if (!saveCheckpoint(checkpoint_path, saved)) {
+                    fprintf(stderr, "cannot write %s\n", checkpoint_path.c_str());
+                }
+            };
+        }
+
+        const bool ok = runStreamingEvaluation(model.path, model.template_type, dataset,
+                                               config, report);
+        if (dataset.n_skipped_lines > 0) {
+            fprintf(stderr, "skipped %ld malformed dataset lines\n", dataset.n_skipped_lines);
+        }
+        closeDatasetStream(dataset);
+
+        if (!ok) {
+            fprintf(stderr, "evaluation failed for %s\n", model.path.c_str());
+            rc = 1;
+            continue;
+        }
+
+        printf("%s: %s items=%ld failed=%ld wall=%ldms model=%ldms shards=%zu load=%ldms repack=%s\n",
+               model.path.c_str(), report.score.summary().c_str(), report.n_items, report.n_failed,
+               report.wall_ms, report.model_ms, report.shard_cpus.size(),
+               report.load.load_ms, report.load.repack ? "on" : "off");
+        std::string stops;
+        for (const auto& stop : report.stops) {
+            stops += std::string(stops.empty() ? "" : " ") + stopReasonName(stop.first) + "=" +
+                     std::to_string(stop.second);
+        }
+        printf("  stops: %s\n", stops.empty() ? "-" : stops.c_str());
+    }
+
+    if (out) {
+        fclose(out);
+    }
+    llama_backend_free();
+    return rc;
+}
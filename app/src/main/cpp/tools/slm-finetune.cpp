@@ -0,0 +1,177 @@
+// Fine-tunes a base model on the labelled allergen dataset so it can be
+// prompted with the ingredient text alone (template 4, buildTunedPrompt)
+// instead of the zero-shot instruction block.
+//
+//   slm-finetune --model qwen2.5-0.5b-instruct-f32.gguf
+//                --dataset food_preprocessed.json --out qwen-allergens-f32.gguf
+//                --epochs 2 --layers 8 --holdout 40
+//
+// Runs on a Linux host or on the device (pushed with adb like slm-daemon).
+// The last --holdout records are kept out of training and used to compare
+// the tuned model against the base one; quantise the result with
+// slm-quantize --model qwen-allergens-f32.gguf:4.
+
+#include "../evaluator.h"
+#include "../finetune.h"
+#include "../llama/llama.h"
+#include "model_arg.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --model F32.gguf[:TEMPLATE] --dataset FILE --out FILE.gguf\n"
+            "          [--epochs N] [--ctx N] [--lr R] [--wd R] [--val-split R]\n"
+            "          [--layers N] [--sgd] [--threads N] [--holdout N]\n"
+            "  TEMPLATE (base model, for --holdout): 0 = ChatML (Qwen), 1 = Gemma,\n"
+            "           2 = Llama 3, 3 = Phi\n",
+            argv0);
+}
+
+// Progress bar of ggml, one line per training or validation pass
+static void showProgress(bool train, ggml_opt_context_t opt_ctx, ggml_opt_dataset_t dataset,
+                         ggml_opt_result_t result, int64_t ibatch, int64_t ibatch_max,
+                         int64_t t_start_us) {
+    ggml_opt_epoch_callback_progress_bar(train, opt_ctx, dataset, result, ibatch, ibatch_max,
+                                         t_start_us);
+    if (ibatch == ibatch_max) {
+        fprintf(stderr, "\n");
+    }
+}
+
+static void printRow(const char* label, const EvalReport& r, double prompt_tokens) {
+    printf("%-6s %13.1f %8ld %9.3f %9.3f %9.3f\n",
+           label, prompt_tokens, r.model_ms,
+           r.score.precision(), r.score.recall(), r.score.microF1());
+}
+
+// Mean prompt length the model actually prefills
+static double meanPromptTokens(const std::string& model_path, int template_type,
+                               const std::vector<FoodRecord>& records) {
+    llama_model* model = loadModel(model_path, false);
+    if (!model || records.empty()) {
+        return 0.0;
+    }
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    long n_tokens = 0;
+    for (const FoodRecord& record : records) {
+        n_tokens += (long) tokenize(vocab, formatAllergenPrompt(record.ingredients, template_type),
+                                    true).size();
+    }
+    llama_model_free(model);
+    return (double) n_tokens / records.size();
+}
+
+int main(int argc, char** argv) {
+    std::string model_path;
+    int template_type = 0;
+    std::string dataset_path;
+    std::string out_path;
+    long n_holdout = 0;
+    FinetuneConfig config;
+    config.n_threads = (int) std::thread::hardware_concurrency();
+    config.progress = showProgress;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--model") {
+            const ModelArg model = parseModelArg(next());
+            model_path = model.path;
+            template_type = model.template_type;
+        }
+        else if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--out") out_path = next();
+        else if (arg == "--epochs") config.n_epochs = atoi(next());
+        else if (arg == "--ctx") config.n_ctx = atoi(next());
+        else if (arg == "--lr") config.learning_rate = (float) atof(next());
+        else if (arg == "--wd") config.weight_decay = (float) atof(next());
+        else if (arg == "--val-split") config.val_split = (float) atof(next());
+        else if (arg == "--layers") config.n_train_layers = atoi(next());
+        else if (arg == "--sgd") config.optimizer = GGML_OPT_OPTIMIZER_TYPE_SGD;
+        else if (arg == "--threads") config.n_threads = atoi(next());
+        else if (arg == "--holdout") n_holdout = atol(next());
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (model_path.empty() || dataset_path.empty() || out_path.empty() || config.n_ctx < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // ================= Dataset split =================
+    std::vector<FoodRecord> records;
+    DatasetStream dataset;
+    if (!openDatasetStream(dataset_path, dataset)) {
+        return 1;
+    }
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        records.push_back(record);
+    }
+    closeDatasetStream(dataset);
+
+    n_holdout = std::min(n_holdout, (long) records.size());
+    std::vector<FoodRecord> holdout(records.end() - n_holdout, records.end());
+    records.resize(records.size() - n_holdout);
+
+    initBackends("");
+
+    // ================= Train =================
+    FinetuneReport report;
+    if (!finetuneModel(model_path, records, config, out_path, report)) {
+        fprintf(stderr, "fine-tuning %s failed\n", model_path.c_str());
+        llama_backend_free();
+        return 1;
+    }
+
+    printf("%ld examples, %ld tokens, %ld windows of %d, %ld trainable parameters, %.1f s\n",
+           report.n_examples, report.n_tokens, report.n_windows, config.n_ctx,
+           report.n_trainable, report.train_ms / 1000.0);
+    printf("%-6s %10s %9s %10s %9s\n", "epoch", "train_loss", "train_acc", "val_loss", "val_acc");
+    for (size_t e = 0; e < report.epochs.size(); e++) {
+        const FinetuneEpoch& epoch = report.epochs[e];
+        printf("%-6zu %10.4f %9.3f %10.4f %9.3f\n", e + 1,
+               epoch.train_loss, epoch.train_accuracy, epoch.val_loss, epoch.val_accuracy);
+    }
+    printf("written %s\n", out_path.c_str());
+
+    // ================= Held-out comparison =================
+    if (!holdout.empty()) {
+        ShardedEvalConfig eval_config;
+        EvalReport base;
+        EvalReport tuned;
+        const bool base_ok = runShardedEvaluation(model_path, template_type, holdout,
+                                                  eval_config, base);
+        const bool tuned_ok = runShardedEvaluation(out_path, TEMPLATE_TUNED, holdout,
+                                                   eval_config, tuned);
+
+        printf("\n%zu held-out items\n", holdout.size());
+        printf("%-6s %13s %8s %9s %9s %9s\n",
+               "model", "prompt_tokens", "model_ms", "precision", "recall", "microF1");
+        if (base_ok) {
+            printRow("base", base, meanPromptTokens(model_path, template_type, holdout));
+        }
+        if (tuned_ok) {
+            printRow("tuned", tuned, meanPromptTokens(out_path, TEMPLATE_TUNED, holdout));
+        }
+    }
+
+    llama_backend_free();
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Embedding classifier: builds a labelled reference index from one
+// dataset and classifies another by nearest-neighbour vote, one prefill
+// per item and no generation (see embedding_index.h).
+//
+//   slm-knn --model qwen2.5-1.5b-instruct-q4_k_m.gguf
+//           --reference off-products.jsonl --index off.slei --calibrate
+//           --dataset food_preprocessed.json --k 8
+//
+// An existing --index built with the same model is reused. Without
+// --dataset the reference set is scored leave-one-out.
+
+#include "../embedding_index.h"
+#include "../engine.h"
+#include "../llama/llama.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --model PATH (--reference FILE | --index FILE) [--index FILE]\n"
+            "          [--dataset FILE] [--k K] [--float] [--calibrate] [--threads N]\n",
+            argv0);
+}
+
+static bool readAll(const std::string& path, std::vector<FoodRecord>& records) {
+    DatasetStream dataset;
+    if (!openDatasetStream(path, dataset)) {
+        return false;
+    }
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        records.push_back(record);
+    }
+    closeDatasetStream(dataset);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string model_path;
+    std::string reference_path;
+    std::string index_path;
+    std::string dataset_path;
+    int k = 8;
+    bool int8 = true;
+    bool calibrate = false;
+    int n_threads = (int) std::thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--model") model_path = next();
+        else if (arg == "--reference") reference_path = next();
+        else if (arg == "--index") index_path = next();
+        else if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--k") k = atoi(next());
+        else if (arg == "--float") int8 = false;
+        else if (arg == "--calibrate") calibrate = true;
+        else if (arg == "--threads") n_threads = atoi(next());
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (model_path.empty() || (reference_path.empty() && index_path.empty())) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    initBackends("");
+    Embedder* embedder = openEmbedder(model_path, n_threads);
+    if (!embedder) {
+        return 1;
+    }
+
+    // ================= Reference index =================
+    EmbeddingIndex index;
+    bool have_index = !index_path.empty() && loadEmbeddingIndex(index_path, index) &&
+                      index.model_name == embedder->model_name;
+    if (have_index) {
+        printf("index %s: %ld rows, n_embd=%d, %s\n", index_path.c_str(), index.size(),
+               index.n_embd, index.int8 ? "int8" : "float");
+    } else {
+        std::vector<FoodRecord> reference;
+        if (reference_path.empty() || !readAll(reference_path, reference)) {
+            fprintf(stderr, "no usable index and no --reference dataset\n");
+            closeEmbedder(embedder);
+            return 1;
+        }
+        auto t_start = Clock::now();
+        if (!buildEmbeddingIndex(*embedder, reference, int8, index)) {
+            closeEmbedder(embedder);
+            return 1;
+        }
+        printf("indexed %ld products in %ld ms\n", index.size(), elapsedMs(t_start, Clock::now()));
+    }
+
+    if (calibrate || !have_index) {
+        if (calibrate) {
+            calibrateThresholds(index, k);
+        }
+        printf("thresholds:");
+        for (int a = 0; a < N_ALLERGENS; a++) {
+            printf(" %s=%.2f", ALLERGEN_LABELS[a], index.thresholds[a]);
+        }
+        printf("\n");
+        if (!index_path.empty() && !saveEmbeddingIndex(index_path, index)) {
+            fprintf(stderr, "cannot write %s\n", index_path.c_str());
+        }
+    }
+
+    // ================= Classify =================
+    AllergenScore score;
+    long embed_ms = 0;
+    long search_us = 0;
+
+    if (dataset_path.empty()) {
+        // Leave-one-out over the reference rows
+        std::vector<float> query(index.n_embd);
+        for (long r = 0; r < index.size(); r++) {
+            for (int i = 0; i < index.n_embd; i++) {
+                query[i] = index.int8 ? index.qvectors[r * index.n_embd + i] * index.scales[r]
+                                      : index.vectors[r * index.n_embd + i];
+            }
+            auto t_search = Clock::now();
+            const AllergenMask predicted = classifyEmbedding(index, query.data(), k, nullptr, r);
+            search_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - t_search).count();
+            score.add(predicted, index.labels[r]);
+        }
+    } else {
+        std::vector<FoodRecord> records;
+        if (!readAll(dataset_path, records)) {
+            closeEmbedder(embedder);
+            return 1;
+        }
+        std::vector<std::string> texts;
+        for (const FoodRecord& record : records) {
+            texts.push_back(record.ingredients);
+        }
+
+        std::vector<float> vectors;
+        auto t_embed = Clock::now();
+        if (!embedTexts(*embedder, texts, vectors)) {
+            closeEmbedder(embedder);
+            return 1;
+        }
+        embed_ms = elapsedMs(t_embed, Clock::now());
+
+        for (size_t i = 0; i < records.size(); i++) {
+            auto t_search = Clock::now();
+            const AllergenMask predicted = classifyEmbedding(
+                    index, vectors.data() + i * index.n_embd, k);
+            search_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - t_search).count();
+            score.add(predicted, parseAllergenList(records[i].allergens_mapped));
+        }
+    }
+
+    const long n = std::max(score.n_samples, 1L);
+    printf("\n%ld items, k=%d%s\n", score.n_samples, k, dataset_path.empty() ? " (leave-one-out)" : "");
+    printf("embedding %.1f ms/item, search %.1f us/item over %ld rows\n",
+           (double) embed_ms / n, (double) search_us / n, index.size());
+    printf("%s\n", score.summary().c_str());
+
+    closeEmbedder(embedder);
+    llama_backend_free();
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Linear-probe classifier: trains a nine-output logistic head on the
+// model's mean-pooled embeddings of a labelled dataset and scores another
+// with it, one prefill per item and no generation (see linear_probe.h).
+//
+//   slm-probe --model qwen2.5-1.5b-instruct-q4_k_m.gguf
+//             --dataset off-products.jsonl --probe qwen.sllp
+//             --eval food_preprocessed.json --epochs 20
+//
+// Without --dataset an existing --probe is loaded and only --eval runs.
+
+#include "../linear_probe.h"
+#include "../engine.h"
+#include "../llama/llama.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --model PATH (--dataset FILE | --probe FILE) [--probe FILE]\n"
+            "          [--eval FILE] [--epochs N] [--batch N] [--lr R] [--wd R]\n"
+            "          [--val-split R] [--sgd] [--threads N]\n",
+            argv0);
+}
+
+static bool readAll(const std::string& path, std::vector<FoodRecord>& records) {
+    DatasetStream dataset;
+    if (!openDatasetStream(path, dataset)) {
+        return false;
+    }
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        records.push_back(record);
+    }
+    closeDatasetStream(dataset);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string model_path;
+    std::string dataset_path;
+    std::string probe_path;
+    std::string eval_path;
+    ProbeConfig config;
+    config.n_threads = (int) std::thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--model") model_path = next();
+        else if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--probe") probe_path = next();
+        else if (arg == "--eval") eval_path = next();
+        else if (arg == "--epochs") config.n_epochs = atoi(next());
+        else if (arg == "--batch") config.n_batch = atoi(next());
+        else if (arg == "--lr") config.learning_rate = (float) atof(next());
+        else if (arg == "--wd") config.weight_decay = (float) atof(next());
+        else if (arg == "--val-split") config.val_split = (float) atof(next());
+        else if (arg == "--sgd") config.optimizer = GGML_OPT_OPTIMIZER_TYPE_SGD;
+        else if (arg == "--threads") config.n_threads = atoi(next());
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (model_path.empty() || (dataset_path.empty() && probe_path.empty()) || config.n_batch < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    initBackends("");
+    Embedder* embedder = openEmbedder(model_path, config.n_threads);
+    if (!embedder) {
+        return 1;
+    }
+
+    // ================= Train or load =================
+    LinearProbe probe;
+    if (!dataset_path.empty()) {
+        std::vector<FoodRecord> records;
+        ProbeReport report;
+        if (!readAll(dataset_path, records) ||
+            !trainLinearProbe(*embedder, records, config, probe, report)) {
+            fprintf(stderr, "training on %s failed\n", dataset_path.c_str());
+            closeEmbedder(embedder);
+            return 1;
+        }
+
+        printf("%ld examples (%ld validation), embedding %ld ms, training %ld ms\n",
+               report.n_examples, report.n_val, report.embed_ms, report.train_ms);
+        printf("%-6s %10s %9s %10s %9s\n", "epoch", "train_loss", "train_acc", "val_loss", "val_acc");
+        for (size_t e = 0; e < report.epochs.size(); e++) {
+            const FinetuneEpoch& epoch = report.epochs[e];
+            printf("%-6zu %10.4f %9.3f %10.4f %9.3f\n", e + 1,
+                   epoch.train_loss, epoch.train_accuracy, epoch.val_loss, epoch.val_accuracy);
+        }
+        printf("thresholds:");
+        for (int a = 0; a < N_ALLERGENS; a++) {
+            printf(" %s=%.2f", ALLERGEN_LABELS[a], probe.thresholds[a]);
+        }
+        printf("\n");
+
+        if (!probe_path.empty() && !saveLinearProbe(probe_path, probe)) {
+            fprintf(stderr, "cannot write %s\n", probe_path.c_str());
+        }
+    } else if (!loadLinearProbe(probe_path, probe) || probe.model_name != embedder->model_name) {
+        fprintf(stderr, "%s is not a probe for %s\n", probe_path.c_str(), embedder->model_name.c_str());
+        closeEmbedder(embedder);
+        return 1;
+    }
+
+    // ================= Evaluate =================
+    if (!eval_path.empty()) {
+        std::vector<FoodRecord> records;
+        if (!readAll(eval_path, records)) {
+            closeEmbedder(embedder);
+            return 1;
+        }
+        std::vector<std::string> texts;
+        for (const FoodRecord& record : records) {
+            texts.push_back(record.ingredients);
+        }
+
+        std::vector<float> vectors;
+        auto t_embed = Clock::now();
+        if (!embedTexts(*embedder, texts, vectors)) {
+            closeEmbedder(embedder);
+            return 1;
+        }
+        const long embed_ms = elapsedMs(t_embed, Clock::now());
+
+        AllergenScore score;
+        for (size_t i = 0; i < records.size(); i++) {
+            const AllergenMask predicted = classifyProbe(probe, vectors.data() + i * probe.n_embd);
+            score.add(predicted, parseAllergenList(records[i].allergens_mapped));
+        }
+
+        const long n = std::max(score.n_samples, 1L);
+        printf("\n%ld items, embedding %.1f ms/item\n", score.n_samples, (double) embed_ms / n);
+        printf("%s\n", score.summary().c_str());
+    }
+
+    closeEmbedder(embedder);
+    llama_backend_free();
+    return 0;
+}
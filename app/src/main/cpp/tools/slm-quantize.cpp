@@ -0,0 +1,205 @@
+// Quantisation sweep: builds an importance matrix from the allergen
+// prompts with the full-precision model, writes one GGUF per target
+// format and benchmarks each on the rest of the dataset for speed and
+// allergen recall / F1 (not perplexity).
+//
+//   slm-quantize --model qwen2.5-1.5b-instruct-f16.gguf:0
+//                --dataset food_preprocessed.json --out-dir quant/
+//                --types q4_0,iq4_nl,q3_k_m,q5_k_m --shards 4
+//
+// Q4_0 is the format the ARM CPU backend repacks at load time (see the
+// _4x4 / _4x8 / _8x8 kernels), so it is usually the fastest on device.
+// The recommended format is the fastest one whose recall stays within
+// --max-recall-drop of the full-precision model.
+
+#include "../evaluator.h"
+#include "../quantize.h"
+#include "../llama/llama.h"
+#include "model_arg.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+struct Variant {
+    std::string type;
+    std::string path;
+    long size_mb = 0;
+    EvalReport report;
+    bool ok = false;
+};
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --model F16.gguf[:TEMPLATE] --dataset FILE [--out-dir DIR]\n"
+            "          [--types q4_0,iq4_nl,q3_k_m,q5_k_m] [--calibration N]\n"
+            "          [--no-imatrix] [--shards K] [--threads N] [--max-recall-drop R]\n"
+            "  TEMPLATE: 0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3, 3 = Phi, 4 = tuned\n",
+            argv0);
+}
+
+static long fileSizeMb(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long) (st.st_size >> 20) : 0;
+}
+
+static std::string baseName(const std::string& path) {
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    const size_t dot = name.rfind(".gguf");
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static void printRow(const char* type, const Variant& v) {
+    const EvalReport& r = v.report;
+    printf("%-8s %7ldMB %8.1f %8ld %9.3f %9.3f %9.3f\n",
+           type, v.size_mb,
+           r.wall_ms > 0 ? r.n_items * 1000.0 / r.wall_ms : 0.0,
+           r.model_ms, r.score.precision(), r.score.recall(), r.score.microF1());
+}
+
+int main(int argc, char** argv) {
+    std::string model_path;
+    int template_type = 0;
+    std::string dataset_path;
+    std::string out_dir = ".";
+    std::string types = "q4_0,iq4_nl,q3_k_m,q5_k_m";
+    long n_calibration = 64;
+    bool use_imatrix = true;
+    int n_threads = (int) std::thread::hardware_concurrency();
+    double max_recall_drop = 0.01;
+    ShardedEvalConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--model") {
+            const ModelArg model = parseModelArg(next());
+            model_path = model.path;
+            template_type = model.template_type;
+        }
+        else if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--out-dir") out_dir = next();
+        else if (arg == "--types") types = next();
+        else if (arg == "--calibration") n_calibration = atol(next());
+        else if (arg == "--no-imatrix") use_imatrix = false;
+        else if (arg == "--shards") config.n_shards = atoi(next());
+        else if (arg == "--threads") n_threads = atoi(next());
+        else if (arg == "--max-recall-drop") max_recall_drop = atof(next());
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (model_path.empty() || dataset_path.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // ================= Dataset split =================
+    // Calibrate on the first N items, benchmark on the others
+    std::vector<FoodRecord> calibration;
+    std::vector<FoodRecord> evaluation;
+    DatasetStream dataset;
+    if (!openDatasetStream(dataset_path, dataset)) {
+        return 1;
+    }
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        ((long) calibration.size() < n_calibration ? calibration : evaluation).push_back(record);
+    }
+    closeDatasetStream(dataset);
+    if (evaluation.empty()) {
+        fprintf(stderr, "dataset smaller than --calibration, benchmarking on the calibration items\n");
+        evaluation = calibration;
+    }
+
+    initBackends("");
+
+    ImportanceMatrix imatrix;
+    if (use_imatrix) {
+        if (!computeImportanceMatrix(model_path, template_type, calibration, n_threads, imatrix)) {
+            fprintf(stderr, "importance matrix failed for %s\n", model_path.c_str());
+            llama_backend_free();
+            return 1;
+        }
+        printf("imatrix: %zu tensors, %ld prompts, %ld tokens\n",
+               imatrix.values.size(), imatrix.n_prompts, imatrix.n_tokens);
+    }
+
+    // ================= Quantise =================
+    std::vector<Variant> variants;
+    std::stringstream type_list(types);
+    std::string type;
+    while (std::getline(type_list, type, ',')) {
+        llama_ftype ftype;
+        if (!parseFtype(type, ftype)) {
+            fprintf(stderr, "unknown type %s\n", type.c_str());
+            continue;
+        }
+
+        Variant variant;
+        variant.type = type;
+        variant.path = out_dir + "/" + baseName(model_path) + "-" + type + ".gguf";
+        if (!quantizeModel(model_path, variant.path, ftype, use_imatrix ? &imatrix : nullptr,
+                           n_threads)) {
+            continue;
+        }
+        variant.size_mb = fileSizeMb(variant.path);
+        variants.push_back(variant);
+    }
+
+    // ================= Benchmark =================
+    Variant baseline;
+    baseline.path = model_path;
+    baseline.size_mb = fileSizeMb(model_path);
+    baseline.ok = runShardedEvaluation(model_path, template_type, evaluation, config, baseline.report);
+
+    for (Variant& variant : variants) {
+        variant.ok = runShardedEvaluation(variant.path, template_type, evaluation, config,
+                                          variant.report);
+    }
+
+    printf("\n%zu items, %d shards\n", evaluation.size(), config.n_shards);
+    printf("%-8s %9s %8s %8s %9s %9s %9s\n",
+           "type", "size", "items/s", "model_ms", "precision", "recall", "microF1");
+    if (baseline.ok) {
+        printRow("base", baseline);
+    }
+
+    const Variant* best = nullptr;
+    for (const Variant& variant : variants) {
+        if (!variant.ok) {
+            printf("%-8s evaluation failed\n", variant.type.c_str());
+            continue;
+        }
+        printRow(variant.type.c_str(), variant);
+
+        const bool keeps_recall = !baseline.ok ||
+                                  variant.report.score.recall() >=
+                                  baseline.report.score.recall() - max_recall_drop;
+        if (keeps_recall && (!best || variant.report.model_ms < best->report.model_ms)) {
+            best = &variant;
+        }
+    }
+
+    if (best) {
+        printf("\nrecommended: %s (%s)\n", best->type.c_str(), best->path.c_str());
+    } else {
+        printf("\nno variant keeps recall within %.3f of the base model\n", max_recall_drop);
+    }
+
+    llama_backend_free();
+    return best ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// Greedy sampling microbenchmark: llama_sampler_sample()'s path (fill a
+// llama_token_data_array with the vocabulary, then the built-in greedy
+// sampler) against the argmax over the logits row (argmax_sampler.h),
+// per vocabulary size. No model needed: the rows are random logits.
+//
+//   slm-sampler-bench [--iters N] [--vocab 32000,128256,151936,256000]
+//
+// Compare the per-sample time with a decode step (slm-eval's OTPS) to see
+// what fraction of a step sampling takes for a small model.
+
+#include "../argmax_sampler.h"
+#include "../engine.h"
+#include "../llama/llama.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr, "usage: %s [--iters N] [--vocab N,N,...]\n", argv0);
+}
+
+// What llama_sampler_sample() does around the sampler for one row
+static llama_token builtinGreedy(llama_sampler* greedy, const float* logits, int n_vocab,
+                                 std::vector<llama_token_data>& cur) {
+    cur.resize(n_vocab);
+    for (llama_token id = 0; id < n_vocab; id++) {
+        cur[id] = llama_token_data{id, logits[id], 0.0f};
+    }
+    llama_token_data_array cur_p = {cur.data(), cur.size(), -1, false};
+    llama_sampler_apply(greedy, &cur_p);
+    return cur_p.data[cur_p.selected].id;
+}
+
+int main(int argc, char** argv) {
+    int n_iters = 2000;
+    std::vector<int> vocab_sizes = {32000, 128256, 151936, 256000};
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--iters") n_iters = std::max(1, atoi(next()));
+        else if (arg == "--vocab") {
+            vocab_sizes.clear();
+            const std::string list = next();
+            for (size_t pos = 0; pos < list.size(); ) {
+                vocab_sizes.push_back(std::max(1, atoi(list.c_str() + pos)));
+                const size_t comma = list.find(',', pos);
+                pos = comma == std::string::npos ? list.size() : comma + 1;
+            }
+        }
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // A few rows so the timing is not of one cached row
+    constexpr int N_ROWS = 8;
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0.0f, 4.0f);
+
+    llama_sampler* greedy = llama_sampler_init_greedy();
+    std::vector<llama_token_data> cur;
+
+    printf("%8s %12s %12s %12s %9s\n", "vocab", "builtin us", "scalar us", "argmax us", "speedup");
+    for (int n_vocab : vocab_sizes) {
+        std::vector<std::vector<float>> rows(N_ROWS, std::vector<float>(n_vocab));
+        for (std::vector<float>& row : rows) {
+            for (float& logit : row) {
+                logit = dist(rng);
+            }
+        }
+
+        // Same answers first
+        for (const std::vector<float>& row : rows) {
+            const llama_token expected = builtinGreedy(greedy, row.data(), n_vocab, cur);
+            if (argmaxLogits(row.data(), n_vocab) != expected ||
+                argmaxLogitsScalar(row.data(), n_vocab) != expected) {
+                fprintf(stderr, "argmax disagrees with the greedy sampler at vocab %d\n", n_vocab);
+                llama_sampler_free(greedy);
+                return 1;
+            }
+        }
+
+        auto time = [&](auto sample) {
+            long checksum = 0;
+            auto t_start = Clock::now();
+            for (int it = 0; it < n_iters; it++) {
+                checksum += sample(rows[it % N_ROWS].data());
+            }
+            const double us = std::chrono::duration<double, std::micro>(Clock::now() - t_start).count();
+            if (checksum < 0) {
+                printf("%ld\n", checksum);  // keeps the loop
+            }
+            return us / n_iters;
+        };
+
+        const double builtin_us = time([&](const float* logits) {
+            return builtinGreedy(greedy, logits, n_vocab, cur);
+        });
+        const double scalar_us = time([&](const float* logits) {
+            return argmaxLogitsScalar(logits, n_vocab);
+        });
+        const double argmax_us = time([&](const float* logits) {
+            return argmaxLogits(logits, n_vocab);
+        });
+
+        printf("%8d %12.2f %12.2f %12.2f %8.1fx\n", n_vocab, builtin_us, scalar_us, argmax_us,
+               builtin_us / std::max(argmax_us, 1e-3));
+    }
+
+    llama_sampler_free(greedy);
+    return 0;
+}
@@ -0,0 +1,600 @@
+// Local OpenAI-compatible HTTP server over the native engine. Binds to
+// 127.0.0.1 only and keeps the models of --models-dir warm between calls,
+// so evaluation scripts and notebooks do not pay a load per run.
+//
+//   slm-server --models-dir ~/models --port 8080 --max-models 2
+//
+//   curl localhost:8080/v1/models
+//   curl localhost:8080/v1/completions -d '{"model": "qwen2.5-1.5b-instruct-q4_k_m",
+//        "prompt": "The capital of France is", "max_tokens": 16, "stream": true}'
+//   curl localhost:8080/v1/allergens -d '{"model": "Llama-3.2-1B-Instruct-Q4_K_M",
+//        "ingredients": ["wheat flour, butter, eggs", "rice, soy sauce"]}'
+//
+// Sampling is greedy like the app; temperature and friends are ignored.
+
+#include "../allergens.h"
+#include "../engine.h"
+#include "../json.h"
+#include "../model_pool.h"
+#include "../native-log.h"
+#include "../scheduler.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <dirent.h>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static ModelPool g_pool;
+
+// ================= Model directory =================
+struct ModelEntry {
+    std::string id;    // file name without .gguf
+    std::string path;
+    int template_type = 0;
+};
+
+static std::mutex g_registry_mutex;
+static std::string g_models_dir = ".";
+static std::vector<ModelEntry> g_registry;
+
+static std::vector<ModelEntry> scanModels() {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    g_registry.clear();
+
+    DIR* dir = opendir(g_models_dir.c_str());
+    if (!dir) {
+        return g_registry;
+    }
+    while (dirent* entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        const std::string ext = ".gguf";
+        if (name.size() <= ext.size() ||
+            name.compare(name.size() - ext.size(), ext.size(), ext) != 0) {
+            continue;
+        }
+        ModelEntry model;
+        model.id = name.substr(0, name.size() - ext.size());
+        model.path = g_models_dir + "/" + name;
+        model.template_type = guessTemplateType(name);
+        g_registry.push_back(model);
+    }
+    closedir(dir);
+    return g_registry;
+}
+
+// Accepts the id with or without ".gguf"; an empty name picks the only model
+static bool findModel(const std::string& name, ModelEntry& out) {
+    for (int pass = 0; pass < 2; pass++) {
+        // Second pass after a rescan: the model may have been copied in since
+        std::vector<ModelEntry> models;
+        if (pass == 0) {
+            std::lock_guard<std::mutex> lock(g_registry_mutex);
+            models = g_registry;
+        } else {
+            models = scanModels();
+        }
+        for (const ModelEntry& model : models) {
+            if (model.id == name || model.id + ".gguf" == name) {
+                out = model;
+                return true;
+            }
+        }
+        if (name.empty() && models.size() == 1) {
+            out = models[0];
+            return true;
+        }
+    }
+    return false;
+}
+
+// ================= HTTP =================
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> headers;  // lower-case names
+    std::string body;
+};
+
+static const size_t MAX_HEADER_BYTES = 64 * 1024;
+static const size_t MAX_BODY_BYTES = 16 * 1024 * 1024;
+
+static bool sendAll(int sock, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += (size_t) n;
+    }
+    return true;
+}
+
+static bool readRequest(int sock, HttpRequest& request) {
+    std::string data;
+    size_t header_end;
+    char buf[4096];
+    while ((header_end = data.find("\r\n\r\n")) == std::string::npos) {
+        if (data.size() > MAX_HEADER_BYTES) {
+            return false;
+        }
+        const ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return false;
+        }
+        data.append(buf, (size_t) n);
+    }
+
+    // Request line
+    const size_t line_end = data.find("\r\n");
+    const std::string line = data.substr(0, line_end);
+    const size_t sp1 = line.find(' ');
+    const size_t sp2 = line.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) {
+        return false;
+    }
+    request.method = line.substr(0, sp1);
+    request.path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    request.path = request.path.substr(0, request.path.find('?'));
+
+    // Headers
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+        size_t end = data.find("\r\n", pos);
+        const std::string header = data.substr(pos, end - pos);
+        const size_t colon = header.find(':');
+        if (colon != std::string::npos) {
+            std::string name = header.substr(0, colon);
+            for (char& c : name) c = (char) tolower((unsigned char) c);
+            size_t v = colon + 1;
+            while (v < header.size() && header[v] == ' ') v++;
+            request.headers[name] = header.substr(v);
+        }
+        pos = end + 2;
+    }
+
+    // Body
+    size_t content_length = 0;
+    auto it = request.headers.find("content-length");
+    if (it != request.headers.end()) {
+        content_length = strtoul(it->second.c_str(), nullptr, 10);
+    }
+    if (content_length > MAX_BODY_BYTES) {
+        return false;
+    }
+    request.body = data.substr(header_end + 4);
+    while (request.body.size() < content_length) {
+        const ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return false;
+        }
+        request.body.append(buf, (size_t) n);
+    }
+    request.body.resize(content_length);
+    return true;
+}
+
+static const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        default:  return "Internal Server Error";
+    }
+}
+
+static void sendJson(int sock, int status, const std::string& body) {
+    sendAll(sock, "HTTP/1.1 " + std::to_string(status) + " " + statusText(status) + "\r\n"
+                  "Content-Type: application/json\r\n"
+                  "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                  "Connection: close\r\n"
+                  "\r\n" + body);
+}
+
+static void sendError(int sock, int status, const std::string& message) {
+    sendJson(sock, status,
+             "{\"error\":{\"message\":" + jsonQuote(message) +
+             ",\"type\":\"" + (status == 500 ? "server_error" : "invalid_request_error") + "\"}}");
+}
+
+static bool startEventStream(int sock) {
+    return sendAll(sock, "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/event-stream\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Connection: close\r\n"
+                         "\r\n");
+}
+
+static bool sendEvent(int sock, const std::string& data) {
+    return sendAll(sock, "data: " + data + "\n\n");
+}
+
+// ================= Inference =================
+// "prompt"/"ingredients" may be a string or an array of strings
+static bool readStrings(const JsonValue* value, std::vector<std::string>& out) {
+    if (!value) {
+        return false;
+    }
+    if (value->type == JsonValue::Type::String) {
+        out.push_back(value->string);
+        return true;
+    }
+    if (value->type != JsonValue::Type::Array || value->array.empty()) {
+        return false;
+    }
+    for (const JsonValue& item : value->array) {
+        if (item.type != JsonValue::Type::String) {
+            return false;
+        }
+        out.push_back(item.string);
+    }
+    return true;
+}
+
+// Everything the scheduler printed up to (not including) the newline stop
+static std::string visibleText(const Request& request, const std::string& text) {
+    return request.stop_at_newline ? text.substr(0, text.find('\n')) : text;
+}
+
+static const char* finishReason(const Request& request) {
+    return request.stop_reason == StopReason::Budget ||
+           request.stop_reason == StopReason::Context ? "length" : "stop";
+}
+
+struct Job {
+    ResidentModel* model = nullptr;
+    std::vector<Request> requests;
+};
+
+static void submitAll(Job& job) {
+    for (Request& request : job.requests) {
+        submitRequest(job.model->scheduler, &request);
+    }
+}
+
+static void waitAll(Job& job) {
+    for (Request& request : job.requests) {
+        waitForRequest(job.model->scheduler, &request);
+    }
+}
+
+// Streams the requests in order; the rest keep decoding meanwhile.
+// emit(i, delta, done) returns false once the client is gone.
+template <typename Emit>
+static void streamAll(Job& job, Emit emit) {
+    bool connected = true;
+    for (size_t i = 0; i < job.requests.size(); i++) {
+        Request& request = job.requests[i];
+        // request.output belongs to the scheduler until Done; only the
+        // deltas handed out under its mutex are read here
+        std::string text;
+        bool done = false;
+        while (!done) {
+            std::string delta;
+            done = waitForOutput(job.model->scheduler, &request, text.size(), delta);
+            const size_t n_visible = visibleText(request, text).size();
+            text += delta;
+            const std::string visible = visibleText(request, text);
+            if (connected) {
+                connected = emit(i, visible.substr(n_visible), done);
+            }
+        }
+    }
+}
+
+static std::string usageJson(const Job& job) {
+    long n_prompt = 0;
+    long n_completion = 0;
+    long n_cached = 0;
+    for (const Request& request : job.requests) {
+        n_prompt += (long) request.prompt_tokens.size();
+        n_completion += request.generated_tokens;
+        n_cached += request.n_cached;
+    }
+    return "{\"prompt_tokens\":" + std::to_string(n_prompt) +
+           ",\"completion_tokens\":" + std::to_string(n_completion) +
+           ",\"total_tokens\":" + std::to_string(n_prompt + n_completion) +
+           ",\"prompt_tokens_details\":{\"cached_tokens\":" + std::to_string(n_cached) + "}}";
+}
+
+static long g_next_id = 1;
+static std::mutex g_id_mutex;
+
+static std::string nextId(const char* prefix) {
+    std::lock_guard<std::mutex> lock(g_id_mutex);
+    return prefix + std::to_string(g_next_id++);
+}
+
+// POST /v1/completions: raw prompt, no chat template
+static void handleCompletions(int sock, const JsonValue& body, const ModelEntry& entry) {
+    std::vector<std::string> prompts;
+    if (!readStrings(body.get("prompt"), prompts)) {
+        sendError(sock, 400, "'prompt' must be a string or an array of strings");
+        return;
+    }
+
+    // Only the newline stop is supported, like the app
+    bool stop_at_newline = false;
+    std::vector<std::string> stops;
+    if (readStrings(body.get("stop"), stops)) {
+        for (const std::string& stop : stops) {
+            stop_at_newline |= stop == "\n";
+        }
+    }
+
+    Job job;
+    job.model = acquireModel(g_pool, entry.path, entry.template_type);
+    if (!job.model) {
+        sendError(sock, 500, "failed to load " + entry.id);
+        return;
+    }
+
+    const Session* session = job.model->session;
+    // session->config.max_tokens is sized for allergen answers; 16 is the API's default
+    const int max_tokens = (int) body.getNumber("max_tokens", 16);
+    job.requests.resize(prompts.size());
+    for (size_t i = 0; i < prompts.size(); i++) {
+        Request& request = job.requests[i];
+        request.id = (int) i;
+        request.prompt_tokens = tokenize(session->vocab, prompts[i], true);
+        request.max_tokens = std::max(1, max_tokens);
+        request.priority = prompts.size() == 1 ? RequestPriority::Interactive
+                                               : RequestPriority::Batch;
+        request.stop_at_newline = stop_at_newline;
+        request.stop_at_labels = false;
+    }
+    submitAll(job);
+
+    const std::string id = nextId("cmpl-");
+    const std::string header = "{\"id\":\"" + id + "\",\"object\":\"text_completion\","
+                               "\"created\":" + std::to_string((long) time(nullptr)) +
+                               ",\"model\":" + jsonQuote(entry.id);
+
+    if (body.getBool("stream", false)) {
+        if (startEventStream(sock)) {
+            streamAll(job, [&](size_t i, const std::string& delta, bool done) {
+                const Request& request = job.requests[i];
+                const std::string reason = done ? jsonQuote(finishReason(request)) : "null";
+                return sendEvent(sock, header + ",\"choices\":[{\"index\":" + std::to_string(i) +
+                                       ",\"text\":" + jsonQuote(delta) +
+                                       ",\"finish_reason\":" + reason + "}]}");
+            });
+            sendEvent(sock, "[DONE]");
+        }
+        waitAll(job);
+        releaseModel(g_pool, job.model);
+        return;
+    }
+
+    waitAll(job);
+    releaseModel(g_pool, job.model);
+
+    std::string choices;
+    for (size_t i = 0; i < job.requests.size(); i++) {
+        const Request& request = job.requests[i];
+        if (request.failed) {
+            sendError(sock, 500, "inference failed for prompt " + std::to_string(i));
+            return;
+        }
+        choices += std::string(i > 0 ? "," : "") +
+                   "{\"index\":" + std::to_string(i) +
+                   ",\"text\":" + jsonQuote(visibleText(request, request.output)) +
+                   ",\"finish_reason\":\"" + finishReason(request) + "\"}";
+    }
+    sendJson(sock, 200, header + ",\"choices\":[" + choices + "],\"usage\":" + usageJson(job) + "}");
+}
+
+static std::string allergenItemJson(size_t index, const std::string& ingredients, const Request& request) {
+    const AllergenMask mask = parsePredictedAllergens(request.output);
+    std::vector<std::string> names;
+    if (mask) {
+        const std::string list = formatAllergenMask(mask);
+        size_t start = 0;
+        while (start < list.size()) {
+            size_t comma = list.find(", ", start);
+            if (comma == std::string::npos) comma = list.size();
+            names.push_back(list.substr(start, comma - start));
+            start = comma + 2;
+        }
+    }
+
+    std::string allergens;
+    for (size_t k = 0; k < names.size(); k++) {
+        allergens += (k > 0 ? "," : "") + jsonQuote(names[k]);
+    }
+
+    return "{\"index\":" + std::to_string(index) +
+           ",\"ingredients\":" + jsonQuote(ingredients) +
+           ",\"allergens\":[" + allergens + "]" +
+           ",\"raw_output\":" + jsonQuote(request.output) +
+           ",\"failed\":" + (request.failed ? "true" : "false") +
+           ",\"metrics\":{\"ttft_ms\":" + std::to_string(request.ttft_ms) +
+           ",\"latency_ms\":" + std::to_string(elapsedMs(request.t_submit, request.t_done)) +
+           ",\"prompt_tokens\":" + std::to_string(request.prompt_tokens.size()) +
+           ",\"cached_tokens\":" + std::to_string(request.n_cached) +
+           ",\"completion_tokens\":" + std::to_string(request.generated_tokens) + "}}";
+}
+
+// POST /v1/allergens: the app's prompt, template and output mapping
+static void handleAllergens(int sock, const JsonValue& body, const ModelEntry& entry) {
+    std::vector<std::string> items;
+    if (!readStrings(body.get("ingredients"), items)) {
+        sendError(sock, 400, "'ingredients' must be a string or an array of strings");
+        return;
+    }
+
+    Job job;
+    job.model = acquireModel(g_pool, entry.path, entry.template_type);
+    if (!job.model) {
+        sendError(sock, 500, "failed to load " + entry.id);
+        return;
+    }
+
+    const Session* session = job.model->session;
+    job.requests.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        Request& request = job.requests[i];
+        request.id = (int) i;
+        request.prompt_tokens = tokenize(session->vocab,
+                                         formatAllergenPrompt(items[i], entry.template_type),
+                                         true);
+        request.max_tokens = session->config.max_tokens;
+        request.priority = items.size() == 1 ? RequestPriority::Interactive
+                                             : RequestPriority::Batch;
+    }
+    submitAll(job);
+
+    if (body.getBool("stream", false)) {
+        // One event per item as soon as it is done
+        if (startEventStream(sock)) {
+            bool connected = true;
+            for (size_t i = 0; i < job.requests.size() && connected; i++) {
+                waitForRequest(job.model->scheduler, &job.requests[i]);
+                connected = sendEvent(sock, allergenItemJson(i, items[i], job.requests[i]));
+            }
+            if (connected) {
+                sendEvent(sock, "[DONE]");
+            }
+        }
+        waitAll(job);
+        releaseModel(g_pool, job.model);
+        return;
+    }
+
+    waitAll(job);
+    releaseModel(g_pool, job.model);
+
+    std::string results;
+    for (size_t i = 0; i < job.requests.size(); i++) {
+        results += (i > 0 ? "," : "") + allergenItemJson(i, items[i], job.requests[i]);
+    }
+    sendJson(sock, 200, "{\"model\":" + jsonQuote(entry.id) +
+                        ",\"results\":[" + results + "],\"usage\":" + usageJson(job) + "}");
+}
+
+static void handleModels(int sock) {
+    std::string data;
+    for (const ModelEntry& model : scanModels()) {
+        data += std::string(data.empty() ? "" : ",") +
+                "{\"id\":" + jsonQuote(model.id) +
+                ",\"object\":\"model\",\"owned_by\":\"local\"" +
+                ",\"template_type\":" + std::to_string(model.template_type) + "}";
+    }
+    sendJson(sock, 200, "{\"object\":\"list\",\"data\":[" + data + "]}");
+}
+
+static void serveConnection(int sock) {
+    HttpRequest request;
+    if (!readRequest(sock, request)) {
+        close(sock);
+        return;
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "%s %s",
+                        request.method.c_str(), request.path.c_str());
+
+    if (request.path == "/health") {
+        sendJson(sock, 200, "{\"status\":\"ok\"}");
+    } else if (request.path == "/v1/models") {
+        handleModels(sock);
+    } else if (request.path == "/v1/completions" || request.path == "/v1/allergens") {
+        JsonValue body;
+        std::string error;
+        ModelEntry entry;
+        if (request.method != "POST") {
+            sendError(sock, 405, "use POST");
+        } else if (!parseJson(request.body, body, &error) || body.type != JsonValue::Type::Object) {
+            sendError(sock, 400, "invalid JSON body: " + error);
+        } else if (!findModel(body.getString("model", ""), entry)) {
+            sendError(sock, 404, "model '" + body.getString("model", "") + "' not found in " +
+                                 g_models_dir);
+        } else if (request.path == "/v1/completions") {
+            handleCompletions(sock, body, entry);
+        } else {
+            handleAllergens(sock, body, entry);
+        }
+    } else {
+        sendError(sock, 404, "unknown endpoint " + request.path);
+    }
+
+    close(sock);
+}
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [--models-dir DIR] [--port N] [--max-models N]\n"
+            "          [--parallel N] [--threads N] [--no-prefix-cache]\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    int port = 8080;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--models-dir") g_models_dir = next();
+        else if (arg == "--port") port = atoi(next());
+        else if (arg == "--max-models") g_pool.max_models = (size_t) std::max(1, atoi(next()));
+        else if (arg == "--parallel") g_pool.config.n_seq_max = std::max(2, atoi(next()));
+        else if (arg == "--threads") g_pool.config.n_threads = atoi(next());
+        else if (arg == "--no-prefix-cache") g_pool.config.prefix_cache = false;
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    const std::vector<ModelEntry> models = scanModels();
+    for (const ModelEntry& model : models) {
+        fprintf(stderr, "  %s (template %d)\n", model.id.c_str(), model.template_type);
+    }
+    if (models.empty()) {
+        fprintf(stderr, "warning: no .gguf files in %s\n", g_models_dir.c_str());
+    }
+
+    const int listen_sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t) port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // never reachable from the network
+    if (listen_sock < 0 ||
+        bind(listen_sock, (sockaddr*) &addr, sizeof(addr)) != 0 ||
+        listen(listen_sock, 64) != 0) {
+        fprintf(stderr, "cannot listen on 127.0.0.1:%d\n", port);
+        return 1;
+    }
+    fprintf(stderr, "slm-server listening on http://127.0.0.1:%d\n", port);
+
+    while (true) {
+        const int sock = accept4(listen_sock, nullptr, nullptr, SOCK_CLOEXEC);
+        if (sock < 0) {
+            continue;
+        }
+        std::thread(serveConnection, sock).detach();
+    }
+}
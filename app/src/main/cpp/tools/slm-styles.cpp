@@ -0,0 +1,207 @@
+// Prompt-style matrix: scores every item of a dataset in several prompt
+// styles with one model (see prompt_styles.h). The styles of an item are
+// decoded together and fork its ingredient prefill, so P styles cost about
+// one ingredient prefill per item instead of P.
+//
+//   slm-styles --model qwen2.5-1.5b-instruct-q4_k_m.gguf:0
+//              --dataset food_preprocessed.json --styles 0,1,2
+//
+// --no-fork prefills every prompt on its own, for comparison.
+
+#include "../allergens.h"
+#include "../dataset.h"
+#include "../engine.h"
+#include "../prompt_styles.h"
+#include "../scheduler.h"
+#include "../llama/llama.h"
+#include "model_arg.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --model PATH[:TEMPLATE] --dataset FILE [--styles 0,1,2]\n"
+            "          [--items N] [--no-fork]\n"
+            "  TEMPLATE: 0 = ChatML (Qwen), 1 = Gemma, 2 = Llama 3, 3 = Phi\n"
+            "  styles:",
+            argv0);
+    for (int s = 0; s < N_PROMPT_STYLES; s++) {
+        fprintf(stderr, " %d = %s", s, PROMPT_STYLES[s].name);
+    }
+    fprintf(stderr, "\n  --items: items decoded together (default 2)\n");
+}
+
+// One dataset item in every style, request k in styles[k]
+struct StyleItem {
+    FoodRecord record;
+    std::unique_ptr<Request[]> requests;
+};
+
+int main(int argc, char** argv) {
+    std::string dataset_path;
+    std::string model_path;
+    int template_type = 0;
+    std::vector<int> styles;
+    int n_items = 2;
+    bool fork = true;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--dataset") dataset_path = next();
+        else if (arg == "--model") {
+            const ModelArg model = parseModelArg(next());
+            model_path = model.path;
+            template_type = model.template_type;
+        }
+        else if (arg == "--styles") {
+            const std::string list = next();
+            for (size_t pos = 0; pos < list.size(); pos = list.find(',', pos) + 1) {
+                styles.push_back(atoi(list.c_str() + pos));
+                if (list.find(',', pos) == std::string::npos) {
+                    break;
+                }
+            }
+        }
+        else if (arg == "--items") n_items = std::max(1, atoi(next()));
+        else if (arg == "--no-fork") fork = false;
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (dataset_path.empty() || model_path.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (styles.empty()) {
+        for (int s = 0; s < N_PROMPT_STYLES; s++) {
+            styles.push_back(s);
+        }
+    }
+    for (int style : styles) {
+        if (style < 0 || style >= N_PROMPT_STYLES) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    const int n_styles = (int) styles.size();
+
+    std::vector<FoodRecord> records;
+    DatasetStream dataset;
+    if (!openDatasetStream(dataset_path, dataset)) {
+        return 1;
+    }
+    FoodRecord record;
+    while (readRecord(dataset, record)) {
+        records.push_back(record);
+    }
+    closeDatasetStream(dataset);
+
+    // A slot per style of every item in flight; nothing interactive here
+    EngineConfig config;
+    config.n_seq_max = n_items * n_styles;
+    config.n_interactive_seqs = 0;
+    Session* session = openSession(model_path, template_type, config);
+    if (!session) {
+        fprintf(stderr, "cannot load %s\n", model_path.c_str());
+        return 1;
+    }
+
+    Scheduler scheduler;
+    initScheduler(scheduler, session);
+
+    std::vector<AllergenScore> scores(n_styles);
+    std::vector<long> n_failed(n_styles, 0);
+    long n_prompt_tokens = 0;
+    long n_prefilled_tokens = 0;
+    auto t_start = Clock::now();
+
+    // Up to two rounds of items queued, like the evaluator's infer stage
+    std::vector<std::unique_ptr<StyleItem>> in_flight;
+    size_t next_record = 0;
+    while (next_record < records.size() || !in_flight.empty()) {
+        while (next_record < records.size() && (int) in_flight.size() < 2 * n_items) {
+            auto item = std::make_unique<StyleItem>();
+            item->record = records[next_record++];
+            item->requests.reset(new Request[n_styles]);
+            for (int k = 0; k < n_styles; k++) {
+                Request& request = item->requests[k];
+                request.id = item->record.id;
+                request.prompt_tokens = tokenize(
+                        session->vocab,
+                        formatStylePrompt(item->record.ingredients, styles[k], template_type), true);
+                request.max_tokens = config.max_tokens;
+            }
+            if (fork) {
+                sharePromptPrefix(item->requests.get(), n_styles);
+            }
+            for (int k = 0; k < n_styles; k++) {
+                submitRequest(scheduler, &item->requests[k]);
+            }
+            in_flight.push_back(std::move(item));
+        }
+
+        stepScheduler(scheduler);
+
+        for (auto& item : in_flight) {
+            bool done = true;
+            for (int k = 0; k < n_styles; k++) {
+                done = done && item->requests[k].state == RequestState::Done;
+            }
+            if (!done) {
+                continue;
+            }
+            const AllergenMask truth = parseAllergenList(item->record.allergens_mapped);
+            for (int k = 0; k < n_styles; k++) {
+                const Request& request = item->requests[k];
+                n_prompt_tokens += (long) request.prompt_tokens.size();
+                n_prefilled_tokens += request.n_prefilled - request.n_cached;
+                if (request.failed) {
+                    n_failed[k]++;
+                } else {
+                    scores[k].add(parsePredictedAllergens(request.output), truth);
+                }
+            }
+            item.reset();
+        }
+        in_flight.erase(std::remove(in_flight.begin(), in_flight.end(), nullptr),
+                        in_flight.end());
+    }
+
+    const long wall_ms = elapsedMs(t_start, Clock::now());
+    printf("%zu items x %d styles in %ld ms (%s)\n", records.size(), n_styles, wall_ms,
+           fork ? "forked prefixes" : "no forks");
+    printf("prompt tokens %ld, prefilled %ld (%.2f prefills per item), forked %ld\n\n",
+           n_prompt_tokens, n_prefilled_tokens,
+           (double) n_prefilled_tokens * n_styles / std::max<long>(n_prompt_tokens, 1),
+           scheduler.n_forked_tokens);
+
+    printf("%-8s %9s %9s %9s %9s %7s\n", "style", "micro-F1", "macro-F1", "exact", "FNR",
+           "failed");
+    for (int k = 0; k < n_styles; k++) {
+        printf("%-8s %9.4f %9.4f %9.4f %9.4f %7ld\n", PROMPT_STYLES[styles[k]].name,
+               scores[k].microF1(), scores[k].macroF1(), scores[k].exactMatchRatio(),
+               scores[k].falseNegativeRate(), n_failed[k]);
+    }
+    for (int k = 0; k < n_styles; k++) {
+        printf("\n[%s]\n%s\n", PROMPT_STYLES[styles[k]].name, scores[k].summary().c_str());
+    }
+
+    freeScheduler(scheduler);
+    closeSession(session);
+    llama_backend_free();
+    return 0;
+}
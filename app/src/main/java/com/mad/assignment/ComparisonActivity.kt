@@ -73,6 +73,7 @@ class ComparisonActivity : AppCompatActivity() {
 
     // Repositories
     private lateinit var firestoreRepository: FirestoreRepository
+    private lateinit var localResultStore: LocalResultStore
 
     // UI Components
     private lateinit var bottomNavigation: BottomNavigationView
@@ -112,6 +113,7 @@ class ComparisonActivity : AppCompatActivity() {
         setContentView(R.layout.activity_comparison)
 
         firestoreRepository = FirestoreRepository()
+        localResultStore = LocalResultStore(this)
 
         initUI()
         setupBottomNavigation()
@@ -178,7 +180,8 @@ class ComparisonActivity : AppCompatActivity() {
     }
 
     /**
-     * Fetch aggregate metrics for all models from Firebase
+     * Fetch aggregate metrics for all models from the on-device store,
+     * falling back to Firebase for models with nothing stored locally yet
      */
     private fun fetchModelMetrics() {
         setLoadingState(true)
@@ -187,8 +190,11 @@ class ComparisonActivity : AppCompatActivity() {
             try {
                 Log.d(TAG, "Fetching metrics for all models...")
 
+                // Plain models always, inference modes once they have results
                 val metrics = withContext(Dispatchers.IO) {
-                    firestoreRepository.getAllModelMetrics(ModelType.values())
+                    resultSeries().mapNotNull { (key, name, standard) ->
+                        loadModelMetrics(key, name, standard).takeIf { standard || it.predictionCount > 0 }
+                    }
                 }
 
                 Log.d(TAG, "Fetched ${metrics.size} model metrics")
@@ -211,6 +217,52 @@ class ComparisonActivity : AppCompatActivity() {
         }
     }
 
+    /**
+     * Stored result sets as (key, display name, standard): every model, then
+     * every model in each other inference mode (MainActivity's mode spinner)
+     */
+    private fun resultSeries(): List<Triple<String, String, Boolean>> =
+        InferenceMode.values().flatMap { mode ->
+            ModelType.values().map {
+                Triple(mode.resultKey(it), mode.resultName(it), mode == InferenceMode.STANDARD)
+            }
+        }
+
+    /**
+     * One result set's metrics from the on-device store. Plain models with
+     * none fall back to Firebase (runs made elsewhere or before the local
+     * store existed); inference modes are newer than the store, so they are
+     * read locally only. A Firebase error leaves it empty.
+     */
+    private suspend fun loadModelMetrics(
+        key: String,
+        displayName: String,
+        standard: Boolean
+    ): ModelAggregateMetrics {
+        val local = localResultStore.getModelAggregateMetrics(key, displayName)
+        if (local.predictionCount > 0 || !standard) return local
+        return try {
+            firestoreRepository.getModelAggregateMetrics(key, displayName)
+        } catch (e: Exception) {
+            Log.w(TAG, "Firebase metrics unavailable for $key: ${e.message}")
+            local
+        }
+    }
+
+    /**
+     * One result set's prediction records, with the same fallback as loadModelMetrics()
+     */
+    private suspend fun loadModelRecords(key: String, standard: Boolean): List<PredictionRecord> {
+        val local = localResultStore.getModelPredictionRecords(key)
+        if (local.isNotEmpty() || !standard) return local
+        return try {
+            firestoreRepository.getModelPredictionRecords(key)
+        } catch (e: Exception) {
+            Log.w(TAG, "Firebase records unavailable for $key: ${e.message}")
+            local
+        }
+    }
+
     /**
      * Display model cards with aggregate metrics and comparative rankings
      */
@@ -489,8 +541,13 @@ class ComparisonActivity : AppCompatActivity() {
 
         lifecycleScope.launch(Dispatchers.IO) {
             try {
-                // Fetch all prediction records from Firestore
-                val allRecords = firestoreRepository.getAllModelPredictionRecords(ModelType.values())
+                // Fetch all prediction records, local store first per result set;
+                // inference modes only get a sheet when they have records
+                val series = resultSeries()
+                    .map { (key, name, standard) -> Triple(key, name, loadModelRecords(key, standard)) to standard }
+                    .filter { (loaded, standard) -> standard || loaded.third.isNotEmpty() }
+                    .map { it.first }
+                val allRecords = series.associate { (key, _, records) -> key to records }
 
                 // Check if there's any data to export
                 val hasData = allRecords.values.any { it.isNotEmpty() }
@@ -527,11 +584,9 @@ class ComparisonActivity : AppCompatActivity() {
                 }
 
                 // Create a sheet for each model
-                ModelType.values().forEach { modelType ->
-                    val records = allRecords[modelType.firestoreKey] ?: emptyList()
-
+                series.forEach { (_, displayName, records) ->
                     // Create sheet with model name (sanitize for Excel sheet name restrictions)
-                    val sheetName = modelType.displayName
+                    val sheetName = displayName
                         .replace(Regex("[\\[\\]\\*\\?/\\\\:]"), "_")
                         .take(31) // Excel sheet name max 31 chars
                     val sheet = workbook.createSheet(sheetName)
@@ -12,10 +12,13 @@ package com.mad.assignment
 
 data class InferenceMetrics (
 
-    // Total time taken to complete the inference
+    // Total time taken to complete the inference: the native per-item
+    // latency (LAT_MS) when reported, else the wall time of the JNI call
     val latencyMs: Long,
 
-    // Memory snapshot
+    // Memory snapshot: change over the native call, which covered
+    // memoryBatchSize items (1 = this item alone, more = a batch aggregate
+    // shared by every item of the batch)
     val javaHeapKb: Long,
     val nativeHeapKb: Long,
     val totalPssKb: Long,
@@ -35,6 +38,9 @@ data class InferenceMetrics (
     val oet: Long,
 
     // Model name used for this inference
-    val modelName: String = ""
+    val modelName: String = "",
+
+    // Items measured together for the memory fields
+    val memoryBatchSize: Int = 1
 
 )
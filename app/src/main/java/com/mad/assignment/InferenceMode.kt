@@ -0,0 +1,44 @@
+package com.mad.assignment
+
+/**
+ * How the home screen runs the selected model over the items.
+ *
+ * Results of every mode are stored under the model's key plus keySuffix,
+ * so the comparison screen lists each mode as its own row next to the
+ * plain model instead of mixing them into one aggregate.
+ *
+ * @property label Name shown in the mode spinner and after the model name
+ * @property keySuffix Appended to ModelType.firestoreKey for storage
+ * @property compression Native ingredient compression (setIngredientCompression)
+ * @property chunkChars Native ingredient chunk size (setIngredientChunking), 0 = off
+ */
+enum class InferenceMode(
+    val label: String,
+    val keySuffix: String,
+    val compression: Int = 0,
+    val chunkChars: Int = 0
+) {
+    // One prompt per item with the full ingredient list
+    STANDARD("Standard", ""),
+
+    // Same prompts with the ingredient list reduced to its normalised atoms
+    NORMALIZED("Normalised ingredients", "_normalized", compression = 1),
+
+    // Normalised atoms without the ones that never carry an allergen
+    COMPRESSED("Compressed ingredients", "_compressed", compression = 2),
+
+    // Long ingredient lists asked about in chunks decoded together
+    CHUNKED("Chunked ingredients", "_chunked", chunkChars = 400),
+
+    // Ingredient phrases asked once each through the per-model atom cache
+    ATOMS("Ingredient atoms", "_atoms"),
+
+    // The model first, its larger sibling (ModelType.largeSibling) for the
+    // answers it is unsure of
+    CASCADE("Cascade", "_cascade");
+
+    fun resultKey(model: ModelType): String = model.firestoreKey + keySuffix
+
+    fun resultName(model: ModelType): String =
+        if (this == STANDARD) model.displayName else "${model.displayName} ($label)"
+}
@@ -0,0 +1,197 @@
+package com.mad.assignment
+
+import android.content.Context
+import android.util.Log
+import java.io.File
+import java.io.IOException
+
+/**
+ * On-device result store backed by the native append-only log
+ * (result_store.cpp, one checksummed file per model under filesDir/results).
+ *
+ * Aggregates are maintained natively on every append, so the comparison
+ * screen reads them in milliseconds and works offline. Same calls as
+ * FirestoreRepository; Firestore is only an optional sync target now.
+ */
+class LocalResultStore(context: Context) {
+
+    companion object {
+        private const val TAG = "LocalResultStore"
+        private const val STORE_DIR = "results"
+
+        // Layout of nativeAggregate(), see result_store.h
+        private const val AGG_COUNT = 0
+        private const val AGG_MATCH = 1
+        private const val AGG_LATENCY = 2
+        private const val AGG_JAVA_HEAP = 3
+        private const val AGG_NATIVE_HEAP = 4
+        private const val AGG_TOTAL_PSS = 5
+        private const val AGG_TTFT = 6
+        private const val AGG_ITPS = 7
+        private const val AGG_OTPS = 8
+        private const val AGG_OET = 9
+        private const val AGG_TP = 10
+        private const val AGG_FP = 11
+        private const val AGG_FN = 12
+        private const val AGG_TN = 13
+        private const val AGG_PRECISION = 14
+        private const val AGG_RECALL = 15
+        private const val AGG_F1_MICRO = 16
+        private const val AGG_F1_MACRO = 17
+        private const val AGG_HAMMING = 18
+        private const val AGG_FNR = 19
+        private const val AGG_HALLUCINATION = 20
+        private const val AGG_OVER_PREDICTION = 21
+        private const val AGG_ABSTENTION_TOTAL = 22
+        private const val AGG_ABSTENTION_CORRECT = 23
+
+        // Fields per row of nativeRecords()
+        private const val RECORD_FIELDS = 6
+
+        init {
+            System.loadLibrary("native-lib")
+        }
+    }
+
+    private external fun nativeInit(dir: String): Boolean
+
+    private external fun nativeAppend(
+        modelKey: String,
+        dataIds: IntArray,
+        datasetNumbers: IntArray,
+        timestampsMs: LongArray,
+        metrics: LongArray,             // 8 per row, InferenceMetrics order
+        matches: BooleanArray,
+        names: Array<String>,
+        ingredients: Array<String>,
+        allergens: Array<String>,
+        mappedAllergens: Array<String>,
+        predictedAllergens: Array<String>
+    ): Boolean
+
+    private external fun nativeAggregate(modelKey: String): DoubleArray
+
+    private external fun nativeRecords(modelKey: String): Array<String>
+
+    init {
+        val dir = File(context.filesDir, STORE_DIR)
+        dir.mkdirs()
+        if (!nativeInit(dir.absolutePath)) {
+            Log.e(TAG, "Cannot initialise result store in ${dir.absolutePath}")
+        }
+    }
+
+    /**
+     * Append a batch of results; durable on disk when this returns.
+     *
+     * @throws IOException if the append fails
+     */
+    fun storeBatchPredictions(results: List<PredictionResult>, modelKey: String) {
+        if (results.isEmpty()) return
+
+        val metrics = LongArray(results.size * 8)
+        results.forEachIndexed { i, r ->
+            val m = r.metrics
+            longArrayOf(
+                m.latencyMs, m.javaHeapKb, m.nativeHeapKb, m.totalPssKb,
+                m.ttft, m.itps, m.otps, m.oet
+            ).copyInto(metrics, i * 8)
+        }
+
+        val ok = nativeAppend(
+            modelKey,
+            results.map { it.dataId }.toIntArray(),
+            results.map { it.datasetNumber }.toIntArray(),
+            results.map { it.timestamp.toDate().time }.toLongArray(),
+            metrics,
+            results.map { it.isMatch }.toBooleanArray(),
+            results.map { it.name }.toTypedArray(),
+            results.map { it.ingredients }.toTypedArray(),
+            results.map { it.allergens }.toTypedArray(),
+            results.map { it.mappedAllergens }.toTypedArray(),
+            results.map { it.predictedAllergens }.toTypedArray()
+        )
+        if (!ok) {
+            throw IOException("Failed to store results for $modelKey")
+        }
+        Log.d(TAG, "Stored ${results.size} results locally for model $modelKey")
+    }
+
+    fun getModelAggregateMetrics(modelKey: String, displayName: String): ModelAggregateMetrics {
+        val a = nativeAggregate(modelKey)
+        val count = a[AGG_COUNT].toInt()
+        if (count == 0) {
+            return ModelAggregateMetrics(
+                modelKey = modelKey,
+                modelDisplayName = displayName,
+                predictionCount = 0,
+                averageAccuracy = 0.0,
+                averageLatencyMs = 0.0,
+                averageTtftMs = 0.0,
+                averageItps = 0.0,
+                averageOtps = 0.0,
+                averageOetMs = 0.0,
+                averageJavaHeapKb = 0.0,
+                averageNativeHeapKb = 0.0,
+                averageTotalPssKb = 0.0
+            )
+        }
+
+        val abstentionTotal = a[AGG_ABSTENTION_TOTAL]
+        return ModelAggregateMetrics(
+            modelKey = modelKey,
+            modelDisplayName = displayName,
+            predictionCount = count,
+            averageAccuracy = a[AGG_MATCH] / count * 100,
+            averageLatencyMs = a[AGG_LATENCY] / count,
+            averageTtftMs = a[AGG_TTFT] / count,
+            averageItps = a[AGG_ITPS] / count,
+            averageOtps = a[AGG_OTPS] / count,
+            averageOetMs = a[AGG_OET] / count,
+            averageJavaHeapKb = a[AGG_JAVA_HEAP] / count,
+            averageNativeHeapKb = a[AGG_NATIVE_HEAP] / count,
+            averageTotalPssKb = a[AGG_TOTAL_PSS] / count,
+            totalTp = a[AGG_TP].toInt(),
+            totalFp = a[AGG_FP].toInt(),
+            totalFn = a[AGG_FN].toInt(),
+            totalTn = a[AGG_TN].toInt(),
+            precision = a[AGG_PRECISION],
+            recall = a[AGG_RECALL],
+            f1Micro = a[AGG_F1_MICRO],
+            f1Macro = a[AGG_F1_MACRO],
+            hammingLoss = a[AGG_HAMMING],
+            fnr = a[AGG_FNR],
+            hallucinationRate = a[AGG_HALLUCINATION] / count * 100,
+            overPredictionRate = a[AGG_OVER_PREDICTION] / count * 100,
+            abstentionAccuracy = if (abstentionTotal > 0)
+                a[AGG_ABSTENTION_CORRECT] / abstentionTotal * 100 else 100.0
+        )
+    }
+
+    fun getAllModelMetrics(models: Array<ModelType>): List<ModelAggregateMetrics> {
+        return models.map { model ->
+            getModelAggregateMetrics(model.firestoreKey, model.displayName)
+        }
+    }
+
+    fun getModelPredictionRecords(modelKey: String): List<PredictionRecord> {
+        return nativeRecords(modelKey).toList()
+            .chunked(RECORD_FIELDS)
+            .map { f ->
+                PredictionRecord(
+                    dataId = f[0].toInt(),
+                    name = f[1],
+                    ingredients = f[2],
+                    groundTruthAllergens = f[3],
+                    predictedAllergens = f[4],
+                    isMatch = f[5] == "1"
+                )
+            }
+    }
+
+    fun getAllModelPredictionRecords(models: Array<ModelType>): Map<String, List<PredictionRecord>> {
+        return models.associate { model ->
+            model.firestoreKey to getModelPredictionRecords(model.firestoreKey)
+        }
+    }
+}
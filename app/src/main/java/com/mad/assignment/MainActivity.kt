@@ -53,7 +53,17 @@ enum class ModelType(
     LLAMA_3_2_3B("Llama 3.2 3B", "Llama-3.2-3B-Instruct-Q4_K_M.gguf", 2, "llama_3_2_3b"),
     PHI_3_5_MINI("Phi 3.5 mini", "Phi-3.5-mini-instruct-Q4_K_M.gguf", 3, "phi_3_5_mini"),
     PHI_3_MINI_4K("Phi 3 mini 4k", "Phi-3-mini-4k-instruct-q4.gguf", 3, "phi_3_mini_4k"),
-    VIKHR_GEMMA_2B("Vikhr Gemma 2B", "Vikhr-Gemma-2B-instruct-Q4_K_M.gguf", 1, "vikhr_gemma_2b")
+    VIKHR_GEMMA_2B("Vikhr Gemma 2B", "Vikhr-Gemma-2B-instruct-Q4_K_M.gguf", 1, "vikhr_gemma_2b"),
+    // Fine-tuned with tools/slm-finetune, prompted with the ingredients only
+    QWEN_2_5_0_5B_TUNED("Qwen 2.5 0.5B (tuned)", "qwen2.5-0.5b-allergens-q4_0.gguf", 4, "qwen_2_5_0_5b_tuned");
+
+    // Larger model of the same family, the second stage of InferenceMode.CASCADE
+    val largeSibling: ModelType?
+        get() = when (this) {
+            QWEN_2_5_1_5B -> QWEN_2_5_3B
+            LLAMA_3_2_1B -> LLAMA_3_2_3B
+            else -> null
+        }
 }
 
 /**
@@ -63,29 +73,95 @@ enum class ModelType(
  * - Reads from foodpreprocessed.xlsx (200 items, 20 datasets)
  * - User can select specific items to predict
  * - Batch processing with coroutines (no UI freeze)
- * - Stores results to Firebase Firestore
+ * - Stores results on device (LocalResultStore) and syncs them to Firebase Firestore
  */
 class MainActivity : AppCompatActivity() {
 
     companion object {
         private const val TAG = "MainActivity"
         private const val ITEMS_PER_DATASET = 10
-
-        // Load native libraries for LLM inference
+        private const val DAEMON_SOCKET = "@slm-daemon"
+        private const val RUN_JOURNAL_DIR = "runs"
+        private const val ATOM_CACHE_DIR = "atoms"
+        // Small-model answers less confident than this go to the large model
+        private const val CASCADE_MIN_CONFIDENCE = 0.6f
+        private const val TEMPLATE_TUNED = 4  // engine.h
+
+        // Load native libraries for LLM inference. The CPU backend is not
+        // loaded here: a source build ships one library per CPU variant and
+        // initNativeBackends() picks the best one for this device.
         init {
             System.loadLibrary("native-lib")
             System.loadLibrary("ggml-base")
-            System.loadLibrary("ggml-cpu")
             System.loadLibrary("llama")
         }
     }
 
     // Native JNI function declaration
     external fun inferAllergens(input: String, modelPath: String, templateType: Int): String
+    external fun inferAllergensBatch(inputs: Array<String>, modelPath: String, templateType: Int): Array<String>
+
+    // Registers the ggml backends from the APK's native library directory
+    external fun initNativeBackends(nativeLibDir: String)
+
+    // LoRA adapter applied on top of the resident model by the next inferences
+    // ("" = base model). Loaded on first use, kept until the model is switched.
+    // Set from resolveModelPath(), see resolveAdapterPath()
+    external fun selectLoraAdapter(adapterPath: String)
+
+    // Ingredient text rewritten natively before tokenisation: 0 = off, 1 = normalised
+    // atoms (no percentages, duplicates or casing), 2 = also drop allergen-free atoms.
+    // Set per batch from InferenceMode.compression
+    external fun setIngredientCompression(mode: Int)
+
+    // Ingredient lists longer than maxChars are split at top-level commas and brackets
+    // into chunks decoded in parallel; the result is the union (CHUNKS=<n>). 0 = off.
+    // Set per batch from InferenceMode.chunkChars
+    external fun setIngredientChunking(maxChars: Int)
+
+    // Routes inference to a running slm-daemon; false keeps it in-process.
+    // Only called when BuildConfig.INFERENCE_DAEMON is set
+    external fun connectInferenceDaemon(socketPath: String): Boolean
+
+    // Resumable Run All: finished items are journaled natively as they complete.
+    // openRunJournal returns the items of an interrupted run, flattened [itemId, result, memory]
+    external fun openRunJournal(journalPath: String, snapshotDir: String): Array<String>
+    external fun inferAllergensBatchJournaled(
+        inputs: Array<String>,
+        itemIds: IntArray,
+        modelPath: String,
+        templateType: Int
+    ): Array<String>
+    external fun journalRunMemory(itemIds: IntArray, memory: String): Boolean
+    external fun closeRunJournal(discard: Boolean)
+
+    // Ingredient atoms: the model is only asked about ingredient phrases missing from
+    // the per-model atom cache; an item's allergens are the union of its atoms' masks
+    external fun inferAllergensAtoms(
+        ingredients: Array<String>,
+        modelPath: String,
+        templateType: Int,
+        cachePath: String
+    ): Array<String>
+
+    // Cascade: every item on the small model, items whose answer confidence (weakest
+    // token probability) is below minConfidence again on the large model. Results
+    // carry CASCADE=small|large, CONF, SMALL_MS and LARGE_MS; LAT_MS covers both.
+    // Loads both models itself; the resident model is dropped for the call
+    external fun inferAllergensCascade(
+        ingredients: Array<String>,
+        smallPath: String,
+        smallTemplate: Int,
+        largePath: String,
+        largeTemplate: Int,
+        minConfidence: Float
+    ): Array<String>
 
     // Repositories
     private lateinit var dataRepository: JsonDataRepository
     private lateinit var firestoreRepository: FirestoreRepository
+    private lateinit var localResultStore: LocalResultStore
+    private lateinit var pendingFirestoreSync: PendingFirestoreSync
 
     // UI Components
     private lateinit var rootLayout: ConstraintLayout
@@ -110,6 +186,7 @@ class MainActivity : AppCompatActivity() {
     // Model selection UI
     private lateinit var spinnerModel: Spinner
     private lateinit var tvModelStatus: TextView
+    private lateinit var spinnerMode: Spinner
     private lateinit var btnRunAll: Button
 
     // Bottom Navigation
@@ -129,6 +206,7 @@ class MainActivity : AppCompatActivity() {
 
     // Model selection state
     private var selectedModelType: ModelType? = null
+    private var selectedMode = InferenceMode.STANDARD
     private var loadingDialog: AlertDialog? = null
     private var availableModels: List<ModelType> = emptyList()
 
@@ -168,11 +246,15 @@ class MainActivity : AppCompatActivity() {
         super.onCreate(savedInstanceState)
         setContentView(R.layout.activity_main)
 
+        // Before any model is loaded
+        initNativeBackends(applicationInfo.nativeLibraryDir)
+
         // Initialize
         initRepositories()
         initUI()
         setupSpinner()
         setupModelSpinner()
+        setupModeSpinner()
         setupBottomNavigation()
         setupRecyclerView()
         setupClickListeners()
@@ -180,15 +262,49 @@ class MainActivity : AppCompatActivity() {
         // Check which models are available in external storage
         checkModelsAndShowStatus()
 
+        // Upload batches whose Firestore sync failed in an earlier session
+        lifecycleScope.launch(Dispatchers.IO) {
+            pendingFirestoreSync.syncPending()
+        }
+
+        // Use the out-of-process engine if one is running on the device. Only
+        // built in with -PinferenceDaemon=true (rooted/permissive devices):
+        // SELinux keeps a normal app from reaching an adb shell daemon
+        if (BuildConfig.INFERENCE_DAEMON) {
+            lifecycleScope.launch(Dispatchers.IO) {
+                val connected = connectInferenceDaemon(DAEMON_SOCKET)
+                Log.d(TAG, "Inference daemon ${if (connected) "connected" else "not running, using in-process engine"}")
+            }
+        }
+
         Log.d(TAG, "MainActivity created")
     }
 
     private fun initRepositories() {
         dataRepository = JsonDataRepository(this)
         firestoreRepository = FirestoreRepository()
+        localResultStore = LocalResultStore(this)
+        pendingFirestoreSync = PendingFirestoreSync(this, firestoreRepository)
         Log.d(TAG, "Repositories initialized")
     }
 
+    /**
+     * Saves results to the on-device store (durable when this returns) and
+     * queues them for Firestore, then syncs in the background. A batch whose
+     * upload fails stays queued and is retried on the next save or launch;
+     * the local store is the source of truth for the comparison screen.
+     */
+    private suspend fun saveResults(results: List<PredictionResult>, modelKey: String) {
+        withContext(Dispatchers.IO) {
+            localResultStore.storeBatchPredictions(results, modelKey)
+            pendingFirestoreSync.add(results, modelKey)
+        }
+
+        lifecycleScope.launch(Dispatchers.IO) {
+            pendingFirestoreSync.syncPending()
+        }
+    }
+
     private fun initUI() {
         rootLayout = findViewById(R.id.rootLayout)
         spinnerDataset = findViewById(R.id.spinnerDataset)
@@ -212,6 +328,7 @@ class MainActivity : AppCompatActivity() {
         // Model selection UI
         spinnerModel = findViewById(R.id.spinnerModel)
         tvModelStatus = findViewById(R.id.tvModelStatus)
+        spinnerMode = findViewById(R.id.spinnerMode)
         btnRunAll = findViewById(R.id.btnRunAll)
 
         // Bottom Navigation
@@ -297,6 +414,30 @@ class MainActivity : AppCompatActivity() {
         Log.d(TAG, "Model spinner setup: ${availableModels.size} models available")
     }
 
+    /**
+     * Setup inference mode spinner; every mode stores its results separately
+     */
+    private fun setupModeSpinner() {
+        val modeAdapter = ArrayAdapter(
+            this,
+            R.layout.spinner_item,
+            InferenceMode.values().map { it.label }
+        )
+        modeAdapter.setDropDownViewResource(R.layout.spinner_item)
+        spinnerMode.adapter = modeAdapter
+
+        spinnerMode.onItemSelectedListener = object : AdapterView.OnItemSelectedListener {
+            override fun onItemSelected(parent: AdapterView<*>?, view: View?, position: Int, id: Long) {
+                selectedMode = InferenceMode.values()[position]
+                Log.d(TAG, "Inference mode selected: ${selectedMode.label}")
+            }
+
+            override fun onNothingSelected(parent: AdapterView<*>?) {
+                selectedMode = InferenceMode.STANDARD
+            }
+        }
+    }
+
     /**
      * Setup bottom navigation for switching between screens
      */
@@ -383,6 +524,7 @@ class MainActivity : AppCompatActivity() {
     private fun setUIEnabled(enabled: Boolean) {
         spinnerDataset.isEnabled = enabled
         spinnerModel.isEnabled = enabled
+        spinnerMode.isEnabled = enabled
         btnLoadDataset.isEnabled = enabled && selectedModelType != null
         btnStartPrediction.isEnabled = enabled && selectedModelType != null && adapter.getSelectedIds().isNotEmpty()
     }
@@ -590,6 +732,7 @@ class MainActivity : AppCompatActivity() {
             showSnackbar("Please select at least one item", isSuccess = false)
             return
         }
+        if (!modeAvailable(selectedMode)) return
 
         // Get selected food items
         val selectedItems = loadedFoodItems.filter { it.id in selectedIds }
@@ -615,11 +758,19 @@ class MainActivity : AppCompatActivity() {
         })
         adapter.submitList(currentStates.toList())
 
+        val mode = selectedMode
         currentJob = lifecycleScope.launch(Dispatchers.Main) {
             try {
                 progressOverall.max = selectedItems.size
                 progressOverall.progress = 0
 
+                // The cascade loads both of its models on every call, so the
+                // whole selection goes through it at once
+                val cascadeResults = if (mode == InferenceMode.CASCADE) {
+                    tvProgress.text = "Running cascade on ${selectedItems.size} items..."
+                    withContext(Dispatchers.Default) { performBatchInference(selectedItems, mode) }
+                } else null
+
                 // Process only selected items
                 selectedItems.forEachIndexed { index, foodItem ->
                     // Check if cancelled
@@ -638,9 +789,8 @@ class MainActivity : AppCompatActivity() {
 
                     try {
                         // Run inference on background thread
-                        val (predictedAllergens, metrics) = withContext(Dispatchers.Default) {
-                            performInference(foodItem)
-                        }
+                        val (predictedAllergens, metrics) = cascadeResults?.get(index)
+                            ?: withContext(Dispatchers.Default) { performInference(foodItem, mode) }
 
                         // Compare prediction with ground truth
                         val isMatch = compareAllergens(predictedAllergens, foodItem.allergensMapped)
@@ -657,7 +807,7 @@ class MainActivity : AppCompatActivity() {
                             metrics = metrics,
                             datasetNumber = currentDatasetNumber,
                             isMatch = isMatch,
-                            modelName = selectedModelType?.displayName ?: "Unknown"
+                            modelName = selectedModelType?.let { mode.resultName(it) } ?: "Unknown"
                         )
                         currentResults.add(result)
 
@@ -684,26 +834,15 @@ class MainActivity : AppCompatActivity() {
                     progressOverall.progress = index + 1
                 }
 
-                // Store results to Firestore using model-specific collection
+                // Store results locally using model-specific store
                 if (currentResults.isNotEmpty()) {
-                    tvProgress.text = "Saving to Firebase..."
-                    withContext(Dispatchers.IO) {
-                        try {
-                            firestoreRepository.storeBatchPredictions(
-                                currentResults,
-                                selectedModelType!!.firestoreKey
-                            )
-                            Log.d(TAG, "Stored ${currentResults.size} results to Firestore for model ${selectedModelType?.firestoreKey}")
-                        } catch (e: Exception) {
-                            Log.e(TAG, "Firestore error: ${e.message}")
-                            throw e
-                        }
-                    }
+                    tvProgress.text = "Saving results..."
+                    saveResults(currentResults.toList(), mode.resultKey(selectedModelType!!))
                 }
 
                 // Show summary
                 showSummary(currentDatasetNumber, currentResults)
-                showSnackbar("Completed! ${currentResults.size} predictions saved to Firestore", isSuccess = true)
+                showSnackbar("Completed! ${currentResults.size} predictions saved", isSuccess = true)
 
             } catch (e: CancellationException) {
                 Log.d(TAG, "Prediction cancelled")
@@ -720,23 +859,20 @@ class MainActivity : AppCompatActivity() {
     /**
      * Perform LLM inference for a single food item
      */
-    private fun performInference(foodItem: FoodItem): Pair<String, InferenceMetrics> {
+    private fun performInference(foodItem: FoodItem, mode: InferenceMode): Pair<String, InferenceMetrics> {
+        if (mode != InferenceMode.STANDARD) {
+            // The other modes run natively over a list of items
+            return performBatchInference(listOf(foodItem), mode).single()
+        }
+
         val modelType = selectedModelType
             ?: throw IllegalStateException("No model selected")
 
-        val prompt = buildPrompt(foodItem.ingredients)
-        val externalDir = getExternalFilesDir(null)
-            ?: throw IllegalStateException("External storage not available")
-        val modelPath = "${externalDir.absolutePath}/${modelType.fileName}"
+        setIngredientCompression(mode.compression)
+        setIngredientChunking(mode.chunkChars)
 
-        // Verify model file exists
-        val modelFile = File(modelPath)
-        if (!modelFile.exists()) {
-            throw IllegalStateException(
-                "Model not found: ${modelType.displayName}\n" +
-                "Push via ADB: adb push ${modelType.fileName} /sdcard/Android/data/com.mad.assignment/files/"
-            )
-        }
+        val prompt = buildPrompt(foodItem.ingredients, modelType)
+        val modelPath = resolveModelPath(modelType)
 
         // Memory measurements before
         val javaBefore = MemoryReader.javaHeapKb()
@@ -753,7 +889,184 @@ class MainActivity : AppCompatActivity() {
         val nativeAfter = MemoryReader.nativeHeapKb()
         val pssAfter = MemoryReader.totalPssKb()
 
-        // Parse result: TTFT_MS=<val>;ITPS=<val>;OTPS=<val>;OET_MS=<val>|<output>
+        return parseInferenceResult(
+            foodItem, rawResult, latencyMs,
+            javaAfter - javaBefore, nativeAfter - nativeBefore, pssAfter - pssBefore,
+            1, modelType
+        )
+    }
+
+    /**
+     * Perform LLM inference for several food items in one native call.
+     * The native scheduler decodes the prompts together and interleaves
+     * long prefills in bounded chunks, so per-item latency comes from the
+     * native LAT_MS field. Memory deltas can only be measured for the whole
+     * batch; every item carries them with memoryBatchSize = batch size.
+     * Only STANDARD batches can be journaled.
+     */
+    private fun performBatchInference(
+        foodItems: List<FoodItem>,
+        mode: InferenceMode,
+        journaled: Boolean = false
+    ): List<Pair<String, InferenceMetrics>> {
+        val modelType = selectedModelType
+            ?: throw IllegalStateException("No model selected")
+
+        val prompts = foodItems.map { buildPrompt(it.ingredients, modelType) }.toTypedArray()
+        val modelPath = resolveModelPath(modelType)
+
+        val javaBefore = MemoryReader.javaHeapKb()
+        val nativeBefore = MemoryReader.nativeHeapKb()
+        val pssBefore = MemoryReader.totalPssKb()
+
+        // Native state shared by all modes, so every batch sets its own
+        setIngredientCompression(mode.compression)
+        setIngredientChunking(mode.chunkChars)
+
+        val startNs = System.nanoTime()
+        val itemIds = foodItems.map { it.id }.toIntArray()
+        val ingredients = foodItems.map { it.ingredients }.toTypedArray()
+        val rawResults = when (mode) {
+            InferenceMode.STANDARD, InferenceMode.NORMALIZED, InferenceMode.COMPRESSED,
+            InferenceMode.CHUNKED -> if (journaled) {
+                inferAllergensBatchJournaled(prompts, itemIds, modelPath, modelType.templateType)
+            } else {
+                inferAllergensBatch(prompts, modelPath, modelType.templateType)
+            }
+            InferenceMode.ATOMS ->
+                inferAllergensAtoms(ingredients, modelPath, modelType.templateType, atomCachePath(modelType))
+            InferenceMode.CASCADE -> {
+                val large = modelType.largeSibling
+                    ?: throw IllegalStateException("No larger model for ${modelType.displayName}")
+                inferAllergensCascade(
+                    ingredients, modelPath, modelType.templateType,
+                    modelFilePath(large), large.templateType, CASCADE_MIN_CONFIDENCE
+                )
+            }
+        }
+        val batchMs = (System.nanoTime() - startNs) / 1_000_000
+
+        val javaDelta = MemoryReader.javaHeapKb() - javaBefore
+        val nativeDelta = MemoryReader.nativeHeapKb() - nativeBefore
+        val pssDelta = MemoryReader.totalPssKb() - pssBefore
+
+        if (journaled) {
+            journalRunMemory(
+                itemIds,
+                "JAVA_KB=$javaDelta;NATIVE_KB=$nativeDelta;PSS_KB=$pssDelta;BATCH_MS=$batchMs;" +
+                    "BATCH_SIZE=${foodItems.size}"
+            )
+        }
+
+        return foodItems.mapIndexed { i, foodItem ->
+            parseInferenceResult(
+                foodItem, rawResults[i], batchMs,
+                javaDelta, nativeDelta, pssDelta,
+                foodItems.size, modelType
+            )
+        }
+    }
+
+    /**
+     * Per-model atom cache; the cached answers are the model's own
+     */
+    private fun atomCachePath(modelType: ModelType): String {
+        val dir = File(filesDir, ATOM_CACHE_DIR).apply { mkdirs() }
+        return File(dir, "${modelType.firestoreKey}.slac").absolutePath
+    }
+
+    /**
+     * Rebuild the outcome of an item finished by an interrupted Run All from
+     * its journal entry. Items killed before their batch returned have no
+     * memory record; their memory deltas are 0. Latency is the native one.
+     */
+    private fun resumeJournaledItem(
+        foodItem: FoodItem,
+        rawResult: String,
+        memory: String,
+        modelType: ModelType
+    ): Pair<String, InferenceMetrics> {
+        val values = memory.split(";")
+            .mapNotNull { field ->
+                val kv = field.split("=", limit = 2)
+                if (kv.size == 2) kv[0] to (kv[1].toLongOrNull() ?: 0L) else null
+            }
+            .toMap()
+
+        return parseInferenceResult(
+            foodItem, rawResult, values["BATCH_MS"] ?: -1L,
+            values["JAVA_KB"] ?: 0L, values["NATIVE_KB"] ?: 0L, values["PSS_KB"] ?: 0L,
+            (values["BATCH_SIZE"] ?: 1L).toInt(), modelType
+        )
+    }
+
+    /**
+     * Resolve the GGUF path for a model and verify it was pushed via ADB;
+     * selects the model's LoRA adapter for the resident engine
+     */
+    private fun resolveModelPath(modelType: ModelType): String {
+        val modelPath = modelFilePath(modelType)
+        selectLoraAdapter(resolveAdapterPath(File(modelPath)))
+        return modelPath
+    }
+
+    /**
+     * GGUF path of a model pushed via ADB, without touching the adapter
+     * selection (the cascade's large model)
+     */
+    private fun modelFilePath(modelType: ModelType): String {
+        val externalDir = getExternalFilesDir(null)
+            ?: throw IllegalStateException("External storage not available")
+        val modelPath = "${externalDir.absolutePath}/${modelType.fileName}"
+
+        // Verify model file exists
+        if (!File(modelPath).exists()) {
+            throw IllegalStateException(
+                "Model not found: ${modelType.displayName}\n" +
+                "Push via ADB: adb push ${modelType.fileName} /sdcard/Android/data/com.mad.assignment/files/"
+            )
+        }
+        return modelPath
+    }
+
+    /**
+     * Whether the selected mode can run on the selected model; says why not
+     */
+    private fun modeAvailable(mode: InferenceMode): Boolean {
+        if (mode == InferenceMode.CASCADE && selectedModelType?.largeSibling == null) {
+            showSnackbar("Cascade needs Qwen 2.5 1.5B or Llama 3.2 1B (they have a larger sibling)", isSuccess = false)
+            return false
+        }
+        return true
+    }
+
+    /**
+     * LoRA adapter pushed next to the model as <model>.lora.gguf (e.g.
+     * qwen2.5-1.5b-instruct-q4_k_m.lora.gguf), "" to run the base model
+     */
+    private fun resolveAdapterPath(modelFile: File): String {
+        val adapterFile = File(modelFile.parentFile, "${modelFile.nameWithoutExtension}.lora.gguf")
+        if (!adapterFile.exists()) return ""
+        Log.d(TAG, "Using LoRA adapter ${adapterFile.name}")
+        return adapterFile.absolutePath
+    }
+
+    /**
+     * Parse the native result string into mapped allergens and metrics.
+     * latencyMs is the caller's wall time, used when the native side did
+     * not report LAT_MS; the memory deltas cover memoryBatchSize items.
+     */
+    private fun parseInferenceResult(
+        foodItem: FoodItem,
+        rawResult: String,
+        latencyMs: Long,
+        javaHeapKb: Long,
+        nativeHeapKb: Long,
+        totalPssKb: Long,
+        memoryBatchSize: Int,
+        modelType: ModelType
+    ): Pair<String, InferenceMetrics> {
+        // Parse result: TTFT_MS=<val>;ITPS=<val>;OTPS=<val>;OET_MS=<val>;LAT_MS=<val>|<output>
         val parts = rawResult.split("|", limit = 2)
         val meta = parts[0]
         val rawOutput = if (parts.size > 1) parts[1] else ""
@@ -762,6 +1075,7 @@ class MainActivity : AppCompatActivity() {
         var itps = -1L
         var otps = -1L
         var oetMs = -1L
+        var nativeLatencyMs = -1L
 
         meta.split(";").forEach {
             when {
@@ -769,19 +1083,21 @@ class MainActivity : AppCompatActivity() {
                 it.startsWith("ITPS=") -> itps = it.removePrefix("ITPS=").toLongOrNull() ?: -1L
                 it.startsWith("OTPS=") -> otps = it.removePrefix("OTPS=").toLongOrNull() ?: -1L
                 it.startsWith("OET_MS=") -> oetMs = it.removePrefix("OET_MS=").toLongOrNull() ?: -1L
+                it.startsWith("LAT_MS=") -> nativeLatencyMs = it.removePrefix("LAT_MS=").toLongOrNull() ?: -1L
             }
         }
 
         val metrics = InferenceMetrics(
-            latencyMs = latencyMs,
-            javaHeapKb = javaAfter - javaBefore,
-            nativeHeapKb = nativeAfter - nativeBefore,
-            totalPssKb = pssAfter - pssBefore,
+            latencyMs = if (nativeLatencyMs >= 0) nativeLatencyMs else latencyMs,
+            javaHeapKb = javaHeapKb,
+            nativeHeapKb = nativeHeapKb,
+            totalPssKb = totalPssKb,
             ttft = ttftMs,
             itps = itps,
             otps = otps,
             oet = oetMs,
-            modelName = modelType.displayName
+            modelName = modelType.displayName,
+            memoryBatchSize = memoryBatchSize
         )
 
         Log.i("SLM_METRICS", "Item ${foodItem.id}: Latency=${metrics.latencyMs}ms | TTFT=${ttftMs}ms | OTPS=${otps} tok/s")
@@ -826,10 +1142,15 @@ class MainActivity : AppCompatActivity() {
     }
 
     /**
-     * Build the zero-shot prompt for allergen detection.
+     * Build the zero-shot prompt for allergen detection (ingredients only
+     * for models fine-tuned on the task).
      * Optimized for small LLMs with clear instruction and constrained output.
      */
-    private fun buildPrompt(ingredients: String): String {
+    private fun buildPrompt(ingredients: String, modelType: ModelType): String {
+        if (modelType.templateType == TEMPLATE_TUNED) {
+            // The instruction was trained into the model
+            return "Ingredients: $ingredients\nAllergens:"
+        }
         return """Detect allergens in the ingredients. Output only allergens from this list: milk, egg, peanut, tree nut, wheat, soy, fish, shellfish, sesame
 
 Ingredients: $ingredients
@@ -875,6 +1196,7 @@ Allergens:"""
             showSnackbar("Please select a model first", isSuccess = false)
             return
         }
+        if (!modeAvailable(selectedMode)) return
 
         Log.d(TAG, "Starting Run All 200 predictions for ${selectedModelType?.displayName}")
 
@@ -893,6 +1215,10 @@ Allergens:"""
         recyclerView.visibility = View.GONE
         tvEmptyState.visibility = View.GONE
 
+        // Only the standard path journals its items natively
+        val mode = selectedMode
+        val useJournal = mode == InferenceMode.STANDARD
+
         currentJob = lifecycleScope.launch(Dispatchers.Main) {
             try {
                 // Load all 200 items from JSON
@@ -911,66 +1237,86 @@ Allergens:"""
                 progressOverall.max = allItems.size
                 progressOverall.progress = 0
 
-                // Process all items
-                allItems.forEachIndexed { index, foodItem ->
+                // Items an interrupted run of this model already finished
+                val modelType = selectedModelType!!
+                val runDir = File(filesDir, RUN_JOURNAL_DIR).apply { mkdirs() }
+                val journalPath = File(runDir, "runall_${modelType.firestoreKey}.jrn").absolutePath
+                val journaled = if (!useJournal) emptyMap<Int, Pair<String, String>>() else withContext(Dispatchers.IO) {
+                    openRunJournal(journalPath, runDir.absolutePath)
+                        .toList()
+                        .chunked(3)
+                        .associate { (id, result, memory) -> id.toInt() to (result to memory) }
+                }
+                if (journaled.isNotEmpty()) {
+                    Log.d(TAG, "Resuming Run All: ${journaled.size} items already done")
+                }
+
+                // Process all items, one dataset per native batch
+                var processed = 0
+                allItems.chunked(ITEMS_PER_DATASET).forEach { chunk ->
                     // Check if cancelled
                     if (!isActive) {
-                        Log.d(TAG, "Run All cancelled at index $index")
+                        Log.d(TAG, "Run All cancelled at index $processed")
                         return@launch
                     }
 
-                    updateProgress(index, allItems.size, foodItem.name)
+                    updateProgress(processed, allItems.size, chunk.first().name)
 
                     try {
-                        // Run inference on background thread
-                        val (predictedAllergens, metrics) = withContext(Dispatchers.Default) {
-                            performInference(foodItem)
+                        // Run inference on background thread, skipping finished items
+                        val pending = chunk.filter { it.id !in journaled }
+                        val fresh = withContext(Dispatchers.Default) {
+                            if (pending.isEmpty()) emptyList()
+                            else performBatchInference(pending, mode, journaled = useJournal)
+                        }
+                        val freshById = pending.map { it.id }.zip(fresh).toMap()
+                        val outcomes = chunk.map { foodItem ->
+                            freshById[foodItem.id] ?: journaled.getValue(foodItem.id).let { (result, memory) ->
+                                resumeJournaledItem(foodItem, result, memory, modelType)
+                            }
                         }
 
-                        // Compare prediction with ground truth
-                        val isMatch = compareAllergens(predictedAllergens, foodItem.allergensMapped)
-
-                        // Create PredictionResult for Firestore
-                        val result = PredictionResult(
-                            dataId = foodItem.id,
-                            name = foodItem.name,
-                            ingredients = foodItem.ingredients,
-                            allergens = foodItem.allergensRaw,
-                            mappedAllergens = foodItem.allergensMapped,
-                            predictedAllergens = predictedAllergens,
-                            timestamp = Timestamp.now(),
-                            metrics = metrics,
-                            datasetNumber = (foodItem.id - 1) / ITEMS_PER_DATASET + 1,
-                            isMatch = isMatch,
-                            modelName = selectedModelType?.displayName ?: "Unknown"
-                        )
-                        currentResults.add(result)
+                        chunk.zip(outcomes).forEach { (foodItem, outcome) ->
+                            val (predictedAllergens, metrics) = outcome
+
+                            // Compare prediction with ground truth
+                            val isMatch = compareAllergens(predictedAllergens, foodItem.allergensMapped)
+
+                            // Create PredictionResult for Firestore
+                            val result = PredictionResult(
+                                dataId = foodItem.id,
+                                name = foodItem.name,
+                                ingredients = foodItem.ingredients,
+                                allergens = foodItem.allergensRaw,
+                                mappedAllergens = foodItem.allergensMapped,
+                                predictedAllergens = predictedAllergens,
+                                timestamp = Timestamp.now(),
+                                metrics = metrics,
+                                datasetNumber = (foodItem.id - 1) / ITEMS_PER_DATASET + 1,
+                                isMatch = isMatch,
+                                modelName = mode.resultName(modelType)
+                            )
+                            currentResults.add(result)
 
-                        Log.d(TAG, "Item ${foodItem.id} completed: match=$isMatch")
+                            Log.d(TAG, "Item ${foodItem.id} completed: match=$isMatch")
+                        }
 
                     } catch (e: Exception) {
-                        Log.e(TAG, "Error processing item ${foodItem.id}: ${e.message}")
-                        // Continue with next item even if one fails
+                        Log.e(TAG, "Error processing items ${chunk.first().id}-${chunk.last().id}: ${e.message}")
+                        // Continue with next batch even if one fails
                     }
 
-                    progressOverall.progress = index + 1
+                    processed += chunk.size
+                    progressOverall.progress = processed
                 }
 
-                // Store all results to Firestore
+                // Store all results locally; the journal is no longer needed
                 if (currentResults.isNotEmpty()) {
-                    tvProgress.text = "Saving ${currentResults.size} results to Firebase..."
-                    withContext(Dispatchers.IO) {
-                        try {
-                            firestoreRepository.storeBatchPredictions(
-                                currentResults,
-                                selectedModelType!!.firestoreKey
-                            )
-                            Log.d(TAG, "Stored ${currentResults.size} results to Firestore")
-                        } catch (e: Exception) {
-                            Log.e(TAG, "Firestore error: ${e.message}")
-                            throw e
-                        }
-                    }
+                    tvProgress.text = "Saving ${currentResults.size} results..."
+                    saveResults(currentResults.toList(), mode.resultKey(modelType))
+                }
+                if (useJournal) {
+                    withContext(Dispatchers.IO) { closeRunJournal(discard = true) }
                 }
 
                 // Show summary
@@ -984,6 +1330,8 @@ Allergens:"""
                 Log.e(TAG, "Run All failed: ${e.message}", e)
                 showSnackbar("Error: ${e.message}", isSuccess = false)
             } finally {
+                // Keeps the journal on cancel or failure so the next Run All resumes
+                if (useJournal) closeRunJournal(discard = false)
                 setProcessingState(false)
             }
         }
@@ -1014,7 +1362,7 @@ Allergens:"""
             totalTime / 60000.0
         )
 
-        tvSummaryFirestore.text = "All 200 predictions saved to Firebase"
+        tvSummaryFirestore.text = "All 200 predictions saved (syncing to Firebase)"
         tvSummaryFirestore.setTextColor(Color.parseColor("#E3EED4"))
 
         summarySection.visibility = View.VISIBLE
@@ -1030,6 +1378,7 @@ Allergens:"""
         btnLoadDataset.isEnabled = !processing && selectedModelType != null
         spinnerDataset.isEnabled = !processing
         spinnerModel.isEnabled = !processing  // Lock model selector during processing
+        spinnerMode.isEnabled = !processing
         btnSelectAll.isEnabled = !processing
         btnDeselectAll.isEnabled = !processing
         btnStartPrediction.isEnabled = !processing && selectedModelType != null
@@ -1070,7 +1419,7 @@ Allergens:"""
             totalTime / 1000.0
         )
 
-        tvSummaryFirestore.text = "Results saved to Firebase Firestore (Dataset $datasetNumber)"
+        tvSummaryFirestore.text = "Results saved on device, syncing to Firestore (Dataset $datasetNumber)"
         tvSummaryFirestore.setTextColor(Color.parseColor("#E3EED4")) // Cream mint for dark background
 
         summarySection.visibility = View.VISIBLE
@@ -1127,7 +1476,9 @@ Allergens:"""
             Java Heap:    ${metrics.javaHeapKb} KB
             Native Heap:  ${metrics.nativeHeapKb} KB
             Total PSS:    ${metrics.totalPssKb} KB
-        """.trimIndent()
+        """.trimIndent() + if (metrics.memoryBatchSize > 1) {
+            "\n(memory measured for a batch of ${metrics.memoryBatchSize} items)"
+        } else ""
         dialogView.findViewById<TextView>(R.id.tvDetailMetrics).text = metricsText
 
         // Timestamp
@@ -0,0 +1,153 @@
+package com.mad.assignment
+
+import android.content.Context
+import android.util.Log
+import com.google.firebase.Timestamp
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
+import org.json.JSONArray
+import org.json.JSONObject
+import java.io.File
+import java.util.Date
+
+/**
+ * Outbox for Firestore uploads (one JSON file per batch under
+ * filesDir/pending_sync).
+ *
+ * A batch is written here before it is sent and removed once Firestore
+ * accepted it, so results of a batch whose upload failed (offline, app
+ * killed mid-upload) are sent again on the next attempt instead of only
+ * existing in the local store.
+ */
+class PendingFirestoreSync(
+    context: Context,
+    private val firestoreRepository: FirestoreRepository
+) {
+
+    companion object {
+        private const val TAG = "PendingFirestoreSync"
+        private const val PENDING_DIR = "pending_sync"
+        private const val MAX_ATTEMPTS = 3
+        private const val RETRY_DELAY_MS = 2_000L
+    }
+
+    private val dir = File(context.filesDir, PENDING_DIR)
+
+    // One sync pass at a time, so a batch is not uploaded twice concurrently
+    private val lock = Mutex()
+
+    /**
+     * Record a batch as pending; it is uploaded by the next syncPending()
+     */
+    fun add(results: List<PredictionResult>, modelKey: String) {
+        if (results.isEmpty()) return
+        dir.mkdirs()
+        val file = File(dir, "${modelKey}_${System.currentTimeMillis()}_${results.first().dataId}.json")
+        val tmp = File(dir, file.name + ".tmp")
+        tmp.writeText(toJson(results, modelKey).toString())
+        if (!tmp.renameTo(file)) Log.w(TAG, "Cannot queue Firestore batch for model $modelKey")
+    }
+
+    /**
+     * Upload every pending batch; batches that still fail stay queued
+     *
+     * @return Number of batches still pending
+     */
+    suspend fun syncPending(): Int = lock.withLock { syncPendingLocked() }
+
+    private suspend fun syncPendingLocked(): Int {
+        val files = dir.listFiles { f -> f.name.endsWith(".json") }?.sortedBy { it.name }
+            ?: return 0
+        var remaining = 0
+        for (file in files) {
+            val (modelKey, results) = try {
+                val batch = JSONObject(file.readText())
+                batch.getString("modelKey") to fromJson(batch.getJSONArray("results"))
+            } catch (e: Exception) {
+                Log.w(TAG, "Dropping unreadable pending batch ${file.name}: ${e.message}")
+                file.delete()
+                continue
+            }
+            if (upload(results, modelKey)) {
+                file.delete()
+            } else {
+                remaining++
+            }
+        }
+        if (remaining > 0) Log.w(TAG, "$remaining batch(es) still pending Firestore sync")
+        return remaining
+    }
+
+    private suspend fun upload(results: List<PredictionResult>, modelKey: String): Boolean {
+        for (attempt in 1..MAX_ATTEMPTS) {
+            try {
+                firestoreRepository.storeBatchPredictions(results, modelKey)
+                Log.d(TAG, "Synced ${results.size} results to Firestore for model $modelKey")
+                return true
+            } catch (e: Exception) {
+                Log.w(TAG, "Firestore sync attempt $attempt failed for model $modelKey: ${e.message}")
+                if (attempt < MAX_ATTEMPTS) delay(RETRY_DELAY_MS * attempt)
+            }
+        }
+        return false
+    }
+
+    private fun toJson(results: List<PredictionResult>, modelKey: String): JSONObject {
+        val array = JSONArray()
+        results.forEach { r ->
+            array.put(JSONObject().apply {
+                put("dataId", r.dataId)
+                put("name", r.name)
+                put("ingredients", r.ingredients)
+                put("allergens", r.allergens)
+                put("mappedAllergens", r.mappedAllergens)
+                put("predictedAllergens", r.predictedAllergens)
+                put("timestampMs", r.timestamp.toDate().time)
+                put("latencyMs", r.metrics.latencyMs)
+                put("javaHeapKb", r.metrics.javaHeapKb)
+                put("nativeHeapKb", r.metrics.nativeHeapKb)
+                put("totalPssKb", r.metrics.totalPssKb)
+                put("ttftMs", r.metrics.ttft)
+                put("itps", r.metrics.itps)
+                put("otps", r.metrics.otps)
+                put("oetMs", r.metrics.oet)
+                put("memoryBatchSize", r.metrics.memoryBatchSize)
+                put("metricsModelName", r.metrics.modelName)
+                put("datasetNumber", r.datasetNumber)
+                put("isMatch", r.isMatch)
+                put("modelName", r.modelName)
+            })
+        }
+        return JSONObject().put("modelKey", modelKey).put("results", array)
+    }
+
+    private fun fromJson(array: JSONArray): List<PredictionResult> =
+        (0 until array.length()).map { i ->
+            val o = array.getJSONObject(i)
+            PredictionResult(
+                dataId = o.getInt("dataId"),
+                name = o.getString("name"),
+                ingredients = o.getString("ingredients"),
+                allergens = o.getString("allergens"),
+                mappedAllergens = o.getString("mappedAllergens"),
+                predictedAllergens = o.getString("predictedAllergens"),
+                timestamp = Timestamp(Date(o.getLong("timestampMs"))),
+                metrics = InferenceMetrics(
+                    latencyMs = o.getLong("latencyMs"),
+                    javaHeapKb = o.getLong("javaHeapKb"),
+                    nativeHeapKb = o.getLong("nativeHeapKb"),
+                    totalPssKb = o.getLong("totalPssKb"),
+                    ttft = o.getLong("ttftMs"),
+                    itps = o.getLong("itps"),
+                    otps = o.getLong("otps"),
+                    oet = o.getLong("oetMs"),
+                    modelName = o.getString("metricsModelName"),
+                    memoryBatchSize = o.getInt("memoryBatchSize")
+                ),
+                datasetNumber = o.getInt("datasetNumber"),
+                isMatch = o.getBoolean("isMatch"),
+                modelName = o.getString("modelName")
+            )
+        }
+}
@@ -54,6 +54,7 @@ data class PredictionResult(
         "itps" to metrics.itps,
         "otps" to metrics.otps,
         "oetMs" to metrics.oet,
+        "memoryBatchSize" to metrics.memoryBatchSize,
 
         // Additional fields for app functionality
         "datasetNumber" to datasetNumber,